@@ -0,0 +1,331 @@
+//
+//  Animation.cpp
+//  Paloma Engine
+//
+
+#include "Animation.hpp"
+#include <cassert>
+
+static void decompose(const matrix_float4x4 &m, simd_float3 &translation,
+                      simd_quatf &rotation, simd_float3 &scale) {
+  translation = m.columns[3].xyz;
+
+  simd_float3 axes[3] = {m.columns[0].xyz, m.columns[1].xyz,
+                         m.columns[2].xyz};
+  scale = {simd_length(axes[0]), simd_length(axes[1]), simd_length(axes[2])};
+
+  matrix_float3x3 basis = {axes[0], axes[1], axes[2]};
+  if (simd_determinant(basis) < 0.0f) {
+    scale.x = -scale.x;
+  }
+
+  const simd_float3 identity[3] = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}};
+  matrix_float3x3 rotationMatrix;
+  for (int i = 0; i < 3; ++i) {
+    rotationMatrix.columns[i] =
+        fabsf(scale[i]) > 1e-8f ? axes[i] / scale[i] : identity[i];
+  }
+  rotation = simd_normalize(simd_quaternion(rotationMatrix));
+}
+
+void AnimationClip::build(
+    const std::vector<Entity> &targets,
+    const std::vector<std::vector<matrix_float4x4>> &samples,
+    float sampleRate) {
+  assert(targets.size() == samples.size());
+
+  this->targets = targets;
+  this->sampleRate = sampleRate;
+  frameCount = samples.empty() ? 0 : (uint32_t)samples[0].size();
+  _groupCount = (trackCount() + 3) / 4;
+
+  // Padding lanes keep an identity pose so sampling never reads garbage.
+  const size_t keyCount = (size_t)frameCount * _groupCount;
+  for (auto *track : {&_translationX, &_translationY, &_translationZ,
+                      &_rotationX, &_rotationY, &_rotationZ}) {
+    track->assign(keyCount, simd_float4{0, 0, 0, 0});
+  }
+  for (auto *track : {&_rotationW, &_scaleX, &_scaleY, &_scaleZ}) {
+    track->assign(keyCount, simd_float4{1, 1, 1, 1});
+  }
+
+  for (uint32_t track = 0; track < trackCount(); ++track) {
+    assert(samples[track].size() == frameCount);
+
+    const uint32_t group = track / 4;
+    const uint32_t lane = track % 4;
+    simd_quatf previous = simd_quaternion(0.0f, 0.0f, 0.0f, 1.0f);
+
+    for (uint32_t frame = 0; frame < frameCount; ++frame) {
+      simd_float3 translation, scale;
+      simd_quatf rotation;
+      decompose(samples[track][frame], translation, rotation, scale);
+
+      // Keep consecutive keys in the same hemisphere for nlerp.
+      if (frame > 0 && simd_dot(previous, rotation) < 0.0f) {
+        rotation = simd_negate(rotation);
+      }
+      previous = rotation;
+
+      const size_t index = (size_t)frame * _groupCount + group;
+      _translationX[index][lane] = translation.x;
+      _translationY[index][lane] = translation.y;
+      _translationZ[index][lane] = translation.z;
+      _rotationX[index][lane] = rotation.vector.x;
+      _rotationY[index][lane] = rotation.vector.y;
+      _rotationZ[index][lane] = rotation.vector.z;
+      _rotationW[index][lane] = rotation.vector.w;
+      _scaleX[index][lane] = scale.x;
+      _scaleY[index][lane] = scale.y;
+      _scaleZ[index][lane] = scale.z;
+    }
+  }
+}
+
+simd_float3 AnimationClip::translation(uint32_t track, uint32_t frame) const {
+  const size_t index = (size_t)frame * _groupCount + track / 4;
+  const uint32_t lane = track % 4;
+  return {_translationX[index][lane], _translationY[index][lane],
+          _translationZ[index][lane]};
+}
+
+simd_quatf AnimationClip::rotation(uint32_t track, uint32_t frame) const {
+  const size_t index = (size_t)frame * _groupCount + track / 4;
+  const uint32_t lane = track % 4;
+  return simd_quaternion(_rotationX[index][lane], _rotationY[index][lane],
+                         _rotationZ[index][lane], _rotationW[index][lane]);
+}
+
+simd_float3 AnimationClip::scale(uint32_t track, uint32_t frame) const {
+  const size_t index = (size_t)frame * _groupCount + track / 4;
+  const uint32_t lane = track % 4;
+  return {_scaleX[index][lane], _scaleY[index][lane], _scaleZ[index][lane]};
+}
+
+// -- Compression --
+
+static constexpr float kSmallestThreeRange = 0.70710678f; // 1 / sqrt(2)
+static constexpr uint32_t kSmallestThreeMax = (1u << 15) - 1;
+
+PackedQuaternion CompressedAnimationClip::packQuaternion(simd_quatf q) {
+  simd_float4 v = simd_normalize(q.vector);
+
+  uint32_t largest = 0;
+  for (uint32_t i = 1; i < 4; ++i) {
+    if (fabsf(v[i]) > fabsf(v[largest])) {
+      largest = i;
+    }
+  }
+  // q and -q are the same rotation; keep the dropped component positive.
+  if (v[largest] < 0.0f) {
+    v = -v;
+  }
+
+  uint64_t bits = (uint64_t)largest << 45;
+  uint32_t shift = 30;
+  for (uint32_t i = 0; i < 4; ++i) {
+    if (i == largest) {
+      continue;
+    }
+    float normalized =
+        std::clamp(v[i] / kSmallestThreeRange * 0.5f + 0.5f, 0.0f, 1.0f);
+    bits |= (uint64_t)lroundf(normalized * kSmallestThreeMax) << shift;
+    shift -= 15;
+  }
+
+  return {{(uint16_t)(bits >> 32), (uint16_t)(bits >> 16), (uint16_t)bits}};
+}
+
+simd_quatf CompressedAnimationClip::unpackQuaternion(PackedQuaternion packed) {
+  const uint64_t bits = (uint64_t)packed.bits[0] << 32 |
+                        (uint64_t)packed.bits[1] << 16 | packed.bits[2];
+  const uint32_t largest = (uint32_t)(bits >> 45) & 3;
+
+  simd_float4 v = 0.0f;
+  float sumOfSquares = 0.0f;
+  uint32_t shift = 30;
+  for (uint32_t i = 0; i < 4; ++i) {
+    if (i == largest) {
+      continue;
+    }
+    float normalized =
+        (float)((bits >> shift) & kSmallestThreeMax) / kSmallestThreeMax;
+    v[i] = (normalized * 2.0f - 1.0f) * kSmallestThreeRange;
+    sumOfSquares += v[i] * v[i];
+    shift -= 15;
+  }
+  v[largest] = sqrtf(std::max(0.0f, 1.0f - sumOfSquares));
+  return simd_quaternion(v);
+}
+
+QuantizedVector CompressedAnimationClip::quantize(simd_float3 value,
+                                                  simd_float3 min,
+                                                  simd_float3 extent) {
+  QuantizedVector quantized;
+  for (int i = 0; i < 3; ++i) {
+    float normalized =
+        extent[i] > 0.0f
+            ? std::clamp((value[i] - min[i]) / extent[i], 0.0f, 1.0f)
+            : 0.0f;
+    quantized.value[i] = (uint16_t)lroundf(normalized * 65535.0f);
+  }
+  return quantized;
+}
+
+static float rotationError(simd_quatf a, simd_quatf b) {
+  // atan2 keeps precision for tiny angles where acos(dot) would not.
+  simd_quatf delta = simd_mul(simd_conjugate(a), b);
+  return 2.0f * atan2f(simd_length(delta.vector.xyz), fabsf(delta.vector.w));
+}
+
+static simd_quatf nlerp(simd_quatf a, simd_quatf b, float t) {
+  simd_float4 end = simd_dot(a.vector, b.vector) < 0.0f ? -b.vector : b.vector;
+  return simd_quaternion(simd_normalize(simd_mix(a.vector, end, t)));
+}
+
+// Greedy reduction: from each kept key, extends the segment as far as
+// interpolating the decoded end keys stays within tolerance of every
+// original frame it covers. Returns the kept frame indices.
+template <typename Value, typename Lerp, typename Error>
+static std::vector<uint32_t> reduceKeys(const std::vector<Value> &original,
+                                        const std::vector<Value> &decoded,
+                                        float tolerance, Lerp &&lerp,
+                                        Error &&error) {
+  const uint32_t count = (uint32_t)original.size();
+
+  bool constant = true;
+  for (uint32_t frame = 0; frame < count && constant; ++frame) {
+    constant = error(decoded[0], original[frame]) <= tolerance;
+  }
+  if (constant) {
+    return {0};
+  }
+
+  auto segmentFits = [&](uint32_t start, uint32_t end) {
+    const float span = (float)(end - start);
+    for (uint32_t frame = start + 1; frame <= end; ++frame) {
+      Value value =
+          lerp(decoded[start], decoded[end], (float)(frame - start) / span);
+      if (error(value, original[frame]) > tolerance) {
+        return false;
+      }
+    }
+    return true;
+  };
+
+  std::vector<uint32_t> keys = {0};
+  uint32_t start = 0;
+  while (start < count - 1) {
+    uint32_t end = start + 1;
+    while (end + 1 < count && segmentFits(start, end + 1)) {
+      end++;
+    }
+    keys.push_back(end);
+    start = end;
+  }
+  return keys;
+}
+
+CompressedAnimationClip
+CompressedAnimationClip::compress(const AnimationClip &clip,
+                                  const Tolerances &tolerances) {
+  // Key frame indices are stored in 16 bits.
+  assert(clip.frameCount <= 65536);
+
+  CompressedAnimationClip compressed;
+  compressed.targets = clip.targets;
+  compressed.sampleRate = clip.sampleRate;
+  compressed.frameCount = clip.frameCount;
+  if (clip.frameCount == 0) {
+    return compressed;
+  }
+
+  auto lerpVector = [](simd_float3 a, simd_float3 b, float t) {
+    return simd_mix(a, b, simd_make_float3(t, t, t));
+  };
+  auto vectorError = [](simd_float3 a, simd_float3 b) {
+    return simd_distance(a, b);
+  };
+
+  std::vector<simd_float3> original(clip.frameCount), decoded(clip.frameCount);
+  std::vector<simd_quatf> originalRotation(clip.frameCount),
+      decodedRotation(clip.frameCount);
+  std::vector<QuantizedVector> quantized(clip.frameCount);
+  std::vector<PackedQuaternion> packed(clip.frameCount);
+
+  // Range-quantizes one vector channel and appends its reduced keys.
+  using VectorChannel =
+      simd_float3 (AnimationClip::*)(uint32_t, uint32_t) const;
+  auto compressVector = [&](VectorChannel read, uint32_t track,
+                            float tolerance, std::vector<Channel> &channels,
+                            std::vector<simd_float3> &mins,
+                            std::vector<simd_float3> &extents,
+                            std::vector<uint16_t> &frames,
+                            std::vector<QuantizedVector> &keys) {
+    simd_float3 min = (clip.*read)(track, 0);
+    simd_float3 max = min;
+    for (uint32_t frame = 0; frame < clip.frameCount; ++frame) {
+      original[frame] = (clip.*read)(track, frame);
+      min = simd_min(min, original[frame]);
+      max = simd_max(max, original[frame]);
+    }
+    const simd_float3 extent = max - min;
+
+    for (uint32_t frame = 0; frame < clip.frameCount; ++frame) {
+      quantized[frame] = quantize(original[frame], min, extent);
+      decoded[frame] = dequantize(quantized[frame], min, extent);
+    }
+
+    auto kept =
+        reduceKeys(original, decoded, tolerance, lerpVector, vectorError);
+    channels.push_back({(uint32_t)keys.size(), (uint32_t)kept.size()});
+    mins.push_back(min);
+    extents.push_back(extent);
+    for (uint32_t frame : kept) {
+      frames.push_back((uint16_t)frame);
+      keys.push_back(quantized[frame]);
+    }
+  };
+
+  for (uint32_t track = 0; track < clip.trackCount(); ++track) {
+    compressVector(&AnimationClip::translation, track, tolerances.translation,
+                   compressed._translationChannels, compressed._translationMin,
+                   compressed._translationExtent, compressed._translationFrames,
+                   compressed._translationKeys);
+    compressVector(&AnimationClip::scale, track, tolerances.scale,
+                   compressed._scaleChannels, compressed._scaleMin,
+                   compressed._scaleExtent, compressed._scaleFrames,
+                   compressed._scaleKeys);
+
+    for (uint32_t frame = 0; frame < clip.frameCount; ++frame) {
+      originalRotation[frame] = clip.rotation(track, frame);
+      packed[frame] = packQuaternion(originalRotation[frame]);
+      decodedRotation[frame] = unpackQuaternion(packed[frame]);
+    }
+    auto kept = reduceKeys(originalRotation, decodedRotation,
+                           tolerances.rotation, nlerp, rotationError);
+    compressed._rotationChannels.push_back(
+        {(uint32_t)compressed._rotationKeys.size(), (uint32_t)kept.size()});
+    for (uint32_t frame : kept) {
+      compressed._rotationFrames.push_back((uint16_t)frame);
+      compressed._rotationKeys.push_back(packed[frame]);
+    }
+  }
+
+  compressed._translationCursors.assign(clip.trackCount(), 0);
+  compressed._rotationCursors.assign(clip.trackCount(), 0);
+  compressed._scaleCursors.assign(clip.trackCount(), 0);
+  return compressed;
+}
+
+size_t CompressedAnimationClip::sizeInBytes() const {
+  auto bytes = [](const auto &vector) {
+    return vector.size() * sizeof(vector[0]);
+  };
+  return bytes(_translationChannels) + bytes(_rotationChannels) +
+         bytes(_scaleChannels) + bytes(_translationMin) +
+         bytes(_translationExtent) + bytes(_scaleMin) + bytes(_scaleExtent) +
+         bytes(_translationFrames) + bytes(_rotationFrames) +
+         bytes(_scaleFrames) + bytes(_translationKeys) + bytes(_rotationKeys) +
+         bytes(_scaleKeys);
+}
@@ -0,0 +1,363 @@
+//
+//  Animation.hpp
+//  Paloma Engine
+//
+
+#pragma once
+#include "Entity.hpp"
+#include <algorithm>
+#include <cmath>
+#include <simd/simd.h>
+#include <vector>
+
+// Four tracks' worth of translation, rotation and scale, one lane per track.
+struct TrackGroupPose {
+  simd_float4 tx, ty, tz;
+  simd_float4 qx, qy, qz, qw;
+  simd_float4 sx, sy, sz;
+};
+
+// Lerps translation and scale and nlerps rotation for four tracks at once.
+// Each channel has its own blend factor per lane.
+static inline TrackGroupPose blendTrackGroup(const TrackGroupPose &a,
+                                             const TrackGroupPose &b,
+                                             simd_float4 translationT,
+                                             simd_float4 rotationT,
+                                             simd_float4 scaleT) {
+  TrackGroupPose pose;
+  pose.tx = simd_mix(a.tx, b.tx, translationT);
+  pose.ty = simd_mix(a.ty, b.ty, translationT);
+  pose.tz = simd_mix(a.tz, b.tz, translationT);
+
+  pose.sx = simd_mix(a.sx, b.sx, scaleT);
+  pose.sy = simd_mix(a.sy, b.sy, scaleT);
+  pose.sz = simd_mix(a.sz, b.sz, scaleT);
+
+  // Keys are sign-aligned at build time, so nlerp never needs to flip.
+  simd_float4 qx = simd_mix(a.qx, b.qx, rotationT);
+  simd_float4 qy = simd_mix(a.qy, b.qy, rotationT);
+  simd_float4 qz = simd_mix(a.qz, b.qz, rotationT);
+  simd_float4 qw = simd_mix(a.qw, b.qw, rotationT);
+
+  simd_float4 invLength = simd_rsqrt(qx * qx + qy * qy + qz * qz + qw * qw);
+  pose.qx = qx * invLength;
+  pose.qy = qy * invLength;
+  pose.qz = qz * invLength;
+  pose.qw = qw * invLength;
+  return pose;
+}
+
+template <typename Writer>
+static inline void writeTrackGroup(const TrackGroupPose &pose,
+                                   const Entity *targets, uint32_t count,
+                                   Writer &&write) {
+  for (uint32_t lane = 0; lane < count; ++lane) {
+    matrix_float3x3 rotation = simd_matrix3x3(simd_quaternion(
+        pose.qx[lane], pose.qy[lane], pose.qz[lane], pose.qw[lane]));
+
+    matrix_float4x4 local;
+    local.columns[0] =
+        simd_make_float4(rotation.columns[0] * pose.sx[lane], 0.0f);
+    local.columns[1] =
+        simd_make_float4(rotation.columns[1] * pose.sy[lane], 0.0f);
+    local.columns[2] =
+        simd_make_float4(rotation.columns[2] * pose.sz[lane], 0.0f);
+    local.columns[3] =
+        simd_make_float4(pose.tx[lane], pose.ty[lane], pose.tz[lane], 1.0f);
+
+    write(targets[lane], local);
+  }
+}
+
+// Transform animation resampled at a fixed rate at import time.
+//
+// Translation, rotation and scale are separate SoA tracks stored frame-major
+// in groups of four tracks, so one frame of four tracks' X translation is a
+// single simd_float4 and sampling is a straight lerp/nlerp across tracks.
+class AnimationClip {
+public:
+  std::vector<Entity> targets;
+  float sampleRate = 30.0f;
+  uint32_t frameCount = 0;
+
+  // samples[track][frame] holds local transforms; every track must have
+  // the same number of frames.
+  void build(const std::vector<Entity> &targets,
+             const std::vector<std::vector<matrix_float4x4>> &samples,
+             float sampleRate);
+
+  float duration() const {
+    return frameCount > 1 ? (float)(frameCount - 1) / sampleRate : 0.0f;
+  }
+
+  uint32_t trackCount() const { return (uint32_t)targets.size(); }
+
+  size_t sizeInBytes() const {
+    return 10 * _translationX.size() * sizeof(simd_float4);
+  }
+
+  simd_float3 translation(uint32_t track, uint32_t frame) const;
+  simd_quatf rotation(uint32_t track, uint32_t frame) const;
+  simd_float3 scale(uint32_t track, uint32_t frame) const;
+
+  // Loops over the clip and calls write(entity, localTransform) per track.
+  template <typename Writer> void sample(float time, Writer &&write) const;
+
+private:
+  uint32_t _groupCount = 0;
+
+  // Indexed [frame * _groupCount + group]
+  std::vector<simd_float4> _translationX, _translationY, _translationZ;
+  std::vector<simd_float4> _rotationX, _rotationY, _rotationZ, _rotationW;
+  std::vector<simd_float4> _scaleX, _scaleY, _scaleZ;
+
+  TrackGroupPose groupPose(size_t index) const {
+    return {_translationX[index], _translationY[index], _translationZ[index],
+            _rotationX[index],    _rotationY[index],    _rotationZ[index],
+            _rotationW[index],    _scaleX[index],       _scaleY[index],
+            _scaleZ[index]};
+  }
+};
+
+template <typename Writer>
+void AnimationClip::sample(float time, Writer &&write) const {
+  if (frameCount == 0) {
+    return;
+  }
+
+  float length = duration();
+  float frame = length > 0.0f ? fmodf(time, length) * sampleRate : 0.0f;
+  uint32_t f0 = std::min((uint32_t)frame, frameCount - 1);
+  uint32_t f1 = std::min(f0 + 1, frameCount - 1);
+  float alpha = frame - (float)f0;
+  const simd_float4 t = simd_make_float4(alpha, alpha, alpha, alpha);
+
+  const size_t base0 = (size_t)f0 * _groupCount;
+  const size_t base1 = (size_t)f1 * _groupCount;
+
+  for (uint32_t group = 0; group < _groupCount; ++group) {
+    TrackGroupPose pose = blendTrackGroup(
+        groupPose(base0 + group), groupPose(base1 + group), t, t, t);
+
+    const uint32_t first = group * 4;
+    writeTrackGroup(pose, targets.data() + first,
+                    std::min(4u, trackCount() - first), write);
+  }
+}
+
+// Smallest-three quaternion in 48 bits: 2 bits for the index of the dropped
+// largest component and 15 bits for each of the other three.
+struct PackedQuaternion {
+  uint16_t bits[3];
+};
+
+// Range-quantized vector: 16 bits per component inside a per-track box.
+struct QuantizedVector {
+  uint16_t value[3];
+};
+
+// Keyframe-reduced, quantized form of an AnimationClip used for playback.
+//
+// Every channel keeps only the keys needed to stay within its tolerance of
+// the baked clip, measured after quantization, so the bound covers both.
+// Sampling decodes the two bracketing keys per track into lanes and then
+// blends four tracks at a time like AnimationClip.
+class CompressedAnimationClip {
+public:
+  struct Tolerances {
+    float translation = 0.0005f; // scene units
+    float rotation = 0.0005f;    // radians
+    float scale = 0.0005f;
+  };
+
+  std::vector<Entity> targets;
+  float sampleRate = 30.0f;
+  uint32_t frameCount = 0;
+
+  static CompressedAnimationClip compress(const AnimationClip &clip,
+                                          const Tolerances &tolerances);
+
+  float duration() const {
+    return frameCount > 1 ? (float)(frameCount - 1) / sampleRate : 0.0f;
+  }
+
+  uint32_t trackCount() const { return (uint32_t)targets.size(); }
+
+  size_t sizeInBytes() const;
+
+  // Encoding helpers, exposed for tools that inspect compressed data.
+  static PackedQuaternion packQuaternion(simd_quatf q);
+  static simd_quatf unpackQuaternion(PackedQuaternion packed);
+
+  static QuantizedVector quantize(simd_float3 value, simd_float3 min,
+                                  simd_float3 extent);
+  static simd_float3 dequantize(QuantizedVector quantized, simd_float3 min,
+                                simd_float3 extent) {
+    simd_float3 normalized = {(float)quantized.value[0],
+                              (float)quantized.value[1],
+                              (float)quantized.value[2]};
+    return min + normalized * (1.0f / 65535.0f) * extent;
+  }
+
+  // Not const: every channel keeps a cursor to its current key, so
+  // forward playback finds its keys in O(1).
+  template <typename Writer> void sample(float time, Writer &&write);
+
+private:
+  struct Channel {
+    uint32_t firstKey;
+    uint32_t keyCount;
+  };
+
+  std::vector<Channel> _translationChannels;
+  std::vector<Channel> _rotationChannels;
+  std::vector<Channel> _scaleChannels;
+
+  // Per track quantization boxes
+  std::vector<simd_float3> _translationMin, _translationExtent;
+  std::vector<simd_float3> _scaleMin, _scaleExtent;
+
+  // Key frame indices and values, all channels back to back
+  std::vector<uint16_t> _translationFrames, _rotationFrames, _scaleFrames;
+  std::vector<QuantizedVector> _translationKeys;
+  std::vector<PackedQuaternion> _rotationKeys;
+  std::vector<QuantizedVector> _scaleKeys;
+
+  std::vector<uint32_t> _translationCursors, _rotationCursors, _scaleCursors;
+
+  // Returns the key pair around frame and the blend factor between them.
+  static float findKeys(const uint16_t *frames, uint32_t keyCount, float frame,
+                        uint32_t &cursor, uint32_t &k0, uint32_t &k1) {
+    if (keyCount == 1) {
+      k0 = k1 = 0;
+      return 0.0f;
+    }
+    if (cursor >= keyCount - 1 || frame < (float)frames[cursor]) {
+      cursor = 0; // looped or seeked backwards
+    }
+    while (cursor + 2 < keyCount && (float)frames[cursor + 1] <= frame) {
+      cursor++;
+    }
+    k0 = cursor;
+    k1 = cursor + 1;
+    float span = (float)(frames[k1] - frames[k0]);
+    return std::clamp((frame - (float)frames[k0]) / span, 0.0f, 1.0f);
+  }
+};
+
+template <typename Writer>
+void CompressedAnimationClip::sample(float time, Writer &&write) {
+  if (frameCount == 0) {
+    return;
+  }
+
+  float length = duration();
+  float frame = length > 0.0f ? fmodf(time, length) * sampleRate : 0.0f;
+
+  for (uint32_t first = 0; first < trackCount(); first += 4) {
+    const uint32_t count = std::min(4u, trackCount() - first);
+
+    TrackGroupPose a = {}, b = {};
+    simd_float4 translationT = 0.0f, rotationT = 0.0f, scaleT = 0.0f;
+
+    for (uint32_t lane = 0; lane < count; ++lane) {
+      const uint32_t track = first + lane;
+      uint32_t k0, k1;
+
+      const Channel &translation = _translationChannels[track];
+      translationT[lane] =
+          findKeys(&_translationFrames[translation.firstKey],
+                   translation.keyCount, frame, _translationCursors[track],
+                   k0, k1);
+      simd_float3 t0 =
+          dequantize(_translationKeys[translation.firstKey + k0],
+                     _translationMin[track], _translationExtent[track]);
+      simd_float3 t1 =
+          dequantize(_translationKeys[translation.firstKey + k1],
+                     _translationMin[track], _translationExtent[track]);
+      a.tx[lane] = t0.x;
+      a.ty[lane] = t0.y;
+      a.tz[lane] = t0.z;
+      b.tx[lane] = t1.x;
+      b.ty[lane] = t1.y;
+      b.tz[lane] = t1.z;
+
+      const Channel &rotation = _rotationChannels[track];
+      rotationT[lane] =
+          findKeys(&_rotationFrames[rotation.firstKey], rotation.keyCount,
+                   frame, _rotationCursors[track], k0, k1);
+      simd_float4 q0 =
+          unpackQuaternion(_rotationKeys[rotation.firstKey + k0]).vector;
+      simd_float4 q1 =
+          unpackQuaternion(_rotationKeys[rotation.firstKey + k1]).vector;
+      if (simd_dot(q0, q1) < 0.0f) {
+        q1 = -q1; // packing canonicalizes the sign
+      }
+      a.qx[lane] = q0.x;
+      a.qy[lane] = q0.y;
+      a.qz[lane] = q0.z;
+      a.qw[lane] = q0.w;
+      b.qx[lane] = q1.x;
+      b.qy[lane] = q1.y;
+      b.qz[lane] = q1.z;
+      b.qw[lane] = q1.w;
+
+      const Channel &scale = _scaleChannels[track];
+      scaleT[lane] = findKeys(&_scaleFrames[scale.firstKey], scale.keyCount,
+                              frame, _scaleCursors[track], k0, k1);
+      simd_float3 s0 = dequantize(_scaleKeys[scale.firstKey + k0],
+                                  _scaleMin[track], _scaleExtent[track]);
+      simd_float3 s1 = dequantize(_scaleKeys[scale.firstKey + k1],
+                                  _scaleMin[track], _scaleExtent[track]);
+      a.sx[lane] = s0.x;
+      a.sy[lane] = s0.y;
+      a.sz[lane] = s0.z;
+      b.sx[lane] = s1.x;
+      b.sy[lane] = s1.y;
+      b.sz[lane] = s1.z;
+    }
+
+    // Unused lanes stay at a zero quaternion; give them identity so the
+    // normalization doesn't divide by zero.
+    for (uint32_t lane = count; lane < 4; ++lane) {
+      a.qw[lane] = b.qw[lane] = 1.0f;
+    }
+
+    TrackGroupPose pose =
+        blendTrackGroup(a, b, translationT, rotationT, scaleT);
+    writeTrackGroup(pose, targets.data() + first, count, write);
+  }
+}
+
+// Plays both clips frame by frame and returns the largest distance between
+// their world-space results, measured at the origin and unit axes of every
+// transform. pose(entity, local) receives each track's local transform, after
+// which worldTransforms(std::vector<matrix_float4x4>&) must fill in the world
+// transforms that result, in the same order every time.
+template <typename Pose, typename WorldTransforms>
+float measureAnimationError(const AnimationClip &reference,
+                            CompressedAnimationClip &compressed, Pose &&pose,
+                            WorldTransforms &&worldTransforms) {
+  const simd_float4 points[] = {
+      {0, 0, 0, 1}, {1, 0, 0, 1}, {0, 1, 0, 1}, {0, 0, 1, 1}};
+  std::vector<matrix_float4x4> expected, actual;
+
+  float maxError = 0.0f;
+  for (uint32_t frame = 0; frame < reference.frameCount; ++frame) {
+    const float time = (float)frame / reference.sampleRate;
+
+    reference.sample(time, pose);
+    worldTransforms(expected);
+    compressed.sample(time, pose);
+    worldTransforms(actual);
+
+    for (size_t i = 0; i < expected.size(); ++i) {
+      for (const auto &point : points) {
+        float error = simd_distance(simd_mul(expected[i], point).xyz,
+                                    simd_mul(actual[i], point).xyz);
+        maxError = std::max(maxError, error);
+      }
+    }
+  }
+  return maxError;
+}
@@ -49,3 +49,15 @@ matrix_float4x4 PerspectiveCamera::projectionMatrix(float aspectRatio) const {
   return matrix_perspective_right_hand(fovRadians, aspectRatio, this->nearZ,
                                        this->farZ);
 }
+
+Frustum PerspectiveCamera::frustum(float aspectRatio) const {
+  return Frustum::fromMatrix(
+      simd_mul(projectionMatrix(aspectRatio), viewMatrix()));
+}
+
+float PerspectiveCamera::screenSpaceError(float worldError, float distance,
+                                          float viewportHeight) const {
+  float fovRadians = this->fieldOfViewDegrees * (M_PI / 180.0f);
+  return worldError * viewportHeight /
+         (2.0f * tanf(fovRadians * 0.5f) * distance);
+}
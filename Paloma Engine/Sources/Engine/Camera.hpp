@@ -9,6 +9,7 @@
 
 #include <simd/simd.h>
 #include "AAPLMathUtilities.h"
+#include "Bounds.hpp"
 
 class PerspectiveCamera {
 public:
@@ -30,4 +31,12 @@ public:
     matrix_float4x4 viewMatrix() const;
 
     matrix_float4x4 projectionMatrix(float aspectRatio) const;
+
+    // World-space view frustum.
+    Frustum frustum(float aspectRatio) const;
+
+    // Height in pixels of a world-space length seen face-on at the given
+    // distance.
+    float screenSpaceError(float worldError, float distance,
+                           float viewportHeight) const;
 };
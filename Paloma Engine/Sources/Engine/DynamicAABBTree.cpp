@@ -0,0 +1,317 @@
+//
+//  DynamicAABBTree.cpp
+//  Paloma Engine
+//
+
+#include "DynamicAABBTree.hpp"
+#include "FrustumCuller.hpp"
+#include <algorithm>
+#include <cassert>
+
+int32_t DynamicAABBTree::createProxy(const AABB &bounds, Entity entity) {
+  const int32_t proxy = allocateNode();
+  Node &node = _nodes[proxy];
+  node.bounds = bounds;
+  node.box = bounds.inflated(kFatMargin);
+  node.entity = entity;
+  node.height = 0;
+
+  insertLeaf(proxy);
+  _proxyCount++;
+  return proxy;
+}
+
+void DynamicAABBTree::destroyProxy(int32_t proxy) {
+  assert(_nodes[proxy].isLeaf());
+  removeLeaf(proxy);
+  freeNode(proxy);
+  _proxyCount--;
+}
+
+bool DynamicAABBTree::moveProxy(int32_t proxy, const AABB &bounds) {
+  Node &node = _nodes[proxy];
+  assert(node.isLeaf());
+  node.bounds = bounds;
+  if (node.box.contains(bounds)) {
+    return false;
+  }
+
+  removeLeaf(proxy);
+  _nodes[proxy].box = bounds.inflated(kFatMargin);
+  insertLeaf(proxy);
+  return true;
+}
+
+void DynamicAABBTree::query(const Frustum &frustum,
+                            std::vector<Entity> &results) const {
+  _frustumStats = {};
+  if (_root == kNullNode) {
+    return;
+  }
+
+  _candidateBounds.clear();
+  _candidates.clear();
+
+  const size_t base = _stack.size();
+  _stack.push_back(_root);
+  while (_stack.size() > base) {
+    const int32_t index = _stack.back();
+    _stack.pop_back();
+    const Node &node = _nodes[index];
+    _frustumStats.nodesVisited++;
+
+    if (node.isLeaf()) {
+      // Only reached below a straddling parent.
+      _candidateBounds.push_back(node.bounds);
+      _candidates.push_back(node.entity);
+      continue;
+    }
+
+    switch (frustum.classify(node.box)) {
+    case Containment::Outside:
+      break;
+    case Containment::Intersects:
+      _stack.push_back(node.child2);
+      _stack.push_back(node.child1);
+      break;
+    case Containment::Inside: {
+      // Every leaf below is visible; collect them without testing.
+      const size_t insideBase = _stack.size();
+      _stack.push_back(index);
+      while (_stack.size() > insideBase) {
+        const Node &inside = _nodes[_stack.back()];
+        _stack.pop_back();
+        if (inside.isLeaf()) {
+          results.push_back(inside.entity);
+          _frustumStats.leavesAccepted++;
+        } else {
+          _stack.push_back(inside.child2);
+          _stack.push_back(inside.child1);
+        }
+      }
+      break;
+    }
+    }
+  }
+
+  _candidateVisible.resize(_candidates.size());
+  FrustumCuller(frustum).cull(_candidateBounds.data(), _candidates.size(),
+                              _candidateVisible.data());
+  _frustumStats.leavesTested = (uint32_t)_candidates.size();
+  for (size_t i = 0; i < _candidates.size(); ++i) {
+    if (_candidateVisible[i]) {
+      results.push_back(_candidates[i]);
+      _frustumStats.leavesAccepted++;
+    }
+  }
+}
+
+void DynamicAABBTree::validate() const {
+#ifdef DEBUG
+  if (_root == kNullNode) {
+    assert(_proxyCount == 0);
+    return;
+  }
+  assert(_nodes[_root].parent == kNullNode);
+
+  uint32_t leafCount = 0;
+  std::vector<int32_t> stack = {_root};
+  while (!stack.empty()) {
+    const int32_t index = stack.back();
+    stack.pop_back();
+    const Node &node = _nodes[index];
+
+    if (node.isLeaf()) {
+      assert(node.height == 0);
+      assert(node.box.contains(node.bounds));
+      leafCount++;
+      continue;
+    }
+
+    const Node &child1 = _nodes[node.child1];
+    const Node &child2 = _nodes[node.child2];
+    assert(child1.parent == index && child2.parent == index);
+    assert(node.height == 1 + std::max(child1.height, child2.height));
+    assert(node.box.contains(child1.box) && node.box.contains(child2.box));
+    stack.push_back(node.child1);
+    stack.push_back(node.child2);
+  }
+  assert(leafCount == _proxyCount);
+#endif
+}
+
+int32_t DynamicAABBTree::allocateNode() {
+  if (_freeList == kNullNode) {
+    _nodes.emplace_back();
+    return (int32_t)_nodes.size() - 1;
+  }
+  const int32_t node = _freeList;
+  _freeList = _nodes[node].parent;
+  _nodes[node] = Node();
+  return node;
+}
+
+void DynamicAABBTree::freeNode(int32_t node) {
+  _nodes[node].parent = _freeList;
+  _nodes[node].height = -1;
+  _freeList = node;
+}
+
+void DynamicAABBTree::insertLeaf(int32_t leaf) {
+  if (_root == kNullNode) {
+    _root = leaf;
+    _nodes[leaf].parent = kNullNode;
+    return;
+  }
+
+  // Descend towards the sibling with the lowest surface area cost: what it
+  // costs to pair with a node plus the growth forced on its ancestors.
+  const AABB leafBox = _nodes[leaf].box;
+  int32_t index = _root;
+  while (!_nodes[index].isLeaf()) {
+    const Node &node = _nodes[index];
+    const float area = node.box.surfaceArea();
+    const float combinedArea = AABB::merged(node.box, leafBox).surfaceArea();
+
+    const float pairCost = 2.0f * combinedArea;
+    const float inheritedCost = 2.0f * (combinedArea - area);
+
+    auto descendCost = [&](int32_t child) {
+      const AABB &childBox = _nodes[child].box;
+      const float merged = AABB::merged(childBox, leafBox).surfaceArea();
+      if (_nodes[child].isLeaf()) {
+        return merged + inheritedCost;
+      }
+      return merged - childBox.surfaceArea() + inheritedCost;
+    };
+    const float cost1 = descendCost(node.child1);
+    const float cost2 = descendCost(node.child2);
+
+    if (pairCost < cost1 && pairCost < cost2) {
+      break;
+    }
+    index = cost1 < cost2 ? node.child1 : node.child2;
+  }
+
+  const int32_t sibling = index;
+  const int32_t oldParent = _nodes[sibling].parent;
+  const int32_t newParent = allocateNode();
+
+  Node &parent = _nodes[newParent];
+  parent.parent = oldParent;
+  parent.box = AABB::merged(leafBox, _nodes[sibling].box);
+  parent.height = _nodes[sibling].height + 1;
+  parent.child1 = sibling;
+  parent.child2 = leaf;
+  _nodes[sibling].parent = newParent;
+  _nodes[leaf].parent = newParent;
+
+  if (oldParent == kNullNode) {
+    _root = newParent;
+  } else if (_nodes[oldParent].child1 == sibling) {
+    _nodes[oldParent].child1 = newParent;
+  } else {
+    _nodes[oldParent].child2 = newParent;
+  }
+
+  refitAncestors(_nodes[leaf].parent);
+}
+
+void DynamicAABBTree::removeLeaf(int32_t leaf) {
+  if (leaf == _root) {
+    _root = kNullNode;
+    return;
+  }
+
+  const int32_t parent = _nodes[leaf].parent;
+  const int32_t grandParent = _nodes[parent].parent;
+  const int32_t sibling = _nodes[parent].child1 == leaf
+                              ? _nodes[parent].child2
+                              : _nodes[parent].child1;
+
+  // The sibling takes the parent's place.
+  _nodes[sibling].parent = grandParent;
+  freeNode(parent);
+
+  if (grandParent == kNullNode) {
+    _root = sibling;
+    return;
+  }
+  if (_nodes[grandParent].child1 == parent) {
+    _nodes[grandParent].child1 = sibling;
+  } else {
+    _nodes[grandParent].child2 = sibling;
+  }
+  refitAncestors(grandParent);
+}
+
+void DynamicAABBTree::refitAncestors(int32_t index) {
+  while (index != kNullNode) {
+    index = balance(index);
+
+    Node &node = _nodes[index];
+    const Node &child1 = _nodes[node.child1];
+    const Node &child2 = _nodes[node.child2];
+    node.height = 1 + std::max(child1.height, child2.height);
+    node.box = AABB::merged(child1.box, child2.box);
+
+    index = node.parent;
+  }
+}
+
+// If one child of a is two levels taller than the other, rotates that child
+// up into a's place and hands a its shorter grandchild. Returns the index of
+// the node now at a's position.
+int32_t DynamicAABBTree::balance(int32_t iA) {
+  Node &a = _nodes[iA];
+  if (a.isLeaf() || a.height < 2) {
+    return iA;
+  }
+
+  const int32_t iB = a.child1;
+  const int32_t iC = a.child2;
+  const int32_t heightDifference = _nodes[iC].height - _nodes[iB].height;
+  if (heightDifference >= -1 && heightDifference <= 1) {
+    return iA;
+  }
+
+  // up is the taller child, keep the sibling that stays under a.
+  const bool rotateRight = heightDifference > 1;
+  const int32_t iUp = rotateRight ? iC : iB;
+  const int32_t iKeep = rotateRight ? iB : iC;
+  Node &up = _nodes[iUp];
+
+  const int32_t iF = up.child1;
+  const int32_t iG = up.child2;
+
+  // up replaces a under a's parent, and a becomes up's first child.
+  up.child1 = iA;
+  up.parent = a.parent;
+  a.parent = iUp;
+  if (up.parent == kNullNode) {
+    _root = iUp;
+  } else if (_nodes[up.parent].child1 == iA) {
+    _nodes[up.parent].child1 = iUp;
+  } else {
+    _nodes[up.parent].child2 = iUp;
+  }
+
+  // up keeps its taller grandchild; the shorter one moves under a.
+  const bool keepF = _nodes[iF].height > _nodes[iG].height;
+  const int32_t iTall = keepF ? iF : iG;
+  const int32_t iShort = keepF ? iG : iF;
+
+  up.child2 = iTall;
+  if (rotateRight) {
+    a.child2 = iShort;
+  } else {
+    a.child1 = iShort;
+  }
+  _nodes[iShort].parent = iA;
+
+  a.box = AABB::merged(_nodes[iKeep].box, _nodes[iShort].box);
+  a.height = 1 + std::max(_nodes[iKeep].height, _nodes[iShort].height);
+  up.box = AABB::merged(a.box, _nodes[iTall].box);
+  up.height = 1 + std::max(a.height, _nodes[iTall].height);
+  return iUp;
+}
@@ -0,0 +1,167 @@
+//
+//  DynamicAABBTree.hpp
+//  Paloma Engine
+//
+
+#pragma once
+#include "Bounds.hpp"
+#include "Entity.hpp"
+#include <cstdint>
+#include <vector>
+
+// Bounding volume hierarchy over entity bounds, updated in place as entities
+// move. Leaves keep a fattened copy of their box so small movements need no
+// restructuring; inserts and removals refit their ancestors and rebalance
+// them with tree rotations, which keeps the height close to log2(leaves).
+class DynamicAABBTree {
+public:
+  static constexpr int32_t kNullNode = -1;
+  // How far a leaf's box is grown beyond its entity's bounds.
+  static constexpr float kFatMargin = 0.1f;
+
+  struct FrustumQueryStats {
+    uint32_t nodesVisited = 0;
+    uint32_t leavesTested = 0;
+    uint32_t leavesAccepted = 0;
+  };
+
+  // Returns the proxy ID, which stays valid until destroyProxy.
+  int32_t createProxy(const AABB &bounds, Entity entity);
+  void destroyProxy(int32_t proxy);
+  // Returns true when the leaf had to be reinserted.
+  bool moveProxy(int32_t proxy, const AABB &bounds);
+
+  const AABB &bounds(int32_t proxy) const { return _nodes[proxy].bounds; }
+  Entity entity(int32_t proxy) const { return _nodes[proxy].entity; }
+
+  uint32_t proxyCount() const { return _proxyCount; }
+  int32_t height() const {
+    return _root == kNullNode ? 0 : _nodes[_root].height;
+  }
+
+  // Appends every entity whose bounds touch the frustum. Subtrees fully
+  // inside are accepted without further tests; leaves under a straddling
+  // node are tested eight at a time with FrustumCuller.
+  void query(const Frustum &frustum, std::vector<Entity> &results) const;
+  const FrustumQueryStats &frustumQueryStats() const { return _frustumStats; }
+
+  // Calls visitor(entity) for every entity whose bounds touch the volume.
+  template <typename Visitor>
+  void query(const AABB &box, Visitor &&visitor) const;
+  template <typename Visitor>
+  void query(const BoundingSphere &sphere, Visitor &&visitor) const;
+
+  // Calls visitor(entity, distance) for every entity whose bounds the ray
+  // hits within maxDistance, in no particular order. The visitor returns the
+  // new maximum distance: its argument to keep only closer hits, the current
+  // maximum to see every hit, or 0 to stop.
+  template <typename Visitor>
+  void raycast(simd_float3 origin, simd_float3 direction, float maxDistance,
+               Visitor &&visitor) const;
+
+  // Checks parent links, heights and enclosing boxes; debug builds only.
+  void validate() const;
+
+private:
+  struct Node {
+    // Fattened for leaves, the union of the children for internal nodes.
+    AABB box;
+    // The bounds the leaf was given.
+    AABB bounds;
+    Entity entity = entt::null;
+    // Next free node while on the free list.
+    int32_t parent = kNullNode;
+    int32_t child1 = kNullNode;
+    int32_t child2 = kNullNode;
+    // 0 for leaves, -1 while free.
+    int32_t height = 0;
+
+    bool isLeaf() const { return child1 == kNullNode; }
+  };
+
+  int32_t allocateNode();
+  void freeNode(int32_t node);
+  void insertLeaf(int32_t leaf);
+  void removeLeaf(int32_t leaf);
+  // Walks from node to the root, rebalancing and refitting every ancestor.
+  void refitAncestors(int32_t node);
+  int32_t balance(int32_t node);
+
+  template <typename Overlaps, typename Visitor>
+  void traverse(Overlaps &&overlaps, Visitor &&visitor) const;
+
+  std::vector<Node> _nodes;
+  int32_t _root = kNullNode;
+  int32_t _freeList = kNullNode;
+  uint32_t _proxyCount = 0;
+
+  // Scratch for queries; nested queries share it above their own base.
+  mutable std::vector<int32_t> _stack;
+  mutable std::vector<AABB> _candidateBounds;
+  mutable std::vector<Entity> _candidates;
+  mutable std::vector<uint8_t> _candidateVisible;
+  mutable FrustumQueryStats _frustumStats;
+};
+
+template <typename Overlaps, typename Visitor>
+void DynamicAABBTree::traverse(Overlaps &&overlaps, Visitor &&visitor) const {
+  if (_root == kNullNode) {
+    return;
+  }
+  const size_t base = _stack.size();
+  _stack.push_back(_root);
+
+  while (_stack.size() > base) {
+    const Node &node = _nodes[_stack.back()];
+    _stack.pop_back();
+
+    if (node.isLeaf()) {
+      if (overlaps(node.bounds) && !visitor(node)) {
+        _stack.resize(base);
+        return;
+      }
+    } else if (overlaps(node.box)) {
+      _stack.push_back(node.child1);
+      _stack.push_back(node.child2);
+    }
+  }
+}
+
+template <typename Visitor>
+void DynamicAABBTree::query(const AABB &box, Visitor &&visitor) const {
+  traverse([&](const AABB &nodeBox) { return nodeBox.intersects(box); },
+           [&](const Node &leaf) {
+             visitor(leaf.entity);
+             return true;
+           });
+}
+
+template <typename Visitor>
+void DynamicAABBTree::query(const BoundingSphere &sphere,
+                            Visitor &&visitor) const {
+  traverse(
+      [&](const AABB &nodeBox) {
+        return nodeBox.intersects(sphere.center, sphere.radius);
+      },
+      [&](const Node &leaf) {
+        visitor(leaf.entity);
+        return true;
+      });
+}
+
+template <typename Visitor>
+void DynamicAABBTree::raycast(simd_float3 origin, simd_float3 direction,
+                              float maxDistance, Visitor &&visitor) const {
+  const simd_float3 inverseDirection = 1.0f / direction;
+  float distance = 0.0f;
+  traverse(
+      [&](const AABB &nodeBox) {
+        return nodeBox.intersectsRay(origin, inverseDirection, maxDistance,
+                                     distance);
+      },
+      [&](const Node &leaf) {
+        // distance still holds the hit on this leaf's bounds.
+        maxDistance = visitor(leaf.entity, distance);
+        return maxDistance > 0.0f;
+      });
+}
@@ -7,81 +7,68 @@
 
 #pragma once
 #include <string>
-#include <vector>
 #include <memory>
-#include <functional>
 #include <simd/simd.h>
+#include "entt.hpp"
+#include "NameID.hpp"
 
-// Forward declaration
-class Entity;
 class Mesh;
 
-class Entity : public std::enable_shared_from_this<Entity> {
-public:
-    std::string name = "UnnamedEntity";
-    
-    matrix_float4x4 transform;
-    
-    std::vector<std::shared_ptr<Entity>> children;
-    std::weak_ptr<Entity> parent;
+// Generational handle: the low 32 bits index a storage slot, the high 32 bits
+// count how often that slot was reused. Destroyed slots go on the registry's
+// free list and come back with a bumped generation, so stale handles fail
+// Scene::isValid() instead of aliasing a new entity.
+enum class Entity : uint64_t {};
 
-    Entity() {
-        transform = matrix_identity_float4x4;
-    }
-    
-    virtual ~Entity() = default;
+// Component pools are paged, so each one is a chain of fixed-size slabs.
+using Registry = entt::basic_registry<Entity>;
 
-    matrix_float4x4 worldTransform() {
-        if (auto p = parent.lock()) {
-            return matrix_multiply(p->worldTransform(), transform);
-        }
-        return transform;
-    }
+// Scene entities live in Scene::registry; these are the components they carry.
 
-    void removeChild(std::shared_ptr<Entity> child) {
-        auto it = std::remove_if(children.begin(), children.end(),
-            [&](const std::shared_ptr<Entity>& e) { return e == child; });
-        
-        if (it != children.end()) {
-            children.erase(it, children.end());
-            child->parent.reset();
-        }
-    }
+// Change through Scene::setName so the scene's lookup index stays current.
+struct Name {
+    std::string value = "UnnamedEntity";
+    NameID id = makeNameID("UnnamedEntity");
+    // Hash of the path below the scene root; 0 while detached from the scene.
+    NameID pathID = 0;
+};
+
+struct LocalTransform {
+    matrix_float4x4 matrix = matrix_identity_float4x4;
+};
 
-    void removeFromParent() {
-        if (auto p = parent.lock()) {
-            p->removeChild(shared_from_this());
-        }
-    }
+struct WorldTransform {
+    matrix_float4x4 matrix = matrix_identity_float4x4;
 
-    void addChild(std::shared_ptr<Entity> child) {
-        child->removeFromParent();
-        children.push_back(child);
-        child->parent = weak_from_this();
-    }
+    // A dirty node always has a dirty subtree; hasDirtyDescendant lets the
+    // update pass skip branches with nothing to recompute.
+    bool dirty = true;
+    bool hasDirtyDescendant = false;
 
-    void visitHierarchy(std::function<void(Entity*)> visitor) {
-        visitor(this);
-        for (auto& child : children) {
-            child->visitHierarchy(visitor);
-        }
-    }
+    // Already queued in Scene::changedEntities() this frame.
+    bool changed = false;
+};
 
-    std::shared_ptr<Entity> childNamed(const std::string& searchName, bool recursively = true) {
-        for (auto& child : children) {
-            if (child->name == searchName) {
-                return child;
-            } else if (recursively) {
-                if (auto found = child->childNamed(searchName, recursively)) {
-                    return found;
-                }
-            }
-        }
-        return nullptr;
-    }
+// Intrusive child list so reparenting never allocates.
+struct Hierarchy {
+    Entity parent = entt::null;
+    Entity firstChild = entt::null;
+    Entity lastChild = entt::null;
+    Entity prevSibling = entt::null;
+    Entity nextSibling = entt::null;
+    uint32_t childCount = 0;
 };
 
-class ModelEntity : public Entity {
-public:
+struct MeshRenderer {
     std::shared_ptr<Mesh> mesh;
 };
+
+// Scene-owned leaf in the spatial index, kept while the entity has a mesh.
+struct SpatialProxy {
+    int32_t node;
+};
+
+// Renderer-owned slot in the persistent instance constants buffer.
+struct InstanceSlot {
+    uint32_t index;
+};
@@ -0,0 +1,238 @@
+//
+//  FrameGraph.cpp
+//  Paloma Engine
+//
+
+#include "FrameGraph.hpp"
+#include "BufferUtilites.hpp"
+#include <algorithm>
+
+void FrameGraph::reset() {
+  _passes.clear();
+  _resources.clear();
+  _executionOrder.clear();
+  _stats = {};
+}
+
+FrameGraphResource
+FrameGraph::createTexture(std::string name, const FrameGraphTextureDesc &desc) {
+  ResourceInfo resource;
+  resource.name = std::move(name);
+  resource.desc = desc;
+  _resources.push_back(std::move(resource));
+  return (FrameGraphResource)(_resources.size() - 1);
+}
+
+FrameGraphResource FrameGraph::importTexture(std::string name,
+                                             void *pTexture) {
+  ResourceInfo resource;
+  resource.name = std::move(name);
+  resource.imported = true;
+  resource.pTexture = pTexture;
+  _resources.push_back(std::move(resource));
+  return (FrameGraphResource)(_resources.size() - 1);
+}
+
+uint32_t FrameGraph::addPass(std::string name, ExecuteFunction execute) {
+  PassInfo pass;
+  pass.name = std::move(name);
+  pass.execute = std::move(execute);
+  _passes.push_back(std::move(pass));
+  return (uint32_t)(_passes.size() - 1);
+}
+
+void FrameGraph::read(uint32_t pass, FrameGraphResource resource) {
+  auto &reads = _passes[pass].reads;
+  if (std::find(reads.begin(), reads.end(), resource) == reads.end()) {
+    reads.push_back(resource);
+  }
+}
+
+void FrameGraph::write(uint32_t pass, FrameGraphResource resource) {
+  auto &writes = _passes[pass].writes;
+  if (std::find(writes.begin(), writes.end(), resource) == writes.end()) {
+    writes.push_back(resource);
+  }
+}
+
+bool FrameGraph::compile(const FrameGraphSizeFunction &sizeOf) {
+  std::vector<bool> written(_resources.size(), false);
+  for (const auto &pass : _passes) {
+    for (FrameGraphResource resource : pass.reads) {
+      if (!_resources[resource].imported && !written[resource]) {
+        return false;
+      }
+    }
+    for (FrameGraphResource resource : pass.writes) {
+      written[resource] = true;
+    }
+  }
+
+  cullPasses();
+
+  _executionOrder.clear();
+  for (uint32_t p = 0; p < _passes.size(); ++p) {
+    if (!_passes[p].culled) {
+      _executionOrder.push_back(p);
+    }
+  }
+
+  computeLifetimes();
+  placeTransients(sizeOf);
+
+  _stats.passes = (uint32_t)_passes.size();
+  _stats.culledPasses = (uint32_t)(_passes.size() - _executionOrder.size());
+  return true;
+}
+
+void FrameGraph::execute() const {
+  for (uint32_t p : _executionOrder) {
+    if (_passes[p].execute) {
+      _passes[p].execute(*this, _passes[p]);
+    }
+  }
+}
+
+void FrameGraph::cullPasses() {
+  // A pass is needed while something reads one of its writes; imported
+  // textures are read by whatever comes after the frame.
+  std::vector<uint32_t> passRefs(_passes.size(), 0);
+  std::vector<uint32_t> resourceRefs(_resources.size(), 0);
+  std::vector<std::vector<uint32_t>> writers(_resources.size());
+  for (uint32_t p = 0; p < _passes.size(); ++p) {
+    auto &pass = _passes[p];
+    pass.culled = false;
+    passRefs[p] = (uint32_t)pass.writes.size() + (pass.hasSideEffects ? 1 : 0);
+    for (FrameGraphResource resource : pass.reads) {
+      resourceRefs[resource]++;
+    }
+    for (FrameGraphResource resource : pass.writes) {
+      writers[resource].push_back(p);
+    }
+  }
+  for (uint32_t r = 0; r < _resources.size(); ++r) {
+    if (_resources[r].imported) {
+      resourceRefs[r]++;
+    }
+  }
+
+  std::vector<FrameGraphResource> unused;
+  auto cull = [&](uint32_t p) {
+    _passes[p].culled = true;
+    for (FrameGraphResource resource : _passes[p].reads) {
+      if (--resourceRefs[resource] == 0) {
+        unused.push_back(resource);
+      }
+    }
+  };
+
+  for (uint32_t r = 0; r < _resources.size(); ++r) {
+    if (resourceRefs[r] == 0) {
+      unused.push_back(r);
+    }
+  }
+  for (uint32_t p = 0; p < _passes.size(); ++p) {
+    if (passRefs[p] == 0) {
+      cull(p);
+    }
+  }
+  while (!unused.empty()) {
+    const FrameGraphResource resource = unused.back();
+    unused.pop_back();
+    for (uint32_t p : writers[resource]) {
+      if (!_passes[p].culled && --passRefs[p] == 0) {
+        cull(p);
+      }
+    }
+  }
+}
+
+void FrameGraph::computeLifetimes() {
+  for (auto &resource : _resources) {
+    resource.firstUse = UINT32_MAX;
+    resource.lastUse = 0;
+  }
+  for (uint32_t i = 0; i < _executionOrder.size(); ++i) {
+    const auto &pass = _passes[_executionOrder[i]];
+    for (const auto *list : {&pass.reads, &pass.writes}) {
+      for (FrameGraphResource r : *list) {
+        _resources[r].firstUse = std::min(_resources[r].firstUse, i);
+        _resources[r].lastUse = std::max(_resources[r].lastUse, i);
+      }
+    }
+  }
+}
+
+void FrameGraph::placeTransients(const FrameGraphSizeFunction &sizeOf) {
+  std::vector<FrameGraphResource> transients;
+  std::vector<size_t> alignments(_resources.size(), 1);
+  _stats.transientTextures = 0;
+  _stats.heapBytes = 0;
+  _stats.unaliasedBytes = 0;
+  _stats.heapAlignment = 1;
+  for (FrameGraphResource r = 0; r < _resources.size(); ++r) {
+    auto &resource = _resources[r];
+    if (resource.imported || resource.firstUse > resource.lastUse) {
+      continue;
+    }
+    const auto allocation = sizeOf(resource.desc);
+    resource.size = allocation.size;
+    alignments[r] = std::max<size_t>(allocation.alignment, 1);
+    _stats.heapAlignment = std::max(_stats.heapAlignment, alignments[r]);
+    _stats.unaliasedBytes += alignUp(allocation.size, alignments[r]);
+    transients.push_back(r);
+  }
+  _stats.transientTextures = (uint32_t)transients.size();
+
+  // Largest first; each texture takes the lowest offset that doesn't
+  // overlap a placed texture whose lifetime overlaps its own.
+  std::stable_sort(transients.begin(), transients.end(),
+                   [&](FrameGraphResource a, FrameGraphResource b) {
+                     return _resources[a].size > _resources[b].size;
+                   });
+
+  std::vector<FrameGraphResource> placed;
+  std::vector<FrameGraphResource> conflicts;
+  for (FrameGraphResource r : transients) {
+    auto &resource = _resources[r];
+    conflicts.clear();
+    for (FrameGraphResource other : placed) {
+      const auto &o = _resources[other];
+      if (o.firstUse <= resource.lastUse && resource.firstUse <= o.lastUse) {
+        conflicts.push_back(other);
+      }
+    }
+    std::sort(conflicts.begin(), conflicts.end(),
+              [&](FrameGraphResource a, FrameGraphResource b) {
+                return _resources[a].heapOffset < _resources[b].heapOffset;
+              });
+
+    size_t offset = 0;
+    for (FrameGraphResource other : conflicts) {
+      const auto &o = _resources[other];
+      if (offset + resource.size <= o.heapOffset) {
+        break;
+      }
+      offset = std::max(offset, alignUp(o.heapOffset + o.size, alignments[r]));
+    }
+    resource.heapOffset = offset;
+    _stats.heapBytes = std::max(_stats.heapBytes, offset + resource.size);
+    placed.push_back(r);
+  }
+
+  for (auto &pass : _passes) {
+    pass.reusesAliasedMemory = false;
+  }
+  for (FrameGraphResource r : transients) {
+    const auto &resource = _resources[r];
+    for (FrameGraphResource other : transients) {
+      const auto &o = _resources[other];
+      if (o.lastUse < resource.firstUse &&
+          o.heapOffset < resource.heapOffset + resource.size &&
+          resource.heapOffset < o.heapOffset + o.size) {
+        _passes[_executionOrder[resource.firstUse]].reusesAliasedMemory = true;
+        break;
+      }
+    }
+  }
+}
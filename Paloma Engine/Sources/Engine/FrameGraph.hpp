@@ -0,0 +1,134 @@
+//
+//  FrameGraph.hpp
+//  Paloma Engine
+//
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Formats and usages are Metal's, kept as integers so the graph can be
+// built and compiled without Metal.
+struct FrameGraphTextureDesc {
+  uint32_t width = 0;
+  uint32_t height = 0;
+  uint32_t pixelFormat = 0; // MTL::PixelFormat
+  uint32_t sampleCount = 1;
+  uint32_t mipLevelCount = 1;
+  uint32_t usage = 0; // MTL::TextureUsage
+
+  bool operator==(const FrameGraphTextureDesc &) const = default;
+};
+
+struct FrameGraphAllocationSize {
+  size_t size;
+  size_t alignment;
+};
+
+// How much heap memory a texture takes, e.g. from
+// MTL::Device::heapTextureSizeAndAlign.
+using FrameGraphSizeFunction =
+    std::function<FrameGraphAllocationSize(const FrameGraphTextureDesc &)>;
+
+using FrameGraphResource = uint32_t;
+
+// Passes are added in execution order and declare the textures they read
+// and write. compile() culls passes whose results nobody uses, works out
+// when each texture is first and last used, and places transient textures
+// in one heap so that textures whose lifetimes don't overlap share memory.
+// Imported textures (the drawable, the view's depth) live outside the heap
+// and count as outputs of the frame.
+//
+// The graph is rebuilt every frame; reset() keeps the storage.
+class FrameGraph {
+public:
+  struct PassInfo;
+  using ExecuteFunction =
+      std::function<void(const FrameGraph &graph, const PassInfo &pass)>;
+
+  struct ResourceInfo {
+    std::string name;
+    FrameGraphTextureDesc desc;
+    bool imported = false;
+    void *pTexture = nullptr;
+
+    // Positions in executionOrder(); firstUse > lastUse if nothing that
+    // runs uses the texture.
+    uint32_t firstUse = UINT32_MAX;
+    uint32_t lastUse = 0;
+
+    // Transient textures only.
+    size_t size = 0;
+    size_t heapOffset = 0;
+  };
+
+  struct PassInfo {
+    std::string name;
+    ExecuteFunction execute;
+    std::vector<FrameGraphResource> reads;
+    std::vector<FrameGraphResource> writes;
+    bool hasSideEffects = false;
+    bool culled = false;
+    // The pass first uses memory that an earlier pass used for another
+    // texture. The heap isn't hazard tracked, so its execute function must
+    // make the GPU wait for earlier passes before touching its textures.
+    bool reusesAliasedMemory = false;
+  };
+
+  struct Stats {
+    uint32_t passes = 0;
+    uint32_t culledPasses = 0;
+    uint32_t transientTextures = 0;
+    // Heap size with aliasing, and what the textures would take without it.
+    size_t heapBytes = 0;
+    size_t unaliasedBytes = 0;
+    size_t heapAlignment = 1;
+  };
+
+  void reset();
+
+  FrameGraphResource createTexture(std::string name,
+                                   const FrameGraphTextureDesc &desc);
+  FrameGraphResource importTexture(std::string name, void *pTexture);
+
+  uint32_t addPass(std::string name, ExecuteFunction execute);
+  void read(uint32_t pass, FrameGraphResource resource);
+  void write(uint32_t pass, FrameGraphResource resource);
+  // Keeps a pass that writes nothing the frame uses.
+  void setSideEffects(uint32_t pass) { _passes[pass].hasSideEffects = true; }
+
+  // Returns false if a pass reads a transient texture that no earlier pass
+  // writes.
+  bool compile(const FrameGraphSizeFunction &sizeOf);
+  // Runs the passes that survived culling, in order. Transient textures
+  // must have been bound with setTexture().
+  void execute() const;
+
+  void setTexture(FrameGraphResource resource, void *pTexture) {
+    _resources[resource].pTexture = pTexture;
+  }
+  void *texture(FrameGraphResource resource) const {
+    return _resources[resource].pTexture;
+  }
+
+  const std::vector<PassInfo> &passes() const { return _passes; }
+  const std::vector<ResourceInfo> &resources() const { return _resources; }
+  // Indices of the passes that run.
+  const std::vector<uint32_t> &executionOrder() const {
+    return _executionOrder;
+  }
+  const Stats &stats() const { return _stats; }
+
+private:
+  std::vector<PassInfo> _passes;
+  std::vector<ResourceInfo> _resources;
+  std::vector<uint32_t> _executionOrder;
+  Stats _stats;
+
+  void cullPasses();
+  void computeLifetimes();
+  void placeTransients(const FrameGraphSizeFunction &sizeOf);
+};
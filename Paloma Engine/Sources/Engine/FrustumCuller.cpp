@@ -0,0 +1,176 @@
+//
+//  FrustumCuller.cpp
+//  Paloma Engine
+//
+
+#include "FrustumCuller.hpp"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+FrustumCuller::FrustumCuller(const Frustum &frustum) {
+  for (uint32_t p = 0; p < Frustum::PlaneCount; ++p) {
+    const simd_float4 &plane = frustum.planes[p];
+    _planes.nx[p] = plane.x;
+    _planes.ny[p] = plane.y;
+    _planes.nz[p] = plane.z;
+    _planes.ax[p] = std::fabs(plane.x);
+    _planes.ay[p] = std::fabs(plane.y);
+    _planes.az[p] = std::fabs(plane.z);
+    _planes.w[p] = plane.w;
+  }
+}
+
+void FrustumCuller::cull(const AABB *boxes, size_t count,
+                         uint8_t *visible) const {
+  BoundsBlock block;
+  for (size_t first = 0; first < count; first += kLaneCount) {
+    const size_t lanes = std::min<size_t>(count - first, kLaneCount);
+    for (size_t lane = 0; lane < kLaneCount; ++lane) {
+      // Unused lanes repeat the last box so they never read garbage.
+      const AABB &box = boxes[first + std::min(lane, lanes - 1)];
+      simd_float3 center = {0, 0, 0};
+      simd_float3 extents = {FLT_MAX, FLT_MAX, FLT_MAX};
+      if (!box.isEmpty()) {
+        center = box.center();
+        extents = box.extents();
+      }
+      block.centerX[lane] = center.x;
+      block.centerY[lane] = center.y;
+      block.centerZ[lane] = center.z;
+      block.extentX[lane] = extents.x;
+      block.extentY[lane] = extents.y;
+      block.extentZ[lane] = extents.z;
+    }
+
+    const uint8_t inside = cullBlock(block, _planes);
+    for (size_t lane = 0; lane < lanes; ++lane) {
+      visible[first + lane] = (inside >> lane) & 1;
+    }
+  }
+}
+
+// A box is outside a plane when even its nearest corner is behind it:
+// dot(n, c) + w + dot(|n|, e) < 0.
+
+#if defined(__AVX__)
+
+uint8_t FrustumCuller::cullBlock(const BoundsBlock &block,
+                                 const PlaneSet &planes) {
+  const __m256 cx = _mm256_load_ps(block.centerX);
+  const __m256 cy = _mm256_load_ps(block.centerY);
+  const __m256 cz = _mm256_load_ps(block.centerZ);
+  const __m256 ex = _mm256_load_ps(block.extentX);
+  const __m256 ey = _mm256_load_ps(block.extentY);
+  const __m256 ez = _mm256_load_ps(block.extentZ);
+
+  __m256 outside = _mm256_setzero_ps();
+  for (uint32_t p = 0; p < Frustum::PlaneCount; ++p) {
+    __m256 distance = _mm256_add_ps(
+        _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(planes.nx[p]), cx),
+                      _mm256_mul_ps(_mm256_set1_ps(planes.ny[p]), cy)),
+        _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(planes.nz[p]), cz),
+                      _mm256_set1_ps(planes.w[p])));
+    __m256 radius = _mm256_add_ps(
+        _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(planes.ax[p]), ex),
+                      _mm256_mul_ps(_mm256_set1_ps(planes.ay[p]), ey)),
+        _mm256_mul_ps(_mm256_set1_ps(planes.az[p]), ez));
+    outside = _mm256_or_ps(
+        outside, _mm256_cmp_ps(_mm256_add_ps(distance, radius),
+                               _mm256_setzero_ps(), _CMP_LT_OQ));
+  }
+  return (uint8_t)~_mm256_movemask_ps(outside);
+}
+
+#elif defined(__SSE2__)
+
+uint8_t FrustumCuller::cullBlock(const BoundsBlock &block,
+                                 const PlaneSet &planes) {
+  uint32_t inside = 0;
+  for (uint32_t half = 0; half < kLaneCount; half += 4) {
+    const __m128 cx = _mm_load_ps(block.centerX + half);
+    const __m128 cy = _mm_load_ps(block.centerY + half);
+    const __m128 cz = _mm_load_ps(block.centerZ + half);
+    const __m128 ex = _mm_load_ps(block.extentX + half);
+    const __m128 ey = _mm_load_ps(block.extentY + half);
+    const __m128 ez = _mm_load_ps(block.extentZ + half);
+
+    __m128 outside = _mm_setzero_ps();
+    for (uint32_t p = 0; p < Frustum::PlaneCount; ++p) {
+      __m128 distance =
+          _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(planes.nx[p]), cx),
+                                _mm_mul_ps(_mm_set1_ps(planes.ny[p]), cy)),
+                     _mm_add_ps(_mm_mul_ps(_mm_set1_ps(planes.nz[p]), cz),
+                                _mm_set1_ps(planes.w[p])));
+      __m128 radius =
+          _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(planes.ax[p]), ex),
+                                _mm_mul_ps(_mm_set1_ps(planes.ay[p]), ey)),
+                     _mm_mul_ps(_mm_set1_ps(planes.az[p]), ez));
+      outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, radius),
+                                                _mm_setzero_ps()));
+    }
+    inside |= (~_mm_movemask_ps(outside) & 0xF) << half;
+  }
+  return (uint8_t)inside;
+}
+
+#elif defined(__ARM_NEON)
+
+uint8_t FrustumCuller::cullBlock(const BoundsBlock &block,
+                                 const PlaneSet &planes) {
+  // NEON has no movemask: weight each lane's all-ones mask by its bit.
+  static const uint32_t kLaneBits[4] = {1, 2, 4, 8};
+  const uint32x4_t laneBits = vld1q_u32(kLaneBits);
+
+  uint32_t inside = 0;
+  for (uint32_t half = 0; half < kLaneCount; half += 4) {
+    const float32x4_t cx = vld1q_f32(block.centerX + half);
+    const float32x4_t cy = vld1q_f32(block.centerY + half);
+    const float32x4_t cz = vld1q_f32(block.centerZ + half);
+    const float32x4_t ex = vld1q_f32(block.extentX + half);
+    const float32x4_t ey = vld1q_f32(block.extentY + half);
+    const float32x4_t ez = vld1q_f32(block.extentZ + half);
+
+    uint32x4_t outside = vdupq_n_u32(0);
+    for (uint32_t p = 0; p < Frustum::PlaneCount; ++p) {
+      float32x4_t sum = vdupq_n_f32(planes.w[p]);
+      sum = vmlaq_n_f32(sum, cx, planes.nx[p]);
+      sum = vmlaq_n_f32(sum, cy, planes.ny[p]);
+      sum = vmlaq_n_f32(sum, cz, planes.nz[p]);
+      sum = vmlaq_n_f32(sum, ex, planes.ax[p]);
+      sum = vmlaq_n_f32(sum, ey, planes.ay[p]);
+      sum = vmlaq_n_f32(sum, ez, planes.az[p]);
+      outside = vorrq_u32(outside, vcltq_f32(sum, vdupq_n_f32(0.0f)));
+    }
+    inside |= (~vaddvq_u32(vandq_u32(outside, laneBits)) & 0xF) << half;
+  }
+  return (uint8_t)inside;
+}
+
+#else
+
+uint8_t FrustumCuller::cullBlock(const BoundsBlock &block,
+                                 const PlaneSet &planes) {
+  uint32_t inside = 0;
+  for (uint32_t lane = 0; lane < kLaneCount; ++lane) {
+    bool outside = false;
+    for (uint32_t p = 0; p < Frustum::PlaneCount && !outside; ++p) {
+      float distance = planes.nx[p] * block.centerX[lane] +
+                       planes.ny[p] * block.centerY[lane] +
+                       planes.nz[p] * block.centerZ[lane] + planes.w[p];
+      float radius = planes.ax[p] * block.extentX[lane] +
+                     planes.ay[p] * block.extentY[lane] +
+                     planes.az[p] * block.extentZ[lane];
+      outside = distance + radius < 0.0f;
+    }
+    inside |= (outside ? 0u : 1u) << lane;
+  }
+  return (uint8_t)inside;
+}
+
+#endif
@@ -0,0 +1,47 @@
+//
+//  FrustumCuller.hpp
+//  Paloma Engine
+//
+
+#pragma once
+#include "Bounds.hpp"
+#include <cstdint>
+#include <cstddef>
+
+// Tests batches of world-space boxes against a frustum. Boxes are packed
+// eight to a block as structure-of-arrays so one SIMD pass tests a whole
+// block against a plane.
+class FrustumCuller {
+public:
+  static constexpr uint32_t kLaneCount = 8;
+
+  explicit FrustumCuller(const Frustum &frustum);
+
+  // Sets visible[i] to 1 when boxes[i] intersects the frustum and to 0
+  // otherwise. An empty box is never culled.
+  void cull(const AABB *boxes, size_t count, uint8_t *visible) const;
+
+private:
+  struct alignas(32) BoundsBlock {
+    float centerX[kLaneCount];
+    float centerY[kLaneCount];
+    float centerZ[kLaneCount];
+    float extentX[kLaneCount];
+    float extentY[kLaneCount];
+    float extentZ[kLaneCount];
+  };
+
+  // Plane normals, their absolute values and offsets, unpacked once.
+  struct PlaneSet {
+    float nx[Frustum::PlaneCount], ny[Frustum::PlaneCount],
+        nz[Frustum::PlaneCount];
+    float ax[Frustum::PlaneCount], ay[Frustum::PlaneCount],
+        az[Frustum::PlaneCount];
+    float w[Frustum::PlaneCount];
+  };
+
+  // Bit i of the result is set when lane i intersects all six planes.
+  static uint8_t cullBlock(const BoundsBlock &block, const PlaneSet &planes);
+
+  PlaneSet _planes;
+};
@@ -6,6 +6,7 @@
 //
 
 #include "ImageBasedLight.hpp"
+#include "GPUMemoryTracker.hpp"
 
 ImageBasedLight::ImageBasedLight(NS::SharedPtr<MTL::Texture> diffuseCubeTexture,
                                  NS::SharedPtr<MTL::Texture> specularCubeTexture, int specularMipLevelCount,
@@ -13,6 +14,13 @@ ImageBasedLight::ImageBasedLight(NS::SharedPtr<MTL::Texture> diffuseCubeTexture,
                                  NS::SharedPtr<MTL::SharedEvent> readyEvent) : diffuseCubeTexture(diffuseCubeTexture), specularCubeTexture(specularCubeTexture), specularMipLevelCount(specularMipLevelCount),scaleAndBiasLookupTexture(scaleAndBiasLookupTexture), readyEvent(readyEvent)
 {}
 
+ImageBasedLight::~ImageBasedLight() {
+    GPUMemoryTracker& memory = GPUMemoryTracker::shared();
+    memory.release(diffuseCubeTexture.get());
+    memory.release(specularCubeTexture.get());
+    memory.release(scaleAndBiasLookupTexture.get());
+}
+
 void ImageBasedLight::generateImageBasedLight(const std::string &url, MTL::Device *pDevice, std::function<void (ImageBasedLight *, NS::Error *)> completion)
 {
     std::string urlCopy = url;
@@ -114,6 +122,15 @@ ImageBasedLight* ImageBasedLightGenerator::makeLight(const std::string &path) {
     auto lookupTexture = NS::TransferPtr(_pDevice->newTexture(lookupTextureDescriptor));
     lookupTexture->setLabel(NS::String::string("DFG Lookup Table (GGX)", NS::UTF8StringEncoding));
 
+    // Accounted to the environment map's file. The equirectangular source and
+    // the unfiltered cube are only needed while generating.
+    const std::string asset = path.substr(path.find_last_of('/') + 1);
+    GPUMemoryTracker& memory = GPUMemoryTracker::shared();
+    for (MTL::Texture* pTexture : { equirectTexture.get(), sourceCubeTexture.get(), specularCubeTexture.get(),
+                                    diffuseCubeTexture.get(), lookupTexture.get() }) {
+        memory.record(pTexture, pTexture->allocatedSize(), GPUMemoryCategory::Environment, asset);
+    }
+
     auto commandBuffer = _pCommandQueue->commandBuffer();
     auto computeCommandEncoder = commandBuffer->computeCommandEncoder();
     
@@ -192,6 +209,9 @@ ImageBasedLight* ImageBasedLightGenerator::makeLight(const std::string &path) {
     auto readyEvent = NS::TransferPtr(_pDevice->newSharedEvent());
     commandBuffer->encodeSignalEvent(readyEvent.get(), 1);
     commandBuffer->commit();
+
+    memory.release(equirectTexture.get());
+    memory.release(sourceCubeTexture.get());
     
     return new ImageBasedLight(diffuseCubeTexture, specularCubeTexture, mipLevelCount, lookupTexture, readyEvent);
 }
@@ -29,6 +29,8 @@ public:
                     NS::SharedPtr<MTL::Texture> specularCubeTexture, int specularMipLevelCount,
                     NS::SharedPtr<MTL::Texture> scaleAndBiasLookupTexture,
                     NS::SharedPtr<MTL::SharedEvent> readyEvent);
+    // Releases the textures from GPUMemoryTracker::shared().
+    ~ImageBasedLight();
     
     static void generateImageBasedLight(
                                         const std::string &url, MTL::Device *pDevice,
@@ -0,0 +1,89 @@
+//
+//  JobSystem.cpp
+//  Paloma Engine
+//
+
+#include "JobSystem.hpp"
+#include <algorithm>
+
+JobSystem::JobSystem(uint32_t workerCount) {
+  _workers.reserve(workerCount);
+  for (uint32_t i = 0; i < workerCount; ++i) {
+    _workers.emplace_back([this] { workerLoop(); });
+  }
+}
+
+JobSystem::~JobSystem() {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _quit = true;
+  }
+  _wake.notify_all();
+  for (auto &worker : _workers) {
+    worker.join();
+  }
+}
+
+uint32_t JobSystem::defaultWorkerCount() {
+  uint32_t hardwareThreads = std::thread::hardware_concurrency();
+  return std::max(hardwareThreads, 2u) - 1;
+}
+
+void JobSystem::parallelFor(uint32_t count,
+                            const std::function<void(uint32_t)> &job) {
+  if (count <= 1 || _workers.empty()) {
+    for (uint32_t i = 0; i < count; ++i) {
+      job(i);
+    }
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _pJob = &job;
+    _count = count;
+    _next.store(0, std::memory_order_relaxed);
+    _activeWorkers = (uint32_t)_workers.size();
+    _generation++;
+  }
+  _wake.notify_all();
+
+  runJobs(job, count);
+
+  // Every worker checks in, so none can still see this job afterwards.
+  std::unique_lock<std::mutex> lock(_mutex);
+  _done.wait(lock, [this] { return _activeWorkers == 0; });
+  _pJob = nullptr;
+}
+
+void JobSystem::runJobs(const std::function<void(uint32_t)> &job,
+                        uint32_t count) {
+  for (uint32_t i = _next.fetch_add(1, std::memory_order_relaxed); i < count;
+       i = _next.fetch_add(1, std::memory_order_relaxed)) {
+    job(i);
+  }
+}
+
+void JobSystem::workerLoop() {
+  uint64_t seenGeneration = 0;
+  std::unique_lock<std::mutex> lock(_mutex);
+
+  while (true) {
+    _wake.wait(lock,
+               [&] { return _quit || _generation != seenGeneration; });
+    if (_quit) {
+      return;
+    }
+    seenGeneration = _generation;
+    const auto *pJob = _pJob;
+    const uint32_t count = _count;
+
+    lock.unlock();
+    runJobs(*pJob, count);
+    lock.lock();
+
+    if (--_activeWorkers == 0) {
+      _done.notify_one();
+    }
+  }
+}
@@ -0,0 +1,48 @@
+//
+//  JobSystem.hpp
+//  Paloma Engine
+//
+
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed pool of worker threads for fork-join work inside a frame.
+class JobSystem {
+public:
+  explicit JobSystem(uint32_t workerCount = defaultWorkerCount());
+  ~JobSystem();
+
+  JobSystem(const JobSystem &) = delete;
+  JobSystem &operator=(const JobSystem &) = delete;
+
+  // One fewer than the hardware threads; the caller is the last one.
+  static uint32_t defaultWorkerCount();
+  uint32_t threadCount() const { return (uint32_t)_workers.size() + 1; }
+
+  // Calls job(i) for every i in [0, count) on the workers and the calling
+  // thread, and returns once all calls are done. Not reentrant.
+  void parallelFor(uint32_t count, const std::function<void(uint32_t)> &job);
+
+private:
+  std::vector<std::thread> _workers;
+
+  std::mutex _mutex;
+  std::condition_variable _wake;
+  std::condition_variable _done;
+
+  const std::function<void(uint32_t)> *_pJob = nullptr;
+  uint32_t _count = 0;
+  std::atomic<uint32_t> _next{0};
+  uint32_t _activeWorkers = 0;
+  uint64_t _generation = 0;
+  bool _quit = false;
+
+  void runJobs(const std::function<void(uint32_t)> &job, uint32_t count);
+  void workerLoop();
+};
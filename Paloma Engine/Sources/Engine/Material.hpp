@@ -8,7 +8,6 @@
 #pragma once
 #include <Metal/Metal.hpp>
 #include <simd/simd.h>
-#include "BufferUtilites.hpp"
 
 enum class AlphaMode : uint32_t {
     Opaque = 0,
@@ -16,14 +15,21 @@ enum class AlphaMode : uint32_t {
     Blend = 2
 };
 
+// Marks a property whose texture isn't streamed.
+constexpr uint32_t kNotStreamed = UINT32_MAX;
+
+// A streamed texture's pTexture is replaced whenever its resident mips
+// change; streamingID indexes Scene::getStreamedTextures().
 struct ScalarProperty {
     NS::SharedPtr<MTL::Texture> pTexture;
+    uint32_t streamingID = kNotStreamed;
     float factor = 1.0f;
     int mappingChannel = 0;
 };
 
 struct ColorProperty {
     NS::SharedPtr<MTL::Texture> pTexture;
+    uint32_t streamingID = kNotStreamed;
     simd_float3 factor = { 0, 0, 0 };
     int mappingChannel = 0;
 };
@@ -53,8 +59,12 @@ public:
     }
 
     NS::SharedPtr<MTL::RenderPipelineState> pRenderPipelineState;
-    
-    BufferView bufferView = { nullptr, 0, 0 };
+
+    // Small IDs assigned by the renderer for draw sort keys. Materials that
+    // share a pipeline state share its pipelineID. materialID is also the
+    // material's entry in the renderer's MaterialTable.
+    uint32_t pipelineID = 0;
+    uint32_t materialID = 0;
 
 public:
     Material() = default;
@@ -0,0 +1,54 @@
+//
+//  MaterialTable.cpp
+//  Paloma Engine
+//
+
+#include "MaterialTable.hpp"
+#include <cassert>
+
+MaterialTable::MaterialTable(GPUDevice *pDevice, size_t framesInFlight,
+                             size_t initialCapacity)
+    : _slots(initialCapacity, framesInFlight, pDevice,
+             GPUMemoryCategory::Materials,
+             // Every entry is bound on its own, so each one must start at a
+             // valid constant buffer offset.
+             alignUp(sizeof(MaterialArguments),
+                     std::lcm(alignof(MaterialArguments),
+                              pDevice->minimumConstantAlignment()))),
+      _framesInFlight(framesInFlight) {}
+
+uint32_t MaterialTable::add(const MaterialArguments &arguments) {
+  const uint32_t materialID = _slots.allocateSlot();
+  if (materialID >= _live.size()) {
+    _live.resize(materialID + 1, false);
+  }
+  _live[materialID] = true;
+  _liveCount++;
+  _slots.update(materialID, arguments);
+  return materialID;
+}
+
+void MaterialTable::update(uint32_t materialID,
+                           const MaterialArguments &arguments) {
+  assert(contains(materialID));
+  _slots.update(materialID, arguments);
+}
+
+void MaterialTable::remove(uint32_t materialID) {
+  assert(contains(materialID));
+  // Frames in flight may still read the entry, but a reused ID only reaches
+  // a frame's copy once that frame is flushed again.
+  _live[materialID] = false;
+  _liveCount--;
+  _slots.freeSlot(materialID);
+}
+
+MaterialTable::Stats MaterialTable::stats() const {
+  Stats stats;
+  stats.liveMaterials = _liveCount;
+  stats.freeSlots = (uint32_t)(_slots.capacity() - _liveCount);
+  stats.capacity = (uint32_t)_slots.capacity();
+  stats.pendingUploads = (uint32_t)_slots.pendingSlotCount();
+  stats.bytes = _slots.capacity() * _slots.stride() * _framesInFlight;
+  return stats;
+}
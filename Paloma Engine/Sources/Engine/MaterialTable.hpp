@@ -0,0 +1,75 @@
+//
+//  MaterialTable.hpp
+//  Paloma Engine
+//
+
+#pragma once
+#include "BufferUtilites.hpp"
+#include "ShaderStructures.h"
+#include <cstdint>
+#include <vector>
+
+// GPU table with one MaterialArguments entry per material, indexed by a
+// material ID that stays the same until the material is removed, even when
+// the table grows. Removed IDs are reused, which keeps them small enough for
+// draw sort keys.
+//
+// Edits are made in place. Every frame in flight reads its own copy of the
+// table, and an edited entry reaches a frame's copy when that frame is
+// flushed, so the GPU never reads an entry while it is being written.
+class MaterialTable {
+public:
+  struct Stats {
+    uint32_t liveMaterials = 0;
+    uint32_t freeSlots = 0;
+    uint32_t capacity = 0;
+    // Entries that some frame's copy has yet to receive.
+    uint32_t pendingUploads = 0;
+    // All frame copies together.
+    size_t bytes = 0;
+
+    float occupancy() const {
+      return capacity > 0 ? (float)liveMaterials / capacity : 0.0f;
+    }
+  };
+
+  MaterialTable(GPUDevice *pDevice, size_t framesInFlight,
+                size_t initialCapacity = 64);
+
+  uint32_t add(const MaterialArguments &arguments);
+  void update(uint32_t materialID, const MaterialArguments &arguments);
+  void remove(uint32_t materialID);
+
+  bool contains(uint32_t materialID) const {
+    return materialID < _live.size() && _live[materialID];
+  }
+  const MaterialArguments &arguments(uint32_t materialID) const {
+    return _slots.value(materialID);
+  }
+
+  // Call once the GPU has finished with frameIndex's previous use.
+  void flush(size_t frameIndex) { _slots.flush(frameIndex); }
+
+  uint64_t gpuAddress(size_t frameIndex, uint32_t materialID) const {
+    return _slots.view(frameIndex, materialID).gpuAddress();
+  }
+  GPUBuffer *getBuffer(size_t frameIndex) const {
+    return _slots.getBuffer(frameIndex);
+  }
+  // Entries are this many bytes apart in every frame's buffer.
+  size_t stride() const { return _slots.stride(); }
+  // Bumped whenever growing replaced the underlying buffers.
+  uint32_t bufferGeneration() const { return _slots.bufferGeneration(); }
+  // Called with each replaced buffer just before it is released.
+  void setReleaseCallback(std::function<void(GPUBuffer *)> onRelease) {
+    _slots.setReleaseCallback(std::move(onRelease));
+  }
+
+  Stats stats() const;
+
+private:
+  FrameSlotBuffer<MaterialArguments> _slots;
+  size_t _framesInFlight;
+  std::vector<bool> _live;
+  uint32_t _liveCount = 0;
+};
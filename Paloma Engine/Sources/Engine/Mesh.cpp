@@ -8,7 +8,7 @@
 #include "Mesh.hpp"
 
 Submesh::Submesh(MTL::PrimitiveType primitiveType,
-                 BufferView indexBuffer,
+                 MetalBufferView indexBuffer,
                  MTL::IndexType indexType,
                  NS::UInteger indexCount,
                  int materialIndex)
@@ -21,7 +21,7 @@ Submesh::Submesh(MTL::PrimitiveType primitiveType,
 }
 
 Mesh::Mesh(std::string name,
-           std::vector<BufferView> vertexBuffers,
+           std::vector<MetalBufferView> vertexBuffers,
            NS::UInteger vertexCount,
            NS::SharedPtr<MDL::VertexDescriptor> vertexDescriptor,
            std::vector<Submesh> submeshes,
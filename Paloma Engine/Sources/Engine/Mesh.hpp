@@ -6,36 +6,85 @@
 
 #include "ModelIO/MDLDefines.hpp"
 #include "ModelIO/ModelIO.hpp"
-#include "BufferUtilites.hpp"
+#include "MetalGPUDevice.hpp"
 #include "Material.hpp"
+#include "Bounds.hpp"
+#include "VertexCompression.hpp"
+
+// CPU copy of a simple mesh's triangles, rasterized by OcclusionBuffer.
+struct OccluderGeometry {
+    std::vector<simd_float3> positions;
+    std::vector<uint32_t> indices;
+
+    bool isEmpty() const { return indices.empty(); }
+};
+
+// A coarser version of a submesh. It indexes the same vertex buffers with
+// 32-bit indices.
+struct SubmeshLOD {
+    MetalBufferView indexBuffer;
+    NS::UInteger indexCount;
+    // How far the surface may have moved from full detail, in mesh units.
+    float error;
+};
 
 class Submesh {
 public:
     Submesh(MTL::PrimitiveType primitiveType,
-            BufferView indexBuffer,
+            MetalBufferView indexBuffer,
             MTL::IndexType indexType,
             NS::UInteger indexCount,
             int materialIndex);
     
     const MTL::PrimitiveType primitiveType;
-    const BufferView indexBuffer;
+    const MetalBufferView indexBuffer;
     const MTL::IndexType indexType;
     const NS::UInteger indexCount;
     int materialIndex;
+
+    // Local-space bounds of the vertices this submesh references.
+    AABB bounds;
+    BoundingSphere boundingSphere;
+
+    // Level 0 is the submesh itself; level n draws lods[n - 1]. Errors grow
+    // with the level.
+    std::vector<SubmeshLOD> lods;
+
+    uint32_t lodCount() const { return 1 + (uint32_t)lods.size(); }
+    const MetalBufferView &indexBufferForLOD(uint32_t lod) const {
+        return lod == 0 ? indexBuffer : lods[lod - 1].indexBuffer;
+    }
+    MTL::IndexType indexTypeForLOD(uint32_t lod) const {
+        return lod == 0 ? indexType : MTL::IndexTypeUInt32;
+    }
+    NS::UInteger indexCountForLOD(uint32_t lod) const {
+        return lod == 0 ? indexCount : lods[lod - 1].indexCount;
+    }
 };
 class Mesh {
 public:
     Mesh(std::string name,
-         std::vector<BufferView> vertexBuffers,
+         std::vector<MetalBufferView> vertexBuffers,
          NS::UInteger vertexCount,
          NS::SharedPtr<MDL::VertexDescriptor> vertexDescriptor,
          std::vector<Submesh> submeshes,
          std::vector<Material> materials);
     
     std::string name;
-    const std::vector<BufferView> vertexBuffers;
+    const std::vector<MetalBufferView> vertexBuffers;
     const NS::UInteger vertexCount;
     const NS::SharedPtr<MDL::VertexDescriptor> vertexDescriptor;
     const std::vector<Submesh> submeshes;
     std::vector<Material> materials;
+
+    // Local-space bounds of all vertices.
+    AABB bounds;
+    BoundingSphere boundingSphere;
+
+    // Empty unless the mesh is small enough to be drawn as an occluder.
+    OccluderGeometry occluder;
+
+    // Compact meshes bind meshConstants to dequantize their positions.
+    VertexFormat vertexFormat = VertexFormat::Standard;
+    MetalBufferView meshConstants = {nullptr, 0, 0};
 };
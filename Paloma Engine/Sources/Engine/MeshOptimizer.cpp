@@ -0,0 +1,328 @@
+//
+//  MeshOptimizer.cpp
+//  Paloma Engine
+//
+
+#include "MeshOptimizer.hpp"
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+
+namespace {
+
+// Forsyth's scoring parameters.
+constexpr uint32_t kScoreCacheSize = 32;
+constexpr float kCacheDecayPower = 1.5f;
+constexpr float kLastTriangleScore = 0.75f;
+constexpr float kValenceBoostScale = 2.0f;
+constexpr float kValenceBoostPower = 0.5f;
+
+// Lines kept by the fetch simulation, 4 KB in total.
+constexpr size_t kFetchCacheLines = 64;
+
+float vertexScore(int32_t cachePosition, uint32_t remainingTriangles) {
+  if (remainingTriangles == 0) {
+    return -1.0f;
+  }
+  float score = 0.0f;
+  if (cachePosition >= 0) {
+    // The last triangle's vertices score the same whatever their order, so
+    // the next triangle doesn't favour one of its edges.
+    if (cachePosition < 3) {
+      score = kLastTriangleScore;
+    } else {
+      const float scale = 1.0f / (kScoreCacheSize - 3);
+      score = powf(1.0f - (cachePosition - 3) * scale, kCacheDecayPower);
+    }
+  }
+  // Vertices with few triangles left are finished off first.
+  return score + kValenceBoostScale *
+                     powf((float)remainingTriangles, -kValenceBoostPower);
+}
+
+// FIFO post-transform cache: a vertex is cached if fewer than cacheSize
+// misses happened since it was last transformed.
+class VertexCacheSimulator {
+public:
+  explicit VertexCacheSimulator(size_t vertexCount)
+      : _missTime(vertexCount, 0) {}
+
+  // Returns true on a miss.
+  bool access(uint32_t vertex) {
+    if (_missTime[vertex] != 0 &&
+        _time - _missTime[vertex] < kVertexCacheSize) {
+      return false;
+    }
+    _missTime[vertex] = ++_time;
+    return true;
+  }
+
+private:
+  std::vector<uint32_t> _missTime;
+  uint32_t _time = 0;
+};
+
+} // namespace
+
+void optimizeVertexCache(uint32_t *indices, size_t indexCount,
+                         size_t vertexCount) {
+  const size_t triangleCount = indexCount / 3;
+  if (triangleCount < 2) {
+    return;
+  }
+
+  // Triangles around each vertex; the first remaining[v] entries are the
+  // triangles not yet emitted.
+  std::vector<uint32_t> offsets(vertexCount + 1, 0);
+  for (size_t i = 0; i < triangleCount * 3; ++i) {
+    offsets[indices[i] + 1]++;
+  }
+  for (size_t v = 0; v < vertexCount; ++v) {
+    offsets[v + 1] += offsets[v];
+  }
+  std::vector<uint32_t> adjacency(triangleCount * 3);
+  std::vector<uint32_t> remaining(vertexCount, 0);
+  for (size_t i = 0; i < triangleCount * 3; ++i) {
+    const uint32_t v = indices[i];
+    adjacency[offsets[v] + remaining[v]++] = (uint32_t)(i / 3);
+  }
+
+  std::vector<int32_t> cachePosition(vertexCount, -1);
+  std::vector<float> scores(vertexCount);
+  for (size_t v = 0; v < vertexCount; ++v) {
+    scores[v] = vertexScore(-1, remaining[v]);
+  }
+  std::vector<float> triangleScores(triangleCount);
+  for (size_t t = 0; t < triangleCount; ++t) {
+    triangleScores[t] = scores[indices[t * 3]] + scores[indices[t * 3 + 1]] +
+                        scores[indices[t * 3 + 2]];
+  }
+
+  std::vector<bool> emitted(triangleCount, false);
+  std::vector<uint32_t> output;
+  output.reserve(triangleCount * 3);
+  std::vector<uint32_t> cache, nextCache;
+  cache.reserve(kScoreCacheSize + 3);
+  nextCache.reserve(kScoreCacheSize + 3);
+
+  int64_t best = 0;
+  for (size_t t = 1; t < triangleCount; ++t) {
+    if (triangleScores[t] > triangleScores[best]) {
+      best = (int64_t)t;
+    }
+  }
+  size_t cursor = 0;
+
+  while (output.size() < triangleCount * 3) {
+    if (best < 0) {
+      // Nothing in the cache has triangles left; restart from the next
+      // triangle in input order.
+      while (emitted[cursor]) {
+        cursor++;
+      }
+      best = (int64_t)cursor;
+    }
+
+    const uint32_t *triangle = &indices[best * 3];
+    output.insert(output.end(), triangle, triangle + 3);
+    emitted[best] = true;
+
+    for (int k = 0; k < 3; ++k) {
+      const uint32_t v = triangle[k];
+      uint32_t *list = &adjacency[offsets[v]];
+      for (uint32_t i = 0; i < remaining[v]; ++i) {
+        if (list[i] == best) {
+          std::swap(list[i], list[remaining[v] - 1]);
+          break;
+        }
+      }
+      remaining[v]--;
+    }
+
+    // The triangle's vertices move to the front of the cache.
+    nextCache.assign(triangle, triangle + 3);
+    for (uint32_t v : cache) {
+      if (v != triangle[0] && v != triangle[1] && v != triangle[2]) {
+        nextCache.push_back(v);
+      }
+    }
+
+    best = -1;
+    float bestScore = -1.0f;
+    for (size_t i = 0; i < nextCache.size(); ++i) {
+      const uint32_t v = nextCache[i];
+      cachePosition[v] = i < kScoreCacheSize ? (int32_t)i : -1;
+      const float score = vertexScore(cachePosition[v], remaining[v]);
+      const float delta = score - scores[v];
+      scores[v] = score;
+      for (uint32_t a = 0; a < remaining[v]; ++a) {
+        const uint32_t t = adjacency[offsets[v] + a];
+        triangleScores[t] += delta;
+        if (triangleScores[t] > bestScore) {
+          bestScore = triangleScores[t];
+          best = t;
+        }
+      }
+    }
+
+    if (nextCache.size() > kScoreCacheSize) {
+      nextCache.resize(kScoreCacheSize);
+    }
+    std::swap(cache, nextCache);
+  }
+
+  std::copy(output.begin(), output.end(), indices);
+}
+
+void optimizeOverdraw(uint32_t *indices, size_t indexCount,
+                      const simd_float3 *positions, size_t vertexCount) {
+  const size_t triangleCount = indexCount / 3;
+  if (triangleCount < 2) {
+    return;
+  }
+
+  // A triangle whose three vertices all miss the cache starts a cluster.
+  std::vector<uint32_t> clusterStarts;
+  VertexCacheSimulator cache(vertexCount);
+  for (size_t t = 0; t < triangleCount; ++t) {
+    int misses = 0;
+    for (int k = 0; k < 3; ++k) {
+      misses += cache.access(indices[t * 3 + k]);
+    }
+    if (t == 0 || misses == 3) {
+      clusterStarts.push_back((uint32_t)t);
+    }
+  }
+  if (clusterStarts.size() < 2) {
+    return;
+  }
+  clusterStarts.push_back((uint32_t)triangleCount);
+  const size_t clusterCount = clusterStarts.size() - 1;
+
+  // Area-weighted centroid and normal of each cluster and of the mesh.
+  std::vector<simd_float3> centroids(clusterCount);
+  std::vector<simd_float3> normals(clusterCount);
+  simd_float3 meshCentroid = {0.0f, 0.0f, 0.0f};
+  float meshArea = 0.0f;
+  for (size_t c = 0; c < clusterCount; ++c) {
+    simd_float3 centroid = {0.0f, 0.0f, 0.0f};
+    simd_float3 normal = {0.0f, 0.0f, 0.0f};
+    float area = 0.0f;
+    for (uint32_t t = clusterStarts[c]; t < clusterStarts[c + 1]; ++t) {
+      const simd_float3 p0 = positions[indices[t * 3]];
+      const simd_float3 p1 = positions[indices[t * 3 + 1]];
+      const simd_float3 p2 = positions[indices[t * 3 + 2]];
+      const simd_float3 n = simd_cross(p1 - p0, p2 - p0);
+      const float triangleArea = simd_length(n);
+      centroid = centroid + (p0 + p1 + p2) * (triangleArea / 3.0f);
+      normal = normal + n;
+      area += triangleArea;
+    }
+    meshCentroid = meshCentroid + centroid;
+    meshArea += area;
+    centroids[c] = area > 0.0f ? centroid * (1.0f / area) : centroid;
+    normals[c] = normal;
+  }
+  if (meshArea > 0.0f) {
+    meshCentroid = meshCentroid * (1.0f / meshArea);
+  }
+
+  // Clusters facing away from the middle of the mesh are likely to occlude
+  // the rest, so they go first.
+  std::vector<float> keys(clusterCount);
+  for (size_t c = 0; c < clusterCount; ++c) {
+    const float length = simd_length(normals[c]);
+    keys[c] = length > 0.0f
+                  ? simd_dot(centroids[c] - meshCentroid, normals[c]) / length
+                  : 0.0f;
+  }
+  std::vector<uint32_t> order(clusterCount);
+  for (size_t c = 0; c < clusterCount; ++c) {
+    order[c] = (uint32_t)c;
+  }
+  std::stable_sort(order.begin(), order.end(),
+                   [&](uint32_t a, uint32_t b) { return keys[a] > keys[b]; });
+
+  std::vector<uint32_t> output;
+  output.reserve(triangleCount * 3);
+  for (uint32_t c : order) {
+    output.insert(output.end(), indices + clusterStarts[c] * 3,
+                  indices + clusterStarts[c + 1] * 3);
+  }
+  std::copy(output.begin(), output.end(), indices);
+}
+
+std::vector<uint32_t> vertexFetchRemap(const uint32_t *indices,
+                                       size_t indexCount, size_t vertexCount) {
+  constexpr uint32_t kUnassigned = UINT32_MAX;
+  std::vector<uint32_t> remap(vertexCount, kUnassigned);
+  uint32_t next = 0;
+  for (size_t i = 0; i < indexCount; ++i) {
+    if (remap[indices[i]] == kUnassigned) {
+      remap[indices[i]] = next++;
+    }
+  }
+  for (size_t v = 0; v < vertexCount; ++v) {
+    if (remap[v] == kUnassigned) {
+      remap[v] = next++;
+    }
+  }
+  return remap;
+}
+
+VertexCacheStats analyzeVertexCache(const uint32_t *indices, size_t indexCount,
+                                    size_t vertexCount) {
+  VertexCacheStats stats;
+  const size_t triangleCount = indexCount / 3;
+  if (triangleCount == 0) {
+    return stats;
+  }
+
+  VertexCacheSimulator cache(vertexCount);
+  std::vector<bool> referenced(vertexCount, false);
+  size_t misses = 0;
+  size_t uniqueVertices = 0;
+  for (size_t i = 0; i < triangleCount * 3; ++i) {
+    misses += cache.access(indices[i]);
+    if (!referenced[indices[i]]) {
+      referenced[indices[i]] = true;
+      uniqueVertices++;
+    }
+  }
+  stats.acmr = (float)misses / triangleCount;
+  stats.atvr = (float)misses / uniqueVertices;
+  return stats;
+}
+
+float analyzeVertexFetch(const uint32_t *indices, size_t indexCount,
+                         size_t vertexCount, size_t vertexStride) {
+  if (indexCount == 0 || vertexStride == 0) {
+    return 0.0f;
+  }
+
+  // FIFO of lines, tracked the same way as the vertex cache.
+  std::unordered_map<size_t, size_t> lineMissTime;
+  std::vector<bool> referenced(vertexCount, false);
+  size_t time = 0;
+  size_t fetchedBytes = 0;
+  size_t uniqueVertices = 0;
+  for (size_t i = 0; i < indexCount; ++i) {
+    const size_t v = indices[i];
+    if (!referenced[v]) {
+      referenced[v] = true;
+      uniqueVertices++;
+    }
+    const size_t first = v * vertexStride / kVertexFetchLineSize;
+    const size_t last = (v * vertexStride + vertexStride - 1) /
+                        kVertexFetchLineSize;
+    for (size_t line = first; line <= last; ++line) {
+      auto [it, inserted] = lineMissTime.try_emplace(line, 0);
+      if (!inserted && time - it->second < kFetchCacheLines) {
+        continue;
+      }
+      it->second = ++time;
+      fetchedBytes += kVertexFetchLineSize;
+    }
+  }
+  return (float)fetchedBytes / (uniqueVertices * vertexStride);
+}
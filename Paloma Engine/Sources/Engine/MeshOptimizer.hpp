@@ -0,0 +1,47 @@
+//
+//  MeshOptimizer.hpp
+//  Paloma Engine
+//
+
+#pragma once
+#include <simd/simd.h>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// FIFO size used to measure post-transform cache behaviour.
+constexpr uint32_t kVertexCacheSize = 16;
+// Line size used to measure vertex fetch.
+constexpr uint32_t kVertexFetchLineSize = 64;
+
+struct VertexCacheStats {
+  // Transformed vertices per triangle; 0.5 is ideal for a large grid, 3 is
+  // the worst case.
+  float acmr = 0.0f;
+  // Transformed vertices per referenced vertex; 1 is ideal.
+  float atvr = 0.0f;
+};
+
+// Reorders triangles for post-transform cache reuse (Forsyth's linear-speed
+// algorithm). Triangles keep their winding.
+void optimizeVertexCache(uint32_t *indices, size_t indexCount,
+                         size_t vertexCount);
+
+// Reorders cache-optimized triangles to draw outward-facing parts of the mesh
+// first. Triangles are split into clusters wherever the cache order already
+// starts over, so cache efficiency is kept while the clusters are sorted.
+void optimizeOverdraw(uint32_t *indices, size_t indexCount,
+                      const simd_float3 *positions, size_t vertexCount);
+
+// remap[oldVertex] is the vertex's new index, in order of first use by the
+// indices. Unreferenced vertices keep their relative order at the end.
+std::vector<uint32_t> vertexFetchRemap(const uint32_t *indices,
+                                       size_t indexCount, size_t vertexCount);
+
+VertexCacheStats analyzeVertexCache(const uint32_t *indices, size_t indexCount,
+                                    size_t vertexCount);
+
+// Bytes fetched through kVertexFetchLineSize lines over the bytes of the
+// referenced vertices; 1 is ideal.
+float analyzeVertexFetch(const uint32_t *indices, size_t indexCount,
+                         size_t vertexCount, size_t vertexStride);
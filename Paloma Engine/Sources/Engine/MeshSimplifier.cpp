@@ -0,0 +1,297 @@
+//
+//  MeshSimplifier.cpp
+//  Paloma Engine
+//
+
+#include "MeshSimplifier.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+namespace {
+
+// Weighted sum of squared distances to a set of planes, as a symmetric 4x4
+// matrix. Dividing by the total weight gives a mean squared distance.
+struct Quadric {
+  double a00 = 0, a01 = 0, a02 = 0, a11 = 0, a12 = 0, a22 = 0;
+  double b0 = 0, b1 = 0, b2 = 0, c = 0;
+  double weight = 0;
+
+  static Quadric fromPlane(simd_float3 n, float d, double weight) {
+    Quadric q;
+    q.a00 = weight * n.x * n.x;
+    q.a01 = weight * n.x * n.y;
+    q.a02 = weight * n.x * n.z;
+    q.a11 = weight * n.y * n.y;
+    q.a12 = weight * n.y * n.z;
+    q.a22 = weight * n.z * n.z;
+    q.b0 = weight * n.x * d;
+    q.b1 = weight * n.y * d;
+    q.b2 = weight * n.z * d;
+    q.c = weight * d * d;
+    q.weight = weight;
+    return q;
+  }
+
+  Quadric &operator+=(const Quadric &o) {
+    a00 += o.a00;
+    a01 += o.a01;
+    a02 += o.a02;
+    a11 += o.a11;
+    a12 += o.a12;
+    a22 += o.a22;
+    b0 += o.b0;
+    b1 += o.b1;
+    b2 += o.b2;
+    c += o.c;
+    weight += o.weight;
+    return *this;
+  }
+
+  double evaluate(simd_float3 p) const {
+    const double x = p.x, y = p.y, z = p.z;
+    const double result = a00 * x * x + a11 * y * y + a22 * z * z +
+                          2.0 * (a01 * x * y + a02 * x * z + a12 * y * z) +
+                          2.0 * (b0 * x + b1 * y + b2 * z) + c;
+    return weight > 0.0 ? std::max(result, 0.0) / weight : 0.0;
+  }
+};
+
+// Cosine of the largest turn a triangle's normal may take in one collapse.
+constexpr float kMaxNormalTurn = 0.25f;
+
+struct Collapse {
+  uint32_t from;
+  uint32_t to;
+  double cost;
+};
+
+struct PositionHash {
+  size_t operator()(const simd_float3 &p) const {
+    uint32_t bits[3];
+    memcpy(&bits[0], &p.x, 4);
+    memcpy(&bits[1], &p.y, 4);
+    memcpy(&bits[2], &p.z, 4);
+    return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^
+           (bits[2] * 83492791u);
+  }
+};
+
+struct PositionEqual {
+  bool operator()(const simd_float3 &a, const simd_float3 &b) const {
+    return a.x == b.x && a.y == b.y && a.z == b.z;
+  }
+};
+
+} // namespace
+
+SimplifiedMesh simplifyMesh(const simd_float3 *positions, size_t vertexCount,
+                            const uint32_t *indices, size_t indexCount,
+                            size_t targetIndexCount) {
+  SimplifiedMesh result;
+  result.indices.reserve(indexCount);
+  for (size_t i = 0; i + 2 < indexCount; i += 3) {
+    if (indices[i] < vertexCount && indices[i + 1] < vertexCount &&
+        indices[i + 2] < vertexCount) {
+      result.indices.insert(result.indices.end(), indices + i,
+                            indices + i + 3);
+    }
+  }
+  auto &triangles = result.indices;
+
+  // Vertices that share a position are split by an attribute seam.
+  std::vector<uint32_t> positionClass(vertexCount);
+  std::vector<bool> locked(vertexCount, false);
+  {
+    std::unordered_map<simd_float3, uint32_t, PositionHash, PositionEqual>
+        firstAtPosition;
+    for (uint32_t v = 0; v < vertexCount; ++v) {
+      auto [it, inserted] = firstAtPosition.try_emplace(positions[v], v);
+      positionClass[v] = it->second;
+      if (!inserted) {
+        locked[v] = true;
+        locked[it->second] = true;
+      }
+    }
+  }
+
+  // Edges used by a single triangle (across seams) lie on a border.
+  {
+    std::unordered_map<uint64_t, uint32_t> edgeUse;
+    auto edgeKey = [&](uint32_t a, uint32_t b) {
+      uint32_t pa = positionClass[a], pb = positionClass[b];
+      if (pa > pb) {
+        std::swap(pa, pb);
+      }
+      return (uint64_t)pa << 32 | pb;
+    };
+    for (size_t t = 0; t < triangles.size(); t += 3) {
+      for (int e = 0; e < 3; ++e) {
+        edgeUse[edgeKey(triangles[t + e], triangles[t + (e + 1) % 3])]++;
+      }
+    }
+    for (size_t t = 0; t < triangles.size(); t += 3) {
+      for (int e = 0; e < 3; ++e) {
+        const uint32_t a = triangles[t + e];
+        const uint32_t b = triangles[t + (e + 1) % 3];
+        if (edgeUse[edgeKey(a, b)] == 1) {
+          locked[a] = true;
+          locked[b] = true;
+        }
+      }
+    }
+  }
+
+  std::vector<Quadric> quadrics(vertexCount);
+  for (size_t t = 0; t < triangles.size(); t += 3) {
+    const simd_float3 p0 = positions[triangles[t]];
+    const simd_float3 p1 = positions[triangles[t + 1]];
+    const simd_float3 p2 = positions[triangles[t + 2]];
+    const simd_float3 normal = simd_cross(p1 - p0, p2 - p0);
+    const float length = simd_length(normal);
+    if (length == 0.0f) {
+      continue;
+    }
+    const simd_float3 n = normal / length;
+    // Weighted by area so dense regions don't dominate the error.
+    const Quadric plane = Quadric::fromPlane(n, -simd_dot(n, p0), length);
+    for (int k = 0; k < 3; ++k) {
+      quadrics[triangles[t + k]] += plane;
+    }
+  }
+
+  std::vector<uint32_t> adjacencyOffsets(vertexCount + 1);
+  std::vector<uint32_t> adjacency;
+  std::vector<Collapse> collapses;
+  std::vector<uint32_t> remap(vertexCount);
+  std::vector<bool> touched(vertexCount);
+  double maxCost = 0.0;
+
+  while (triangles.size() > targetIndexCount) {
+    // Triangles around each vertex, rebuilt every pass.
+    std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+    for (uint32_t index : triangles) {
+      adjacencyOffsets[index + 1]++;
+    }
+    for (size_t v = 0; v < vertexCount; ++v) {
+      adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+    }
+    adjacency.resize(triangles.size());
+    {
+      std::vector<uint32_t> cursor(adjacencyOffsets.begin(),
+                                   adjacencyOffsets.end() - 1);
+      for (size_t i = 0; i < triangles.size(); ++i) {
+        adjacency[cursor[triangles[i]]++] = (uint32_t)(i / 3);
+      }
+    }
+
+    collapses.clear();
+    for (size_t t = 0; t < triangles.size(); t += 3) {
+      for (int e = 0; e < 3; ++e) {
+        const uint32_t a = triangles[t + e];
+        const uint32_t b = triangles[t + (e + 1) % 3];
+        Collapse best = {0, 0, -1.0};
+        for (auto [from, to] : {std::pair{a, b}, std::pair{b, a}}) {
+          if (locked[from]) {
+            continue;
+          }
+          Quadric merged = quadrics[from];
+          merged += quadrics[to];
+          const double cost = merged.evaluate(positions[to]);
+          if (best.cost < 0.0 || cost < best.cost) {
+            best = {from, to, cost};
+          }
+        }
+        if (best.cost >= 0.0) {
+          collapses.push_back(best);
+        }
+      }
+    }
+    std::sort(collapses.begin(), collapses.end(),
+              [](const Collapse &a, const Collapse &b) {
+                return a.cost < b.cost;
+              });
+
+    for (uint32_t v = 0; v < vertexCount; ++v) {
+      remap[v] = v;
+    }
+    std::fill(touched.begin(), touched.end(), false);
+
+    size_t triangleCount = triangles.size() / 3;
+    const size_t targetTriangles = targetIndexCount / 3;
+    bool collapsedAny = false;
+
+    for (const Collapse &collapse : collapses) {
+      if (triangleCount <= targetTriangles) {
+        break;
+      }
+      if (touched[collapse.from] || touched[collapse.to]) {
+        continue;
+      }
+
+      // Reject the collapse if any surviving triangle would flip, or turn
+      // far enough to fold into a sliver along a locked seam.
+      bool flips = false;
+      uint32_t removed = 0;
+      for (uint32_t a = adjacencyOffsets[collapse.from];
+           a < adjacencyOffsets[collapse.from + 1] && !flips; ++a) {
+        const uint32_t *triangle = &triangles[adjacency[a] * 3];
+        if (triangle[0] == collapse.to || triangle[1] == collapse.to ||
+            triangle[2] == collapse.to) {
+          removed++;
+          continue;
+        }
+        simd_float3 before[3], after[3];
+        for (int k = 0; k < 3; ++k) {
+          before[k] = positions[triangle[k]];
+          after[k] = triangle[k] == collapse.from ? positions[collapse.to]
+                                                  : before[k];
+        }
+        const simd_float3 n0 =
+            simd_cross(before[1] - before[0], before[2] - before[0]);
+        const simd_float3 n1 =
+            simd_cross(after[1] - after[0], after[2] - after[0]);
+        flips = simd_dot(n0, n1) <=
+                kMaxNormalTurn * simd_length(n0) * simd_length(n1);
+      }
+      if (flips) {
+        continue;
+      }
+
+      remap[collapse.from] = collapse.to;
+      quadrics[collapse.to] += quadrics[collapse.from];
+      maxCost = std::max(maxCost, collapse.cost);
+      triangleCount -= removed;
+      collapsedAny = true;
+
+      // Everything around the collapse is stale until the next pass.
+      for (uint32_t a = adjacencyOffsets[collapse.from];
+           a < adjacencyOffsets[collapse.from + 1]; ++a) {
+        const uint32_t *triangle = &triangles[adjacency[a] * 3];
+        touched[triangle[0]] = touched[triangle[1]] = touched[triangle[2]] =
+            true;
+      }
+    }
+
+    if (!collapsedAny) {
+      break;
+    }
+
+    size_t write = 0;
+    for (size_t t = 0; t < triangles.size(); t += 3) {
+      const uint32_t a = remap[triangles[t]];
+      const uint32_t b = remap[triangles[t + 1]];
+      const uint32_t c = remap[triangles[t + 2]];
+      if (a != b && b != c && c != a) {
+        triangles[write++] = a;
+        triangles[write++] = b;
+        triangles[write++] = c;
+      }
+    }
+    triangles.resize(write);
+  }
+
+  result.error = (float)std::sqrt(maxCost);
+  return result;
+}
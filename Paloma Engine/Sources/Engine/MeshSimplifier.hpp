@@ -0,0 +1,29 @@
+//
+//  MeshSimplifier.hpp
+//  Paloma Engine
+//
+
+#pragma once
+#include <simd/simd.h>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct SimplifiedMesh {
+  // Triangles over the original vertices; no vertex is added or moved.
+  std::vector<uint32_t> indices;
+  // Estimated distance the surface moved, in the positions' units.
+  float error = 0.0f;
+};
+
+// Quadric error edge collapse. Each collapse folds a vertex into a neighbour
+// along the cheapest edge, so the result keeps using the original vertex
+// buffer. Vertices on an open border, and vertices whose position is shared
+// with another vertex (a UV or normal seam), are never removed. This keeps
+// borders and seams intact at every level. Collapses that would flip a
+// triangle are rejected.
+//
+// Stops at targetIndexCount or when nothing more can be collapsed.
+SimplifiedMesh simplifyMesh(const simd_float3 *positions, size_t vertexCount,
+                            const uint32_t *indices, size_t indexCount,
+                            size_t targetIndexCount);
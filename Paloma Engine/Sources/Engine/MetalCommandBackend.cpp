@@ -0,0 +1,52 @@
+//
+//  MetalCommandBackend.cpp
+//  Paloma Engine
+//
+
+#include "MetalCommandBackend.hpp"
+#include <string>
+
+void MetalCommandBackend::begin(MTL4::RenderCommandEncoder *pEncoder,
+                                MTL4::ArgumentTable *pVertexArgumentTable,
+                                MTL4::ArgumentTable *pFragmentArgumentTable) {
+  _pEncoder = pEncoder;
+  _pArgumentTables[(uint32_t)RenderStage::Vertex] = pVertexArgumentTable;
+  _pArgumentTables[(uint32_t)RenderStage::Fragment] = pFragmentArgumentTable;
+}
+
+void MetalCommandBackend::setDepthStencilState(
+    const MTL::DepthStencilState *pState) {
+  _pEncoder->setDepthStencilState(pState);
+}
+
+void MetalCommandBackend::setRenderPipelineState(
+    const MTL::RenderPipelineState *pState) {
+  _pEncoder->setRenderPipelineState(pState);
+}
+
+void MetalCommandBackend::setAddress(RenderStage stage, uint64_t address,
+                                     uint32_t index) {
+  _pArgumentTables[(uint32_t)stage]->setAddress(address, index);
+}
+
+void MetalCommandBackend::registerLabel(uint32_t labelID,
+                                        std::string_view label) {
+  if (labelID >= _labels.size()) {
+    _labels.resize(labelID + 1);
+  }
+  _labels[labelID] = NS::RetainPtr(NS::String::string(
+      std::string(label).c_str(), NS::UTF8StringEncoding));
+}
+
+void MetalCommandBackend::pushDebugGroup(uint32_t labelID) {
+  _pEncoder->pushDebugGroup(_labels[labelID].get());
+}
+
+void MetalCommandBackend::popDebugGroup() { _pEncoder->popDebugGroup(); }
+
+void MetalCommandBackend::drawIndexed(const IndexedDraw &draw) {
+  _pEncoder->drawIndexedPrimitives(
+      (MTL::PrimitiveType)draw.primitiveType, draw.indexCount,
+      (MTL::IndexType)draw.indexType, draw.indexBufferAddress,
+      draw.indexBufferLength, draw.instanceCount);
+}
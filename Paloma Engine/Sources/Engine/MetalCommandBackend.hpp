@@ -0,0 +1,31 @@
+//
+//  MetalCommandBackend.hpp
+//  Paloma Engine
+//
+
+#pragma once
+#include "RenderCommands.hpp"
+#include <Metal/Metal.hpp>
+#include <vector>
+
+// Issues tracked commands on a Metal 4 render encoder and its argument tables.
+class MetalCommandBackend : public RenderCommandBackend {
+public:
+  void begin(MTL4::RenderCommandEncoder *pEncoder,
+             MTL4::ArgumentTable *pVertexArgumentTable,
+             MTL4::ArgumentTable *pFragmentArgumentTable);
+
+  void setDepthStencilState(const MTL::DepthStencilState *pState) override;
+  void setRenderPipelineState(const MTL::RenderPipelineState *pState) override;
+  void setAddress(RenderStage stage, uint64_t address,
+                  uint32_t index) override;
+  void registerLabel(uint32_t labelID, std::string_view label) override;
+  void pushDebugGroup(uint32_t labelID) override;
+  void popDebugGroup() override;
+  void drawIndexed(const IndexedDraw &draw) override;
+
+private:
+  MTL4::RenderCommandEncoder *_pEncoder = nullptr;
+  MTL4::ArgumentTable *_pArgumentTables[2] = {};
+  std::vector<NS::SharedPtr<NS::String>> _labels;
+};
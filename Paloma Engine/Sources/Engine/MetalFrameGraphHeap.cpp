@@ -0,0 +1,124 @@
+//
+//  MetalFrameGraphHeap.cpp
+//  Paloma Engine
+//
+
+#include "MetalFrameGraphHeap.hpp"
+#include "BufferUtilites.hpp"
+#include "GPUMemoryTracker.hpp"
+#include <algorithm>
+
+MetalFrameGraphHeap::MetalFrameGraphHeap(MTL::Device *pDevice,
+                                         MTL::ResidencySet *pResidencySet,
+                                         uint32_t framesInFlight)
+    : _pDevice(pDevice), _pResidencySet(pResidencySet),
+      _heaps(framesInFlight) {}
+
+NS::SharedPtr<MTL::TextureDescriptor>
+MetalFrameGraphHeap::makeDescriptor(const FrameGraphTextureDesc &desc) const {
+  auto pDescriptor =
+      NS::TransferPtr(MTL::TextureDescriptor::alloc()->init());
+  pDescriptor->setTextureType(desc.sampleCount > 1
+                                  ? MTL::TextureType2DMultisample
+                                  : MTL::TextureType2D);
+  pDescriptor->setPixelFormat((MTL::PixelFormat)desc.pixelFormat);
+  pDescriptor->setWidth(desc.width);
+  pDescriptor->setHeight(desc.height);
+  pDescriptor->setSampleCount(desc.sampleCount);
+  pDescriptor->setMipmapLevelCount(desc.mipLevelCount);
+  pDescriptor->setStorageMode(MTL::StorageModePrivate);
+  pDescriptor->setUsage(desc.usage != 0 ? (MTL::TextureUsage)desc.usage
+                                        : MTL::TextureUsageRenderTarget |
+                                              MTL::TextureUsageShaderRead);
+  return pDescriptor;
+}
+
+FrameGraphAllocationSize
+MetalFrameGraphHeap::sizeOf(const FrameGraphTextureDesc &desc) {
+  for (const auto &[cachedDesc, size] : _sizes) {
+    if (cachedDesc == desc) {
+      return size;
+    }
+  }
+  const MTL::SizeAndAlign sizeAndAlign =
+      _pDevice->heapTextureSizeAndAlign(makeDescriptor(desc).get());
+  const FrameGraphAllocationSize size = {sizeAndAlign.size,
+                                         sizeAndAlign.align};
+  _sizes.emplace_back(desc, size);
+  return size;
+}
+
+bool MetalFrameGraphHeap::realize(FrameGraph &graph, uint32_t frameIdx) {
+  const auto &stats = graph.stats();
+  if (stats.transientTextures == 0) {
+    return false;
+  }
+
+  FrameHeap &frame = _heaps[frameIdx];
+  bool residencyChanged = false;
+
+  const size_t heapSize = alignUp(stats.heapBytes, stats.heapAlignment);
+  if (!frame.pHeap || frame.pHeap->size() < heapSize) {
+    if (frame.pHeap) {
+      _pResidencySet->removeAllocation(frame.pHeap.get());
+      GPUMemoryTracker::shared().release(frame.pHeap.get());
+      residencyChanged = true;
+    }
+    frame.textures.clear();
+
+    auto pHeapDescriptor =
+        NS::TransferPtr(MTL::HeapDescriptor::alloc()->init());
+    pHeapDescriptor->setType(MTL::HeapTypePlacement);
+    pHeapDescriptor->setStorageMode(MTL::StorageModePrivate);
+    pHeapDescriptor->setHazardTrackingMode(MTL::HazardTrackingModeUntracked);
+    pHeapDescriptor->setSize(heapSize);
+    frame.pHeap = NS::TransferPtr(_pDevice->newHeap(pHeapDescriptor.get()));
+    if (!frame.pHeap) {
+      return residencyChanged;
+    }
+    frame.pHeap->setLabel(NS::String::string("Frame Graph Transients",
+                                             NS::UTF8StringEncoding));
+    GPUMemoryTracker::shared().record(frame.pHeap.get(), frame.pHeap->size(),
+                                      GPUMemoryCategory::RenderTargets,
+                                      "Renderer");
+
+    _pResidencySet->addAllocation(frame.pHeap.get());
+    residencyChanged = true;
+  }
+
+  for (auto &cached : frame.textures) {
+    cached.used = false;
+  }
+
+  const auto &resources = graph.resources();
+  for (FrameGraphResource r = 0; r < resources.size(); ++r) {
+    const auto &resource = resources[r];
+    if (resource.imported || resource.firstUse > resource.lastUse) {
+      continue;
+    }
+
+    auto it = std::find_if(
+        frame.textures.begin(), frame.textures.end(), [&](const auto &c) {
+          return !c.used && c.offset == resource.heapOffset &&
+                 c.desc == resource.desc;
+        });
+    if (it == frame.textures.end()) {
+      CachedTexture cached;
+      cached.desc = resource.desc;
+      cached.offset = resource.heapOffset;
+      cached.pTexture = NS::TransferPtr(frame.pHeap->newTexture(
+          makeDescriptor(resource.desc).get(), resource.heapOffset));
+      cached.pTexture->setLabel(NS::String::string(resource.name.c_str(),
+                                                   NS::UTF8StringEncoding));
+      frame.textures.push_back(std::move(cached));
+      it = frame.textures.end() - 1;
+    }
+    it->used = true;
+    graph.setTexture(r, it->pTexture.get());
+  }
+
+  // Textures the graph no longer asks for only hold on to heap ranges.
+  std::erase_if(frame.textures,
+                [](const CachedTexture &cached) { return !cached.used; });
+  return residencyChanged;
+}
@@ -0,0 +1,50 @@
+//
+//  MetalFrameGraphHeap.hpp
+//  Paloma Engine
+//
+
+#pragma once
+#include "FrameGraph.hpp"
+#include <Metal/Metal.hpp>
+#include <vector>
+
+// Backs a compiled FrameGraph's transient textures with a placement heap per
+// frame in flight, at the offsets the graph chose. Textures are kept between
+// frames by description and offset, so a graph that has the same shape every
+// frame creates nothing after the first frames.
+class MetalFrameGraphHeap {
+public:
+  MetalFrameGraphHeap(MTL::Device *pDevice, MTL::ResidencySet *pResidencySet,
+                      uint32_t framesInFlight);
+
+  // Size function for FrameGraph::compile.
+  FrameGraphAllocationSize sizeOf(const FrameGraphTextureDesc &desc);
+
+  // Binds every transient texture of a compiled graph. Call once the GPU
+  // has finished with frameIdx's previous use. Returns true if the residency
+  // set changed and needs a commit. If the heap can't be created, the
+  // transient textures are left unbound.
+  bool realize(FrameGraph &graph, uint32_t frameIdx);
+
+private:
+  struct CachedTexture {
+    FrameGraphTextureDesc desc;
+    size_t offset;
+    NS::SharedPtr<MTL::Texture> pTexture;
+    bool used;
+  };
+
+  struct FrameHeap {
+    NS::SharedPtr<MTL::Heap> pHeap;
+    std::vector<CachedTexture> textures;
+  };
+
+  MTL::Device *_pDevice;
+  MTL::ResidencySet *_pResidencySet;
+  std::vector<FrameHeap> _heaps;
+  std::vector<std::pair<FrameGraphTextureDesc, FrameGraphAllocationSize>>
+      _sizes;
+
+  NS::SharedPtr<MTL::TextureDescriptor>
+  makeDescriptor(const FrameGraphTextureDesc &desc) const;
+};
@@ -0,0 +1,40 @@
+//
+//  MetalGPUDevice.cpp
+//  Paloma Engine
+//
+
+#include "MetalGPUDevice.hpp"
+
+MetalBuffer::MetalBuffer(NS::SharedPtr<MTL::Buffer> pBuffer,
+                         GPUMemoryCategory category)
+    : _pBuffer(std::move(pBuffer)) {
+  GPUMemoryTracker::shared().record(_pBuffer.get(),
+                                    _pBuffer->allocatedSize(), category,
+                                    "Renderer");
+}
+
+MetalBuffer::~MetalBuffer() {
+  GPUMemoryTracker::shared().release(_pBuffer.get());
+}
+
+void MetalBuffer::setLabel(const char *label) {
+  _pBuffer->setLabel(NS::String::string(label, NS::UTF8StringEncoding));
+}
+
+MetalGPUDevice::MetalGPUDevice(MTL::Device *pDevice) : _pDevice(pDevice) {
+  if (pDevice->supportsFamily(MTL::GPUFamilyApple2)) {
+    _minimumAlignment = 4;
+  } else if (pDevice->supportsFamily(MTL::GPUFamilyMac2)) {
+    _minimumAlignment = 32;
+  } else {
+    _minimumAlignment = 256;
+  }
+}
+
+std::unique_ptr<GPUBuffer>
+MetalGPUDevice::newBuffer(size_t length, GPUMemoryCategory category) {
+  return std::make_unique<MetalBuffer>(
+      NS::TransferPtr(
+          _pDevice->newBuffer(length, MTL::ResourceStorageModeShared)),
+      category);
+}
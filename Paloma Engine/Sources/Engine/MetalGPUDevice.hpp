@@ -0,0 +1,57 @@
+//
+//  MetalGPUDevice.hpp
+//  Paloma Engine
+//
+
+#pragma once
+#include "GPUDevice.hpp"
+#include <Metal/Metal.hpp>
+
+// A range of a Metal buffer, for asset data that never goes through
+// GPUDevice.
+struct MetalBufferView {
+  MTL::Buffer *pBuffer;
+  size_t offset;
+  size_t length;
+
+  uint64_t gpuAddress() const { return pBuffer->gpuAddress() + offset; }
+};
+
+// Accounted to the "Renderer" asset in GPUMemoryTracker::shared() for as
+// long as it lives.
+class MetalBuffer : public GPUBuffer {
+public:
+  MetalBuffer(NS::SharedPtr<MTL::Buffer> pBuffer, GPUMemoryCategory category);
+  ~MetalBuffer() override;
+
+  size_t length() const override { return _pBuffer->length(); }
+  void *contents() const override { return _pBuffer->contents(); }
+  uint64_t gpuAddress() const override { return _pBuffer->gpuAddress(); }
+  void setLabel(const char *label) override;
+
+  MTL::Buffer *buffer() const { return _pBuffer.get(); }
+
+private:
+  NS::SharedPtr<MTL::Buffer> _pBuffer;
+};
+
+class MetalGPUDevice : public GPUDevice {
+public:
+  explicit MetalGPUDevice(MTL::Device *pDevice);
+
+  std::unique_ptr<GPUBuffer> newBuffer(size_t length,
+                                       GPUMemoryCategory category) override;
+  size_t minimumConstantAlignment() const override {
+    return _minimumAlignment;
+  }
+
+private:
+  MTL::Device *_pDevice;
+  size_t _minimumAlignment;
+};
+
+// The Metal buffer behind a buffer made by MetalGPUDevice, e.g. to make it
+// resident.
+inline MTL::Buffer *metalBuffer(const GPUBuffer *pBuffer) {
+  return static_cast<const MetalBuffer *>(pBuffer)->buffer();
+}
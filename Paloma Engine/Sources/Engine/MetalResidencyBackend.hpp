@@ -0,0 +1,28 @@
+//
+//  MetalResidencyBackend.hpp
+//  Paloma Engine
+//
+
+#pragma once
+#include "ResidencyManager.hpp"
+#include <Metal/Metal.hpp>
+
+// Applies a ResidencyManager's changes to a residency set whose allocations
+// are MTL::Allocation pointers. The caller commits the set.
+class MetalResidencyBackend : public ResidencyBackend {
+public:
+  explicit MetalResidencyBackend(MTL::ResidencySet *pResidencySet)
+      : _pResidencySet(pResidencySet) {}
+
+  void add(const void *pAllocation) override {
+    _pResidencySet->addAllocation(
+        static_cast<const MTL::Allocation *>(pAllocation));
+  }
+  void remove(const void *pAllocation) override {
+    _pResidencySet->removeAllocation(
+        static_cast<const MTL::Allocation *>(pAllocation));
+  }
+
+private:
+  MTL::ResidencySet *_pResidencySet;
+};
@@ -0,0 +1,123 @@
+//
+//  MetalTextureStreaming.cpp
+//  Paloma Engine
+//
+
+#include "MetalTextureStreaming.hpp"
+#include "GPUMemoryTracker.hpp"
+#include <algorithm>
+#include <cstring>
+
+MetalTextureStreamingBackend::MetalTextureStreamingBackend(
+    MTL::Device *pDevice, MTL::ResidencySet *pResidencySet)
+    : _pDevice(pDevice), _pResidencySet(pResidencySet) {}
+
+uint32_t MetalTextureStreamingBackend::addTexture(TextureStreamer &streamer,
+                                                  MDL::Texture *pSource,
+                                                  bool sRGB,
+                                                  std::string asset) {
+  StreamedTexture texture;
+  const vector_int2 size = pSource->dimensions();
+  texture.width = (uint32_t)std::max(size.x, 1);
+  texture.height = (uint32_t)std::max(size.y, 1);
+  texture.sRGB = sRGB;
+  texture.asset = std::move(asset);
+
+  // Expands the source to RGBA; a missing alpha channel is opaque.
+  NS::Data *pData = pSource->texelDataWithTopLeftOrigin();
+  const NS::UInteger channels = pSource->channelCount();
+  const NS::Integer rowStride = pSource->rowStride();
+  std::vector<uint8_t> base((size_t)texture.width * texture.height * 4, 255);
+  if (pData && rowStride > 0 &&
+      pData->length() >= (NS::UInteger)rowStride * texture.height) {
+    const auto *bytes = (const uint8_t *)pData->mutableBytes();
+    for (uint32_t y = 0; y < texture.height; ++y) {
+      const uint8_t *row = bytes + (size_t)y * rowStride;
+      for (uint32_t x = 0; x < texture.width; ++x) {
+        memcpy(&base[((size_t)y * texture.width + x) * 4], row + x * channels,
+               std::min<NS::UInteger>(channels, 4));
+      }
+    }
+  }
+
+  uint32_t w = texture.width;
+  uint32_t h = texture.height;
+  texture.mips.push_back(std::move(base));
+  while (w > 1 || h > 1) {
+    texture.mips.push_back(
+        downsampleRGBA8(texture.mips.back(), w, h, texture.sRGB));
+    w = std::max(w / 2, 1u);
+    h = std::max(h / 2, 1u);
+  }
+  _textures.push_back(std::move(texture));
+
+  const uint32_t id = streamer.addTexture(_textures.back().width,
+                                          _textures.back().height, 4);
+  setFirstResidentMip(id, streamer.minimumResidentMip(id));
+  return id;
+}
+
+bool MetalTextureStreamingBackend::setFirstResidentMip(uint32_t id,
+                                                       uint32_t firstMip) {
+  StreamedTexture &texture = _textures[id];
+  const uint32_t width = std::max(texture.width >> firstMip, 1u);
+  const uint32_t height = std::max(texture.height >> firstMip, 1u);
+  const uint32_t mipCount = (uint32_t)texture.mips.size() - firstMip;
+
+  auto pDescriptor = NS::TransferPtr(MTL::TextureDescriptor::alloc()->init());
+  pDescriptor->setTextureType(MTL::TextureType2D);
+  pDescriptor->setPixelFormat(texture.sRGB ? MTL::PixelFormatRGBA8Unorm_sRGB
+                                           : MTL::PixelFormatRGBA8Unorm);
+  pDescriptor->setWidth(width);
+  pDescriptor->setHeight(height);
+  pDescriptor->setMipmapLevelCount(mipCount);
+  pDescriptor->setStorageMode(MTL::StorageModeShared);
+  pDescriptor->setUsage(MTL::TextureUsageShaderRead);
+
+  MTL::Texture *pTexture = _pDevice->newTexture(pDescriptor.get());
+  if (!pTexture) {
+    return false;
+  }
+  pTexture->setLabel(
+      NS::String::string("Streamed Texture", NS::UTF8StringEncoding));
+  for (uint32_t level = 0; level < mipCount; ++level) {
+    const uint32_t w = std::max(width >> level, 1u);
+    const uint32_t h = std::max(height >> level, 1u);
+    pTexture->replaceRegion(MTL::Region(0, 0, w, h), level,
+                            texture.mips[firstMip + level].data(), w * 4);
+  }
+
+  // Frames already encoded may still sample the old texture.
+  if (texture.pTexture) {
+    _retired.push_back({texture.pTexture, _frameIndex});
+  }
+  texture.pTexture = NS::TransferPtr(pTexture);
+  GPUMemoryTracker::shared().record(pTexture, pTexture->allocatedSize(),
+                                    GPUMemoryCategory::Textures,
+                                    texture.asset);
+  _pResidencySet->addAllocation(texture.pTexture.get());
+  _residencyChanged = true;
+  _changed.push_back(id);
+  return true;
+}
+
+void MetalTextureStreamingBackend::beginFrame(uint64_t frameIndex,
+                                              uint64_t completedFrame) {
+  _frameIndex = frameIndex;
+  _changed.clear();
+  std::erase_if(_retired, [&](const RetiredTexture &retired) {
+    if (retired.frameIndex > completedFrame) {
+      return false;
+    }
+    _pResidencySet->removeAllocation(retired.pTexture.get());
+    GPUMemoryTracker::shared().release(retired.pTexture.get());
+    _residencyChanged = true;
+    return true;
+  });
+}
+
+bool MetalTextureStreamingBackend::takeResidencyChanged() {
+  const bool changed = _residencyChanged;
+  _residencyChanged = false;
+  return changed;
+}
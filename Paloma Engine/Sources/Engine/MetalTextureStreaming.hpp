@@ -0,0 +1,68 @@
+//
+//  MetalTextureStreaming.hpp
+//  Paloma Engine
+//
+
+#pragma once
+#include "TextureStreamer.hpp"
+#include <Metal/Metal.hpp>
+#include <ModelIO/ModelIO.hpp>
+#include <string>
+#include <vector>
+
+// Streams 8-bit RGBA textures for a TextureStreamer. Every mip is built on
+// the CPU when a texture is added and stays there as the streaming source;
+// a change of first resident mip creates a texture holding just the
+// resident mips and retires the old one once the GPU has finished with it.
+class MetalTextureStreamingBackend : public TextureStreamingBackend {
+public:
+  MetalTextureStreamingBackend(MTL::Device *pDevice,
+                               MTL::ResidencySet *pResidencySet);
+
+  // Builds pSource's mips, registers it with streamer and makes its
+  // minimum resident mips resident. Textures must be added in the order
+  // the streamer hands out IDs, so the returned ID is also the index here.
+  // The GPU copies are accounted to asset.
+  uint32_t addTexture(TextureStreamer &streamer, MDL::Texture *pSource,
+                      bool sRGB, std::string asset);
+
+  bool setFirstResidentMip(uint32_t texture, uint32_t firstMip) override;
+
+  // Releases textures retired by frames up to completedFrame and forgets
+  // the previous frame's changes. Call before TextureStreamer::update.
+  void beginFrame(uint64_t frameIndex, uint64_t completedFrame);
+
+  const NS::SharedPtr<MTL::Texture> &texture(uint32_t id) const {
+    return _textures[id].pTexture;
+  }
+  // Textures replaced since beginFrame.
+  const std::vector<uint32_t> &changedTextures() const { return _changed; }
+
+  // True if the residency set changed since the last call and needs a
+  // commit.
+  bool takeResidencyChanged();
+
+private:
+  struct StreamedTexture {
+    // RGBA8 texels of every mip, finest first.
+    std::vector<std::vector<uint8_t>> mips;
+    uint32_t width;
+    uint32_t height;
+    bool sRGB;
+    std::string asset;
+    NS::SharedPtr<MTL::Texture> pTexture;
+  };
+
+  struct RetiredTexture {
+    NS::SharedPtr<MTL::Texture> pTexture;
+    uint64_t frameIndex;
+  };
+
+  MTL::Device *_pDevice;
+  MTL::ResidencySet *_pResidencySet;
+  std::vector<StreamedTexture> _textures;
+  std::vector<RetiredTexture> _retired;
+  std::vector<uint32_t> _changed;
+  uint64_t _frameIndex = 0;
+  bool _residencyChanged = false;
+};
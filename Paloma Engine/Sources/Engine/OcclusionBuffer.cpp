@@ -0,0 +1,306 @@
+//
+//  OcclusionBuffer.cpp
+//  Paloma Engine
+//
+
+#include "OcclusionBuffer.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+static_assert(OcclusionBuffer::kWidth % 8 == 0,
+              "Rows are rasterized eight pixels at a time");
+static_assert(OcclusionBuffer::kHeight % OcclusionBuffer::kBandHeight == 0,
+              "Bands must tile the buffer");
+
+static inline simd_float8 splat(float value) {
+  return simd_float8{value, value, value, value, value, value, value, value};
+}
+
+OcclusionBuffer::OcclusionBuffer() {
+  uint32_t width = kWidth;
+  uint32_t height = kHeight;
+  while (true) {
+    _levels.emplace_back(width * height, 1.0f);
+    if (width == 1 && height == 1) {
+      break;
+    }
+    width = std::max(width / 2, 1u);
+    height = std::max(height / 2, 1u);
+  }
+}
+
+uint32_t OcclusionBuffer::levelWidth(uint32_t level) const {
+  return std::max(kWidth >> level, 1u);
+}
+
+uint32_t OcclusionBuffer::levelHeight(uint32_t level) const {
+  return std::max(kHeight >> level, 1u);
+}
+
+float OcclusionBuffer::depth(uint32_t x, uint32_t y, uint32_t level) const {
+  return _levels[level][y * levelWidth(level) + x];
+}
+
+void OcclusionBuffer::begin(const matrix_float4x4 &viewProjection) {
+  _viewProjection = viewProjection;
+  _triangles.clear();
+  _stats = {};
+  std::fill(_levels[0].begin(), _levels[0].end(), 1.0f);
+}
+
+void OcclusionBuffer::addOccluder(const simd_float3 *positions,
+                                  uint32_t vertexCount,
+                                  const uint32_t *indices, uint32_t indexCount,
+                                  const matrix_float4x4 &modelMatrix) {
+  const matrix_float4x4 transform =
+      simd_mul(_viewProjection, modelMatrix);
+  _clipPositions.resize(vertexCount);
+  for (uint32_t i = 0; i < vertexCount; ++i) {
+    _clipPositions[i] =
+        simd_mul(transform, simd_make_float4(positions[i], 1.0f));
+  }
+
+  for (uint32_t i = 0; i + 2 < indexCount; i += 3) {
+    if (indices[i] >= vertexCount || indices[i + 1] >= vertexCount ||
+        indices[i + 2] >= vertexCount) {
+      continue;
+    }
+    addClippedTriangle(_clipPositions[indices[i]],
+                       _clipPositions[indices[i + 1]],
+                       _clipPositions[indices[i + 2]]);
+  }
+  _stats.occluders++;
+}
+
+void OcclusionBuffer::addClippedTriangle(simd_float4 a, simd_float4 b,
+                                         simd_float4 c) {
+  // Metal's near plane is clip z = 0; everything with z >= 0 has w > 0.
+  const bool aInside = a.z >= 0.0f;
+  const bool bInside = b.z >= 0.0f;
+  const bool cInside = c.z >= 0.0f;
+  if (aInside && bInside && cInside) {
+    addScreenTriangle(a, b, c);
+    return;
+  }
+  if (!aInside && !bInside && !cInside) {
+    return;
+  }
+
+  const simd_float4 input[3] = {a, b, c};
+  simd_float4 output[4];
+  uint32_t count = 0;
+  for (uint32_t i = 0; i < 3; ++i) {
+    const simd_float4 &current = input[i];
+    const simd_float4 &next = input[(i + 1) % 3];
+    if (current.z >= 0.0f) {
+      output[count++] = current;
+    }
+    if ((current.z >= 0.0f) != (next.z >= 0.0f)) {
+      const float t = current.z / (current.z - next.z);
+      output[count++] = current + (next - current) * t;
+    }
+  }
+
+  addScreenTriangle(output[0], output[1], output[2]);
+  if (count == 4) {
+    addScreenTriangle(output[0], output[2], output[3]);
+  }
+}
+
+void OcclusionBuffer::addScreenTriangle(simd_float4 a, simd_float4 b,
+                                        simd_float4 c) {
+  auto toScreen = [](simd_float4 clip) {
+    const float inverseW = 1.0f / clip.w;
+    return simd_make_float3((clip.x * inverseW * 0.5f + 0.5f) * kWidth,
+                            (0.5f - clip.y * inverseW * 0.5f) * kHeight,
+                            clip.z * inverseW);
+  };
+
+  ScreenTriangle triangle;
+  triangle.v[0] = toScreen(a);
+  triangle.v[1] = toScreen(b);
+  triangle.v[2] = toScreen(c);
+
+  const simd_float3 &v0 = triangle.v[0];
+  const float area = (triangle.v[1].x - v0.x) * (triangle.v[2].y - v0.y) -
+                     (triangle.v[2].x - v0.x) * (triangle.v[1].y - v0.y);
+  if (std::fabs(area) < 1e-6f) {
+    return;
+  }
+  if (area < 0.0f) {
+    std::swap(triangle.v[1], triangle.v[2]);
+  }
+
+  const float minX = std::min({v0.x, triangle.v[1].x, triangle.v[2].x});
+  const float maxX = std::max({v0.x, triangle.v[1].x, triangle.v[2].x});
+  triangle.minY = std::min({v0.y, triangle.v[1].y, triangle.v[2].y});
+  triangle.maxY = std::max({v0.y, triangle.v[1].y, triangle.v[2].y});
+  if (maxX < 0.0f || minX >= kWidth || triangle.maxY < 0.0f ||
+      triangle.minY >= kHeight) {
+    return;
+  }
+
+  _triangles.push_back(triangle);
+  _stats.triangles++;
+}
+
+void OcclusionBuffer::rasterize(JobSystem &jobSystem) {
+  jobSystem.parallelFor(kHeight / kBandHeight,
+                        [this](uint32_t band) { rasterizeBand(band); });
+  buildPyramid();
+}
+
+void OcclusionBuffer::rasterizeBand(uint32_t band) {
+  const int32_t bandBegin = band * kBandHeight;
+  const int32_t bandEnd = bandBegin + kBandHeight;
+  const simd_float8 laneOffsets = {0.5f, 1.5f, 2.5f, 3.5f,
+                                   4.5f, 5.5f, 6.5f, 7.5f};
+  const simd_float8 zero = splat(0.0f);
+  float *pDepth = _levels[0].data();
+
+  for (const ScreenTriangle &triangle : _triangles) {
+    if (triangle.maxY < bandBegin || triangle.minY >= bandEnd) {
+      continue;
+    }
+    const simd_float3 &v0 = triangle.v[0];
+    const simd_float3 &v1 = triangle.v[1];
+    const simd_float3 &v2 = triangle.v[2];
+
+    // Edge a->b is A * x + B * y + C, positive on the triangle's side.
+    float edgeA[3], edgeB[3], edgeC[3];
+    const simd_float3 *vertices[4] = {&v0, &v1, &v2, &v0};
+    for (int e = 0; e < 3; ++e) {
+      const simd_float3 &from = *vertices[e];
+      const simd_float3 &to = *vertices[e + 1];
+      edgeA[e] = from.y - to.y;
+      edgeB[e] = to.x - from.x;
+      edgeC[e] = -(edgeA[e] * from.x + edgeB[e] * from.y);
+    }
+
+    // z / w is linear in screen space.
+    const float area = (v1.x - v0.x) * (v2.y - v0.y) -
+                       (v2.x - v0.x) * (v1.y - v0.y);
+    const float dzdx =
+        ((v1.z - v0.z) * (v2.y - v0.y) - (v2.z - v0.z) * (v1.y - v0.y)) /
+        area;
+    const float dzdy =
+        ((v2.z - v0.z) * (v1.x - v0.x) - (v1.z - v0.z) * (v2.x - v0.x)) /
+        area;
+
+    const int32_t minX =
+        std::max((int32_t)std::floor(std::min({v0.x, v1.x, v2.x})), 0);
+    const int32_t maxX = std::min(
+        (int32_t)std::floor(std::max({v0.x, v1.x, v2.x})), (int32_t)kWidth - 1);
+    const int32_t minY =
+        std::max((int32_t)std::floor(triangle.minY), bandBegin);
+    const int32_t maxY =
+        std::min((int32_t)std::floor(triangle.maxY), bandEnd - 1);
+
+    for (int32_t y = minY; y <= maxY; ++y) {
+      const float py = y + 0.5f;
+      const float row0 = edgeB[0] * py + edgeC[0];
+      const float row1 = edgeB[1] * py + edgeC[1];
+      const float row2 = edgeB[2] * py + edgeC[2];
+      const float rowZ = v0.z + dzdy * (py - v0.y) - dzdx * v0.x;
+      float *pRow = pDepth + y * kWidth;
+
+      for (int32_t x = minX & ~7; x <= maxX; x += 8) {
+        const simd_float8 px = splat((float)x) + laneOffsets;
+        const simd_float8 e0 = px * edgeA[0] + row0;
+        const simd_float8 e1 = px * edgeA[1] + row1;
+        const simd_float8 e2 = px * edgeA[2] + row2;
+        const simd_int8 inside = (e0 >= zero) & (e1 >= zero) & (e2 >= zero);
+        if (!simd_any(inside)) {
+          continue;
+        }
+
+        const simd_float8 z = px * dzdx + rowZ;
+        simd_float8 depth;
+        memcpy(&depth, pRow + x, sizeof(depth));
+        depth = simd_select(depth, simd_min(depth, z), inside);
+        memcpy(pRow + x, &depth, sizeof(depth));
+      }
+    }
+  }
+}
+
+void OcclusionBuffer::buildPyramid() {
+  for (uint32_t level = 1; level < _levels.size(); ++level) {
+    const uint32_t width = levelWidth(level);
+    const uint32_t height = levelHeight(level);
+    const uint32_t sourceWidth = levelWidth(level - 1);
+    const uint32_t sourceHeight = levelHeight(level - 1);
+    const float *pSource = _levels[level - 1].data();
+    float *pTarget = _levels[level].data();
+
+    for (uint32_t y = 0; y < height; ++y) {
+      const uint32_t y0 = std::min(y * 2, sourceHeight - 1);
+      const uint32_t y1 = std::min(y * 2 + 1, sourceHeight - 1);
+      for (uint32_t x = 0; x < width; ++x) {
+        const uint32_t x0 = std::min(x * 2, sourceWidth - 1);
+        const uint32_t x1 = std::min(x * 2 + 1, sourceWidth - 1);
+        pTarget[y * width + x] =
+            std::max(std::max(pSource[y0 * sourceWidth + x0],
+                              pSource[y0 * sourceWidth + x1]),
+                     std::max(pSource[y1 * sourceWidth + x0],
+                              pSource[y1 * sourceWidth + x1]));
+      }
+    }
+  }
+}
+
+bool OcclusionBuffer::isVisible(const AABB &worldBounds) {
+  _stats.tested++;
+  if (worldBounds.isEmpty()) {
+    return true;
+  }
+
+  float minX = FLT_MAX, minY = FLT_MAX, minZ = FLT_MAX;
+  float maxX = -FLT_MAX, maxY = -FLT_MAX;
+  for (uint32_t corner = 0; corner < 8; ++corner) {
+    const simd_float3 position = {
+        corner & 1 ? worldBounds.max.x : worldBounds.min.x,
+        corner & 2 ? worldBounds.max.y : worldBounds.min.y,
+        corner & 4 ? worldBounds.max.z : worldBounds.min.z};
+    const simd_float4 clip =
+        simd_mul(_viewProjection, simd_make_float4(position, 1.0f));
+    if (clip.z < 0.0f) {
+      // Crosses the near plane, so it covers too much of the screen to test.
+      return true;
+    }
+    const float inverseW = 1.0f / clip.w;
+    const float x = (clip.x * inverseW * 0.5f + 0.5f) * kWidth;
+    const float y = (0.5f - clip.y * inverseW * 0.5f) * kHeight;
+    minX = std::min(minX, x);
+    maxX = std::max(maxX, x);
+    minY = std::min(minY, y);
+    maxY = std::max(maxY, y);
+    minZ = std::min(minZ, clip.z * inverseW);
+  }
+
+  if (maxX < 0.0f || minX >= kWidth || maxY < 0.0f || minY >= kHeight) {
+    return true;
+  }
+  const uint32_t x0 = (uint32_t)std::max(minX, 0.0f);
+  const uint32_t y0 = (uint32_t)std::max(minY, 0.0f);
+  const uint32_t x1 = (uint32_t)std::min(maxX, kWidth - 1.0f);
+  const uint32_t y1 = (uint32_t)std::min(maxY, kHeight - 1.0f);
+
+  // The coarsest level where the rectangle spans at most 3x3 texels.
+  const uint32_t size = std::max(x1 - x0, y1 - y0) + 1;
+  uint32_t level = 0;
+  while ((size >> level) > 2 && level + 1 < levelCount()) {
+    level++;
+  }
+
+  for (uint32_t y = y0 >> level; y <= y1 >> level; ++y) {
+    for (uint32_t x = x0 >> level; x <= x1 >> level; ++x) {
+      if (depth(x, y, level) >= minZ) {
+        return true;
+      }
+    }
+  }
+  _stats.occluded++;
+  return false;
+}
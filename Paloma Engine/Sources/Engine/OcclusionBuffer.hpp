@@ -0,0 +1,76 @@
+//
+//  OcclusionBuffer.hpp
+//  Paloma Engine
+//
+
+#pragma once
+#include "Bounds.hpp"
+#include "JobSystem.hpp"
+#include <cstdint>
+#include <vector>
+
+// Low-resolution software depth buffer for occlusion culling. Occluder
+// triangles are rasterized on the CPU, eight pixels at a time, into a depth
+// buffer and a max-depth pyramid (HiZ). Bounds are then tested against the
+// pyramid before their draws are emitted. Depth follows Metal: 0 at the near
+// plane, 1 at the far plane.
+class OcclusionBuffer {
+public:
+  static constexpr uint32_t kWidth = 256;
+  static constexpr uint32_t kHeight = 128;
+  // Rows per rasterization job; bands never share pixels.
+  static constexpr uint32_t kBandHeight = 16;
+
+  struct Stats {
+    uint32_t occluders = 0;
+    uint32_t triangles = 0;
+    uint32_t tested = 0;
+    uint32_t occluded = 0;
+  };
+
+  OcclusionBuffer();
+
+  // Starts a frame: forgets all occluders and clears depth to the far plane.
+  void begin(const matrix_float4x4 &viewProjection);
+
+  // Queues the triangles of a mesh given in its local space. Triangles that
+  // cross the near plane are clipped; both windings are rasterized.
+  void addOccluder(const simd_float3 *positions, uint32_t vertexCount,
+                   const uint32_t *indices, uint32_t indexCount,
+                   const matrix_float4x4 &modelMatrix);
+
+  // Rasterizes the queued triangles, one band of rows per job, and builds
+  // the pyramid.
+  void rasterize(JobSystem &jobSystem);
+
+  // False only when the box lies entirely behind rasterized occluders.
+  bool isVisible(const AABB &worldBounds);
+
+  uint32_t levelCount() const { return (uint32_t)_levels.size(); }
+  uint32_t levelWidth(uint32_t level) const;
+  uint32_t levelHeight(uint32_t level) const;
+  // Level 0 is the depth buffer; each level above holds the farthest depth
+  // of the 2x2 texels below it.
+  float depth(uint32_t x, uint32_t y, uint32_t level = 0) const;
+
+  const Stats &stats() const { return _stats; }
+
+private:
+  // Screen-space vertices with depth, wound so the edge functions are
+  // positive inside.
+  struct ScreenTriangle {
+    simd_float3 v[3];
+    float minY, maxY;
+  };
+
+  void addClippedTriangle(simd_float4 a, simd_float4 b, simd_float4 c);
+  void addScreenTriangle(simd_float4 a, simd_float4 b, simd_float4 c);
+  void rasterizeBand(uint32_t band);
+  void buildPyramid();
+
+  matrix_float4x4 _viewProjection;
+  std::vector<ScreenTriangle> _triangles;
+  std::vector<simd_float4> _clipPositions;
+  std::vector<std::vector<float>> _levels;
+  Stats _stats;
+};
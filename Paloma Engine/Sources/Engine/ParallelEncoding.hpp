@@ -0,0 +1,62 @@
+//
+//  ParallelEncoding.hpp
+//  Paloma Engine
+//
+
+#pragma once
+#include "JobSystem.hpp"
+#include "RenderCommands.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+// A contiguous run [begin, end) of the sorted draw list.
+struct EncodeChunk {
+  uint32_t index;
+  size_t begin;
+  size_t end;
+};
+
+// Splits count draws into at most maxChunks even chunks of at least
+// minDrawsPerChunk, so small lists stay on a single thread.
+static inline std::vector<EncodeChunk>
+splitIntoChunks(size_t count, uint32_t maxChunks, size_t minDrawsPerChunk) {
+  size_t chunkCount = count / std::max<size_t>(minDrawsPerChunk, 1);
+  chunkCount = std::clamp<size_t>(chunkCount, 1, std::max(maxChunks, 1u));
+
+  std::vector<EncodeChunk> chunks;
+  chunks.reserve(chunkCount);
+  for (size_t i = 0; i < chunkCount; ++i) {
+    chunks.push_back(
+        {(uint32_t)i, count * i / chunkCount, count * (i + 1) / chunkCount});
+  }
+  return chunks;
+}
+
+// Encodes every chunk on the job system into its own recording backend and
+// stitches the streams back together in chunk order, the way the Metal path
+// commits its per-chunk command buffers. encode(chunk, encoder) must only
+// touch state owned by its chunk.
+template <typename EncodeFn>
+std::vector<RecordingCommandBackend::Command>
+recordChunks(JobSystem &jobSystem, const std::vector<EncodeChunk> &chunks,
+             EncodeFn &&encode, RenderStateCounters *pCounters = nullptr) {
+  std::vector<RecordingCommandBackend> backends(chunks.size());
+  std::vector<RenderStateCounters> counters(chunks.size());
+
+  jobSystem.parallelFor((uint32_t)chunks.size(), [&](uint32_t i) {
+    StateTrackingEncoder encoder(&backends[i]);
+    encode(chunks[i], encoder);
+    counters[i] = encoder.counters();
+  });
+
+  std::vector<RecordingCommandBackend::Command> stitched;
+  for (size_t i = 0; i < chunks.size(); ++i) {
+    stitched.insert(stitched.end(), backends[i].commands.begin(),
+                    backends[i].commands.end());
+    if (pCounters) {
+      *pCounters += counters[i];
+    }
+  }
+  return stitched;
+}
@@ -0,0 +1,158 @@
+//
+//  RenderCommands.cpp
+//  Paloma Engine
+//
+
+#include "RenderCommands.hpp"
+#include <cassert>
+
+uint32_t RenderStateCounters::totalIssued() const {
+  uint32_t total = 0;
+  for (uint32_t count : issued) {
+    total += count;
+  }
+  return total;
+}
+
+uint32_t RenderStateCounters::totalSkipped() const {
+  uint32_t total = 0;
+  for (uint32_t count : skipped) {
+    total += count;
+  }
+  return total;
+}
+
+RenderStateCounters &
+RenderStateCounters::operator+=(const RenderStateCounters &other) {
+  for (uint32_t kind = 0; kind < KindCount; ++kind) {
+    issued[kind] += other.issued[kind];
+    skipped[kind] += other.skipped[kind];
+  }
+  draws += other.draws;
+  labelsRegistered += other.labelsRegistered;
+  return *this;
+}
+
+// -- StateTrackingEncoder --
+
+void StateTrackingEncoder::setBackend(RenderCommandBackend *pBackend) {
+  _pBackend = pBackend;
+  _labels.clear();
+  reset();
+}
+
+void StateTrackingEncoder::reset() {
+  _hasDepthStencilState = false;
+  _hasPipelineState = false;
+  _boundAddresses[0] = _boundAddresses[1] = 0;
+}
+
+void StateTrackingEncoder::setDepthStencilState(
+    const MTL::DepthStencilState *pState) {
+  if (_hasDepthStencilState && _pDepthStencilState == pState) {
+    _counters.skipped[RenderStateCounters::DepthStencil]++;
+    return;
+  }
+  _pDepthStencilState = pState;
+  _hasDepthStencilState = true;
+  _counters.issued[RenderStateCounters::DepthStencil]++;
+  _pBackend->setDepthStencilState(pState);
+}
+
+void StateTrackingEncoder::setRenderPipelineState(
+    const MTL::RenderPipelineState *pState) {
+  if (_hasPipelineState && _pPipelineState == pState) {
+    _counters.skipped[RenderStateCounters::Pipeline]++;
+    return;
+  }
+  _pPipelineState = pState;
+  _hasPipelineState = true;
+  _counters.issued[RenderStateCounters::Pipeline]++;
+  _pBackend->setRenderPipelineState(pState);
+}
+
+void StateTrackingEncoder::setAddress(RenderStage stage, uint64_t address,
+                                      uint32_t index) {
+  assert(index < kMaxBindings);
+
+  const uint32_t s = (uint32_t)stage;
+  const uint32_t bit = 1u << index;
+  const auto kind = stage == RenderStage::Vertex
+                        ? RenderStateCounters::VertexAddress
+                        : RenderStateCounters::FragmentAddress;
+
+  if ((_boundAddresses[s] & bit) && _addresses[s][index] == address) {
+    _counters.skipped[kind]++;
+    return;
+  }
+  _addresses[s][index] = address;
+  _boundAddresses[s] |= bit;
+  _counters.issued[kind]++;
+  _pBackend->setAddress(stage, address, index);
+}
+
+void StateTrackingEncoder::pushDebugGroup(const void *owner,
+                                          std::string_view label) {
+  auto [it, inserted] = _labels.try_emplace(owner, (uint32_t)_labels.size());
+  if (inserted) {
+    _counters.labelsRegistered++;
+    _pBackend->registerLabel(it->second, label);
+  }
+  _pBackend->pushDebugGroup(it->second);
+}
+
+void StateTrackingEncoder::popDebugGroup() { _pBackend->popDebugGroup(); }
+
+void StateTrackingEncoder::drawIndexed(const IndexedDraw &draw) {
+  _counters.draws++;
+  _pBackend->drawIndexed(draw);
+}
+
+// -- RecordingCommandBackend --
+
+void RecordingCommandBackend::setDepthStencilState(
+    const MTL::DepthStencilState *pState) {
+  Command command{CommandType::SetDepthStencilState};
+  command.pState = pState;
+  commands.push_back(command);
+}
+
+void RecordingCommandBackend::setRenderPipelineState(
+    const MTL::RenderPipelineState *pState) {
+  Command command{CommandType::SetRenderPipelineState};
+  command.pState = pState;
+  commands.push_back(command);
+}
+
+void RecordingCommandBackend::setAddress(RenderStage stage, uint64_t address,
+                                         uint32_t index) {
+  Command command{CommandType::SetAddress};
+  command.stage = stage;
+  command.address = address;
+  command.index = index;
+  commands.push_back(command);
+}
+
+void RecordingCommandBackend::registerLabel(uint32_t labelID,
+                                            std::string_view label) {
+  if (labelID >= labels.size()) {
+    labels.resize(labelID + 1);
+  }
+  labels[labelID] = label;
+}
+
+void RecordingCommandBackend::pushDebugGroup(uint32_t labelID) {
+  Command command{CommandType::PushDebugGroup};
+  command.index = labelID;
+  commands.push_back(command);
+}
+
+void RecordingCommandBackend::popDebugGroup() {
+  commands.push_back({CommandType::PopDebugGroup});
+}
+
+void RecordingCommandBackend::drawIndexed(const IndexedDraw &draw) {
+  Command command{CommandType::DrawIndexed};
+  command.draw = draw;
+  commands.push_back(command);
+}
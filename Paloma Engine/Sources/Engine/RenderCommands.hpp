@@ -0,0 +1,147 @@
+//
+//  RenderCommands.hpp
+//  Paloma Engine
+//
+
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Only compared and passed through here, so this header needs no Metal.
+namespace MTL {
+class DepthStencilState;
+class RenderPipelineState;
+} // namespace MTL
+
+enum class RenderStage : uint32_t { Vertex = 0, Fragment = 1 };
+
+struct IndexedDraw {
+  uint32_t primitiveType; // MTL::PrimitiveType
+  uint32_t indexType;     // MTL::IndexType
+  uint32_t indexCount;
+  uint32_t instanceCount = 1;
+  uint64_t indexBufferAddress;
+  uint64_t indexBufferLength;
+};
+
+// Receives the commands that are left after redundant state is dropped.
+class RenderCommandBackend {
+public:
+  virtual ~RenderCommandBackend() = default;
+
+  virtual void setDepthStencilState(const MTL::DepthStencilState *pState) = 0;
+  virtual void
+  setRenderPipelineState(const MTL::RenderPipelineState *pState) = 0;
+  virtual void setAddress(RenderStage stage, uint64_t address,
+                          uint32_t index) = 0;
+
+  // Each label is registered once and then referred to by its ID.
+  virtual void registerLabel(uint32_t labelID, std::string_view label) = 0;
+  virtual void pushDebugGroup(uint32_t labelID) = 0;
+  virtual void popDebugGroup() = 0;
+
+  virtual void drawIndexed(const IndexedDraw &draw) = 0;
+};
+
+struct RenderStateCounters {
+  enum Kind : uint32_t {
+    DepthStencil,
+    Pipeline,
+    VertexAddress,
+    FragmentAddress,
+    KindCount
+  };
+
+  uint32_t issued[KindCount] = {};
+  uint32_t skipped[KindCount] = {};
+  uint32_t draws = 0;
+  uint32_t labelsRegistered = 0;
+
+  uint32_t totalIssued() const;
+  uint32_t totalSkipped() const;
+
+  RenderStateCounters &operator+=(const RenderStateCounters &other);
+};
+
+// Forwards commands to a backend, dropping any bind that matches what is
+// already bound. reset() forgets the bound state, so call it whenever the
+// backend starts a new encoder.
+class StateTrackingEncoder {
+public:
+  static constexpr uint32_t kMaxBindings = 32;
+
+  explicit StateTrackingEncoder(RenderCommandBackend *pBackend = nullptr)
+      : _pBackend(pBackend) {}
+
+  void setBackend(RenderCommandBackend *pBackend);
+  void reset();
+
+  void setDepthStencilState(const MTL::DepthStencilState *pState);
+  void setRenderPipelineState(const MTL::RenderPipelineState *pState);
+  void setAddress(RenderStage stage, uint64_t address, uint32_t index);
+
+  // The label is interned the first time owner is seen; later pushes for the
+  // same owner reuse it without touching the string.
+  void pushDebugGroup(const void *owner, std::string_view label);
+  void popDebugGroup();
+
+  void drawIndexed(const IndexedDraw &draw);
+
+  const RenderStateCounters &counters() const { return _counters; }
+  void resetCounters() { _counters = {}; }
+
+private:
+  RenderCommandBackend *_pBackend;
+
+  const MTL::DepthStencilState *_pDepthStencilState = nullptr;
+  const MTL::RenderPipelineState *_pPipelineState = nullptr;
+  uint64_t _addresses[2][kMaxBindings] = {};
+  uint32_t _boundAddresses[2] = {};
+  bool _hasDepthStencilState = false;
+  bool _hasPipelineState = false;
+
+  std::unordered_map<const void *, uint32_t> _labels;
+  RenderStateCounters _counters;
+};
+
+// Keeps every command it receives, for checking the tracker without a GPU.
+class RecordingCommandBackend : public RenderCommandBackend {
+public:
+  enum class CommandType : uint32_t {
+    SetDepthStencilState,
+    SetRenderPipelineState,
+    SetAddress,
+    PushDebugGroup,
+    PopDebugGroup,
+    DrawIndexed
+  };
+
+  struct Command {
+    CommandType type;
+    const void *pState = nullptr;
+    RenderStage stage = RenderStage::Vertex;
+    uint64_t address = 0;
+    uint32_t index = 0;
+    IndexedDraw draw = {};
+  };
+
+  std::vector<Command> commands;
+  std::vector<std::string> labels;
+
+  void clear() {
+    commands.clear();
+    labels.clear();
+  }
+
+  void setDepthStencilState(const MTL::DepthStencilState *pState) override;
+  void setRenderPipelineState(const MTL::RenderPipelineState *pState) override;
+  void setAddress(RenderStage stage, uint64_t address,
+                  uint32_t index) override;
+  void registerLabel(uint32_t labelID, std::string_view label) override;
+  void pushDebugGroup(uint32_t labelID) override;
+  void popDebugGroup() override;
+  void drawIndexed(const IndexedDraw &draw) override;
+};
@@ -0,0 +1,97 @@
+//
+//  RenderQueue.cpp
+//  Paloma Engine
+//
+
+#include "RenderQueue.hpp"
+#include "RadixSort.hpp"
+#include <algorithm>
+#include <cassert>
+
+uint64_t SortKey::make(RenderPass pass, AlphaMode alphaMode,
+                       uint32_t pipelineID, uint32_t materialID,
+                       float viewDepth, float maxDepth) {
+  assert(pipelineID < (1u << kPipelineBits));
+  assert(materialID < (1u << kMaterialBits));
+
+  constexpr uint32_t maxDepthValue = (1u << kDepthBits) - 1;
+  float normalizedDepth =
+      maxDepth > 0.0f ? std::clamp(viewDepth / maxDepth, 0.0f, 1.0f) : 0.0f;
+  uint64_t depth = (uint64_t)(normalizedDepth * maxDepthValue);
+
+  uint64_t state = (uint64_t)pipelineID << kMaterialBits | materialID;
+
+  uint64_t key = (uint64_t)pass;
+  key = key << kAlphaBits | (uint64_t)alphaMode;
+  if (alphaMode == AlphaMode::Blend) {
+    key = key << kDepthBits | (maxDepthValue - depth);
+    key = key << (kPipelineBits + kMaterialBits) | state;
+  } else {
+    key = key << (kPipelineBits + kMaterialBits) | state;
+    key = key << kDepthBits | depth;
+  }
+  return key;
+}
+
+void RenderQueue::clear() {
+  _items.clear();
+  _batches.clear();
+  _pending.clear();
+  _instanceSlots.clear();
+  _packets.clear();
+  _itemForSubmesh.clear();
+}
+
+void RenderQueue::push(RenderPass pass, const Mesh &mesh,
+                       const Submesh &submesh, uint32_t lod,
+                       const Material &material, uint32_t instanceSlot,
+                       float viewDepth, float maxDepth) {
+  uint32_t itemIndex = (uint32_t)_items.size();
+
+  if (material.alphaMode != AlphaMode::Blend) {
+    auto [it, inserted] =
+        _itemForSubmesh.try_emplace({&submesh, lod}, itemIndex);
+    if (!inserted) {
+      itemIndex = it->second;
+      Batch &batch = _batches[itemIndex];
+      batch.viewDepth = std::min(batch.viewDepth, viewDepth);
+      _items[itemIndex].instanceCount++;
+      _pending.push_back({itemIndex, instanceSlot});
+      return;
+    }
+  }
+
+  _items.push_back({&mesh, &submesh, &material, lod, 0, 1});
+  _batches.push_back({pass, viewDepth, maxDepth});
+  _pending.push_back({itemIndex, instanceSlot});
+}
+
+void RenderQueue::sort() {
+  // Counting sort of the pending instances by draw.
+  uint32_t offset = 0;
+  for (auto &item : _items) {
+    item.firstInstance = offset;
+    offset += item.instanceCount;
+    item.instanceCount = 0;
+  }
+
+  _instanceSlots.resize(_pending.size());
+  for (const auto &instance : _pending) {
+    DrawItem &item = _items[instance.itemIndex];
+    _instanceSlots[item.firstInstance + item.instanceCount++] =
+        instance.instanceSlot;
+  }
+
+  _packets.resize(_items.size());
+  for (uint32_t i = 0; i < _items.size(); ++i) {
+    const DrawItem &item = _items[i];
+    const Batch &batch = _batches[i];
+    _packets[i].sortKey = SortKey::make(
+        batch.pass, item.material->alphaMode, item.material->pipelineID,
+        item.material->materialID, batch.viewDepth, batch.maxDepth);
+    _packets[i].itemIndex = i;
+  }
+
+  radixSort(_packets, _scratch,
+            [](const DrawPacket &packet) { return packet.sortKey; });
+}
@@ -0,0 +1,100 @@
+//
+//  RenderQueue.hpp
+//  Paloma Engine
+//
+
+#pragma once
+#include "Material.hpp"
+#include "Mesh.hpp"
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+enum class RenderPass : uint32_t { Main = 0 };
+
+// What a packet draws: one submesh LOD and material for a run of instances in
+// RenderQueue::instanceSlots(). Stays put while packets are sorted.
+struct DrawItem {
+  const Mesh *mesh;
+  const Submesh *submesh;
+  const Material *material;
+  uint32_t lod;
+  uint32_t firstInstance;
+  uint32_t instanceCount;
+};
+
+struct DrawPacket {
+  uint64_t sortKey;
+  uint32_t itemIndex;
+};
+
+// Sort key layout, most significant bits first:
+//
+//   opaque and mask: pass:4 | alpha:2 | pipeline:14 | material:20 | depth:24
+//   blend:           pass:4 | alpha:2 | depth:24 | pipeline:14 | material:20
+//
+// Opaque draws group by state and go front to back; blended draws go back to
+// front and only group by state at equal depth.
+namespace SortKey {
+constexpr uint32_t kPassBits = 4;
+constexpr uint32_t kAlphaBits = 2;
+constexpr uint32_t kPipelineBits = 14;
+constexpr uint32_t kMaterialBits = 20;
+constexpr uint32_t kDepthBits = 24;
+
+uint64_t make(RenderPass pass, AlphaMode alphaMode, uint32_t pipelineID,
+              uint32_t materialID, float viewDepth, float maxDepth);
+} // namespace SortKey
+
+// Per-frame list of draw packets. Storage is kept between frames.
+//
+// Opaque and mask instances of the same submesh LOD and material are merged
+// into one instanced draw, keyed by the front-most instance. Blended instances
+// stay separate so they can be sorted back to front.
+class RenderQueue {
+public:
+  void clear();
+  void push(RenderPass pass, const Mesh &mesh, const Submesh &submesh,
+            uint32_t lod, const Material &material, uint32_t instanceSlot,
+            float viewDepth, float maxDepth);
+  // Lays out each draw's instances contiguously and sorts the packets.
+  void sort();
+
+  const std::vector<DrawPacket> &packets() const { return _packets; }
+  const DrawItem &item(const DrawPacket &packet) const {
+    return _items[packet.itemIndex];
+  }
+  // Instance slots of all draws, each draw's run starting at firstInstance.
+  const std::vector<uint32_t> &instanceSlots() const { return _instanceSlots; }
+
+private:
+  struct Batch {
+    RenderPass pass;
+    float viewDepth;
+    float maxDepth;
+  };
+
+  struct PendingInstance {
+    uint32_t itemIndex;
+    uint32_t instanceSlot;
+  };
+
+  std::vector<DrawItem> _items;
+  std::vector<Batch> _batches; // parallel to _items
+  std::vector<PendingInstance> _pending;
+  std::vector<uint32_t> _instanceSlots;
+  std::vector<DrawPacket> _packets;
+  std::vector<DrawPacket> _scratch;
+
+  using SubmeshLODKey = std::pair<const Submesh *, uint32_t>;
+  struct SubmeshLODHash {
+    size_t operator()(const SubmeshLODKey &key) const {
+      return std::hash<const Submesh *>()(key.first) ^ key.second;
+    }
+  };
+
+  // A submesh fixes both its mesh and its material index. There is one pass
+  // per frame so far, so it doesn't need to be part of the key.
+  std::unordered_map<SubmeshLODKey, uint32_t, SubmeshLODHash> _itemForSubmesh;
+};
@@ -12,13 +12,22 @@
 
 extern "C" double CACurrentMediaTime();
 
-struct DrawCall {
-  std::shared_ptr<Mesh> mesh;
-  const Submesh *submesh;
-  Material *material;
-  matrix_float4x4 modelTransform;
-  simd_float3 modelViewPosition;
-};
+// Calls fn with each of material's properties whose texture is streamed.
+template <typename MaterialType, typename Function>
+static void forEachStreamedProperty(MaterialType &material, Function &&fn) {
+  auto visit = [&](auto &property) {
+    if (property.streamingID != kNotStreamed) {
+      fn(property);
+    }
+  };
+  visit(material.baseColor);
+  visit(material.opacity);
+  visit(material.metalness);
+  visit(material.roughness);
+  visit(material.emissive);
+  visit(material.normal);
+  visit(material.occlusion);
+}
 
 RendererInterface *CreateRenderer(MTL::Device *pDevice) {
   if (pDevice->supportsFamily(MTL::GPUFamilyMetal4)) {
@@ -31,18 +40,13 @@ RendererInterface *CreateRenderer(MTL::Device *pDevice) {
 }
 
 Metal4Renderer::Metal4Renderer(MTL::Device *pDevice)
-    : _pDevice(NS::RetainPtr(pDevice)) {
+    : _pDevice(NS::RetainPtr(pDevice)),
+      _pGPUDevice(std::make_unique<MetalGPUDevice>(pDevice)) {
 
   _colorPixelFormat = MTL::PixelFormatBGRA8Unorm_sRGB;
   _depthStencilPixelFormat = MTL::PixelFormatDepth32Float;
 
   _pCommandQueue = NS::TransferPtr(_pDevice->newMTL4CommandQueue());
-  _pCommandBuffer = NS::TransferPtr(_pDevice->newCommandBuffer());
-
-  for (int i = 0; i < kMaxFramesInFlight; i++) {
-    _pCommandAllocators.push_back(
-        NS::TransferPtr(_pDevice->newCommandAllocator()));
-  }
 
   const uint32_t sampleCounts[] = {8, 4, 2, 1}; // for MSAA
   _rasterSampleCount = 1;                       // default - no MSAA
@@ -82,6 +86,10 @@ Metal4Renderer::Metal4Renderer(MTL::Device *pDevice)
 
     assert(false);
   }
+  _pResidencyBackend = new MetalResidencyBackend(_pResidencySet.get());
+  _pResidencyManager =
+      new ResidencyManager(_pResidencyBackend, kResidencyBudget,
+                           kResidencyLowWater, kMinIdleFrames);
 
   // -- Create Argument Tables --
   auto argumentDescriptor =
@@ -90,24 +98,58 @@ Metal4Renderer::Metal4Renderer(MTL::Device *pDevice)
       std::max((uint32_t)VertexBufferCount, (uint32_t)FragmentBufferCount));
   argumentDescriptor->setMaxTextureBindCount(FragmentTextureCount);
 
-  _pVertexArgumentTable = NS::TransferPtr(
-      _pDevice->newArgumentTable(argumentDescriptor.get(), &pError));
-  if (!_pVertexArgumentTable) {
+  // -- Create Encode Contexts --
+  const uint32_t encodeContextCount =
+      std::min(_jobSystem.threadCount(), kMaxEncodeChunks);
+  for (uint32_t i = 0; i < encodeContextCount; i++) {
+    auto context = std::make_unique<EncodeContext>();
+    context->pCommandBuffer =
+        NS::TransferPtr(_pDevice->newCommandBuffer());
+
+    for (int frame = 0; frame < kMaxFramesInFlight; frame++) {
+      context->pCommandAllocators[frame] =
+          NS::TransferPtr(_pDevice->newCommandAllocator());
+    }
+    context->pUploadAllocator =
+        new FrameAllocator(kUploadChunkSize, _pGPUDevice.get(),
+                           GPUMemoryCategory::Constants);
 
-    assert(false);
-  }
-  _pFragmentArgumentTable = NS::TransferPtr(
-      _pDevice->newArgumentTable(argumentDescriptor.get(), &pError));
-  if (!_pFragmentArgumentTable) {
+    context->pVertexArgumentTable = NS::TransferPtr(
+        _pDevice->newArgumentTable(argumentDescriptor.get(), &pError));
+    if (!context->pVertexArgumentTable) {
 
-    assert(false);
-  }
+      assert(false);
+    }
+    context->pFragmentArgumentTable = NS::TransferPtr(
+        _pDevice->newArgumentTable(argumentDescriptor.get(), &pError));
+    if (!context->pFragmentArgumentTable) {
 
-  for (int i = 0; i < kMaxFramesInFlight; i++) {
-    _pConstantBuffers[i] = new RingBuffer(64 * 1024, _pDevice.get());
+      assert(false);
+    }
+
+    _encodeContexts.push_back(std::move(context));
   }
 
-  _pMaterialsBuffer = new RingBuffer(64 * 1024, _pDevice.get());
+  _pConstantAllocator = new FrameAllocator(
+      kUploadChunkSize, _pGPUDevice.get(), GPUMemoryCategory::Constants);
+
+  _pMaterialTable = new MaterialTable(_pGPUDevice.get(), kMaxFramesInFlight);
+  _pMaterialTable->setReleaseCallback(
+      [this](GPUBuffer *pBuffer) { removeReleasedBuffer(pBuffer); });
+
+  _pFrameGraphHeap = new MetalFrameGraphHeap(
+      _pDevice.get(), _pResidencySet.get(), kMaxFramesInFlight);
+
+  _pTextureStreamingBackend =
+      new MetalTextureStreamingBackend(_pDevice.get(), _pResidencySet.get());
+  _pTextureStreamer = new TextureStreamer(
+      _pTextureStreamingBackend, kTextureBudget, kMaxTextureUploadBytes);
+
+  _pInstanceBuffer = new FrameSlotBuffer<InstanceConstants>(
+      1024, kMaxFramesInFlight, _pGPUDevice.get(),
+      GPUMemoryCategory::Instances);
+  _pInstanceBuffer->setReleaseCallback(
+      [this](GPUBuffer *pBuffer) { removeReleasedBuffer(pBuffer); });
 
   // -- Create Depth Stencil States --
   auto depthStencilDescriptor =
@@ -153,12 +195,16 @@ void Metal4Renderer::makeResources() {
     return;
   }
 
-  _pScene.reset(Scene::load(scenePath, _pDevice.get()));
+  _pScene.reset(Scene::load(scenePath, _pDevice.get(), kVertexFormat,
+                            kStreamTextures));
   if (!_pScene) {
 
     return;
   }
 
+  _pScene->registry.on_destroy<InstanceSlot>()
+      .connect<&Metal4Renderer::onInstanceSlotDestroyed>(*this);
+
   ImageBasedLight::generateImageBasedLight(
       envPathStr, _pDevice.get(),
       [this](ImageBasedLight *pLight, NS::Error *pError) {
@@ -178,55 +224,46 @@ void Metal4Renderer::makeResources() {
 
         _pScene->lights.push_back(Light());
 
-        _pScene->rootEntity->visitHierarchy([this](Entity *pEntity) {
-          auto pModelEntity = dynamic_cast<ModelEntity *>(pEntity);
-          if (pModelEntity && pModelEntity->mesh) {
-            auto &mesh = pModelEntity->mesh;
+        const auto &streamedTextures = _pScene->getStreamedTextures();
+        for (const auto &source : streamedTextures) {
+          _pTextureStreamingBackend->addTexture(*_pTextureStreamer,
+                                                source.pTexture.get(),
+                                                source.sRGB, source.asset);
+        }
+        _streamedTextureUsers.resize(streamedTextures.size());
+
+        auto meshes = _pScene->registry.view<MeshRenderer>();
+        for (auto [entity, renderer] : meshes.each()) {
+          if (renderer.mesh) {
+            auto &mesh = renderer.mesh;
 
             for (auto &material : mesh->materials) {
               if (material.alphaMode == AlphaMode::Blend) {
                 material.alphaMode = AlphaMode::Mask;
               }
 
-              material.pRenderPipelineState =
-                  makePipelineState(mesh.get(), &material);
-
-              MaterialConstants constants;
-              constants.opacityFactor = material.opacity.factor;
-              constants.baseColorFactor = {material.baseColor.factor.x,
-                                           material.baseColor.factor.y,
-                                           material.baseColor.factor.z, 1.0f};
-              constants.metallicFactor = material.metalness.factor;
-              constants.roughnessFactor = material.roughness.factor;
-              constants.emissiveFactor = material.emissive.factor;
-              constants.alphaCutoff = material.alphaThreshold;
-              constants.normalScale = material.normal.factor;
-              constants.occlusionStrength = material.occlusion.factor;
-
-              MaterialArguments args;
-              args.constants = constants;
-
-              auto getID = [](const NS::SharedPtr<MTL::Texture> &t) {
-                return t ? t->gpuResourceID() : MTL::ResourceID{0};
-              };
-
-              args.baseColorTexture = getID(material.baseColor.pTexture);
-              args.normalTexture = getID(material.normal.pTexture);
-              args.emissiveTexture = getID(material.emissive.pTexture);
-              args.roughnessTexture = getID(material.roughness.pTexture);
-              args.metalnessTexture = getID(material.metalness.pTexture);
-              args.occlusionTexture = getID(material.occlusion.pTexture);
-              args.opacityTexture = getID(material.opacity.pTexture);
-
-              if (_pMaterialsBuffer) {
-                material.bufferView = _pMaterialsBuffer->copy(args);
-              }
+              bindStreamedTextures(material);
+              forEachStreamedProperty(material, [&](const auto &property) {
+                auto &users = _streamedTextureUsers[property.streamingID];
+                if (std::find(users.begin(), users.end(), &material) ==
+                    users.end()) {
+                  users.push_back(&material);
+                }
+              });
+
+              auto pipeline = makePipelineState(mesh.get(), &material);
+              material.pRenderPipelineState = pipeline.pipelineState;
+              material.pipelineID = pipeline.id;
+
+              material.materialID =
+                  _pMaterialTable->add(makeMaterialArguments(material));
             }
           }
-        });
+        }
 
-        if (auto pCameraNode = _pScene->rootEntity->childNamed("Camera")) {
-          matrix_float4x4 camWorld = pCameraNode->worldTransform();
+        auto cameraNode = _pScene->findEntity("Camera");
+        if (cameraNode != entt::null) {
+          matrix_float4x4 camWorld = _pScene->worldTransform(cameraNode);
           _camera.position = camWorld.columns[3].xyz;
 
           matrix_float3x3 rotMat;
@@ -249,33 +286,20 @@ void Metal4Renderer::makeResources() {
 }
 
 void Metal4Renderer::makeSceneResourcesResident(Scene *scene) {
-  const auto &sceneResources = scene->getResources();
-  if (!sceneResources.empty()) {
-    std::vector<const MTL::Allocation *> allocations;
-    allocations.reserve(sceneResources.size());
-    for (const auto &res : sceneResources) {
-
-      allocations.push_back(
-          reinterpret_cast<const MTL::Allocation *>(res.get()));
-    }
-    _pResidencySet->addAllocations(allocations.data(), allocations.size());
+  for (const auto &res : scene->getResources()) {
+    _pResidencyManager->track(res.get(), res->allocatedSize());
   }
 
-  std::vector<const MTL::Allocation *> constantAllocations;
-  constantAllocations.reserve(kMaxFramesInFlight);
-  for (int i = 0; i < kMaxFramesInFlight; ++i) {
-    if (_pConstantBuffers[i]) {
-      constantAllocations.push_back(reinterpret_cast<const MTL::Allocation *>(
-          _pConstantBuffers[i]->getBuffer()));
-    }
-  }
-  _pResidencySet->addAllocations(constantAllocations.data(),
-                                 constantAllocations.size());
+  addNewUploadChunks();
 
-  if (_pMaterialsBuffer) {
+  for (int i = 0; i < kMaxFramesInFlight; ++i) {
+    _pResidencySet->addAllocation(reinterpret_cast<const MTL::Allocation *>(
+        metalBuffer(_pMaterialTable->getBuffer(i))));
     _pResidencySet->addAllocation(reinterpret_cast<const MTL::Allocation *>(
-        _pMaterialsBuffer->getBuffer()));
+        metalBuffer(_pInstanceBuffer->getBuffer(i))));
   }
+  _residentMaterialTableGeneration = _pMaterialTable->bufferGeneration();
+  _residentInstanceBufferGeneration = _pInstanceBuffer->bufferGeneration();
 
   if (auto *light = scene->getLightingEnvironment()) {
     const MTL::Allocation *iblAllocations[3] = {
@@ -294,7 +318,20 @@ void Metal4Renderer::makeSceneResourcesResident(Scene *scene) {
   _hasPreparedResources = true;
 }
 
-NS::SharedPtr<MTL::RenderPipelineState>
+bool Metal4Renderer::addNewUploadChunks() {
+  std::vector<GPUBuffer *> chunks;
+  _pConstantAllocator->takeNewChunks(chunks);
+  for (const auto &context : _encodeContexts) {
+    context->pUploadAllocator->takeNewChunks(chunks);
+  }
+  for (auto *pChunk : chunks) {
+    _pResidencySet->addAllocation(
+        reinterpret_cast<const MTL::Allocation *>(metalBuffer(pChunk)));
+  }
+  return !chunks.empty();
+}
+
+Metal4Renderer::CachedPipeline
 Metal4Renderer::makePipelineState(Mesh *pMesh, Material *pMaterial) {
   bool hasNormals = pMesh->vertexDescriptor->attributeNamed(
                         MDL::VertexAttributeNormal) != nil;
@@ -332,8 +369,45 @@ Metal4Renderer::makePipelineState(Mesh *pMesh, Material *pMaterial) {
   int opacityUVSet = pMaterial->opacity.mappingChannel;
 
   bool useIBL = (_pScene->pLightingEnvironment != nullptr);
+  bool useCompactVertices = pMesh->vertexFormat == VertexFormat::Compact;
 
   uint32_t alphaMode = (uint32_t)pMaterial->alphaMode;
+
+  NameID pipelineKey = kEmptyNameID;
+  auto hashValue = [&](uint32_t value) {
+    pipelineKey = appendNameID(
+        pipelineKey, std::string_view((const char *)&value, sizeof(value)));
+  };
+  for (uint32_t value :
+       {(uint32_t)hasNormals, (uint32_t)hasTangents, (uint32_t)hasTexCoords0,
+        (uint32_t)hasTexCoords1, (uint32_t)hasVertexColors,
+        (uint32_t)hasBaseColorTexture, (uint32_t)baseColorUVSet,
+        (uint32_t)hasEmissiveTexture, (uint32_t)emissiveUVSet,
+        (uint32_t)hasNormalTexture, (uint32_t)normalUVSet,
+        (uint32_t)hasMetalnessTexture, (uint32_t)metalnessUVSet,
+        (uint32_t)hasRoughnessTexture, (uint32_t)roughnessUVSet,
+        (uint32_t)hasOcclusionTexture, (uint32_t)occlusionUVSet,
+        (uint32_t)hasOpacityTexture, (uint32_t)opacityUVSet, (uint32_t)useIBL,
+        alphaMode, (uint32_t)useCompactVertices}) {
+    hashValue(value);
+  }
+  for (NS::UInteger i = 0; i < attributes->count(); ++i) {
+    auto *attr = (MDL::VertexAttribute *)attributes->object(i);
+    pipelineKey = appendNameID(pipelineKey, attr->name()->utf8String());
+    hashValue((uint32_t)attr->format());
+    hashValue((uint32_t)attr->offset());
+    hashValue((uint32_t)attr->bufferIndex());
+  }
+  NS::Array *layouts = pMesh->vertexDescriptor->layouts();
+  for (NS::UInteger i = 0; i < layouts->count(); ++i) {
+    hashValue((uint32_t)((MDL::VertexBufferLayout *)layouts->object(i))
+                  ->stride());
+  }
+
+  if (auto it = _pipelineCache.find(pipelineKey); it != _pipelineCache.end()) {
+    return it->second;
+  }
+
   NS::SharedPtr<MTL::FunctionConstantValues> functionConstants;
   functionConstants =
       NS::TransferPtr(MTL::FunctionConstantValues::alloc()->init());
@@ -374,6 +448,7 @@ Metal4Renderer::makePipelineState(Mesh *pMesh, Material *pMaterial) {
   setInt(opacityUVSet, "opacityUVSet");
   setBool(useIBL, "useIBL");
   setUInt(alphaMode, "alphaMode");
+  setBool(useCompactVertices, "useCompactVertices");
 
   auto vertexFunction =
       NS::TransferPtr(MTL4::SpecializedFunctionDescriptor::alloc()->init());
@@ -437,8 +512,12 @@ Metal4Renderer::makePipelineState(Mesh *pMesh, Material *pMaterial) {
   }
 
   NS::Error *pError = nullptr;
-  return NS::TransferPtr(_pCompiler->newRenderPipelineState(
+  CachedPipeline pipeline;
+  pipeline.pipelineState = NS::TransferPtr(_pCompiler->newRenderPipelineState(
       renderPipelineDescriptor.get(), nullptr, &pError));
+  pipeline.id = (uint32_t)_pipelineCache.size();
+  _pipelineCache[pipelineKey] = pipeline;
+  return pipeline;
 }
 
 // void Metal4Renderer::updateCamera() {
@@ -473,16 +552,312 @@ void Metal4Renderer::updateScene(float deltaTime) {
   if (!_pScene)
     return;
 
-  _pScene->rootEntity->visitHierarchy([this](Entity *pEntity) {
-    if (dynamic_cast<ModelEntity *>(pEntity)) {
-      // Smooth rotation based on time (0.5 radians per second)
-      float angle = _time * 0.5f;
-      // Rotate around Y axis
-      pEntity->transform = matrix4x4_rotation(angle, 0, 1, 0);
+  _pScene->updateAnimations((float)_time);
+  _pScene->updateTransforms();
+}
+
+bool Metal4Renderer::updateInstances(uint64_t frameIdx) {
+  auto &registry = _pScene->registry;
+
+  // Only entities that moved or had their MeshRenderer edited are rebuilt.
+  for (auto entity : _pScene->changedEntities()) {
+    if (!registry.all_of<MeshRenderer>(entity)) {
+      continue;
+    }
+
+    auto *pSlot = registry.try_get<InstanceSlot>(entity);
+    if (!pSlot) {
+      pSlot = &registry.emplace<InstanceSlot>(entity,
+                                              _pInstanceBuffer->allocateSlot());
     }
+
+    const matrix_float4x4 &modelTransform =
+        registry.get<WorldTransform>(entity).matrix;
+
+    InstanceConstants instanceConstants;
+    instanceConstants.modelMatrix = modelTransform;
+
+    simd_float3x3 model3x3 = {simd_make_float3(modelTransform.columns[0]),
+                              simd_make_float3(modelTransform.columns[1]),
+                              simd_make_float3(modelTransform.columns[2])};
+
+    instanceConstants.normalMatrix = simd_transpose(simd_inverse(model3x3));
+
+    _pInstanceBuffer->update(pSlot->index, instanceConstants);
+  }
+  _pScene->clearChanges();
+
+  _pInstanceBuffer->flush(frameIdx);
+
+  bool residencyChanged = _releasedResidentBuffers;
+  _releasedResidentBuffers = false;
+  if (_pInstanceBuffer->bufferGeneration() !=
+      _residentInstanceBufferGeneration) {
+    for (int i = 0; i < kMaxFramesInFlight; ++i) {
+      _pResidencySet->addAllocation(reinterpret_cast<const MTL::Allocation *>(
+          metalBuffer(_pInstanceBuffer->getBuffer(i))));
+    }
+    _residentInstanceBufferGeneration = _pInstanceBuffer->bufferGeneration();
+    residencyChanged = true;
+  }
+  return residencyChanged;
+}
+
+void Metal4Renderer::removeReleasedBuffer(GPUBuffer *pBuffer) {
+  _pResidencySet->removeAllocation(
+      reinterpret_cast<const MTL::Allocation *>(metalBuffer(pBuffer)));
+  _releasedResidentBuffers = true;
+}
+
+bool Metal4Renderer::updateMaterials(uint64_t frameIdx) {
+  _pMaterialTable->flush(frameIdx);
+
+  bool residencyChanged = _releasedResidentBuffers;
+  _releasedResidentBuffers = false;
+  if (_pMaterialTable->bufferGeneration() !=
+      _residentMaterialTableGeneration) {
+    for (int i = 0; i < kMaxFramesInFlight; ++i) {
+      _pResidencySet->addAllocation(reinterpret_cast<const MTL::Allocation *>(
+          metalBuffer(_pMaterialTable->getBuffer(i))));
+    }
+    _residentMaterialTableGeneration = _pMaterialTable->bufferGeneration();
+    residencyChanged = true;
+  }
+  return residencyChanged;
+}
+
+MaterialArguments
+Metal4Renderer::makeMaterialArguments(const Material &material) const {
+  MaterialConstants constants;
+  constants.opacityFactor = material.opacity.factor;
+  constants.baseColorFactor = {material.baseColor.factor.x,
+                               material.baseColor.factor.y,
+                               material.baseColor.factor.z, 1.0f};
+  constants.metallicFactor = material.metalness.factor;
+  constants.roughnessFactor = material.roughness.factor;
+  constants.emissiveFactor = material.emissive.factor;
+  constants.alphaCutoff = material.alphaThreshold;
+  constants.normalScale = material.normal.factor;
+  constants.occlusionStrength = material.occlusion.factor;
+
+  MaterialArguments args;
+  args.constants = constants;
+
+  auto getID = [](const NS::SharedPtr<MTL::Texture> &t) {
+    return t ? t->gpuResourceID() : MTL::ResourceID{0};
+  };
+
+  args.baseColorTexture = getID(material.baseColor.pTexture);
+  args.normalTexture = getID(material.normal.pTexture);
+  args.emissiveTexture = getID(material.emissive.pTexture);
+  args.roughnessTexture = getID(material.roughness.pTexture);
+  args.metalnessTexture = getID(material.metalness.pTexture);
+  args.occlusionTexture = getID(material.occlusion.pTexture);
+  args.opacityTexture = getID(material.opacity.pTexture);
+  return args;
+}
+
+void Metal4Renderer::useDrawResources(const Mesh &mesh,
+                                      const Submesh &submesh, uint32_t lod,
+                                      const Material &material) {
+  for (const auto &vertexBuffer : mesh.vertexBuffers) {
+    _pResidencyManager->use(vertexBuffer.pBuffer);
+  }
+  if (mesh.vertexFormat == VertexFormat::Compact) {
+    _pResidencyManager->use(mesh.meshConstants.pBuffer);
+  }
+  _pResidencyManager->use(submesh.indexBufferForLOD(lod).pBuffer);
+  for (const auto *pTexture :
+       {&material.baseColor.pTexture, &material.opacity.pTexture,
+        &material.metalness.pTexture, &material.roughness.pTexture,
+        &material.emissive.pTexture, &material.normal.pTexture,
+        &material.occlusion.pTexture}) {
+    _pResidencyManager->use(pTexture->get());
+  }
+}
+
+void Metal4Renderer::bindStreamedTextures(Material &material) {
+  forEachStreamedProperty(material, [&](auto &property) {
+    property.pTexture =
+        _pTextureStreamingBackend->texture(property.streamingID);
   });
 }
 
+void Metal4Renderer::requestStreamedTextures(const Material &material,
+                                             float screenPixels) {
+  forEachStreamedProperty(material, [&](const auto &property) {
+    _pTextureStreamer->requestScreenSize(property.streamingID, screenPixels);
+  });
+}
+
+bool Metal4Renderer::updateTextureStreaming(uint64_t completedFrame) {
+  _pTextureStreamingBackend->beginFrame(_frameIndex, completedFrame);
+  _pTextureStreamer->update(_frameIndex);
+  for (uint32_t id : _pTextureStreamingBackend->changedTextures()) {
+    for (Material *pMaterial : _streamedTextureUsers[id]) {
+      bindStreamedTextures(*pMaterial);
+      _pMaterialTable->update(pMaterial->materialID,
+                              makeMaterialArguments(*pMaterial));
+    }
+  }
+  return _pTextureStreamingBackend->takeResidencyChanged();
+}
+
+void Metal4Renderer::onInstanceSlotDestroyed(Registry &registry,
+                                             Entity entity) {
+  _pInstanceBuffer->freeSlot(registry.get<InstanceSlot>(entity).index);
+}
+
+void Metal4Renderer::collectFrameStats() {
+  if (_pScene) {
+    const auto &spatialIndex = _pScene->getSpatialIndex();
+    _frameStats.culling = spatialIndex.frustumQueryStats();
+    _frameStats.spatialProxies = spatialIndex.proxyCount();
+  }
+  _frameStats.occlusion = _occlusionBuffer.stats();
+
+  _frameStats.uploads = _pConstantAllocator->stats();
+  for (const auto &context : _encodeContexts) {
+    const auto &stats = context->pUploadAllocator->stats();
+    _frameStats.uploads.frameBytes += stats.frameBytes;
+    _frameStats.uploads.highWaterBytes += stats.highWaterBytes;
+    _frameStats.uploads.chunkBytes += stats.chunkBytes;
+    _frameStats.uploads.chunkCount += stats.chunkCount;
+    _frameStats.uploads.chunksCreatedThisFrame += stats.chunksCreatedThisFrame;
+  }
+
+  _frameStats.frameGraph = _frameGraph.stats();
+  _frameStats.materials = _pMaterialTable->stats();
+  _frameStats.streaming = _pTextureStreamer->stats();
+  _frameStats.residency = _pResidencyManager->stats();
+  _frameStats.gpuMemory = GPUMemoryTracker::shared().total();
+}
+
+void Metal4Renderer::encodeChunk(
+    EncodeContext &context, const EncodeChunk &chunk,
+    MTL4::RenderPassDescriptor *pRenderPassDescriptor,
+    MTL4::RenderEncoderOptions options, uint64_t frameIdx,
+    const FrameBindings &bindings, bool waitForAliasedMemory) {
+  // Runs on a worker thread, which has no pool of its own.
+  auto pPool = NS::TransferPtr(NS::AutoreleasePool::alloc()->init());
+
+  auto *pAllocator = context.pCommandAllocators[frameIdx].get();
+  pAllocator->reset();
+  FrameAllocator *pUploadAllocator = context.pUploadAllocator;
+
+  auto *pVertexTable = context.pVertexArgumentTable.get();
+  auto *pFragmentTable = context.pFragmentArgumentTable.get();
+
+  context.pCommandBuffer->beginCommandBuffer(pAllocator);
+  auto *pCommandEncoder = context.pCommandBuffer->renderCommandEncoder(
+      pRenderPassDescriptor, options);
+
+  if (waitForAliasedMemory) {
+    // Transient heaps are untracked: finish every earlier use of the memory
+    // before this pass's textures take it over.
+    pCommandEncoder->barrierAfterQueueStages(
+        MTL::StageAll, MTL::StageVertex | MTL::StageFragment,
+        MTL4::VisibilityOptionResourceAlias);
+  }
+  pCommandEncoder->setFrontFacingWinding(MTL::WindingCounterClockwise);
+  pCommandEncoder->setArgumentTable(pVertexTable, MTL::RenderStageVertex);
+  pCommandEncoder->setArgumentTable(pFragmentTable, MTL::RenderStageFragment);
+
+  if (auto ibl = _pScene->pLightingEnvironment) {
+    pFragmentTable->setTexture(ibl->diffuseCubeTexture.get()->gpuResourceID(),
+                               fragmentTextureDiffuseEnvironment);
+    pFragmentTable->setTexture(ibl->specularCubeTexture.get()->gpuResourceID(),
+                               fragmentTextureSpecularEnvironment);
+    pFragmentTable->setTexture(
+        ibl->scaleAndBiasLookupTexture.get()->gpuResourceID(),
+        fragmentTextureGGXLookup);
+  }
+
+  context.backend.begin(pCommandEncoder, pVertexTable, pFragmentTable);
+  StateTrackingEncoder &encoder = context.encoder;
+  encoder.reset();
+  encoder.resetCounters();
+
+  encoder.setAddress(RenderStage::Fragment, bindings.lights,
+                     fragmentBufferLights);
+  encoder.setAddress(RenderStage::Vertex, bindings.frameConstants,
+                     vertexBufferFrameConstants);
+  encoder.setAddress(RenderStage::Fragment, bindings.frameConstants,
+                     fragmentBufferFrameConstants);
+  encoder.setAddress(RenderStage::Vertex, bindings.instances,
+                     vertexBufferInstanceConstants);
+
+  const auto &packets = _renderQueue.packets();
+  const auto &instanceSlots = _renderQueue.instanceSlots();
+
+  // The chunk's instance slots go into its own upload allocator, in draw
+  // order.
+  size_t instanceCount = 0;
+  for (size_t i = chunk.begin; i < chunk.end; ++i) {
+    instanceCount += _renderQueue.item(packets[i]).instanceCount;
+  }
+  BufferView slotsView = {nullptr, 0, 0};
+  uint32_t *pSlots = nullptr;
+  if (instanceCount > 0) {
+    slotsView = pUploadAllocator->allocate(instanceCount * sizeof(uint32_t),
+                                           alignof(uint32_t));
+    pSlots = (uint32_t *)slotsView.contents();
+  }
+  uint32_t nextInstance = 0;
+
+  for (size_t i = chunk.begin; i < chunk.end; ++i) {
+    const DrawItem &item = _renderQueue.item(packets[i]);
+    const Material &material = *item.material;
+    encoder.pushDebugGroup(item.mesh, item.mesh->name);
+
+    encoder.setDepthStencilState(
+        _pDepthStencilStates[(int)material.alphaMode].get());
+
+    for (size_t b = 0; b < item.mesh->vertexBuffers.size(); ++b) {
+      encoder.setAddress(RenderStage::Vertex,
+                         item.mesh->vertexBuffers[b].pBuffer->gpuAddress(),
+                         vertexBuffer0 + (uint32_t)b);
+    }
+    if (item.mesh->vertexFormat == VertexFormat::Compact) {
+      encoder.setAddress(RenderStage::Vertex,
+                         item.mesh->meshConstants.gpuAddress(),
+                         vertexBufferMeshConstants);
+    }
+
+    memcpy(pSlots + nextInstance, instanceSlots.data() + item.firstInstance,
+           item.instanceCount * sizeof(uint32_t));
+    encoder.setAddress(RenderStage::Vertex,
+                       slotsView.gpuAddress() + nextInstance * sizeof(uint32_t),
+                       vertexBufferInstanceSlots);
+    nextInstance += item.instanceCount;
+
+    if (material.pRenderPipelineState) {
+      encoder.setRenderPipelineState(material.pRenderPipelineState.get());
+    }
+
+    encoder.setAddress(RenderStage::Fragment,
+                       bindings.materials +
+                           material.materialID * bindings.materialStride,
+                       fragmentBufferMaterial);
+
+    IndexedDraw draw;
+    const MetalBufferView &indexBuffer =
+        item.submesh->indexBufferForLOD(item.lod);
+    draw.primitiveType = (uint32_t)item.submesh->primitiveType;
+    draw.indexType = (uint32_t)item.submesh->indexTypeForLOD(item.lod);
+    draw.indexCount = (uint32_t)item.submesh->indexCountForLOD(item.lod);
+    draw.instanceCount = item.instanceCount;
+    draw.indexBufferAddress = indexBuffer.gpuAddress();
+    draw.indexBufferLength = indexBuffer.length;
+    encoder.drawIndexed(draw);
+
+    encoder.popDebugGroup();
+  }
+
+  pCommandEncoder->endEncoding();
+  context.pCommandBuffer->endCommandBuffer();
+}
+
 void Metal4Renderer::drawInMTKView(MTK::View *pView) {
   auto pPool = NS::TransferPtr(NS::AutoreleasePool::alloc()->init());
 
@@ -531,27 +906,22 @@ void Metal4Renderer::drawInMTKView(MTK::View *pView) {
   _frameIndex++;
 
   const auto frameIdx = _frameIndex % kMaxFramesInFlight;
-  auto allocator = _pCommandAllocators[frameIdx].get();
-  allocator->reset();
 
-  RingBuffer *constantsBuffer = _pConstantBuffers[frameIdx];
-  constantsBuffer->reset();
-
-  _pCommandBuffer->beginCommandBuffer(allocator);
-
-  const auto commandEncoder =
-      _pCommandBuffer->renderCommandEncoder(renderPassDescriptor);
-
-  commandEncoder->setFrontFacingWinding(MTL::WindingCounterClockwise);
+  // Chunks of frames the GPU has finished are reused; a frame that needs
+  // more than the pool holds gets new chunks instead of wrapping.
+  const uint64_t completedFrame = _pFrameCompletionEvent->signaledValue();
+  FrameAllocator *constantsBuffer = _pConstantAllocator;
+  constantsBuffer->beginFrame(_frameIndex, completedFrame);
+  for (const auto &context : _encodeContexts) {
+    context->pUploadAllocator->beginFrame(_frameIndex, completedFrame);
+  }
+  _pResidencyManager->beginFrame(_frameIndex, completedFrame);
 
-  commandEncoder->setArgumentTable(_pVertexArgumentTable.get(),
-                                   MTL::RenderStageVertex);
-  commandEncoder->setArgumentTable(_pFragmentArgumentTable.get(),
-                                   MTL::RenderStageFragment);
+  bool residencyChanged = updateInstances(frameIdx);
+  residencyChanged |= updateTextureStreaming(completedFrame);
+  residencyChanged |= updateMaterials(frameIdx);
 
   auto lightView = constantsBuffer->copy(_pScene->lights);
-  _pFragmentArgumentTable->setAddress(lightView.gpuAddress(),
-                                      fragmentBufferLights);
 
   matrix_float4x4 viewMatrix = _camera.viewMatrix();
   CGSize drawableSize = pView->drawableSize();
@@ -581,132 +951,206 @@ void Metal4Renderer::drawInMTKView(MTK::View *pView) {
 
   auto frameView = constantsBuffer->copy(frameConstants);
 
-  _pVertexArgumentTable->setAddress(frameView.gpuAddress(),
-                                    vertexBufferFrameConstants);
-  _pFragmentArgumentTable->setAddress(frameView.gpuAddress(),
-                                      fragmentBufferFrameConstants);
-
-  std::vector<DrawCall> drawCalls;
-  drawCalls.reserve(100);
-
-  _pScene->rootEntity->visitHierarchy([&](Entity *pEntity) {
-    auto pModelEntity = dynamic_cast<ModelEntity *>(pEntity);
-    if (pModelEntity && pModelEntity->mesh) {
-      auto mesh = pModelEntity->mesh;
-
-      simd_float4 localPos = {
-          (float)pModelEntity->worldTransform().columns[3].x,
-          (float)pModelEntity->worldTransform().columns[3].y,
-          (float)pModelEntity->worldTransform().columns[3].z, 1.0f};
-      simd_float4 modelViewPos4 = matrix_multiply(viewMatrix, localPos);
-      simd_float3 modelViewPos = {modelViewPos4.x, modelViewPos4.y,
-                                  modelViewPos4.z};
-
-      for (auto &submesh : mesh->submeshes) {
-        if (submesh.materialIndex < mesh->materials.size()) {
-          Material *pMaterial = &mesh->materials[submesh.materialIndex];
-
-          DrawCall dc;
-          dc.mesh = mesh;
-          dc.submesh = &submesh;
-          dc.material = pMaterial;
-          dc.modelTransform = pModelEntity->worldTransform();
-          dc.modelViewPosition = modelViewPos;
-
-          drawCalls.push_back(dc);
-        }
-      }
+  const Frustum frustum = _camera.frustum(aspectRatio);
+  _visibleEntities.clear();
+  _pScene->getSpatialIndex().query(frustum, _visibleEntities);
+  _frameStats.submeshesCulled = 0;
+  _frameStats.lodTriangles = 0;
+  _frameStats.fullDetailTriangles = 0;
+
+  _renderQueue.clear();
+
+  auto &registry = _pScene->registry;
+  const auto &spatialIndex = _pScene->getSpatialIndex();
+
+  // Pick the visible occluders that cover the most of the screen.
+  _occluders.clear();
+  const float focalLength = projectionMatrix.columns[1].y;
+  for (auto entity : _visibleEntities) {
+    const auto *pRenderer = registry.try_get<MeshRenderer>(entity);
+    if (!pRenderer || !pRenderer->mesh ||
+        pRenderer->mesh->occluder.isEmpty()) {
+      continue;
     }
-  });
-
-  std::sort(drawCalls.begin(), drawCalls.end(),
-            [](const DrawCall &a, const DrawCall &b) {
-              int leftSort = a.material->relativeSortOrder();
-              int rightSort = b.material->relativeSortOrder();
-
-              if (leftSort > 0 && rightSort > 0) {
-                return a.modelViewPosition.z < b.modelViewPosition.z;
-              }
-              return leftSort < rightSort;
-            });
-
-  if (auto ibl = _pScene->pLightingEnvironment) {
-    _pCommandQueue->wait(ibl->readyEvent.get(), 1);
-
-    _pFragmentArgumentTable->setTexture(
-        ibl->diffuseCubeTexture.get()->gpuResourceID(),
-        fragmentTextureDiffuseEnvironment);
-    _pFragmentArgumentTable->setTexture(
-        ibl->specularCubeTexture.get()->gpuResourceID(),
-        fragmentTextureSpecularEnvironment);
-    _pFragmentArgumentTable->setTexture(
-        ibl->scaleAndBiasLookupTexture.get()->gpuResourceID(),
-        fragmentTextureGGXLookup);
+    const AABB &bounds =
+        spatialIndex.bounds(registry.get<SpatialProxy>(entity).node);
+    const float distance =
+        std::max(simd_distance(bounds.center(), _camera.position),
+                 _camera.nearZ);
+    const float screenSize =
+        simd_length(bounds.extents()) * focalLength / distance;
+    if (screenSize >= kMinOccluderScreenSize) {
+      _occluders.emplace_back(screenSize, entity);
+    }
+  }
+  if (_occluders.size() > kMaxOccluders) {
+    std::partial_sort(_occluders.begin(), _occluders.begin() + kMaxOccluders,
+                      _occluders.end(), std::greater<>());
+    _occluders.resize(kMaxOccluders);
   }
 
-  for (const auto &dc : drawCalls) {
-    commandEncoder->pushDebugGroup(
-        NS::String::string(dc.mesh->name.c_str(), NS::UTF8StringEncoding));
+  _occlusionBuffer.begin(viewProjectionMatrix);
+  for (const auto &[screenSize, entity] : _occluders) {
+    const auto &occluder = registry.get<MeshRenderer>(entity).mesh->occluder;
+    _occlusionBuffer.addOccluder(
+        occluder.positions.data(), (uint32_t)occluder.positions.size(),
+        occluder.indices.data(), (uint32_t)occluder.indices.size(),
+        registry.get<WorldTransform>(entity).matrix);
+  }
+  if (!_occluders.empty()) {
+    _occlusionBuffer.rasterize(_jobSystem);
+  }
 
-    if (dc.material->alphaMode == AlphaMode::Opaque) {
-      commandEncoder->setDepthStencilState(
-          _pDepthStencilStates[(int)AlphaMode::Opaque].get());
-    } else if (dc.material->alphaMode == AlphaMode::Mask) {
-      commandEncoder->setDepthStencilState(
-          _pDepthStencilStates[(int)AlphaMode::Mask].get());
-    } else {
-      commandEncoder->setDepthStencilState(
-          _pDepthStencilStates[(int)AlphaMode::Blend].get());
+  for (auto entity : _visibleEntities) {
+    const auto *pRenderer = registry.try_get<MeshRenderer>(entity);
+    const auto *pSlot = registry.try_get<InstanceSlot>(entity);
+    if (!pRenderer || !pRenderer->mesh || !pSlot) {
+      continue;
     }
-
-    for (size_t i = 0; i < dc.mesh->vertexBuffers.size(); ++i) {
-      _pVertexArgumentTable->setAddress(
-          dc.mesh->vertexBuffers[i].pBuffer->gpuAddress(), vertexBuffer0 + i);
+    if (!_occluders.empty() &&
+        !_occlusionBuffer.isVisible(spatialIndex.bounds(
+            registry.get<SpatialProxy>(entity).node))) {
+      continue;
     }
-
-    // Instance Constants
-    InstanceConstants instanceConstants;
-    instanceConstants.modelMatrix = dc.modelTransform;
-
-    simd_float3x3 model3x3 = {simd_make_float3(dc.modelTransform.columns[0]),
-                              simd_make_float3(dc.modelTransform.columns[1]),
-                              simd_make_float3(dc.modelTransform.columns[2])};
-
-    instanceConstants.normalMatrix = simd_transpose(simd_inverse(model3x3));
-
-    auto instanceView = constantsBuffer->copy(instanceConstants);
-    _pVertexArgumentTable->setAddress(instanceView.gpuAddress(),
-                                      vertexBufferInstanceConstants);
-    _pFragmentArgumentTable->setAddress(instanceView.gpuAddress(),
-                                        fragmentBufferInstanceConstants);
-
-    if (dc.material->pRenderPipelineState) {
-      commandEncoder->setRenderPipelineState(
-          dc.material->pRenderPipelineState.get());
+    const Mesh &mesh = *pRenderer->mesh;
+    const auto &world = registry.get<WorldTransform>(entity);
+    const bool testSubmeshes = mesh.submeshes.size() > 1;
+
+    simd_float4 modelViewPos4 =
+        matrix_multiply(viewMatrix, world.matrix.columns[3]);
+    float viewDepth = -modelViewPos4.z;
+
+    // LOD errors are in mesh units; scale them into the world and measure
+    // from the nearest point of the bounding sphere.
+    const float worldScale =
+        std::max({simd_length(world.matrix.columns[0].xyz),
+                  simd_length(world.matrix.columns[1].xyz),
+                  simd_length(world.matrix.columns[2].xyz)});
+    const simd_float3 sphereCenter =
+        simd_mul(world.matrix,
+                 simd_make_float4(mesh.boundingSphere.center, 1.0f))
+            .xyz;
+    const float lodDistance =
+        std::max(simd_distance(sphereCenter, _camera.position) -
+                     mesh.boundingSphere.radius * worldScale,
+                 _camera.nearZ);
+
+    for (const auto &submesh : mesh.submeshes) {
+      if (testSubmeshes && !submesh.bounds.isEmpty() &&
+          !frustum.intersects(submesh.bounds.transformed(world.matrix))) {
+        _frameStats.submeshesCulled++;
+        continue;
+      }
+      if (submesh.materialIndex < mesh.materials.size()) {
+        // The coarsest level whose error stays under the pixel threshold.
+        uint32_t lod = submesh.lodCount() - 1;
+        while (lod > 0 &&
+               _camera.screenSpaceError(submesh.lods[lod - 1].error *
+                                            worldScale,
+                                        lodDistance,
+                                        (float)drawableSize.height) >
+                   kMaxScreenSpaceError) {
+          lod--;
+        }
+        if (submesh.primitiveType == MTL::PrimitiveTypeTriangle) {
+          _frameStats.lodTriangles += submesh.indexCountForLOD(lod) / 3;
+          _frameStats.fullDetailTriangles += submesh.indexCount / 3;
+        }
+        const Material &material = mesh.materials[submesh.materialIndex];
+        _renderQueue.push(RenderPass::Main, mesh, submesh, lod, material,
+                          pSlot->index, viewDepth, _camera.farZ);
+        useDrawResources(mesh, submesh, lod, material);
+        // Takes the submesh's projected diameter as the texture's size on
+        // screen; the requests are applied next frame.
+        requestStreamedTextures(
+            material,
+            _camera.screenSpaceError(2.0f * submesh.boundingSphere.radius *
+                                         worldScale,
+                                     lodDistance, (float)drawableSize.height));
+      }
     }
+  }
 
-    if (dc.material->bufferView.pBuffer) {
-      _pFragmentArgumentTable->setAddress(dc.material->bufferView.gpuAddress(),
-                                          fragmentBufferMaterial);
-    }
+  _renderQueue.sort();
+
+  FrameBindings bindings;
+  bindings.frameConstants = frameView.gpuAddress();
+  bindings.lights = lightView.gpuAddress();
+  bindings.instances = _pInstanceBuffer->getBuffer(frameIdx)->gpuAddress();
+  bindings.materials = _pMaterialTable->getBuffer(frameIdx)->gpuAddress();
+  bindings.materialStride = _pMaterialTable->stride();
+
+  // The forward pass draws into the view's attachments, which the graph
+  // imports. Passes that need their own targets create transient textures,
+  // which _pFrameGraphHeap places in memory shared between them.
+  _frameGraph.reset();
+  const auto color = _frameGraph.importTexture(
+      "Color", renderPassDescriptor->colorAttachments()->object(0)->texture());
+  const auto depth = _frameGraph.importTexture(
+      "Depth", renderPassDescriptor->depthAttachment()->texture());
+
+  std::vector<EncodeChunk> chunks;
+  const uint32_t forwardPass =
+      _frameGraph.addPass("Forward", [&](const FrameGraph &,
+                                         const FrameGraph::PassInfo &pass) {
+        // Chunks encode one render pass across several command buffers:
+        // every chunk but the first resumes it and every chunk but the last
+        // suspends it.
+        chunks = splitIntoChunks(_renderQueue.packets().size(),
+                                 (uint32_t)_encodeContexts.size(),
+                                 kMinDrawsPerChunk);
+
+        _jobSystem.parallelFor((uint32_t)chunks.size(), [&](uint32_t i) {
+          NS::UInteger options = MTL4::RenderEncoderOptionNone;
+          if (i > 0) {
+            options |= MTL4::RenderEncoderOptionResuming;
+          }
+          if (i + 1 < chunks.size()) {
+            options |= MTL4::RenderEncoderOptionSuspending;
+          }
+          // Only the first chunk starts the pass, so only it has to wait
+          // for aliased memory.
+          encodeChunk(*_encodeContexts[i], chunks[i], renderPassDescriptor,
+                      (MTL4::RenderEncoderOptions)options, frameIdx,
+                      bindings, i == 0 && pass.reusesAliasedMemory);
+        });
+      });
+  _frameGraph.write(forwardPass, color);
+  _frameGraph.write(forwardPass, depth);
+
+  [[maybe_unused]] const bool compiled =
+      _frameGraph.compile([this](const FrameGraphTextureDesc &desc) {
+        return _pFrameGraphHeap->sizeOf(desc);
+      });
+  assert(compiled);
+  residencyChanged |=
+      _pFrameGraphHeap->realize(_frameGraph, (uint32_t)frameIdx);
 
-    commandEncoder->drawIndexedPrimitives(
-        dc.submesh->primitiveType, dc.submesh->indexCount,
-        dc.submesh->indexType, dc.submesh->indexBuffer.gpuAddress(),
-        dc.submesh->indexBuffer.length);
+  _frameGraph.execute();
 
-    commandEncoder->popDebugGroup();
+  residencyChanged |= _pResidencyManager->endFrame();
+  residencyChanged |= addNewUploadChunks();
+  if (residencyChanged) {
+    _pResidencySet->commit();
   }
 
-  commandEncoder->endEncoding();
+  _frameStats.encoding = {};
+  std::vector<const MTL4::CommandBuffer *> commandBuffers;
+  for (const auto &chunk : chunks) {
+    const auto &context = *_encodeContexts[chunk.index];
+    _frameStats.encoding += context.encoder.counters();
+    commandBuffers.push_back(context.pCommandBuffer.get());
+  }
+  collectFrameStats();
 
-  _pCommandBuffer->endCommandBuffer();
+  if (auto ibl = _pScene->pLightingEnvironment) {
+    _pCommandQueue->wait(ibl->readyEvent.get(), 1);
+  }
 
   const auto drawable = pView->currentDrawable();
 
   _pCommandQueue->wait(drawable);
-  const MTL4::CommandBuffer *pCmdBufs[] = {_pCommandBuffer.get()};
-  _pCommandQueue->commit(pCmdBufs, 1);
+  _pCommandQueue->commit(commandBuffers.data(), commandBuffers.size());
   _pCommandQueue->signalDrawable(drawable);
   drawable->present();
 
@@ -10,11 +10,28 @@
 #include "BufferUtilites.hpp"
 #include "Camera.hpp"
 #include "FlyCamera.hpp"
+#include "FrameGraph.hpp"
+#include "GPUMemoryTracker.hpp"
 #include "Material.hpp"
+#include "MaterialTable.hpp"
 #include "Mesh.hpp"
 #include "Metal/Metal.hpp"
+#include "JobSystem.hpp"
+#include "MetalCommandBackend.hpp"
+#include "MetalFrameGraphHeap.hpp"
+#include "MetalGPUDevice.hpp"
+#include "MetalResidencyBackend.hpp"
+#include "MetalTextureStreaming.hpp"
+#include "ParallelEncoding.hpp"
 #include "MetalKit/MetalKit.hpp"
+#include "OcclusionBuffer.hpp"
+#include "RenderQueue.hpp"
+#include "ResidencyManager.hpp"
 #include "Scene.hpp"
+#include "ShaderStructures.h"
+#include "TextureStreamer.hpp"
+#include <memory>
+#include <unordered_map>
 
 class RendererInterface : public MTK::ViewDelegate {
 public:
@@ -34,29 +51,101 @@ public:
 
   virtual void configure(MTK::View *pView) override;
 
+  // What the last frame did, gathered once it has been encoded, for tools
+  // and overlays to show.
+  struct FrameStats {
+    RenderStateCounters encoding;
+    DynamicAABBTree::FrustumQueryStats culling;
+    uint32_t spatialProxies = 0;
+    uint32_t submeshesCulled = 0;
+    OcclusionBuffer::Stats occlusion;
+    // Triangles submitted at the chosen LODs, and at full detail.
+    unsigned long long lodTriangles = 0;
+    unsigned long long fullDetailTriangles = 0;
+    // Every upload allocator together.
+    FrameAllocator::Stats uploads;
+    FrameGraph::Stats frameGraph;
+    MaterialTable::Stats materials;
+    TextureStreamer::Stats streaming;
+    ResidencyManager::Stats residency;
+    GPUMemoryUsage gpuMemory;
+  };
+
+  const FrameStats &frameStats() const { return _frameStats; }
+
 private:
+  struct CachedPipeline {
+    NS::SharedPtr<MTL::RenderPipelineState> pipelineState;
+    uint32_t id = 0;
+  };
+
+  // Addresses every chunk binds before its first draw.
+  struct FrameBindings {
+    uint64_t frameConstants;
+    uint64_t lights;
+    uint64_t instances;
+    uint64_t materials;
+    size_t materialStride;
+  };
+
+  struct EncodeContext;
+
   void makeResources();
+  // Hands the scene's resources to _pResidencyManager and makes the
+  // renderer's own buffers and the lighting environment resident.
   void makeSceneResourcesResident(Scene *scene);
-  NS::SharedPtr<MTL::RenderPipelineState>
-  makePipelineState(Mesh *pMesh, Material *pMaterial);
+  // Marks what a queued draw reads as used this frame.
+  void useDrawResources(const Mesh &mesh, const Submesh &submesh,
+                        uint32_t lod, const Material &material);
+  // Adds upload chunks created since the last call to the residency set.
+  // Returns true if the set needs a commit.
+  bool addNewUploadChunks();
+  // Materials with the same specialization and vertex layout share one
+  // pipeline state and pipeline ID.
+  CachedPipeline makePipelineState(Mesh *pMesh, Material *pMaterial);
   void updateCamera(float deltaTime);
   void updateScene(float deltaTime);
+  // Flush instance constants and material entries. Return true if the
+  // residency set needs a commit.
+  bool updateInstances(uint64_t frameIdx);
+  bool updateMaterials(uint64_t frameIdx);
+  MaterialArguments makeMaterialArguments(const Material &material) const;
+  // Points material's streamed properties at their current textures.
+  void bindStreamedTextures(Material &material);
+  void requestStreamedTextures(const Material &material, float screenPixels);
+  // Applies last frame's mip requests and rewrites the materials whose
+  // textures changed. Returns true if the residency set needs a commit.
+  bool updateTextureStreaming(uint64_t completedFrame);
+  void onInstanceSlotDestroyed(Registry &registry, Entity entity);
+  // Takes a buffer that growing replaced out of the residency set just
+  // before it is released.
+  void removeReleasedBuffer(GPUBuffer *pBuffer);
+  void collectFrameStats();
+  void encodeChunk(EncodeContext &context, const EncodeChunk &chunk,
+                   MTL4::RenderPassDescriptor *pRenderPassDescriptor,
+                   MTL4::RenderEncoderOptions options, uint64_t frameIdx,
+                   const FrameBindings &bindings, bool waitForAliasedMemory);
 
 private:
   NS::SharedPtr<MTL::Device> _pDevice;
+  // Creates the buffers behind the upload utilities.
+  std::unique_ptr<MetalGPUDevice> _pGPUDevice;
   NS::SharedPtr<MTL4::CommandQueue> _pCommandQueue;
-  NS::SharedPtr<MTL4::CommandBuffer> _pCommandBuffer;
-  std::vector<NS::SharedPtr<MTL4::CommandAllocator>> _pCommandAllocators;
 
   NS::SharedPtr<MTL::Library> _pLibrary;
   NS::SharedPtr<MTL4::Compiler> _pCompiler;
 
   NS::SharedPtr<MTL::ResidencySet> _pResidencySet;
+  // Scene resources are resident only while recent frames draw with them;
+  // past kResidencyBudget, those unused for kMinIdleFrames are removed down
+  // to kResidencyLowWater.
+  static constexpr size_t kResidencyBudget = 512 * 1024 * 1024;
+  static constexpr size_t kResidencyLowWater = 448 * 1024 * 1024;
+  static constexpr uint32_t kMinIdleFrames = 120;
+  MetalResidencyBackend *_pResidencyBackend;
+  ResidencyManager *_pResidencyManager;
   NS::SharedPtr<MTL::SharedEvent> _pFrameCompletionEvent;
 
-  NS::SharedPtr<MTL4::ArgumentTable> _pVertexArgumentTable;
-  NS::SharedPtr<MTL4::ArgumentTable> _pFragmentArgumentTable;
-
   MTL::PixelFormat _colorPixelFormat;
   MTL::PixelFormat _depthStencilPixelFormat;
   uint32_t _rasterSampleCount;
@@ -64,13 +153,69 @@ private:
   NS::SharedPtr<MTL::DepthStencilState> _pDepthStencilStates[3];
 
   static constexpr uint64_t kMaxFramesInFlight = 3;
+  // Compact vertices take 20-24 bytes instead of 56-64.
+  static constexpr VertexFormat kVertexFormat = VertexFormat::Compact;
   std::shared_ptr<Scene> _pScene;
   PerspectiveCamera _camera;
   FlyCamera _flyCamera;
-  RingBuffer *_pConstantBuffers[kMaxFramesInFlight];
-  RingBuffer *_pMaterialsBuffer;
+  // Per-frame uploads grow in chunks of this size.
+  static constexpr size_t kUploadChunkSize = 64 * 1024;
+  FrameAllocator *_pConstantAllocator;
+  MaterialTable *_pMaterialTable;
+  uint32_t _residentMaterialTableGeneration = 0;
+  FrameSlotBuffer<InstanceConstants> *_pInstanceBuffer;
+  uint32_t _residentInstanceBufferGeneration = 0;
+  bool _releasedResidentBuffers = false;
   uint64_t _frameIndex = 0;
 
+  FrameGraph _frameGraph;
+  MetalFrameGraphHeap *_pFrameGraphHeap;
+
+  // Material textures keep only the mips their on-screen size needs,
+  // within kTextureBudget, and stream in at most kMaxTextureUploadBytes a
+  // frame.
+  static constexpr bool kStreamTextures = true;
+  static constexpr size_t kTextureBudget = 256 * 1024 * 1024;
+  static constexpr size_t kMaxTextureUploadBytes = 16 * 1024 * 1024;
+  MetalTextureStreamingBackend *_pTextureStreamingBackend;
+  TextureStreamer *_pTextureStreamer;
+  // The materials sampling each streamed texture.
+  std::vector<std::vector<Material *>> _streamedTextureUsers;
+
+  RenderQueue _renderQueue;
+  std::vector<Entity> _visibleEntities;
+
+  // Submeshes draw their coarsest LOD whose error covers at most this many
+  // pixels.
+  static constexpr float kMaxScreenSpaceError = 1.0f;
+
+  // The largest on-screen occluder meshes are rasterized each frame; an
+  // occluder's bounding sphere must span this much of the view's height.
+  static constexpr uint32_t kMaxOccluders = 16;
+  static constexpr float kMinOccluderScreenSize = 0.1f;
+  OcclusionBuffer _occlusionBuffer;
+  std::vector<std::pair<float, Entity>> _occluders;
+
+  // Everything one thread needs to encode a chunk of the draw list. Chunk i
+  // always uses context i; its command buffer is committed in chunk order.
+  struct EncodeContext {
+    NS::SharedPtr<MTL4::CommandBuffer> pCommandBuffer;
+    NS::SharedPtr<MTL4::CommandAllocator> pCommandAllocators[kMaxFramesInFlight];
+    NS::SharedPtr<MTL4::ArgumentTable> pVertexArgumentTable;
+    NS::SharedPtr<MTL4::ArgumentTable> pFragmentArgumentTable;
+    FrameAllocator *pUploadAllocator;
+    MetalCommandBackend backend;
+    StateTrackingEncoder encoder{&backend};
+  };
+
+  static constexpr uint32_t kMaxEncodeChunks = 8;
+  static constexpr size_t kMinDrawsPerChunk = 128;
+  JobSystem _jobSystem;
+  std::vector<std::unique_ptr<EncodeContext>> _encodeContexts;
+  FrameStats _frameStats;
+
+  std::unordered_map<NameID, CachedPipeline> _pipelineCache;
+
   bool _hasPreparedResources = false;
   bool _iblReady = false;
   double _lastRenderTime = 0.0;
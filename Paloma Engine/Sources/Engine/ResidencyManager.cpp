@@ -0,0 +1,121 @@
+//
+//  ResidencyManager.cpp
+//  Paloma Engine
+//
+
+#include "ResidencyManager.hpp"
+#include <algorithm>
+
+ResidencyManager::ResidencyManager(ResidencyBackend *pBackend,
+                                   size_t budgetBytes, size_t lowWaterBytes,
+                                   uint32_t minIdleFrames)
+    : _pBackend(pBackend), _lowWaterBytes(std::min(lowWaterBytes, budgetBytes)),
+      _minIdleFrames(minIdleFrames) {
+  _stats.budgetBytes = budgetBytes;
+}
+
+void ResidencyManager::track(const void *pAllocation, size_t bytes) {
+  if (!pAllocation || _indices.contains(pAllocation)) {
+    return;
+  }
+  _indices[pAllocation] = (uint32_t)_allocations.size();
+  _allocations.push_back({pAllocation, bytes, 0, false});
+  _stats.trackedBytes += bytes;
+  _stats.trackedAllocations++;
+}
+
+void ResidencyManager::untrack(const void *pAllocation) {
+  auto it = _indices.find(pAllocation);
+  if (it == _indices.end()) {
+    return;
+  }
+  const uint32_t index = it->second;
+  const Allocation &allocation = _allocations[index];
+  if (allocation.resident) {
+    _pBackend->remove(pAllocation);
+    _stats.residentBytes -= allocation.bytes;
+    _stats.residentAllocations--;
+    _changed = true;
+  }
+  _stats.trackedBytes -= allocation.bytes;
+  _stats.trackedAllocations--;
+
+  // Swap with the last allocation to keep the array dense.
+  _indices.erase(it);
+  if (index + 1 != _allocations.size()) {
+    _allocations[index] = _allocations.back();
+    _indices[_allocations[index].pAllocation] = index;
+  }
+  _allocations.pop_back();
+}
+
+void ResidencyManager::beginFrame(uint64_t frameIndex,
+                                  uint64_t completedFrame) {
+  _frameIndex = frameIndex;
+  _completedFrame = completedFrame;
+  _stats.madeResident = 0;
+  _stats.evicted = 0;
+}
+
+void ResidencyManager::use(const void *pAllocation) {
+  auto it = _indices.find(pAllocation);
+  if (it == _indices.end()) {
+    return;
+  }
+  Allocation &allocation = _allocations[it->second];
+  allocation.lastUsed = _frameIndex;
+  if (!allocation.resident) {
+    _pBackend->add(pAllocation);
+    allocation.resident = true;
+    _stats.residentBytes += allocation.bytes;
+    _stats.residentAllocations++;
+    _stats.madeResident++;
+    _changed = true;
+  }
+}
+
+bool ResidencyManager::endFrame() {
+  if (_stats.residentBytes > _stats.budgetBytes) {
+    // Least recently used first, among allocations that have been idle long
+    // enough and that no frame in flight uses.
+    const uint64_t idleBefore =
+        _frameIndex > _minIdleFrames ? _frameIndex - _minIdleFrames : 0;
+    const uint64_t usedBy = std::min(idleBefore, _completedFrame + 1);
+    _candidates.clear();
+    for (uint32_t i = 0; i < _allocations.size(); ++i) {
+      if (_allocations[i].resident && _allocations[i].lastUsed < usedBy) {
+        _candidates.push_back(i);
+      }
+    }
+    std::sort(_candidates.begin(), _candidates.end(),
+              [&](uint32_t a, uint32_t b) {
+                return _allocations[a].lastUsed < _allocations[b].lastUsed;
+              });
+    for (uint32_t i : _candidates) {
+      if (_stats.residentBytes <= _lowWaterBytes) {
+        break;
+      }
+      Allocation &allocation = _allocations[i];
+      _pBackend->remove(allocation.pAllocation);
+      allocation.resident = false;
+      _stats.residentBytes -= allocation.bytes;
+      _stats.residentAllocations--;
+      _stats.evicted++;
+      _changed = true;
+    }
+  }
+
+  const bool changed = _changed;
+  _changed = false;
+  return changed;
+}
+
+void ResidencyManager::setBudget(size_t budgetBytes, size_t lowWaterBytes) {
+  _stats.budgetBytes = budgetBytes;
+  _lowWaterBytes = std::min(lowWaterBytes, budgetBytes);
+}
+
+bool ResidencyManager::isResident(const void *pAllocation) const {
+  auto it = _indices.find(pAllocation);
+  return it != _indices.end() && _allocations[it->second].resident;
+}
@@ -0,0 +1,102 @@
+//
+//  ResidencyManager.hpp
+//  Paloma Engine
+//
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// Adds allocations to and removes them from whatever keeps them resident.
+// Allocations are opaque pointers.
+class ResidencyBackend {
+public:
+  virtual ~ResidencyBackend() = default;
+
+  virtual void add(const void *pAllocation) = 0;
+  virtual void remove(const void *pAllocation) = 0;
+};
+
+// Keeps the allocations the last frames drew with resident, within a byte
+// budget. Tracked allocations become resident when a frame first uses
+// them. Once the resident total goes over the budget, the least recently
+// used allocations are removed until it is down to the low-water mark,
+// so a scene hovering around the budget doesn't evict every frame.
+// Allocations used within the last minIdleFrames frames, or by a frame the
+// GPU hasn't finished, are never removed; the manager goes over budget
+// instead.
+class ResidencyManager {
+public:
+  struct Stats {
+    size_t residentBytes = 0;
+    size_t trackedBytes = 0;
+    size_t budgetBytes = 0;
+    uint32_t residentAllocations = 0;
+    uint32_t trackedAllocations = 0;
+    // During the last frame.
+    uint32_t madeResident = 0;
+    uint32_t evicted = 0;
+  };
+
+  ResidencyManager(ResidencyBackend *pBackend, size_t budgetBytes,
+                   size_t lowWaterBytes, uint32_t minIdleFrames);
+
+  // Starts managing pAllocation, which isn't resident until used. Tracking
+  // an allocation twice does nothing.
+  void track(const void *pAllocation, size_t bytes);
+  // Stops managing pAllocation and removes it if resident. The caller
+  // keeps it alive until the frames that used it have completed.
+  void untrack(const void *pAllocation);
+
+  void beginFrame(uint64_t frameIndex, uint64_t completedFrame);
+  // Marks pAllocation as used by this frame, making it resident. Untracked
+  // allocations are ignored.
+  void use(const void *pAllocation);
+  // Evicts if over budget. Returns true if residency changed during the
+  // frame and needs a commit before the frame's work is submitted.
+  bool endFrame();
+
+  void setBudget(size_t budgetBytes, size_t lowWaterBytes);
+
+  bool isResident(const void *pAllocation) const;
+  const Stats &stats() const { return _stats; }
+
+private:
+  struct Allocation {
+    const void *pAllocation;
+    size_t bytes;
+    uint64_t lastUsed;
+    bool resident;
+  };
+
+  ResidencyBackend *_pBackend;
+  size_t _lowWaterBytes;
+  uint32_t _minIdleFrames;
+  std::vector<Allocation> _allocations;
+  std::unordered_map<const void *, uint32_t> _indices;
+  std::vector<uint32_t> _candidates;
+  uint64_t _frameIndex = 0;
+  uint64_t _completedFrame = 0;
+  bool _changed = false;
+  Stats _stats;
+};
+
+// Keeps every change it receives, for checking the manager without a GPU.
+class RecordingResidencyBackend : public ResidencyBackend {
+public:
+  struct Change {
+    const void *pAllocation;
+    bool added;
+  };
+
+  std::vector<Change> changes;
+
+  void add(const void *pAllocation) override {
+    changes.push_back({pAllocation, true});
+  }
+  void remove(const void *pAllocation) override {
+    changes.push_back({pAllocation, false});
+  }
+};
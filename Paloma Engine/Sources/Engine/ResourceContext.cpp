@@ -1,8 +1,21 @@
 #include "ResourceContext.hpp"
 #include "AAPLMathUtilities.h"
+#include "GPUMemoryTracker.hpp"
+#include "MeshOptimizer.hpp"
+#include "MeshSimplifier.hpp"
+#include "ModelIOExtentions.hpp"
+#include "TextureStreamer.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
 #include <iostream>
 
-ResourceContext::ResourceContext(MTL::Device *pDevice) : _pDevice(pDevice) {
+ResourceContext::ResourceContext(MTL::Device *pDevice, std::string asset,
+                                 VertexFormat vertexFormat,
+                                 bool streamTextures)
+    : _pDevice(pDevice), _asset(std::move(asset)), _vertexFormat(vertexFormat),
+      _streamTextures(streamTextures) {
   _pTextureLoader = NS::TransferPtr(MTK::TextureLoader::alloc()->init(pDevice));
 
   auto keySRGB = MTK::TextureLoaderOptionSRGB;
@@ -54,6 +67,8 @@ NS::SharedPtr<MTL::Texture> ResourceContext::convert(MDL::Texture *mdlTexture,
   }
 
   NS::SharedPtr<MTL::Texture> texture = NS::TransferPtr(rawTexture);
+  // A view keeps the loaded texture alive, so it's accounted at its size.
+  const size_t bytes = texture->allocatedSize();
 
   if (semantic == TextureSemantic::Color &&
       texture->pixelFormat() != MTL::PixelFormatRGBA8Unorm_sRGB) {
@@ -66,10 +81,49 @@ NS::SharedPtr<MTL::Texture> ResourceContext::convert(MDL::Texture *mdlTexture,
 
   resources.push_back(texture);
   _textureCache[mdlTexture] = texture;
+  GPUMemoryTracker::shared().record(texture.get(), bytes,
+                                    GPUMemoryCategory::Textures, _asset);
 
   return texture;
 }
 
+uint32_t ResourceContext::streamedTexture(MDL::Texture *mdlTexture,
+                                         TextureSemantic semantic) {
+  if (!_streamTextures) {
+    return kNotStreamed;
+  }
+  auto it = _streamedTextureCache.find(mdlTexture);
+  if (it != _streamedTextureCache.end()) {
+    return it->second;
+  }
+
+  // The streamer builds 8-bit RGBA mips itself; anything else, and textures
+  // small enough to stay whole anyway, go through the texture loader.
+  const vector_int2 size = mdlTexture->dimensions();
+  const NS::UInteger channels = mdlTexture->channelCount();
+  if (mdlTexture->channelEncoding() != MDL::TextureChannelEncodingUInt8 ||
+      (channels != 3 && channels != 4) || mdlTexture->isCube() ||
+      (uint32_t)std::max(size.x, size.y) <=
+          TextureStreamer::kMinResidentSize) {
+    return kNotStreamed;
+  }
+
+  const uint32_t id = (uint32_t)streamedTextures.size();
+  streamedTextures.push_back(
+      {NS::RetainPtr(mdlTexture), semantic == TextureSemantic::Color, _asset});
+  _streamedTextureCache[mdlTexture] = id;
+  return id;
+}
+
+template <typename Property>
+void ResourceContext::convert(MDL::Texture *mdlTexture,
+                              TextureSemantic semantic, Property &property) {
+  property.streamingID = streamedTexture(mdlTexture, semantic);
+  if (property.streamingID == kNotStreamed) {
+    property.pTexture = convert(mdlTexture, semantic);
+  }
+}
+
 Material ResourceContext::convert(MDL::Material *mdlMaterial) {
   auto it = _materialCache.find(mdlMaterial);
   if (it != _materialCache.end()) {
@@ -93,7 +147,7 @@ Material ResourceContext::convert(MDL::Material *mdlMaterial) {
     if (prop->type() == MDL::MaterialPropertyTypeTexture) {
       if (auto sampler = prop->textureSamplerValue()) {
         if (auto tex = sampler->texture()) {
-          material.baseColor.pTexture = convert(tex, TextureSemantic::Color);
+          convert(tex, TextureSemantic::Color, material.baseColor);
         }
       }
       material.baseColor.factor = {1, 1, 1};
@@ -107,7 +161,7 @@ Material ResourceContext::convert(MDL::Material *mdlMaterial) {
     if (prop->type() == MDL::MaterialPropertyTypeTexture) {
       if (auto sampler = prop->textureSamplerValue()) {
         if (auto tex = sampler->texture()) {
-          material.roughness.pTexture = convert(tex, TextureSemantic::Raw);
+          convert(tex, TextureSemantic::Raw, material.roughness);
         }
       }
     } else if (prop->type() == MDL::MaterialPropertyTypeFloat) {
@@ -119,7 +173,7 @@ Material ResourceContext::convert(MDL::Material *mdlMaterial) {
     if (prop->type() == MDL::MaterialPropertyTypeTexture) {
       if (auto sampler = prop->textureSamplerValue()) {
         if (auto tex = sampler->texture()) {
-          material.metalness.pTexture = convert(tex, TextureSemantic::Raw);
+          convert(tex, TextureSemantic::Raw, material.metalness);
         }
       }
       material.metalness.factor = 1.0f;
@@ -132,7 +186,7 @@ Material ResourceContext::convert(MDL::Material *mdlMaterial) {
     if (prop->type() == MDL::MaterialPropertyTypeTexture) {
       if (auto sampler = prop->textureSamplerValue()) {
         if (auto tex = sampler->texture()) {
-          material.normal.pTexture = convert(tex, TextureSemantic::Raw);
+          convert(tex, TextureSemantic::Raw, material.normal);
         }
       }
     }
@@ -142,7 +196,7 @@ Material ResourceContext::convert(MDL::Material *mdlMaterial) {
     if (prop->type() == MDL::MaterialPropertyTypeTexture) {
       if (auto sampler = prop->textureSamplerValue()) {
         if (auto tex = sampler->texture()) {
-          material.emissive.pTexture = convert(tex, TextureSemantic::Color);
+          convert(tex, TextureSemantic::Color, material.emissive);
         }
       }
       material.emissive.factor = {1, 1, 1};
@@ -155,7 +209,7 @@ Material ResourceContext::convert(MDL::Material *mdlMaterial) {
     if (prop->type() == MDL::MaterialPropertyTypeTexture) {
       if (auto sampler = prop->textureSamplerValue()) {
         if (auto tex = sampler->texture()) {
-          material.occlusion.pTexture = convert(tex, TextureSemantic::Raw);
+          convert(tex, TextureSemantic::Raw, material.occlusion);
         }
       }
     }
@@ -170,7 +224,7 @@ Material ResourceContext::convert(MDL::Material *mdlMaterial) {
     if (prop->type() == MDL::MaterialPropertyTypeTexture) {
       if (auto sampler = prop->textureSamplerValue()) {
         if (auto tex = sampler->texture()) {
-          material.opacity.pTexture = convert(tex, TextureSemantic::Raw);
+          convert(tex, TextureSemantic::Raw, material.opacity);
         }
       }
       material.alphaMode = AlphaMode::Blend;
@@ -181,10 +235,281 @@ Material ResourceContext::convert(MDL::Material *mdlMaterial) {
   return material;
 }
 
+static simd_float3 readPosition(const uint8_t *positions, NS::UInteger index,
+                                NS::UInteger stride) {
+  const auto *p = (const float *)(positions + index * stride);
+  return simd_make_float3(p[0], p[1], p[2]);
+}
+
+// Box and sphere around the positions picked by indices, or around all
+// positions when indices is null. The sphere is centred on the box.
+static void computeBounds(const uint8_t *positions, NS::UInteger stride,
+                          NS::UInteger vertexCount, const uint32_t *indices,
+                          NS::UInteger indexCount, AABB &bounds,
+                          BoundingSphere &sphere) {
+  const NS::UInteger count = indices ? indexCount : vertexCount;
+  auto vertexAt = [&](NS::UInteger i) -> NS::UInteger {
+    return indices ? indices[i] : i;
+  };
+
+  bounds = {};
+  for (NS::UInteger i = 0; i < count; ++i) {
+    if (vertexAt(i) < vertexCount) {
+      bounds.expand(readPosition(positions, vertexAt(i), stride));
+    }
+  }
+  if (bounds.isEmpty()) {
+    sphere = {};
+    return;
+  }
+
+  const simd_float3 center = bounds.center();
+  float radiusSquared = 0.0f;
+  for (NS::UInteger i = 0; i < count; ++i) {
+    if (vertexAt(i) < vertexCount) {
+      simd_float3 p = readPosition(positions, vertexAt(i), stride);
+      radiusSquared = std::max(radiusSquared, simd_distance_squared(p, center));
+    }
+  }
+  sphere = {center, std::sqrt(radiusSquared)};
+}
+
+void ResourceContext::optimizeVertexOrder(MDL::Mesh *mdlMesh) {
+  const NS::UInteger vertexCount = mdlMesh->vertexCount();
+  MDL::VertexAttributeData *pPositions =
+      mdlMesh->vertexAttributeDataForAttributeNamed(
+          MDL::VertexAttributePosition, MDL::VertexFormatFloat3);
+  NS::Array *mdlSubmeshes = mdlMesh->submeshes();
+  if (!pPositions || vertexCount == 0 || !mdlSubmeshes) {
+    return;
+  }
+
+  std::vector<simd_float3> positions(vertexCount);
+  for (NS::UInteger v = 0; v < vertexCount; ++v) {
+    positions[v] = readPosition((const uint8_t *)pPositions->dataStart(), v,
+                                pPositions->stride());
+  }
+
+  // Every submesh's indices, widened to 32 bits and concatenated.
+  std::vector<uint32_t> indices;
+  std::vector<NS::UInteger> firstIndex;
+  for (NS::UInteger i = 0; i < mdlSubmeshes->count(); ++i) {
+    MDL::Submesh *mdlSubmesh = mdlSubmeshes->object<MDL::Submesh>(i);
+    // Remapped indices may be as high as the mesh's last vertex.
+    const NS::UInteger indexBits = mdlSubmesh->indexType();
+    if (indexBits < 32 && vertexCount > (1ull << indexBits)) {
+      return;
+    }
+    MDL::MeshBuffer *pIndices =
+        mdlSubmesh->indexBufferAsIndexType(MDL::IndexBitDepthUInt32);
+    MDL::MeshBufferMap *pMap = pIndices ? mapMeshBuffer(pIndices) : nullptr;
+    if (!pMap) {
+      return;
+    }
+    const auto *submeshIndices = (const uint32_t *)pMap->bytes();
+    firstIndex.push_back(indices.size());
+    indices.insert(indices.end(), submeshIndices,
+                   submeshIndices + mdlSubmesh->indexCount());
+  }
+  firstIndex.push_back(indices.size());
+  if (std::any_of(indices.begin(), indices.end(),
+                  [&](uint32_t index) { return index >= vertexCount; })) {
+    return;
+  }
+
+  NS::Array *mdlLayouts = mdlMesh->vertexDescriptor()->layouts();
+  auto layoutStride = [&](NS::UInteger buffer) -> NS::UInteger {
+    return buffer < mdlLayouts->count()
+               ? mdlLayouts->object<MDL::VertexBufferLayout>(buffer)->stride()
+               : 0;
+  };
+
+  for (NS::UInteger i = 0; i < mdlSubmeshes->count(); ++i) {
+    MDL::Submesh *mdlSubmesh = mdlSubmeshes->object<MDL::Submesh>(i);
+    if (mdlSubmesh->geometryType() != MDL::GeometryTypeTriangles) {
+      continue;
+    }
+    uint32_t *submeshIndices = indices.data() + firstIndex[i];
+    const NS::UInteger indexCount = firstIndex[i + 1] - firstIndex[i];
+    optimizeVertexCache(submeshIndices, indexCount, vertexCount);
+    optimizeOverdraw(submeshIndices, indexCount, positions.data(),
+                     vertexCount);
+  }
+
+  // Moves every vertex buffer into first-use order.
+  const std::vector<uint32_t> remap =
+      vertexFetchRemap(indices.data(), indices.size(), vertexCount);
+  NS::Array *mdlVertexBuffers = mdlMesh->vertexBuffers();
+  std::vector<uint8_t> scratch;
+  for (NS::UInteger b = 0; b < mdlVertexBuffers->count(); ++b) {
+    auto *pBuffer = mdlVertexBuffers->object<MDL::MeshBuffer>(b);
+    const NS::UInteger stride = layoutStride(b);
+    MDL::MeshBufferMap *pMap = pBuffer ? mapMeshBuffer(pBuffer) : nullptr;
+    if (!pMap || stride == 0 || pBuffer->length() < vertexCount * stride) {
+      continue;
+    }
+    auto *bytes = (uint8_t *)pMap->bytes();
+    scratch.assign(bytes, bytes + vertexCount * stride);
+    for (NS::UInteger v = 0; v < vertexCount; ++v) {
+      memcpy(bytes + remap[v] * stride, scratch.data() + v * stride, stride);
+    }
+  }
+  for (uint32_t &index : indices) {
+    index = remap[index];
+  }
+
+  // Writes the indices back at each submesh's own width.
+  for (NS::UInteger i = 0; i < mdlSubmeshes->count(); ++i) {
+    MDL::Submesh *mdlSubmesh = mdlSubmeshes->object<MDL::Submesh>(i);
+    MDL::MeshBufferMap *pMap = mapMeshBuffer(mdlSubmesh->indexBuffer());
+    void *bytes = pMap ? pMap->bytes() : nullptr;
+    for (NS::UInteger k = firstIndex[i]; bytes && k < firstIndex[i + 1]; ++k) {
+      const NS::UInteger j = k - firstIndex[i];
+      switch (mdlSubmesh->indexType()) {
+      case MDL::IndexBitDepthUInt8:
+        ((uint8_t *)bytes)[j] = (uint8_t)indices[k];
+        break;
+      case MDL::IndexBitDepthUInt16:
+        ((uint16_t *)bytes)[j] = (uint16_t)indices[k];
+        break;
+      default:
+        ((uint32_t *)bytes)[j] = indices[k];
+        break;
+      }
+    }
+  }
+}
+
+bool ResourceContext::compactVertices(
+    std::vector<MetalBufferView> &vertexBuffers, NS::UInteger vertexCount,
+    NS::SharedPtr<MDL::VertexDescriptor> &vertexDescriptor,
+    MetalBufferView &meshConstants) {
+  NS::Array *layouts = vertexDescriptor->layouts();
+  const NS::UInteger stride =
+      layouts->count() > 0
+          ? layouts->object<MDL::VertexBufferLayout>(0)->stride()
+          : 0;
+  const bool hasTexCoords1 = stride == StandardVertexLayout::stride(true);
+  if (vertexBuffers.size() != 1 || vertexCount == 0 ||
+      stride != StandardVertexLayout::stride(hasTexCoords1) ||
+      vertexBuffers[0].length < vertexCount * stride) {
+    return false;
+  }
+
+  const auto *source = (const uint8_t *)vertexBuffers[0].pBuffer->contents() +
+                       vertexBuffers[0].offset;
+  AABB bounds;
+  for (NS::UInteger v = 0; v < vertexCount; ++v) {
+    bounds.expand(readPosition(source, v, stride));
+  }
+  const MeshConstants constants = makeMeshConstants(bounds);
+
+  const NS::UInteger compactStride =
+      CompactVertexLayout::stride(hasTexCoords1);
+  MTL::Buffer *pBuffer = _pDevice->newBuffer(vertexCount * compactStride,
+                                             MTL::ResourceStorageModeShared);
+  pBuffer->setLabel(
+      NS::String::string("Compact Vertex Attributes", NS::UTF8StringEncoding));
+  auto *destination = (uint8_t *)pBuffer->contents();
+  for (NS::UInteger v = 0; v < vertexCount; ++v) {
+    writeCompactVertex(
+        readStandardVertex(source + v * stride, hasTexCoords1), constants,
+        hasTexCoords1, destination + v * compactStride);
+  }
+  vertexBuffers = {{pBuffer, 0, vertexCount * compactStride}};
+  resources.push_back(NS::TransferPtr(pBuffer));
+  GPUMemoryTracker::shared().record(pBuffer, pBuffer->allocatedSize(),
+                                    GPUMemoryCategory::Vertices, _asset);
+
+  MTL::Buffer *pConstants = _pDevice->newBuffer(
+      &constants, sizeof(constants), MTL::ResourceStorageModeShared);
+  pConstants->setLabel(
+      NS::String::string("Mesh Constants", NS::UTF8StringEncoding));
+  meshConstants = {pConstants, 0, sizeof(constants)};
+  resources.push_back(NS::TransferPtr(pConstants));
+  GPUMemoryTracker::shared().record(pConstants, pConstants->allocatedSize(),
+                                    GPUMemoryCategory::Vertices, _asset);
+
+  // Same attribute names as the standard layout, so pipelines still see
+  // which attributes exist.
+  auto compact = NS::TransferPtr(MDL::VertexDescriptor::alloc()->init());
+  auto setAttribute = [&](NS::UInteger index, NS::String *name,
+                          MDL::VertexFormat format, NS::UInteger offset) {
+    auto attr = compact->attributes()->object<MDL::VertexAttribute>(index);
+    attr->setName(name);
+    attr->setFormat(format);
+    attr->setOffset(offset);
+    attr->setBufferIndex(0);
+  };
+  setAttribute(0, MDL::VertexAttributePosition,
+               MDL::VertexFormatShort4Normalized,
+               CompactVertexLayout::kPositionOffset);
+  setAttribute(1, MDL::VertexAttributeNormal,
+               MDL::VertexFormatShort2Normalized,
+               CompactVertexLayout::kNormalOffset);
+  setAttribute(2, MDL::VertexAttributeTangent,
+               MDL::VertexFormatShort2Normalized,
+               CompactVertexLayout::kTangentOffset);
+  setAttribute(3, MDL::VertexAttributeTextureCoordinate,
+               MDL::VertexFormatHalf2, CompactVertexLayout::kTexCoords0Offset);
+  if (hasTexCoords1) {
+    setAttribute(4, MDL::VertexAttributeTextureCoordinate,
+                 MDL::VertexFormatHalf2,
+                 CompactVertexLayout::kTexCoords1Offset);
+  }
+  compact->layouts()->object<MDL::VertexBufferLayout>(0)->setStride(
+      compactStride);
+  vertexDescriptor = compact;
+  return true;
+}
+
+void ResourceContext::buildLODs(Submesh &submesh,
+                                const std::vector<simd_float3> &positions,
+                                const uint32_t *indices,
+                                NS::UInteger indexCount) {
+  if (submesh.primitiveType != MTL::PrimitiveTypeTriangle ||
+      indexCount < kMinLODTriangles * 3) {
+    return;
+  }
+
+  NS::UInteger previousCount = indexCount;
+  for (uint32_t level = 1; level <= kMaxLODs; ++level) {
+    const NS::UInteger target = (indexCount >> level) / 3 * 3;
+    SimplifiedMesh lod = simplifyMesh(positions.data(), positions.size(),
+                                      indices, indexCount, target);
+    // Locked seams and borders stop the reduction; skip levels that barely
+    // save anything over the previous one.
+    if (lod.indices.empty() || lod.indices.size() > previousCount * 3 / 4) {
+      break;
+    }
+    optimizeVertexCache(lod.indices.data(), lod.indices.size(),
+                        positions.size());
+
+    const NS::UInteger length = lod.indices.size() * sizeof(uint32_t);
+    MTL::Buffer *pBuffer = _pDevice->newBuffer(
+        lod.indices.data(), length, MTL::ResourceStorageModeShared);
+    pBuffer->setLabel(
+        NS::String::string("LOD Indices", NS::UTF8StringEncoding));
+    resources.push_back(NS::TransferPtr(pBuffer));
+    GPUMemoryTracker::shared().record(pBuffer, pBuffer->allocatedSize(),
+                                      GPUMemoryCategory::Indices, _asset);
+
+    submesh.lods.push_back(
+        {{pBuffer, 0, length}, lod.indices.size(), lod.error});
+    previousCount = lod.indices.size();
+  }
+}
+
 std::shared_ptr<Mesh> ResourceContext::convert(MDL::Mesh *mdlMesh) {
+  optimizeVertexOrder(mdlMesh);
+
   NS::Error *pError = nullptr;
 
-  MTK::Mesh *mtkMesh = MTK::Mesh::alloc()->init(mdlMesh, _pDevice, &pError);
+  // Released on return: the index buffers and vertex descriptor are retained
+  // on their own, and in the compact format the float vertex buffer is
+  // replaced and goes with it.
+  auto mtkMesh =
+      NS::TransferPtr(MTK::Mesh::alloc()->init(mdlMesh, _pDevice, &pError));
 
   if (!mtkMesh) {
     std::cerr << "Failed to create MTKMesh: "
@@ -195,7 +520,7 @@ std::shared_ptr<Mesh> ResourceContext::convert(MDL::Mesh *mdlMesh) {
     return nullptr;
   }
 
-  std::vector<BufferView> vertexBuffers;
+  std::vector<MetalBufferView> vertexBuffers;
   NS::Array *mtkBuffers = mtkMesh->vertexBuffers();
 
   for (NS::UInteger i = 0; i < mtkBuffers->count(); ++i) {
@@ -206,7 +531,6 @@ std::shared_ptr<Mesh> ResourceContext::convert(MDL::Mesh *mdlMesh) {
         NS::String::string("Vertex Attributes", NS::UTF8StringEncoding);
     mtlBuffer->setLabel(label);
 
-    resources.push_back(NS::RetainPtr(mtlBuffer));
     vertexBuffers.push_back(
         {mtlBuffer, mtkBuffer->offset(), mtkBuffer->length()});
   }
@@ -222,6 +546,22 @@ std::shared_ptr<Mesh> ResourceContext::convert(MDL::Mesh *mdlMesh) {
   NS::Array *mtkSubmeshes = mtkMesh->submeshes();
   NS::Array *mdlSubmeshes = mdlMesh->submeshes();
 
+  // Bounds for culling, read back from the ModelIO copy of the vertices.
+  MDL::VertexAttributeData *pPositions =
+      mdlMesh->vertexAttributeDataForAttributeNamed(
+          MDL::VertexAttributePosition, MDL::VertexFormatFloat3);
+  const auto *positions =
+      pPositions ? (const uint8_t *)pPositions->dataStart() : nullptr;
+  const NS::UInteger stride = pPositions ? pPositions->stride() : 0;
+  const NS::UInteger vertexCount = positions ? mdlMesh->vertexCount() : 0;
+
+  std::vector<simd_float3> vertexPositions(vertexCount);
+  for (NS::UInteger v = 0; v < vertexCount; ++v) {
+    vertexPositions[v] = readPosition(positions, v, stride);
+  }
+
+  std::vector<uint32_t> occluderIndices;
+  bool canOcclude = vertexCount > 0;
 
   for (NS::UInteger i = 0; i < mtkSubmeshes->count(); ++i) {
     MTK::Submesh *mtkSubmesh = mtkSubmeshes->object<MTK::Submesh>(i);
@@ -229,6 +569,8 @@ std::shared_ptr<Mesh> ResourceContext::convert(MDL::Mesh *mdlMesh) {
     MTL::Buffer *mtlIdxBuf = mtkIdxBuffer->buffer();
 
     resources.push_back(NS::RetainPtr(mtlIdxBuf));
+    GPUMemoryTracker::shared().record(mtlIdxBuf, mtlIdxBuf->allocatedSize(),
+                                      GPUMemoryCategory::Indices, _asset);
 
     if (i < mdlSubmeshes->count()) {
       MDL::Submesh *mdlOriginal = mdlSubmeshes->object<MDL::Submesh>(i);
@@ -241,18 +583,76 @@ std::shared_ptr<Mesh> ResourceContext::convert(MDL::Mesh *mdlMesh) {
       materials.push_back(defaultMaterial);
     }
 
-    submeshes.push_back(
-        Submesh(mtkSubmesh->primitiveType(),
-                {mtlIdxBuf, mtkIdxBuffer->offset(), mtkIdxBuffer->length()},
-                mtkSubmesh->indexType(), mtkSubmesh->indexCount(), (int)i));
+    Submesh submesh(mtkSubmesh->primitiveType(),
+                    {mtlIdxBuf, mtkIdxBuffer->offset(), mtkIdxBuffer->length()},
+                    mtkSubmesh->indexType(), mtkSubmesh->indexCount(), (int)i);
+    if (positions && i < mdlSubmeshes->count()) {
+      MDL::Submesh *mdlSubmesh = mdlSubmeshes->object<MDL::Submesh>(i);
+      MDL::MeshBuffer *pIndices =
+          mdlSubmesh->indexBufferAsIndexType(MDL::IndexBitDepthUInt32);
+      if (MDL::MeshBufferMap *pMap =
+              pIndices ? mapMeshBuffer(pIndices) : nullptr) {
+        const auto *indices = (const uint32_t *)pMap->bytes();
+        const NS::UInteger indexCount = mdlSubmesh->indexCount();
+        computeBounds(positions, stride, vertexCount, indices, indexCount,
+                      submesh.bounds, submesh.boundingSphere);
+        buildLODs(submesh, vertexPositions, indices, indexCount);
+
+        // Masked and blended surfaces have holes, so only an opaque mesh
+        // may hide what is behind it.
+        if (submesh.primitiveType == MTL::PrimitiveTypeTriangle &&
+            materials.back().alphaMode == AlphaMode::Opaque &&
+            occluderIndices.size() + indexCount <=
+                kMaxOccluderTriangles * 3) {
+          occluderIndices.insert(occluderIndices.end(), indices,
+                                 indices + indexCount);
+        } else {
+          canOcclude = false;
+        }
+      } else {
+        canOcclude = false;
+      }
+    }
+    submeshes.push_back(submesh);
   }
 
   NS::String *nameObj = ((MDL::Named *)mdlMesh)->name();
   std::string name =
       nameObj ? nameObj->cString(NS::UTF8StringEncoding) : "Mesh";
 
-  auto vertexDescriptor = NS::RetainPtr(mtkMesh->vertexDescriptor());
+  NS::SharedPtr<MDL::VertexDescriptor> vertexDescriptor =
+      NS::RetainPtr(mtkMesh->vertexDescriptor());
+
+  MetalBufferView meshConstants = {nullptr, 0, 0};
+  const bool compact =
+      _vertexFormat == VertexFormat::Compact &&
+      compactVertices(vertexBuffers, mtkMesh->vertexCount(), vertexDescriptor,
+                      meshConstants);
+  if (!compact) {
+    for (const auto &vertexBuffer : vertexBuffers) {
+      resources.push_back(NS::RetainPtr(vertexBuffer.pBuffer));
+      GPUMemoryTracker::shared().record(
+          vertexBuffer.pBuffer, vertexBuffer.pBuffer->allocatedSize(),
+          GPUMemoryCategory::Vertices, _asset);
+    }
+  }
+
+  auto mesh =
+      std::make_shared<Mesh>(name, vertexBuffers, mtkMesh->vertexCount(),
+                             vertexDescriptor, submeshes, materials);
+  if (compact) {
+    mesh->vertexFormat = VertexFormat::Compact;
+    mesh->meshConstants = meshConstants;
+  }
+  if (positions) {
+    computeBounds(positions, stride, vertexCount, nullptr, 0, mesh->bounds,
+                  mesh->boundingSphere);
+  }
+
+  if (canOcclude && !occluderIndices.empty()) {
+    mesh->occluder.positions = std::move(vertexPositions);
+    mesh->occluder.indices = std::move(occluderIndices);
+  }
 
-  return std::make_shared<Mesh>(name, vertexBuffers, mtkMesh->vertexCount(),
-                                vertexDescriptor, submeshes, materials);
+  return mesh;
 }
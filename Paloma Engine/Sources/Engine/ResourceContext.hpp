@@ -7,16 +7,41 @@
 #include <ModelIO/ModelIO.hpp>
 #include <map>
 #include <memory>
+#include <string>
 #include <vector>
 
+// A texture left for the renderer to stream instead of being loaded whole.
+struct StreamedTextureSource {
+  NS::SharedPtr<MDL::Texture> pTexture;
+  bool sRGB;
+  // Owning asset for memory accounting.
+  std::string asset;
+};
+
 class ResourceContext {
 public:
   enum class TextureSemantic { Raw, Color };
 
   // Keep references to resources to prevent deallocation
   std::vector<NS::SharedPtr<MTL::Resource>> resources;
+  // Indexed by the streamingID of material properties.
+  std::vector<StreamedTextureSource> streamedTextures;
+
+  // Meshes up to this size keep a CPU copy for occlusion culling.
+  static constexpr uint32_t kMaxOccluderTriangles = 2048;
 
-  ResourceContext(MTL::Device *pDevice);
+  // Triangle submeshes at least this large get up to kMaxLODs coarser
+  // levels, each with about half the triangles of the one before.
+  static constexpr uint32_t kMinLODTriangles = 256;
+  static constexpr uint32_t kMaxLODs = 4;
+
+  // Everything created is accounted to asset in GPUMemoryTracker::shared().
+  // Meshes in Scene::load's standard layout are repacked into vertexFormat.
+  // With streamTextures, material textures the streamer can handle are left
+  // in streamedTextures instead of being loaded.
+  ResourceContext(MTL::Device *pDevice, std::string asset,
+                  VertexFormat vertexFormat = VertexFormat::Standard,
+                  bool streamTextures = false);
 
   // Conversion methods
   std::shared_ptr<Mesh> convert(MDL::Mesh *mdlMesh);
@@ -25,7 +50,31 @@ public:
                                       TextureSemantic semantic);
 
 private:
+  // Loads mdlTexture into property, or leaves it to the streamer.
+  template <typename Property>
+  void convert(MDL::Texture *mdlTexture, TextureSemantic semantic,
+               Property &property);
+  // Index into streamedTextures, or kNotStreamed if mdlTexture has to be
+  // loaded whole.
+  uint32_t streamedTexture(MDL::Texture *mdlTexture, TextureSemantic semantic);
+  // Reorders the triangles of each submesh for the post-transform cache and
+  // overdraw, then the vertices into first-use order. Works in place on the
+  // ModelIO buffers, before they are wrapped in an MTK::Mesh.
+  void optimizeVertexOrder(MDL::Mesh *mdlMesh);
+  // Repacks a single standard vertex buffer into CompactVertexLayout and
+  // replaces the buffer and descriptor. Returns false if the layout isn't
+  // the standard one.
+  bool compactVertices(std::vector<MetalBufferView> &vertexBuffers,
+                       NS::UInteger vertexCount,
+                       NS::SharedPtr<MDL::VertexDescriptor> &vertexDescriptor,
+                       MetalBufferView &meshConstants);
+  void buildLODs(Submesh &submesh, const std::vector<simd_float3> &positions,
+                 const uint32_t *indices, NS::UInteger indexCount);
+
   MTL::Device *_pDevice;
+  std::string _asset;
+  VertexFormat _vertexFormat;
+  bool _streamTextures;
   NS::SharedPtr<MTK::TextureLoader> _pTextureLoader;
 
   NS::SharedPtr<NS::Dictionary> _dataTextureOptions;
@@ -33,5 +82,6 @@ private:
 
   // Caches
   std::map<MDL::Texture *, NS::SharedPtr<MTL::Texture>> _textureCache;
+  std::map<MDL::Texture *, uint32_t> _streamedTextureCache;
   std::map<MDL::Material *, Material> _materialCache;
 };
@@ -8,21 +8,22 @@
 #include "Scene.hpp"
 #include "AAPLMathUtilities.h"
 #include "Entity.hpp"
+#include "GPUMemoryTracker.hpp"
 #include "Mesh.hpp"
 #include "ObjCUtils.hpp"
 #include "ResourceContext.hpp"
 #include <MetalKit/MetalKit.hpp>
+#include <algorithm>
+#include <cmath>
 #include <objc/runtime.h>
 #include <simd/simd.h>
 #include <unordered_map>
 
-Scene *Scene::load(const std::string &path, MTL::Device *pDevice) {
+Scene *Scene::load(const std::string &path, MTL::Device *pDevice,
+                   VertexFormat vertexFormat, bool streamTextures) {
 
   auto scene = new Scene();
 
-  scene->rootEntity = std::make_shared<Entity>();
-  scene->rootEntity->name = "SceneRoot";
-
   auto bufferAllocator =
       NS::TransferPtr(MTK::MeshBufferAllocator::alloc()->init(pDevice));
 
@@ -38,18 +39,30 @@ Scene *Scene::load(const std::string &path, MTL::Device *pDevice) {
 
   NS::Array *allObjects = asset->childObjectsOfClass(mdlObjectClass);
 
-  auto resourceContext = ResourceContext(pDevice);
+  // Allocations are accounted to the file they came from.
+  const std::string assetName = path.substr(path.find_last_of('/') + 1);
+  auto resourceContext =
+      ResourceContext(pDevice, assetName, vertexFormat, streamTextures);
+
+  auto &registry = scene->registry;
 
-  std::unordered_map<MDL::Object *, std::shared_ptr<Entity>> entityMap;
+  std::unordered_map<MDL::Object *, Entity> entityMap;
+  std::vector<std::pair<Entity, MDL::TransformComponent *>> animatedObjects;
   for (NS::UInteger i = 0; i < allObjects->count(); ++i) {
     auto pObject = allObjects->object<MDL::Object>(i);
 
-    std::shared_ptr<Entity> entity;
+    std::string entityName = "UnnamedEntity";
+    if (auto named = (MDL::Named *)pObject) {
+      NS::String *name = named->name();
+      if (name) {
+        entityName = name->cString(NS::UTF8StringEncoding);
+      }
+    }
+
+    Entity entity = scene->createEntity(entityName);
     if (is_kind_of<MDL::Mesh>(pObject, mdlMeshClass)) {
       MDL::Mesh *mdlMesh = (MDL::Mesh *)pObject;
 
-      auto modelEntity = std::make_shared<ModelEntity>();
-
       MDL::VertexDescriptor *inputs = mdlMesh->vertexDescriptor();
       NS::Array *attributes = inputs->attributes();
 
@@ -72,7 +85,7 @@ Scene *Scene::load(const std::string &path, MTL::Device *pDevice) {
             vertexDescriptor->attributes()->object<MDL::VertexAttribute>(0);
         attr->setName(MDL::VertexAttributePosition);
         attr->setFormat(MDL::VertexFormatFloat4);
-        attr->setOffset(0);
+        attr->setOffset(StandardVertexLayout::kPositionOffset);
         attr->setBufferIndex(0);
       }
       // Attr 1: Normal
@@ -81,7 +94,7 @@ Scene *Scene::load(const std::string &path, MTL::Device *pDevice) {
             vertexDescriptor->attributes()->object<MDL::VertexAttribute>(1);
         attr->setName(MDL::VertexAttributeNormal);
         attr->setFormat(MDL::VertexFormatFloat3);
-        attr->setOffset(16);
+        attr->setOffset(StandardVertexLayout::kNormalOffset);
         attr->setBufferIndex(0);
       }
       // Attr 2: Tangent
@@ -90,7 +103,7 @@ Scene *Scene::load(const std::string &path, MTL::Device *pDevice) {
             vertexDescriptor->attributes()->object<MDL::VertexAttribute>(2);
         attr->setName(MDL::VertexAttributeTangent);
         attr->setFormat(MDL::VertexFormatFloat4);
-        attr->setOffset(32);
+        attr->setOffset(StandardVertexLayout::kTangentOffset);
         attr->setBufferIndex(0);
       }
       // Attr 3: TexCoord 1
@@ -99,7 +112,7 @@ Scene *Scene::load(const std::string &path, MTL::Device *pDevice) {
             vertexDescriptor->attributes()->object<MDL::VertexAttribute>(3);
         attr->setName(MDL::VertexAttributeTextureCoordinate);
         attr->setFormat(MDL::VertexFormatFloat2);
-        attr->setOffset(48);
+        attr->setOffset(StandardVertexLayout::kTexCoords0Offset);
         attr->setBufferIndex(0);
       }
       // Attr 4: TexCoord 2 (if hasMultipleUVs)
@@ -108,14 +121,14 @@ Scene *Scene::load(const std::string &path, MTL::Device *pDevice) {
             vertexDescriptor->attributes()->object<MDL::VertexAttribute>(4);
         attr->setName(MDL::VertexAttributeTextureCoordinate);
         attr->setFormat(MDL::VertexFormatFloat2);
-        attr->setOffset(56);
+        attr->setOffset(StandardVertexLayout::kTexCoords1Offset);
         attr->setBufferIndex(0);
       }
 
       {
         auto layout =
             vertexDescriptor->layouts()->object<MDL::VertexBufferLayout>(0);
-        layout->setStride(hasMultipleUVs ? 64 : 56);
+        layout->setStride(StandardVertexLayout::stride(hasMultipleUVs));
       }
 
       mdlMesh->setVertexDescriptor(vertexDescriptor.get());
@@ -124,25 +137,20 @@ Scene *Scene::load(const std::string &path, MTL::Device *pDevice) {
           MDL::VertexAttributeTextureCoordinate, MDL::VertexAttributeNormal,
           MDL::VertexAttributeTangent);
 
-      modelEntity->mesh = resourceContext.convert(mdlMesh);
-      entity = modelEntity;
-    } else {
-
-      entity = std::make_shared<Entity>();
-    }
-
-    if (auto named = (MDL::Named *)pObject) {
-      NS::String *name = named->name();
-      if (name) {
-        entity->name = name->cString(NS::UTF8StringEncoding);
-      }
+      registry.emplace<MeshRenderer>(entity,
+                                     resourceContext.convert(mdlMesh));
     }
 
     if (MDL::TransformComponent *transformComp = pObject->transform()) {
 
       matrix_float4x4 modelMatrix = transformComp->localTransformAtTime(0.0);
 
-      entity->transform = modelMatrix;
+      scene->setLocalTransform(entity, modelMatrix);
+
+      NS::Array *keyTimes = transformComp->keyTimes();
+      if (keyTimes && keyTimes->count() > 1) {
+        animatedObjects.push_back({entity, transformComp});
+      }
     }
 
     entityMap[pObject] = entity;
@@ -151,16 +159,148 @@ Scene *Scene::load(const std::string &path, MTL::Device *pDevice) {
     if (parentObject) {
       auto it = entityMap.find(parentObject);
       if (it != entityMap.end()) {
-        it->second->addChild(entity);
+        scene->addChild(it->second, entity);
       } else {
         printf("Logic error: Entity parent not found in map (load order "
                "issue?)\n");
       }
     } else {
-      scene->rootEntity->addChild(entity);
+      scene->addChild(scene->rootEntity, entity);
     }
 
     scene->resources = resourceContext.resources;
+    scene->streamedTextures = resourceContext.streamedTextures;
   }
+
+  if (!animatedObjects.empty()) {
+    AnimationClip clip = bakeAnimation(asset.get(), animatedObjects);
+    scene->animations.push_back(CompressedAnimationClip::compress(clip, {}));
+  }
+
+  scene->updateTransforms();
   return scene;
 }
+
+AnimationClip Scene::bakeAnimation(
+    MDL::Asset *pAsset,
+    const std::vector<std::pair<Entity, MDL::TransformComponent *>> &objects) {
+  double startTime = pAsset->startTime();
+  double endTime = pAsset->endTime();
+  if (endTime <= startTime) {
+    startTime = objects[0].second->minimumTime();
+    endTime = objects[0].second->maximumTime();
+    for (const auto &[entity, pTransform] : objects) {
+      startTime = std::min(startTime, pTransform->minimumTime());
+      endTime = std::max(endTime, pTransform->maximumTime());
+    }
+  }
+
+  double frameInterval = pAsset->frameInterval();
+  float sampleRate = frameInterval > 0.0 ? (float)(1.0 / frameInterval) : 30.0f;
+  uint32_t frameCount =
+      (uint32_t)std::ceil((endTime - startTime) * sampleRate) + 1;
+
+  std::vector<Entity> targets;
+  std::vector<std::vector<matrix_float4x4>> samples;
+  targets.reserve(objects.size());
+  samples.reserve(objects.size());
+
+  for (const auto &[entity, pTransform] : objects) {
+    std::vector<matrix_float4x4> track(frameCount);
+    for (uint32_t frame = 0; frame < frameCount; ++frame) {
+      double time = std::min(startTime + frame / (double)sampleRate, endTime);
+      track[frame] = pTransform->localTransformAtTime(time);
+    }
+    targets.push_back(entity);
+    samples.push_back(std::move(track));
+  }
+
+  AnimationClip clip;
+  clip.build(targets, samples, sampleRate);
+  return clip;
+}
+
+void Scene::updateAnimations(float time) {
+  for (auto &clip : animations) {
+    clip.sample(time, [this](Entity entity, const matrix_float4x4 &local) {
+      setLocalTransform(entity, local);
+    });
+  }
+}
+
+float Scene::measureAnimationError(const AnimationClip &reference,
+                                   CompressedAnimationClip &compressed) {
+  auto apply = [this](Entity entity, const matrix_float4x4 &local) {
+    setLocalTransform(entity, local);
+  };
+
+  const std::vector<Entity> entities = flattenedHierarchy();
+  const float error = ::measureAnimationError(
+      reference, compressed, apply, [&](std::vector<matrix_float4x4> &world) {
+        updateTransforms();
+        world.resize(entities.size());
+        for (size_t i = 0; i < entities.size(); ++i) {
+          world[i] = registry.get<WorldTransform>(entities[i]).matrix;
+        }
+      });
+
+  compressed.sample(0.0f, apply);
+  updateTransforms();
+  return error;
+}
+
+Scene::Scene() {
+  registry.on_construct<MeshRenderer>()
+      .connect<&Scene::onRenderableChanged>(*this);
+  registry.on_update<MeshRenderer>()
+      .connect<&Scene::onRenderableChanged>(*this);
+  registry.on_destroy<SpatialProxy>()
+      .connect<&Scene::onSpatialProxyDestroyed>(*this);
+}
+
+Scene::~Scene() {
+  for (const auto &resource : resources) {
+    GPUMemoryTracker::shared().release(resource.get());
+  }
+}
+
+void Scene::updateTransforms() {
+  SceneGraph::updateTransforms();
+  updateSpatialIndex();
+}
+
+void Scene::updateSpatialIndex() {
+  // Entities stay queued until clearChanges(), so calling this more than
+  // once a frame only re-checks boxes that already fit.
+  const std::vector<Entity> &changed = changedEntities();
+  for (size_t i = 0; i < changed.size(); ++i) {
+    const Entity entity = changed[i];
+    auto *pRenderer = registry.try_get<MeshRenderer>(entity);
+    if (!pRenderer || !pRenderer->mesh) {
+      registry.remove<SpatialProxy>(entity);
+      continue;
+    }
+
+    // Detached subtrees are not visited by updateTransforms().
+    const matrix_float4x4 &matrix = worldTransform(entity);
+    AABB bounds = pRenderer->mesh->bounds.transformed(matrix);
+    if (bounds.isEmpty()) {
+      bounds = {matrix.columns[3].xyz, matrix.columns[3].xyz};
+    }
+
+    if (auto *pProxy = registry.try_get<SpatialProxy>(entity)) {
+      spatialIndex.moveProxy(pProxy->node, bounds);
+    } else {
+      registry.emplace<SpatialProxy>(entity,
+                                     spatialIndex.createProxy(bounds, entity));
+    }
+  }
+}
+
+void Scene::onRenderableChanged(Registry &, Entity entity) {
+  markChanged(entity);
+}
+
+void Scene::onSpatialProxyDestroyed(Registry &, Entity entity) {
+  spatialIndex.destroyProxy(registry.get<SpatialProxy>(entity).node);
+}
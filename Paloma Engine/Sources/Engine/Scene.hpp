@@ -8,34 +8,77 @@
 #pragma once
 #include <Metal/Metal.hpp>
 #include <ModelIO/ModelIO.hpp>
-#include <map>
 #include <string>
 #include <vector>
-// #include "Entity.hpp"
+#include "Animation.hpp"
+#include "DynamicAABBTree.hpp"
+#include "Entity.hpp"
 #include "ImageBasedLight.hpp"
+#include "ResourceContext.hpp"
+#include "SceneGraph.hpp"
 #include "ShaderStructures.h"
+#include "VertexCompression.hpp"
 
-class Entity;
-class Scene {
+class Scene : public SceneGraph {
 public:
-public:
-  static Scene *load(const std::string &path, MTL::Device *pDevice);
+  // Meshes are imported in StandardVertexLayout and, for
+  // VertexFormat::Compact, repacked into CompactVertexLayout. With
+  // streamTextures, material textures that can be streamed are left in
+  // getStreamedTextures() for the renderer.
+  static Scene *load(const std::string &path, MTL::Device *pDevice,
+                     VertexFormat vertexFormat = VertexFormat::Standard,
+                     bool streamTextures = false);
+  // Releases the scene's resources from GPUMemoryTracker::shared().
+  ~Scene();
   const std::vector<NS::SharedPtr<MTL::Resource>> &getResources() const {
     return resources;
   }
+  const std::vector<StreamedTextureSource> &getStreamedTextures() const {
+    return streamedTextures;
+  }
   ImageBasedLight *getLightingEnvironment() const {
     return pLightingEnvironment;
   }
 
+  // Also moves the spatial index leaves of the entities that changed.
+  void updateTransforms();
+
+  // -- Spatial queries --
+  // World-space bounds of every entity with a mesh, current as of the last
+  // updateTransforms().
+  const DynamicAABBTree &getSpatialIndex() const { return spatialIndex; }
+
+  // -- Animation --
+  const std::vector<CompressedAnimationClip> &getAnimations() const {
+    return animations;
+  }
+  // Samples every clip at time and writes the result into local transforms.
+  void updateAnimations(float time);
+
+  // Plays both clips frame by frame and returns the largest distance between
+  // their world-space results, measured at each node's origin and unit axes.
+  // Leaves the scene posed at the start of the compressed clip.
+  float measureAnimationError(const AnimationClip &reference,
+                              CompressedAnimationClip &compressed);
+
 private:
   friend class Metal4Renderer;
-  std::shared_ptr<Entity> rootEntity;
-
   std::vector<Light> lights;
+  std::vector<CompressedAnimationClip> animations;
+  DynamicAABBTree spatialIndex;
 
   ImageBasedLight *pLightingEnvironment = nullptr;
 
   std::vector<NS::SharedPtr<MTL::Resource>> resources;
+  std::vector<StreamedTextureSource> streamedTextures;
+
+  static AnimationClip bakeAnimation(
+      MDL::Asset *pAsset,
+      const std::vector<std::pair<Entity, MDL::TransformComponent *>> &objects);
+
+  void updateSpatialIndex();
+  void onSpatialProxyDestroyed(Registry &registry, Entity entity);
+  void onRenderableChanged(Registry &registry, Entity entity);
 
-  Scene() = default;
+  Scene();
 };
@@ -0,0 +1,296 @@
+//
+//  SceneGraph.cpp
+//  Paloma Engine
+//
+
+#include "SceneGraph.hpp"
+#include <cassert>
+
+SceneGraph::SceneGraph() {
+  registry.on_destroy<WorldTransform>()
+      .connect<&SceneGraph::onEntityDestroyed>(*this);
+  rootEntity = createEntity("SceneRoot");
+}
+
+Entity SceneGraph::createEntity(const std::string &name, Entity parent) {
+  auto entity = registry.create();
+  registry.emplace<Name>(entity, name, makeNameID(name));
+  registry.emplace<LocalTransform>(entity);
+  registry.emplace<WorldTransform>(entity);
+  registry.emplace<Hierarchy>(entity);
+
+  if (parent != entt::null) {
+    addChild(parent, entity);
+  }
+  return entity;
+}
+
+void SceneGraph::destroyEntity(Entity entity) {
+  assert(entity != rootEntity);
+  removeFromParent(entity);
+
+  visitHierarchy(entity, [this](Entity current) {
+    pendingDestroy.push_back(current);
+  });
+  registry.destroy(pendingDestroy.begin(), pendingDestroy.end());
+  pendingDestroy.clear();
+  hierarchyChanged = true;
+}
+
+void SceneGraph::addChild(Entity parent, Entity child) {
+  removeFromParent(child);
+
+  auto &parentNode = registry.get<Hierarchy>(parent);
+  auto &childNode = registry.get<Hierarchy>(child);
+
+  childNode.parent = parent;
+  childNode.prevSibling = parentNode.lastChild;
+  childNode.nextSibling = entt::null;
+
+  if (parentNode.lastChild != entt::null) {
+    registry.get<Hierarchy>(parentNode.lastChild).nextSibling = child;
+  } else {
+    parentNode.firstChild = child;
+  }
+  parentNode.lastChild = child;
+  parentNode.childCount++;
+  hierarchyChanged = true;
+
+  if (isInScene(parent)) {
+    indexSubtree(child);
+  }
+  markTransformDirty(child);
+}
+
+void SceneGraph::removeChild(Entity parent, Entity child) {
+  if (registry.get<Hierarchy>(child).parent != parent) {
+    return;
+  }
+  if (isInScene(child)) {
+    unindexSubtree(child);
+  }
+
+  auto &childNode = registry.get<Hierarchy>(child);
+
+  auto &parentNode = registry.get<Hierarchy>(parent);
+  if (childNode.prevSibling != entt::null) {
+    registry.get<Hierarchy>(childNode.prevSibling).nextSibling =
+        childNode.nextSibling;
+  } else {
+    parentNode.firstChild = childNode.nextSibling;
+  }
+  if (childNode.nextSibling != entt::null) {
+    registry.get<Hierarchy>(childNode.nextSibling).prevSibling =
+        childNode.prevSibling;
+  } else {
+    parentNode.lastChild = childNode.prevSibling;
+  }
+  parentNode.childCount--;
+
+  childNode.parent = entt::null;
+  childNode.prevSibling = entt::null;
+  childNode.nextSibling = entt::null;
+  hierarchyChanged = true;
+
+  markTransformDirty(child);
+}
+
+void SceneGraph::removeFromParent(Entity entity) {
+  auto parent = registry.get<Hierarchy>(entity).parent;
+  if (parent != entt::null) {
+    removeChild(parent, entity);
+  }
+}
+
+const std::vector<Entity> &SceneGraph::flattenedHierarchy() {
+  if (hierarchyChanged) {
+    flatHierarchy.clear();
+    visitHierarchy(rootEntity, [this](Entity entity) {
+      flatHierarchy.push_back(entity);
+    });
+    hierarchyChanged = false;
+  }
+  return flatHierarchy;
+}
+
+void SceneGraph::setName(Entity entity, const std::string &name) {
+  // Renaming changes the path of the whole subtree.
+  bool indexed = isInScene(entity) && entity != rootEntity;
+  if (indexed) {
+    unindexSubtree(entity);
+  }
+
+  auto &component = registry.get<Name>(entity);
+  component.value = name;
+  component.id = makeNameID(name);
+
+  if (indexed) {
+    indexSubtree(entity);
+  }
+}
+
+Entity SceneGraph::findEntity(std::string_view name) const {
+  auto it = nameIndex.find(makeNameID(name));
+  return it != nameIndex.end() ? it->second : entt::null;
+}
+
+Entity SceneGraph::entityAtPath(std::string_view path) const {
+  auto it = pathIndex.find(makeNameID(path));
+  return it != pathIndex.end() ? it->second : entt::null;
+}
+
+Entity SceneGraph::childNamed(Entity entity, const std::string &searchName,
+                         bool recursively) {
+  if (!isInScene(entity)) {
+    return entt::null;
+  }
+
+  NameID nameID = makeNameID(searchName);
+  if (!recursively) {
+    NameID pathID =
+        entity == rootEntity
+            ? nameID
+            : makeChildPathID(registry.get<Name>(entity).pathID, searchName);
+    auto it = pathIndex.find(pathID);
+    return it != pathIndex.end() ? it->second : entt::null;
+  }
+
+  auto [first, last] = nameIndex.equal_range(nameID);
+  for (auto it = first; it != last; ++it) {
+    for (auto parent = registry.get<Hierarchy>(it->second).parent;
+         parent != entt::null;
+         parent = registry.get<Hierarchy>(parent).parent) {
+      if (parent == entity) {
+        return it->second;
+      }
+    }
+  }
+  return entt::null;
+}
+
+bool SceneGraph::isInScene(Entity entity) const {
+  return entity == rootEntity || registry.get<Name>(entity).pathID != 0;
+}
+
+void SceneGraph::indexSubtree(Entity entity) {
+  visitHierarchy(entity, [this](Entity current) {
+    auto parent = registry.get<Hierarchy>(current).parent;
+    NameID parentPathID =
+        parent != rootEntity ? registry.get<Name>(parent).pathID : 0;
+
+    auto &name = registry.get<Name>(current);
+    name.pathID = parent != rootEntity
+                      ? makeChildPathID(parentPathID, name.value)
+                      : name.id;
+
+    nameIndex.emplace(name.id, current);
+    pathIndex.try_emplace(name.pathID, current);
+  });
+}
+
+void SceneGraph::unindexSubtree(Entity entity) {
+  visitHierarchy(entity, [this](Entity current) {
+    auto &name = registry.get<Name>(current);
+
+    auto [first, last] = nameIndex.equal_range(name.id);
+    for (auto it = first; it != last; ++it) {
+      if (it->second == current) {
+        nameIndex.erase(it);
+        break;
+      }
+    }
+
+    auto path = pathIndex.find(name.pathID);
+    if (path != pathIndex.end() && path->second == current) {
+      pathIndex.erase(path);
+    }
+    name.pathID = 0;
+  });
+}
+
+void SceneGraph::setLocalTransform(Entity entity,
+                                   const matrix_float4x4 &matrix) {
+  registry.get<LocalTransform>(entity).matrix = matrix;
+  markTransformDirty(entity);
+}
+
+const matrix_float4x4 &SceneGraph::worldTransform(Entity entity) {
+  auto &world = registry.get<WorldTransform>(entity);
+  if (world.dirty) {
+    const auto &local = registry.get<LocalTransform>(entity).matrix;
+    auto parent = registry.get<Hierarchy>(entity).parent;
+    if (parent != entt::null) {
+      world.matrix = matrix_multiply(worldTransform(parent), local);
+    } else {
+      world.matrix = local;
+    }
+    world.dirty = false;
+    markChanged(entity);
+  }
+  return world.matrix;
+}
+
+void SceneGraph::markTransformDirty(Entity entity) {
+  // A dirty node always has a dirty subtree, so marking can stop early.
+  visitHierarchy(entity, [this](Entity current) {
+    auto &world = registry.get<WorldTransform>(current);
+    if (world.dirty) {
+      return false;
+    }
+    world.dirty = true;
+    return true;
+  });
+
+  for (auto parent = registry.get<Hierarchy>(entity).parent;
+       parent != entt::null;
+       parent = registry.get<Hierarchy>(parent).parent) {
+    auto &world = registry.get<WorldTransform>(parent);
+    if (world.hasDirtyDescendant) {
+      break;
+    }
+    world.hasDirtyDescendant = true;
+  }
+}
+
+void SceneGraph::updateTransforms() {
+  if (registry.get<WorldTransform>(rootEntity).dirty) {
+    // Everything is dirty (e.g. right after load): a linear pass over the
+    // flattened hierarchy sees every parent before its children.
+    for (auto entity : flattenedHierarchy()) {
+      worldTransform(entity);
+      registry.get<WorldTransform>(entity).hasDirtyDescendant = false;
+    }
+    return;
+  }
+
+  visitHierarchy(rootEntity, [this](Entity entity) {
+    auto &world = registry.get<WorldTransform>(entity);
+    if (!world.dirty && !world.hasDirtyDescendant) {
+      return false;
+    }
+    worldTransform(entity);
+    world.hasDirtyDescendant = false;
+    return true;
+  });
+}
+
+void SceneGraph::clearChanges() {
+  for (auto entity : changed) {
+    registry.get<WorldTransform>(entity).changed = false;
+  }
+  changed.clear();
+}
+
+void SceneGraph::markChanged(Entity entity) {
+  auto &world = registry.get<WorldTransform>(entity);
+  if (!world.changed) {
+    world.changed = true;
+    changed.push_back(entity);
+  }
+}
+
+void SceneGraph::onEntityDestroyed(Registry &, Entity entity) {
+  if (registry.get<WorldTransform>(entity).changed) {
+    std::erase(changed, entity);
+  }
+}
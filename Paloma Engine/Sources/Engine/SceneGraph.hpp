@@ -0,0 +1,123 @@
+//
+//  SceneGraph.hpp
+//  Paloma Engine
+//
+
+#pragma once
+#include "Entity.hpp"
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+// The entity hierarchy of a scene with its cached world transforms and name
+// index. Scene adds the GPU resources, spatial index and animation on top;
+// this part needs neither Metal nor ModelIO.
+class SceneGraph {
+public:
+  // Creates the root entity, "SceneRoot".
+  SceneGraph();
+  SceneGraph(const SceneGraph &) = delete;
+  SceneGraph &operator=(const SceneGraph &) = delete;
+
+  Registry &getRegistry() { return registry; }
+  Entity getRootEntity() const { return rootEntity; }
+
+  // -- Hierarchy --
+  Entity createEntity(const std::string &name, Entity parent = entt::null);
+  // Destroys the entity and its whole subtree.
+  void destroyEntity(Entity entity);
+  bool isValid(Entity entity) const { return registry.valid(entity); }
+
+  void addChild(Entity parent, Entity child);
+  void removeChild(Entity parent, Entity child);
+  void removeFromParent(Entity entity);
+  void setName(Entity entity, const std::string &name);
+
+  // Pre-order, depth-first walk on an explicit stack. A visitor returning
+  // bool can return false to skip the children of the node it was given.
+  template <typename Visitor>
+  void visitHierarchy(Entity entity, Visitor &&visitor);
+
+  // Every entity under the root in pre-order, so parents always precede
+  // their children. Rebuilt lazily after the hierarchy changes.
+  const std::vector<Entity> &flattenedHierarchy();
+
+  // O(1) lookups through the name and path index. Paths are relative to
+  // the scene root, e.g. "Root/Rig/Camera".
+  Entity findEntity(std::string_view name) const;
+  Entity entityAtPath(std::string_view path) const;
+  Entity childNamed(Entity entity, const std::string &searchName,
+                    bool recursively = true);
+
+  // -- Transforms --
+  void setLocalTransform(Entity entity, const matrix_float4x4 &matrix);
+  const matrix_float4x4 &worldTransform(Entity entity);
+
+  // Propagates pending local transform changes to cached world transforms,
+  // recomputing only dirty subtrees.
+  void updateTransforms();
+
+  // -- Change tracking --
+  // Entities whose world transform changed since the last clearChanges(),
+  // plus whatever markChanged() was called for. Each entity appears at most
+  // once.
+  const std::vector<Entity> &changedEntities() const { return changed; }
+  void clearChanges();
+
+protected:
+  Registry registry;
+  Entity rootEntity = entt::null;
+
+  void markChanged(Entity entity);
+
+private:
+  std::vector<Entity> traversalStack;
+  std::vector<Entity> flatHierarchy;
+  std::vector<Entity> pendingDestroy;
+  std::vector<Entity> changed;
+  bool hierarchyChanged = true;
+
+  // Only entities attached under the root are indexed. Duplicate paths keep
+  // the first entity that was indexed.
+  std::unordered_multimap<NameID, Entity> nameIndex;
+  std::unordered_map<NameID, Entity> pathIndex;
+
+  bool isInScene(Entity entity) const;
+  void indexSubtree(Entity entity);
+  void unindexSubtree(Entity entity);
+
+  void markTransformDirty(Entity entity);
+  void onEntityDestroyed(Registry &registry, Entity entity);
+};
+
+template <typename Visitor>
+void SceneGraph::visitHierarchy(Entity entity, Visitor &&visitor) {
+  // Looked up once; registry.get() finds the pool by type on every call.
+  const auto &hierarchy = registry.storage<Hierarchy>();
+  // Nested walks share the stack above their own base.
+  const size_t base = traversalStack.size();
+  traversalStack.push_back(entity);
+
+  while (traversalStack.size() > base) {
+    auto current = traversalStack.back();
+    traversalStack.pop_back();
+
+    bool descend = true;
+    if constexpr (std::is_same_v<std::invoke_result_t<Visitor &, Entity>,
+                                 bool>) {
+      descend = visitor(current);
+    } else {
+      visitor(current);
+    }
+
+    if (descend) {
+      // Pushed in reverse so siblings come off the stack in order.
+      for (auto child = hierarchy.get(current).lastChild; child != entt::null;
+           child = hierarchy.get(child).prevSibling) {
+        traversalStack.push_back(child);
+      }
+    }
+  }
+}
@@ -0,0 +1,252 @@
+//
+//  TextureStreamer.cpp
+//  Paloma Engine
+//
+
+#include "TextureStreamer.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+uint32_t mipForScreenSize(uint32_t width, uint32_t height,
+                          float screenPixels) {
+  const uint32_t size = std::max(width, height);
+  if (size == 0 || screenPixels >= size) {
+    return 0;
+  }
+  const float texelsPerPixel = size / std::max(screenPixels, 1.0f);
+  return (uint32_t)std::floor(std::log2(texelsPerPixel));
+}
+
+static float srgbToLinear(float c) {
+  return c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+}
+
+static float linearToSRGB(float c) {
+  return c <= 0.0031308f ? c * 12.92f : 1.055f * powf(c, 1.0f / 2.4f) - 0.055f;
+}
+
+std::vector<uint8_t> downsampleRGBA8(const std::vector<uint8_t> &source,
+                                     uint32_t width, uint32_t height,
+                                     bool sRGB) {
+  static const auto decode = [] {
+    std::array<float, 256> table;
+    for (uint32_t i = 0; i < 256; ++i) {
+      table[i] = srgbToLinear(i / 255.0f);
+    }
+    return table;
+  }();
+
+  const uint32_t w = std::max(width / 2, 1u);
+  const uint32_t h = std::max(height / 2, 1u);
+  std::vector<uint8_t> mip((size_t)w * h * 4);
+  for (uint32_t y = 0; y < h; ++y) {
+    const uint32_t y0 = std::min(y * 2, height - 1);
+    const uint32_t y1 = std::min(y * 2 + 1, height - 1);
+    for (uint32_t x = 0; x < w; ++x) {
+      const uint32_t x0 = std::min(x * 2, width - 1);
+      const uint32_t x1 = std::min(x * 2 + 1, width - 1);
+      for (uint32_t c = 0; c < 4; ++c) {
+        auto at = [&](uint32_t sx, uint32_t sy) {
+          return source[((size_t)sy * width + sx) * 4 + c];
+        };
+        uint8_t &texel = mip[((size_t)y * w + x) * 4 + c];
+        if (sRGB && c < 3) {
+          const float linear = (decode[at(x0, y0)] + decode[at(x1, y0)] +
+                                decode[at(x0, y1)] + decode[at(x1, y1)]) *
+                               0.25f;
+          texel = (uint8_t)(linearToSRGB(linear) * 255.0f + 0.5f);
+        } else {
+          const uint32_t sum =
+              at(x0, y0) + at(x1, y0) + at(x0, y1) + at(x1, y1);
+          texel = (uint8_t)((sum + 2) / 4);
+        }
+      }
+    }
+  }
+  return mip;
+}
+
+TextureStreamer::TextureStreamer(TextureStreamingBackend *pBackend,
+                                 size_t budgetBytes,
+                                 size_t maxUploadBytesPerFrame)
+    : _pBackend(pBackend), _maxUploadBytesPerFrame(maxUploadBytesPerFrame) {
+  _stats.budgetBytes = budgetBytes;
+}
+
+uint32_t TextureStreamer::addTexture(uint32_t width, uint32_t height,
+                                     size_t bytesPerTexel) {
+  Texture texture;
+  texture.width = width;
+  texture.height = height;
+  uint32_t w = std::max(width, 1u);
+  uint32_t h = std::max(height, 1u);
+  texture.minimumMip = 0;
+  while (true) {
+    if (std::max(w, h) > kMinResidentSize) {
+      texture.minimumMip++;
+    }
+    texture.mipBytes.push_back((size_t)w * h * bytesPerTexel);
+    if (w == 1 && h == 1) {
+      break;
+    }
+    w = std::max(w / 2, 1u);
+    h = std::max(h / 2, 1u);
+  }
+  texture.lastNeeded.assign(texture.mipBytes.size(), 0);
+  texture.firstMip = texture.minimumMip;
+  _textures.push_back(std::move(texture));
+
+  const uint32_t id = (uint32_t)(_textures.size() - 1);
+  _stats.residentBytes += residentBytes(id, _textures[id].firstMip);
+  _stats.textures++;
+  return id;
+}
+
+size_t TextureStreamer::residentBytes(uint32_t texture,
+                                      uint32_t firstMip) const {
+  const auto &mipBytes = _textures[texture].mipBytes;
+  size_t bytes = 0;
+  for (uint32_t m = firstMip; m < mipBytes.size(); ++m) {
+    bytes += mipBytes[m];
+  }
+  return bytes;
+}
+
+void TextureStreamer::request(uint32_t texture, uint32_t mip) {
+  Texture &t = _textures[texture];
+  mip = std::min(mip, t.minimumMip);
+  if (t.requestedMip == kNoRequest) {
+    _requested.push_back(texture);
+    t.requestedMip = mip;
+  } else {
+    t.requestedMip = std::min(t.requestedMip, mip);
+  }
+}
+
+bool TextureStreamer::evict(size_t bytes, uint64_t frameIndex) {
+  size_t freed = 0;
+  std::vector<std::pair<uint32_t, uint32_t>> dropped;
+  while (freed < bytes) {
+    // The mip that was needed least recently, among mips not needed now.
+    uint32_t victim = UINT32_MAX;
+    uint64_t oldest = frameIndex;
+    for (uint32_t t = 0; t < _textures.size(); ++t) {
+      const uint32_t mip = _targetMips[t];
+      if (mip < _textures[t].minimumMip &&
+          _textures[t].lastNeeded[mip] < oldest) {
+        oldest = _textures[t].lastNeeded[mip];
+        victim = t;
+      }
+    }
+    if (victim == UINT32_MAX) {
+      for (auto it = dropped.rbegin(); it != dropped.rend(); ++it) {
+        _targetMips[it->first] = it->second;
+      }
+      return false;
+    }
+    dropped.emplace_back(victim, _targetMips[victim]);
+    freed += _textures[victim].mipBytes[_targetMips[victim]];
+    _targetMips[victim]++;
+  }
+  _stats.residentBytes -= freed;
+  return true;
+}
+
+void TextureStreamer::update(uint64_t frameIndex) {
+  _stats.wantedBytes = 0;
+  _stats.deferred = 0;
+  _stats.streamedIn = 0;
+  _stats.streamedOut = 0;
+  _stats.uploadedBytes = 0;
+
+  for (uint32_t t : _requested) {
+    Texture &texture = _textures[t];
+    for (uint32_t m = texture.requestedMip; m < texture.lastNeeded.size();
+         ++m) {
+      texture.lastNeeded[m] = frameIndex;
+    }
+  }
+  for (uint32_t t = 0; t < _textures.size(); ++t) {
+    const Texture &texture = _textures[t];
+    _stats.wantedBytes +=
+        residentBytes(t, texture.requestedMip != kNoRequest
+                             ? texture.requestedMip
+                             : texture.minimumMip);
+  }
+
+  // Largest shortfall first.
+  std::vector<uint32_t> upgrades;
+  for (uint32_t t : _requested) {
+    if (_textures[t].requestedMip < _textures[t].firstMip) {
+      upgrades.push_back(t);
+    }
+  }
+  std::stable_sort(upgrades.begin(), upgrades.end(),
+                   [&](uint32_t a, uint32_t b) {
+                     return _textures[a].firstMip - _textures[a].requestedMip >
+                            _textures[b].firstMip - _textures[b].requestedMip;
+                   });
+
+  _targetMips.resize(_textures.size());
+  for (uint32_t t = 0; t < _textures.size(); ++t) {
+    _targetMips[t] = _textures[t].firstMip;
+  }
+
+  for (uint32_t t : upgrades) {
+    const Texture &texture = _textures[t];
+    const size_t currentBytes = residentBytes(t, texture.firstMip);
+    uint32_t target = texture.requestedMip;
+    for (; target < texture.firstMip; ++target) {
+      const size_t bytes = residentBytes(t, target) - currentBytes;
+      // The first upload of a frame may go over, so mips larger than the
+      // limit still stream in.
+      if (_stats.uploadedBytes > 0 &&
+          _stats.uploadedBytes + bytes > _maxUploadBytesPerFrame) {
+        continue;
+      }
+      if (_stats.residentBytes + bytes > _stats.budgetBytes &&
+          !evict(_stats.residentBytes + bytes - _stats.budgetBytes,
+                 frameIndex)) {
+        continue;
+      }
+      _stats.residentBytes += bytes;
+      _stats.uploadedBytes += bytes;
+      break;
+    }
+    if (target != texture.requestedMip) {
+      _stats.deferred++;
+    }
+    _targetMips[t] = target;
+  }
+
+  for (uint32_t t = 0; t < _textures.size(); ++t) {
+    Texture &texture = _textures[t];
+    const uint32_t target = _targetMips[t];
+    if (target == texture.firstMip) {
+      continue;
+    }
+    if (!_pBackend->setFirstResidentMip(t, target)) {
+      // Undo the accounting; the texture keeps its mips.
+      _stats.residentBytes += residentBytes(t, texture.firstMip);
+      _stats.residentBytes -= residentBytes(t, target);
+      if (target < texture.firstMip) {
+        _stats.uploadedBytes -=
+            residentBytes(t, target) - residentBytes(t, texture.firstMip);
+        _stats.deferred++;
+      }
+      continue;
+    }
+    if (target < texture.firstMip) {
+      _stats.streamedIn++;
+    } else {
+      _stats.streamedOut++;
+    }
+    texture.firstMip = target;
+  }
+
+  for (uint32_t t : _requested) {
+    _textures[t].requestedMip = kNoRequest;
+  }
+  _requested.clear();
+}
@@ -0,0 +1,137 @@
+//
+//  TextureStreamer.hpp
+//  Paloma Engine
+//
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Changes which mips of a texture are in GPU memory. A texture with first
+// resident mip m holds mips m and coarser.
+class TextureStreamingBackend {
+public:
+  virtual ~TextureStreamingBackend() = default;
+
+  // Returns false if the mips couldn't be made resident; the texture then
+  // keeps what it had.
+  virtual bool setFirstResidentMip(uint32_t texture, uint32_t firstMip) = 0;
+};
+
+// The mip whose texels are closest to one per pixel when the texture covers
+// screenPixels pixels across, assuming the UVs span the texture once.
+uint32_t mipForScreenSize(uint32_t width, uint32_t height, float screenPixels);
+
+// Halves an RGBA8 image with a box filter; an odd last row or column is
+// folded into its neighbour. sRGB colour is averaged in linear space, like
+// the GPU filters it; alpha is always linear.
+std::vector<uint8_t> downsampleRGBA8(const std::vector<uint8_t> &source,
+                                     uint32_t width, uint32_t height,
+                                     bool sRGB);
+
+// Decides which mips of each streamed texture are resident. Culling asks
+// for the mip each visible texture needs; update() streams in what was asked
+// for, largest shortfall first, and keeps the resident total under a byte
+// budget by dropping the least recently needed mips. A texture never drops
+// below the mips that fit kMinResidentSize, which it starts with.
+class TextureStreamer {
+public:
+  // Largest dimension always kept resident.
+  static constexpr uint32_t kMinResidentSize = 64;
+
+  struct Stats {
+    size_t residentBytes = 0;
+    size_t budgetBytes = 0;
+    // What the last update's requests would take without a budget.
+    size_t wantedBytes = 0;
+    uint32_t textures = 0;
+    // Textures whose request the last update couldn't satisfy.
+    uint32_t deferred = 0;
+    uint32_t streamedIn = 0;
+    uint32_t streamedOut = 0;
+    size_t uploadedBytes = 0;
+  };
+
+  TextureStreamer(TextureStreamingBackend *pBackend, size_t budgetBytes,
+                  size_t maxUploadBytesPerFrame);
+
+  // Registers a texture that the backend holds at minimumResidentMip().
+  // IDs count up from 0 in the order textures are added.
+  uint32_t addTexture(uint32_t width, uint32_t height, size_t bytesPerTexel);
+
+  // Asks for mip or finer to be resident. Several requests in one frame keep
+  // the finest.
+  void request(uint32_t texture, uint32_t mip);
+  // Asks for the mip that suits the texture covering screenPixels across.
+  void requestScreenSize(uint32_t texture, float screenPixels) {
+    const Texture &t = _textures[texture];
+    request(texture, mipForScreenSize(t.width, t.height, screenPixels));
+  }
+
+  // Applies the requests made since the last update.
+  void update(uint64_t frameIndex);
+
+  void setBudget(size_t budgetBytes) { _stats.budgetBytes = budgetBytes; }
+
+  uint32_t firstResidentMip(uint32_t texture) const {
+    return _textures[texture].firstMip;
+  }
+  uint32_t minimumResidentMip(uint32_t texture) const {
+    return _textures[texture].minimumMip;
+  }
+  uint32_t mipCount(uint32_t texture) const {
+    return (uint32_t)_textures[texture].mipBytes.size();
+  }
+  // Bytes of mips firstMip and coarser.
+  size_t residentBytes(uint32_t texture, uint32_t firstMip) const;
+
+  const Stats &stats() const { return _stats; }
+
+private:
+  static constexpr uint32_t kNoRequest = UINT32_MAX;
+
+  struct Texture {
+    std::vector<size_t> mipBytes;
+    // When each mip was last needed.
+    std::vector<uint64_t> lastNeeded;
+    uint32_t width;
+    uint32_t height;
+    uint32_t firstMip;
+    uint32_t minimumMip;
+    uint32_t requestedMip = kNoRequest;
+  };
+
+  TextureStreamingBackend *_pBackend;
+  size_t _maxUploadBytesPerFrame;
+  std::vector<Texture> _textures;
+  std::vector<uint32_t> _requested;
+  // First resident mips planned by the current update.
+  std::vector<uint32_t> _targetMips;
+  Stats _stats;
+
+  // Frees at least bytes from _targetMips by dropping mips last needed
+  // before frameIndex. Returns false, having changed nothing, if it can't.
+  bool evict(size_t bytes, uint64_t frameIndex);
+};
+
+// Keeps every change it receives, for checking the streamer without a GPU.
+class RecordingTextureStreamingBackend : public TextureStreamingBackend {
+public:
+  struct Change {
+    uint32_t texture;
+    uint32_t firstMip;
+  };
+
+  std::vector<Change> changes;
+  // Fails every change while set, like a device out of memory.
+  bool failChanges = false;
+
+  bool setFirstResidentMip(uint32_t texture, uint32_t firstMip) override {
+    if (failChanges) {
+      return false;
+    }
+    changes.push_back({texture, firstMip});
+    return true;
+  }
+};
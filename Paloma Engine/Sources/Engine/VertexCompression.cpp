@@ -0,0 +1,217 @@
+//
+//  VertexCompression.cpp
+//  Paloma Engine
+//
+
+#include "VertexCompression.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+MeshConstants makeMeshConstants(const AABB &bounds) {
+  MeshConstants constants;
+  if (bounds.isEmpty()) {
+    constants.positionScale = {1.0f, 1.0f, 1.0f};
+    constants.positionOffset = {0.0f, 0.0f, 0.0f};
+    return constants;
+  }
+  const simd_float3 extents = bounds.extents();
+  constants.positionOffset = bounds.center();
+  constants.positionScale = {extents.x > 0.0f ? extents.x : 1.0f,
+                             extents.y > 0.0f ? extents.y : 1.0f,
+                             extents.z > 0.0f ? extents.z : 1.0f};
+  return constants;
+}
+
+static simd_float2 readFloat2(const uint8_t *p) {
+  float v[2];
+  memcpy(v, p, sizeof(v));
+  return {v[0], v[1]};
+}
+
+static simd_float3 readFloat3(const uint8_t *p) {
+  float v[3];
+  memcpy(v, p, sizeof(v));
+  return {v[0], v[1], v[2]};
+}
+
+VertexAttributes readStandardVertex(const uint8_t *vertex,
+                                    bool hasTexCoords1) {
+  using namespace StandardVertexLayout;
+  VertexAttributes attributes;
+  attributes.position = readFloat3(vertex + kPositionOffset);
+  attributes.normal = readFloat3(vertex + kNormalOffset);
+  float tangent[4];
+  memcpy(tangent, vertex + kTangentOffset, sizeof(tangent));
+  attributes.tangent = {tangent[0], tangent[1], tangent[2], tangent[3]};
+  attributes.texCoords0 = readFloat2(vertex + kTexCoords0Offset);
+  attributes.texCoords1 = hasTexCoords1
+                              ? readFloat2(vertex + kTexCoords1Offset)
+                              : simd_float2{0.0f, 0.0f};
+  return attributes;
+}
+
+void writeCompactVertex(const VertexAttributes &attributes,
+                        const MeshConstants &constants, bool hasTexCoords1,
+                        uint8_t *vertex) {
+  using namespace CompactVertexLayout;
+  const simd_float3 local = (attributes.position - constants.positionOffset) /
+                            constants.positionScale;
+  const int16_t position[4] = {encodeSnorm16(local.x), encodeSnorm16(local.y),
+                               encodeSnorm16(local.z),
+                               attributes.tangent.w < 0.0f ? (int16_t)-32767
+                                                           : (int16_t)32767};
+  memcpy(vertex + kPositionOffset, position, sizeof(position));
+
+  const simd_float2 normal = encodeOctahedral(attributes.normal);
+  const int16_t packedNormal[2] = {encodeSnorm16(normal.x),
+                                   encodeSnorm16(normal.y)};
+  memcpy(vertex + kNormalOffset, packedNormal, sizeof(packedNormal));
+
+  const simd_float2 tangent = encodeOctahedral(attributes.tangent.xyz);
+  const int16_t packedTangent[2] = {encodeSnorm16(tangent.x),
+                                    encodeSnorm16(tangent.y)};
+  memcpy(vertex + kTangentOffset, packedTangent, sizeof(packedTangent));
+
+  const uint16_t texCoords0[2] = {encodeHalf(attributes.texCoords0.x),
+                                  encodeHalf(attributes.texCoords0.y)};
+  memcpy(vertex + kTexCoords0Offset, texCoords0, sizeof(texCoords0));
+  if (hasTexCoords1) {
+    const uint16_t texCoords1[2] = {encodeHalf(attributes.texCoords1.x),
+                                    encodeHalf(attributes.texCoords1.y)};
+    memcpy(vertex + kTexCoords1Offset, texCoords1, sizeof(texCoords1));
+  }
+}
+
+VertexAttributes readCompactVertex(const uint8_t *vertex,
+                                   const MeshConstants &constants,
+                                   bool hasTexCoords1) {
+  using namespace CompactVertexLayout;
+  VertexAttributes attributes;
+
+  int16_t position[4];
+  memcpy(position, vertex + kPositionOffset, sizeof(position));
+  const simd_float3 local = {decodeSnorm16(position[0]),
+                             decodeSnorm16(position[1]),
+                             decodeSnorm16(position[2])};
+  attributes.position =
+      local * constants.positionScale + constants.positionOffset;
+
+  int16_t normal[2];
+  memcpy(normal, vertex + kNormalOffset, sizeof(normal));
+  attributes.normal =
+      decodeOctahedral({decodeSnorm16(normal[0]), decodeSnorm16(normal[1])});
+
+  int16_t tangent[2];
+  memcpy(tangent, vertex + kTangentOffset, sizeof(tangent));
+  const simd_float3 tangentDirection =
+      decodeOctahedral({decodeSnorm16(tangent[0]), decodeSnorm16(tangent[1])});
+  attributes.tangent = {tangentDirection.x, tangentDirection.y,
+                        tangentDirection.z, position[3] < 0 ? -1.0f : 1.0f};
+
+  uint16_t texCoords[2];
+  memcpy(texCoords, vertex + kTexCoords0Offset, sizeof(texCoords));
+  attributes.texCoords0 = {decodeHalf(texCoords[0]), decodeHalf(texCoords[1])};
+  attributes.texCoords1 = {0.0f, 0.0f};
+  if (hasTexCoords1) {
+    memcpy(texCoords, vertex + kTexCoords1Offset, sizeof(texCoords));
+    attributes.texCoords1 = {decodeHalf(texCoords[0]),
+                             decodeHalf(texCoords[1])};
+  }
+  return attributes;
+}
+
+int16_t encodeSnorm16(float value) {
+  return (int16_t)lroundf(std::clamp(value, -1.0f, 1.0f) * 32767.0f);
+}
+
+float decodeSnorm16(int16_t value) {
+  // Same as the GPU: -32768 and -32767 both map to -1.
+  return std::max(value / 32767.0f, -1.0f);
+}
+
+simd_float2 encodeOctahedral(simd_float3 direction) {
+  const float sum =
+      fabsf(direction.x) + fabsf(direction.y) + fabsf(direction.z);
+  if (sum == 0.0f) {
+    return {0.0f, 0.0f};
+  }
+  simd_float2 p = {direction.x / sum, direction.y / sum};
+  if (direction.z < 0.0f) {
+    // Fold the lower hemisphere over the diagonals.
+    const simd_float2 folded = {(1.0f - fabsf(p.y)) * (p.x >= 0.0f ? 1 : -1),
+                                (1.0f - fabsf(p.x)) * (p.y >= 0.0f ? 1 : -1)};
+    p = folded;
+  }
+  return p;
+}
+
+simd_float3 decodeOctahedral(simd_float2 encoded) {
+  simd_float3 n = {encoded.x, encoded.y,
+                   1.0f - fabsf(encoded.x) - fabsf(encoded.y)};
+  const float t = std::max(-n.z, 0.0f);
+  n.x += n.x >= 0.0f ? -t : t;
+  n.y += n.y >= 0.0f ? -t : t;
+  return simd_normalize(n);
+}
+
+uint16_t encodeHalf(float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  const uint32_t sign = (bits >> 16) & 0x8000;
+  const uint32_t biasedExponent = (bits >> 23) & 0xff;
+  uint32_t mantissa = bits & 0x7fffff;
+
+  if (biasedExponent == 0xff) {
+    // Infinity stays infinity; NaN stays a quiet NaN.
+    return (uint16_t)(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+  }
+
+  const int32_t exponent = (int32_t)biasedExponent - 127 + 15;
+  if (exponent >= 31) {
+    return (uint16_t)(sign | 0x7c00);
+  }
+
+  uint32_t shift = 13;
+  uint32_t half = 0;
+  if (exponent <= 0) {
+    // Subnormal half, or zero once the value is too small.
+    if (exponent < -10) {
+      return (uint16_t)sign;
+    }
+    mantissa |= 0x800000;
+    shift = (uint32_t)(14 - exponent);
+  } else {
+    half = (uint32_t)exponent << 10;
+  }
+  half |= mantissa >> shift;
+
+  // Round to nearest even; a carry correctly bumps the exponent.
+  const uint32_t remainder = mantissa & ((1u << shift) - 1);
+  const uint32_t halfway = 1u << (shift - 1);
+  if (remainder > halfway || (remainder == halfway && (half & 1))) {
+    half++;
+  }
+  return (uint16_t)(sign | half);
+}
+
+float decodeHalf(uint16_t value) {
+  const uint32_t sign = (uint32_t)(value & 0x8000) << 16;
+  const uint32_t exponent = (value >> 10) & 0x1f;
+  const uint32_t mantissa = value & 0x3ff;
+
+  if (exponent == 0) {
+    const float magnitude = ldexpf((float)mantissa, -24);
+    return sign ? -magnitude : magnitude;
+  }
+
+  uint32_t bits;
+  if (exponent == 31) {
+    bits = sign | 0x7f800000 | (mantissa << 13);
+  } else {
+    bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+  }
+  float result;
+  memcpy(&result, &bits, sizeof(result));
+  return result;
+}
@@ -0,0 +1,67 @@
+//
+//  VertexCompression.hpp
+//  Paloma Engine
+//
+
+#pragma once
+#include "Bounds.hpp"
+#include "ShaderStructures.h"
+#include <simd/simd.h>
+#include <cstddef>
+#include <cstdint>
+
+// How a mesh's vertices are laid out in its single vertex buffer.
+enum class VertexFormat : uint32_t { Standard, Compact };
+
+// The layout Scene::load asks ModelIO for: 56 bytes, 64 with a second UV set.
+namespace StandardVertexLayout {
+constexpr size_t kPositionOffset = 0;    // float4
+constexpr size_t kNormalOffset = 16;     // float3
+constexpr size_t kTangentOffset = 32;    // float4, w is the bitangent sign
+constexpr size_t kTexCoords0Offset = 48; // float2
+constexpr size_t kTexCoords1Offset = 56; // float2
+constexpr size_t stride(bool hasTexCoords1) { return hasTexCoords1 ? 64 : 56; }
+} // namespace StandardVertexLayout
+
+// Quantized layout: 20 bytes, 24 with a second UV set.
+namespace CompactVertexLayout {
+// snorm16 x4: position in MeshConstants' box, w is the bitangent sign.
+constexpr size_t kPositionOffset = 0;
+constexpr size_t kNormalOffset = 8;      // snorm16 x2, octahedral
+constexpr size_t kTangentOffset = 12;    // snorm16 x2, octahedral
+constexpr size_t kTexCoords0Offset = 16; // half2
+constexpr size_t kTexCoords1Offset = 20; // half2
+constexpr size_t stride(bool hasTexCoords1) { return hasTexCoords1 ? 24 : 20; }
+} // namespace CompactVertexLayout
+
+struct VertexAttributes {
+  simd_float3 position;
+  simd_float3 normal;
+  simd_float4 tangent;
+  simd_float2 texCoords0;
+  simd_float2 texCoords1;
+};
+
+// Maps the bounds onto the snorm16 range [-1, 1] on every axis.
+MeshConstants makeMeshConstants(const AABB &bounds);
+
+VertexAttributes readStandardVertex(const uint8_t *vertex, bool hasTexCoords1);
+void writeCompactVertex(const VertexAttributes &attributes,
+                        const MeshConstants &constants, bool hasTexCoords1,
+                        uint8_t *vertex);
+// What pbr_vertex reconstructs from a compact vertex.
+VertexAttributes readCompactVertex(const uint8_t *vertex,
+                                   const MeshConstants &constants,
+                                   bool hasTexCoords1);
+
+int16_t encodeSnorm16(float value);
+float decodeSnorm16(int16_t value);
+
+// Unit vector to the [-1, 1] square and back.
+simd_float2 encodeOctahedral(simd_float3 direction);
+simd_float3 decodeOctahedral(simd_float2 encoded);
+
+// IEEE half floats, rounded to nearest even. UVs far outside [0, 1] lose
+// precision in this form.
+uint16_t encodeHalf(float value);
+float decodeHalf(uint16_t value);
@@ -37,6 +37,13 @@ typedef struct {
   simd_float3x3 normalMatrix;
 } InstanceConstants;
 
+// Compact vertices store positions as snorm16 inside the mesh's bounds:
+// position = stored * positionScale + positionOffset.
+typedef struct {
+  simd_float3 positionScale;
+  simd_float3 positionOffset;
+} MeshConstants;
+
 typedef struct {
   simd_float3 position;
   simd_float3 direction;
@@ -87,6 +94,8 @@ enum {
   vertexBuffer3,
   vertexBufferFrameConstants,
   vertexBufferInstanceConstants,
+  vertexBufferInstanceSlots,
+  vertexBufferMeshConstants,
 
   VertexBufferCount // Keep last
 };
@@ -95,7 +104,6 @@ enum {
   fragmentBufferFrameConstants,
   fragmentBufferLights,
   fragmentBufferMaterial,
-  fragmentBufferInstanceConstants,
 
   FragmentBufferCount // Keep last
 };
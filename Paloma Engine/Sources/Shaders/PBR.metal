@@ -55,6 +55,7 @@ constexpr constant bool hasOpacityMap     [[function_constant(17)]];
 constexpr constant int opacityUVSet       [[function_constant(18)]];
 constexpr constant bool useIBL            [[function_constant(19)]];
 constexpr constant unsigned int alphaMode [[function_constant(20)]];
+constexpr constant bool useCompactVertices [[function_constant(21)]];
 
 #pragma mark - Constexpr samplers
 
@@ -74,6 +75,9 @@ struct Material {
     texture2d<float, access::sample> opacityTexture;
 };
 
+// With useCompactVertices the attributes hold the CompactVertexLayout:
+// position is snorm16 in the mesh's bounds with the bitangent sign in w,
+// normal and tangent are octahedral in .xy and UVs are halfs.
 typedef struct {
     float4 position   [[attribute(0)]];
     float3 normal     [[attribute(1) function_constant(hasNormals)]];
@@ -195,17 +199,30 @@ static float2 getRoughnessUV(FragmentIn v) {
 
 #pragma mark - Vertex attribute accessors
 
+static float3 decodeOctahedral(float2 e)
+{
+    float3 n = float3(e, 1.0f - abs(e.x) - abs(e.y));
+    float t = saturate(-n.z);
+    n.xy += select(float2(t), float2(-t), n.xy >= 0.0f);
+    return normalize(n);
+}
+
 static float4 getPosition(VertexIn v)
 {
-    float4 pos = float4(v.position.xyz, 1.0f);
-    return pos;
+    return float4(v.position.xyz, 1.0f);
+}
+
+// Only callable under useCompactVertices, where the mesh constants exist.
+static float4 getCompactPosition(VertexIn v, constant MeshConstants &mesh)
+{
+    return float4(v.position.xyz * mesh.positionScale + mesh.positionOffset, 1.0f);
 }
 
 static float3 getNormal(VertexIn v)
 {
     float3 normal { 0.0f, 0.0f, 1.0f };
     if (hasNormals) {
-        normal = v.normal;
+        normal = useCompactVertices ? decodeOctahedral(v.normal.xy) : v.normal;
     }
     return normalize(normal);
 }
@@ -215,8 +232,13 @@ static float4 getTangent(VertexIn v)
     float3 tangent { 1.0f, 0.0f, 0.0f };
     float tangentW = 1.0f;
     if (hasTangents) {
-        tangent = v.tangent.xyz;
-        tangentW = v.tangent.w;
+        if (useCompactVertices) {
+            tangent = decodeOctahedral(v.tangent.xy);
+            tangentW = v.position.w < 0.0f ? -1.0f : 1.0f;
+        } else {
+            tangent = v.tangent.xyz;
+            tangentW = v.tangent.w;
+        }
     }
     return float4(normalize(tangent), tangentW);
 }
@@ -504,14 +526,24 @@ static float3 getIBLRadianceLambertian(texturecube<float, access::sample> lamber
 
 #pragma mark - Primitive vertex function
 
+// Draws are instanced: instanceSlots lists the slot of every instance in
+// this draw, and the slot indexes the persistent instance constants.
 vertex VertexOut pbr_vertex(VertexIn in [[stage_in]],
-                            constant FrameConstants &frame       [[buffer(vertexBufferFrameConstants)]],
-                            constant InstanceConstants &instance [[buffer(vertexBufferInstanceConstants)]])
+                            uint instanceID                             [[instance_id]],
+                            constant FrameConstants &frame              [[buffer(vertexBufferFrameConstants)]],
+                            const device InstanceConstants *instances   [[buffer(vertexBufferInstanceConstants)]],
+                            const device uint *instanceSlots            [[buffer(vertexBufferInstanceSlots)]],
+                            constant MeshConstants *mesh                [[buffer(vertexBufferMeshConstants), function_constant(useCompactVertices)]])
 {
     VertexOut out{};
+    const device InstanceConstants &instance = instances[instanceSlots[instanceID]];
 
     out.pointSize = 1.0f;
-    float4 worldPosition = instance.modelMatrix * getPosition(in);
+    float4 modelPosition = getPosition(in);
+    if (useCompactVertices) {
+        modelPosition = getCompactPosition(in, *mesh);
+    }
+    float4 worldPosition = instance.modelMatrix * modelPosition;
     out.position = worldPosition.xyz / worldPosition.w;
 
     if (hasNormals) {
@@ -550,7 +582,6 @@ typedef float4 FragmentOut;
 
 fragment FragmentOut pbr_fragment(FragmentIn in                                             [[stage_in]],
                                   constant FrameConstants &frame                            [[buffer(fragmentBufferFrameConstants)]],
-                                  constant InstanceConstants &instance                      [[buffer(fragmentBufferInstanceConstants)]],
                                   constant Material &material                               [[buffer(fragmentBufferMaterial)]],
                                   constant Light *lights                                    [[buffer(fragmentBufferLights)]],
                                   texturecube<float, access::sample> lambertEnvironmentMap  [[texture(fragmentTextureDiffuseEnvironment)]],
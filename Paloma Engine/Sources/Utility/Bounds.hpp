@@ -0,0 +1,157 @@
+//
+//  Bounds.hpp
+//  Paloma Engine
+//
+
+#pragma once
+#include <simd/simd.h>
+#include <cfloat>
+
+struct AABB {
+    simd_float3 min = { FLT_MAX, FLT_MAX, FLT_MAX };
+    simd_float3 max = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+    bool isEmpty() const { return min.x > max.x; }
+
+    simd_float3 center() const { return (min + max) * 0.5f; }
+    simd_float3 extents() const { return (max - min) * 0.5f; }
+
+    void expand(simd_float3 point) {
+        min = simd_min(min, point);
+        max = simd_max(max, point);
+    }
+
+    void expand(const AABB& other) {
+        min = simd_min(min, other.min);
+        max = simd_max(max, other.max);
+    }
+
+    AABB inflated(float margin) const {
+        return { min - margin, max + margin };
+    }
+
+    static AABB merged(const AABB& a, const AABB& b) {
+        return { simd_min(a.min, b.min), simd_max(a.max, b.max) };
+    }
+
+    float surfaceArea() const {
+        simd_float3 size = max - min;
+        return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+    }
+
+    bool contains(const AABB& other) const {
+        return simd_all(min <= other.min) && simd_all(other.max <= max);
+    }
+
+    bool intersects(const AABB& other) const {
+        return simd_all(min <= other.max) && simd_all(other.min <= max);
+    }
+
+    bool intersects(simd_float3 sphereCenter, float radius) const {
+        simd_float3 closest = simd_clamp(sphereCenter, min, max);
+        return simd_distance_squared(closest, sphereCenter) <= radius * radius;
+    }
+
+    // Slab test against the ray origin + t * direction, t in [0, maxDistance].
+    // On a hit, distance is where the ray enters (0 when it starts inside).
+    bool intersectsRay(simd_float3 origin, simd_float3 inverseDirection,
+                       float maxDistance, float& distance) const {
+        simd_float3 t0 = (min - origin) * inverseDirection;
+        simd_float3 t1 = (max - origin) * inverseDirection;
+        simd_float3 tNear = simd_min(t0, t1);
+        simd_float3 tFar = simd_max(t0, t1);
+        float enter = simd_reduce_max(simd_make_float4(tNear, 0.0f));
+        float exit = simd_reduce_min(simd_make_float4(tFar, maxDistance));
+        distance = enter;
+        return enter <= exit;
+    }
+
+    // Box around this box after transform (Arvo's method).
+    AABB transformed(const matrix_float4x4& transform) const {
+        if (isEmpty()) {
+            return *this;
+        }
+        simd_float3 c = simd_mul(transform, simd_make_float4(center(), 1.0f)).xyz;
+        simd_float3 e = extents();
+        simd_float3 worldExtents = simd_abs(transform.columns[0].xyz) * e.x +
+                                   simd_abs(transform.columns[1].xyz) * e.y +
+                                   simd_abs(transform.columns[2].xyz) * e.z;
+        return { c - worldExtents, c + worldExtents };
+    }
+};
+
+struct BoundingSphere {
+    simd_float3 center = { 0, 0, 0 };
+    float radius = 0.0f;
+};
+
+enum class Containment { Outside, Intersects, Inside };
+
+// Six inward-facing planes (xyz normal, w offset); a point p is inside when
+// dot(plane.xyz, p) + plane.w >= 0 for every plane.
+struct Frustum {
+    enum Plane { Left, Right, Bottom, Top, Near, Far, PlaneCount };
+
+    simd_float4 planes[PlaneCount];
+
+    // Planes of a Metal clip volume (z from 0 to w) in the space the matrix
+    // maps from, e.g. world space for a view-projection matrix.
+    static Frustum fromMatrix(const matrix_float4x4& m) {
+        simd_float4 rows[4];
+        for (int i = 0; i < 4; ++i) {
+            rows[i] = simd_make_float4(m.columns[0][i], m.columns[1][i], m.columns[2][i], m.columns[3][i]);
+        }
+
+        Frustum frustum;
+        frustum.planes[Left] = rows[3] + rows[0];
+        frustum.planes[Right] = rows[3] - rows[0];
+        frustum.planes[Bottom] = rows[3] + rows[1];
+        frustum.planes[Top] = rows[3] - rows[1];
+        frustum.planes[Near] = rows[2];
+        frustum.planes[Far] = rows[3] - rows[2];
+
+        for (auto& plane : frustum.planes) {
+            plane /= simd_length(plane.xyz);
+        }
+        return frustum;
+    }
+
+    bool intersects(const AABB& box) const {
+        simd_float3 c = box.center();
+        simd_float3 e = box.extents();
+        for (const auto& plane : planes) {
+            float distance = simd_dot(plane.xyz, c) + plane.w;
+            float radius = simd_dot(simd_abs(plane.xyz), e);
+            if (distance + radius < 0.0f) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    Containment classify(const AABB& box) const {
+        simd_float3 c = box.center();
+        simd_float3 e = box.extents();
+        Containment result = Containment::Inside;
+        for (const auto& plane : planes) {
+            float distance = simd_dot(plane.xyz, c) + plane.w;
+            float radius = simd_dot(simd_abs(plane.xyz), e);
+            if (distance + radius < 0.0f) {
+                return Containment::Outside;
+            }
+            if (distance - radius < 0.0f) {
+                result = Containment::Intersects;
+            }
+        }
+        return result;
+    }
+
+    bool intersects(const BoundingSphere& sphere) const {
+        for (const auto& plane : planes) {
+            if (simd_dot(plane.xyz, sphere.center) + plane.w < -sphere.radius) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
@@ -6,8 +6,12 @@
 //
 
 #pragma once
-#include <Metal/Metal.hpp>
+#include "GPUDevice.hpp"
+#include <algorithm>
 #include <cassert>
+#include <cstring>
+#include <functional>
+#include <memory>
 #include <vector>
 #include <numeric>
 
@@ -15,81 +19,291 @@ static inline size_t alignUp(size_t n, size_t alignment) {
     return (n + alignment - 1) & ~(alignment - 1);
 }
 
-struct BufferView {
-    MTL::Buffer *pBuffer;
-    size_t offset;
-    size_t length;
-    
-    uint64_t gpuAddress() const { return pBuffer->gpuAddress() + offset; }
-};
-
-class RingBuffer {
+// Linear allocator for data that lives for one frame. Allocations come from
+// GPU buffer chunks; when the current chunk is full another one is chained
+// instead of wrapping, so a frame never overwrites its own data. A frame's
+// chunks return to the pool once the GPU has completed that frame, so a
+// steady-state frame creates no buffers. Not thread safe: use one per thread.
+class FrameAllocator {
 public:
-    RingBuffer(size_t length, MTL::Device* pDevice) : _nextOffset(0) {
-        _pBuffer = NS::TransferPtr(pDevice->newBuffer(length, MTL::ResourceStorageModeShared));
-        
-        if (pDevice->supportsFamily(MTL::GPUFamilyApple2)) {
-            _minimumAlignment = 4;
-        } else if (pDevice->supportsFamily(MTL::GPUFamilyMac2)) {
-            _minimumAlignment = 32;
-        } else {
-            _minimumAlignment = 256;
+    struct Stats {
+        size_t frameBytes = 0;     // requested this frame, alignment included
+        size_t highWaterBytes = 0; // largest frameBytes so far
+        size_t chunkBytes = 0;     // every chunk, pooled or in use
+        uint32_t chunkCount = 0;
+        uint32_t chunksCreatedThisFrame = 0;
+    };
+
+    FrameAllocator(size_t chunkSize, GPUDevice* pDevice, GPUMemoryCategory category)
+    : _pDevice(pDevice)
+    , _category(category)
+    , _chunkSize(chunkSize)
+    , _minimumAlignment(pDevice->minimumConstantAlignment()) {
+        _free.push_back(newChunk(chunkSize));
+    }
+
+    // Starts frameIndex. Chunks used by frames up to completedFrameIndex are
+    // free again.
+    void beginFrame(uint64_t frameIndex, uint64_t completedFrameIndex) {
+        for (auto& chunk : _inUse) {
+            if (chunk.frameIndex <= completedFrameIndex) {
+                _free.push_back(std::move(chunk.pBuffer));
+            }
         }
+        std::erase_if(_inUse, [&](const Chunk& chunk) {
+            return !chunk.pBuffer;
+        });
+        _frameIndex = frameIndex;
+        _hasChunk = false;
+        _stats.frameBytes = 0;
+        _stats.chunksCreatedThisFrame = 0;
     }
-    
-    // reset pointer (every frame)
-    void reset() {
-        _nextOffset = 0;
-    }
-    
-    // allocate memory in buffer
-    // if there is not enough space to reach the end of the buffer, it "loops" back to the beginning
-    BufferView allocate(size_t length, size_t alignment){
-        assert(length <= _pBuffer->length());
-        
-        size_t effectiveAligment = std::lcm(alignment, _minimumAlignment);
-        size_t offset = alignUp(_nextOffset, effectiveAligment);
-        
-        if (offset + length >= _pBuffer->length()) {
+
+    BufferView allocate(size_t length, size_t alignment) {
+        size_t effectiveAlignment = std::lcm(alignment, _minimumAlignment);
+        size_t offset = alignUp(_offset, effectiveAlignment);
+
+        if (!_hasChunk || offset + length > _inUse.back().pBuffer->length()) {
+            acquireChunk(length);
             offset = 0;
         }
-        
-        _nextOffset = offset + length;
-        return { _pBuffer.get(), offset, length};
+
+        _stats.frameBytes += offset + length - _offset;
+        _stats.highWaterBytes = std::max(_stats.highWaterBytes, _stats.frameBytes);
+        _offset = offset + length;
+        return { _inUse.back().pBuffer.get(), offset, length };
     }
-    
+
     // Copy 1 object
     template <typename T>
     BufferView copy(const T& value) {
         static_assert(std::is_trivially_copyable<T>::value, "The type must be POD-compatible to be copied to the GPU");
-        
+
         BufferView view = allocate(sizeof(T), alignof(T));
-        uint8_t* pContents = (uint8_t*)_pBuffer->contents();
-        memcpy(pContents + view.offset, &value, sizeof(T));
-        
+        memcpy((uint8_t*)view.pBuffer->contents() + view.offset, &value, sizeof(T));
         return view;
     }
-    
+
     // Copy vector of elements
     template <typename T>
     BufferView copy(const std::vector<T>& elements) {
         static_assert(std::is_trivially_copyable<T>::value, "The type must be POD-compatible to be copied to the GPU");
-        
-        if (elements.empty()) return { _pBuffer.get(), 0, 0 };
+
+        if (elements.empty()) return { nullptr, 0, 0 };
         size_t totalSize = sizeof(T) * elements.size();
-        
+
         BufferView view = allocate(totalSize, alignof(T));
-        
-        uint8_t* pContents = (uint8_t*)_pBuffer->contents();
-        memcpy(pContents + view.offset, elements.data(), totalSize);
-        
+        memcpy((uint8_t*)view.pBuffer->contents() + view.offset, elements.data(), totalSize);
         return view;
     }
-    
-    MTL::Buffer* getBuffer() const { return _pBuffer.get(); }
-    
+
+    // Appends the chunks created since the last call, which still have to be
+    // made resident.
+    void takeNewChunks(std::vector<GPUBuffer*>& chunks) {
+        chunks.insert(chunks.end(), _newChunks.begin(), _newChunks.end());
+        _newChunks.clear();
+    }
+
+    const Stats& stats() const { return _stats; }
+
 private:
-    NS::SharedPtr<MTL::Buffer> _pBuffer;
+    struct Chunk {
+        std::unique_ptr<GPUBuffer> pBuffer;
+        uint64_t frameIndex;
+    };
+
+    GPUDevice* _pDevice;
+    GPUMemoryCategory _category;
+    size_t _chunkSize;
     size_t _minimumAlignment;
-    size_t _nextOffset;
+
+    std::vector<Chunk> _inUse; // oldest frame first
+    std::vector<std::unique_ptr<GPUBuffer>> _free;
+    std::vector<GPUBuffer*> _newChunks;
+    uint64_t _frameIndex = 0;
+    bool _hasChunk = false;
+    size_t _offset = 0;
+    Stats _stats;
+
+    std::unique_ptr<GPUBuffer> newChunk(size_t length) {
+        auto pBuffer = _pDevice->newBuffer(length, _category);
+        pBuffer->setLabel("Frame Upload Chunk");
+        _newChunks.push_back(pBuffer.get());
+        _stats.chunkBytes += length;
+        _stats.chunkCount++;
+        return pBuffer;
+    }
+
+    void acquireChunk(size_t minimumLength) {
+        auto it = std::find_if(_free.begin(), _free.end(), [&](const auto& pBuffer) {
+            return pBuffer->length() >= minimumLength;
+        });
+        std::unique_ptr<GPUBuffer> pBuffer;
+        if (it != _free.end()) {
+            pBuffer = std::move(*it);
+            _free.erase(it);
+        } else {
+            // Oversized requests get a chunk of their own size.
+            pBuffer = newChunk(std::max(_chunkSize, minimumLength));
+            _stats.chunksCreatedThisFrame++;
+        }
+        _inUse.push_back({ std::move(pBuffer), _frameIndex });
+        _hasChunk = true;
+        _offset = 0;
+    }
+};
+
+// Persistent array of T slots with one shared copy per frame in flight.
+// update() stores the value once; flush() copies it into a frame's buffer
+// when that frame comes around, so a slot that stops changing costs nothing
+// after framesInFlight frames. Slots are stride bytes apart; with the default
+// stride they are packed like a T array so shaders can index a frame's buffer
+// directly.
+template <typename T>
+class FrameSlotBuffer {
+public:
+    static_assert(std::is_trivially_copyable<T>::value, "The type must be POD-compatible to be copied to the GPU");
+
+    FrameSlotBuffer(size_t capacity, size_t framesInFlight, GPUDevice* pDevice, GPUMemoryCategory category,
+                    size_t stride = sizeof(T))
+    : _pDevice(pDevice)
+    , _category(category)
+    , _framesInFlight(framesInFlight)
+    , _stride(stride) {
+        assert(framesInFlight <= 8);
+        assert(stride >= sizeof(T));
+        allocateBuffers(std::max<size_t>(capacity, 1));
+    }
+
+    uint32_t allocateSlot() {
+        if (!_freeSlots.empty()) {
+            uint32_t slot = _freeSlots.back();
+            _freeSlots.pop_back();
+            return slot;
+        }
+        if (_values.size() == _capacity) {
+            grow(_capacity * 2);
+        }
+        _values.emplace_back();
+        _pendingMask.push_back(0);
+        return (uint32_t)(_values.size() - 1);
+    }
+
+    void freeSlot(uint32_t slot) {
+        _freeSlots.push_back(slot);
+    }
+
+    void update(uint32_t slot, const T& value) {
+        _values[slot] = value;
+        if (_pendingMask[slot] == 0) {
+            _pendingSlots.push_back(slot);
+        }
+        _pendingMask[slot] = (uint8_t)((1u << _framesInFlight) - 1);
+    }
+
+    // Call once the GPU has finished with frameIndex's previous use.
+    void flush(size_t frameIndex) {
+        retireBuffers();
+
+        uint8_t frameBit = (uint8_t)(1u << frameIndex);
+        uint8_t* pContents = (uint8_t*)_buffers[frameIndex]->contents();
+
+        size_t kept = 0;
+        for (uint32_t slot : _pendingSlots) {
+            if (_pendingMask[slot] & frameBit) {
+                memcpy(pContents + slot * _stride, &_values[slot], sizeof(T));
+                _pendingMask[slot] &= ~frameBit;
+            }
+            if (_pendingMask[slot] != 0) {
+                _pendingSlots[kept++] = slot;
+            }
+        }
+        _pendingSlots.resize(kept);
+        _flushCount++;
+    }
+
+    BufferView view(size_t frameIndex, uint32_t slot) const {
+        return { _buffers[frameIndex].get(), slot * _stride, sizeof(T) };
+    }
+
+    const T& value(uint32_t slot) const { return _values[slot]; }
+
+    GPUBuffer* getBuffer(size_t frameIndex) const { return _buffers[frameIndex].get(); }
+
+    // Bumped whenever growing replaced the underlying buffers.
+    uint32_t bufferGeneration() const { return _bufferGeneration; }
+
+    // Called with each buffer growing replaced, once no frame in flight reads
+    // it and just before it is released, so whoever made it resident can
+    // remove it first.
+    void setReleaseCallback(std::function<void(GPUBuffer*)> onRelease) {
+        _onRelease = std::move(onRelease);
+    }
+
+    size_t stride() const { return _stride; }
+    size_t capacity() const { return _capacity; }
+    // Slots handed out so far, free ones included.
+    size_t slotCount() const { return _values.size(); }
+    size_t freeSlotCount() const { return _freeSlots.size(); }
+    // Slots that some frame's buffer has yet to receive.
+    size_t pendingSlotCount() const { return _pendingSlots.size(); }
+
+private:
+    struct RetiredBuffer {
+        std::unique_ptr<GPUBuffer> pBuffer;
+        uint64_t releaseAfterFlush;
+    };
+
+    GPUDevice* _pDevice;
+    GPUMemoryCategory _category;
+    size_t _framesInFlight;
+    size_t _stride;
+    size_t _capacity = 0;
+
+    std::vector<std::unique_ptr<GPUBuffer>> _buffers;
+    std::vector<RetiredBuffer> _retired;
+    uint32_t _bufferGeneration = 0;
+    uint64_t _flushCount = 0;
+    std::function<void(GPUBuffer*)> _onRelease;
+
+    std::vector<T> _values;
+    std::vector<uint8_t> _pendingMask;
+    std::vector<uint32_t> _pendingSlots;
+    std::vector<uint32_t> _freeSlots;
+
+    void allocateBuffers(size_t capacity) {
+        _buffers.clear();
+        for (size_t i = 0; i < _framesInFlight; ++i) {
+            _buffers.push_back(_pDevice->newBuffer(capacity * _stride, _category));
+        }
+        _capacity = capacity;
+        _bufferGeneration++;
+    }
+
+    void grow(size_t capacity) {
+        // Frames still in flight may read the old buffers; keep them alive
+        // until every frame has been flushed once more.
+        for (auto& pBuffer : _buffers) {
+            _retired.push_back({ std::move(pBuffer), _flushCount + _framesInFlight });
+        }
+        allocateBuffers(capacity);
+
+        _pendingSlots.clear();
+        for (uint32_t slot = 0; slot < _values.size(); ++slot) {
+            _pendingMask[slot] = (uint8_t)((1u << _framesInFlight) - 1);
+            _pendingSlots.push_back(slot);
+        }
+    }
+
+    void retireBuffers() {
+        std::erase_if(_retired, [this](const RetiredBuffer& retired) {
+            if (retired.releaseAfterFlush > _flushCount) {
+                return false;
+            }
+            if (_onRelease) {
+                _onRelease(retired.pBuffer.get());
+            }
+            return true;
+        });
+    }
 };
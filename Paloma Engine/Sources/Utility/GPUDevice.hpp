@@ -0,0 +1,46 @@
+//
+//  GPUDevice.hpp
+//  Paloma Engine
+//
+
+#pragma once
+#include "GPUMemoryTracker.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// CPU-visible GPU buffer. Only the upload utilities go through this; asset
+// buffers created by ModelIO stay Metal buffers.
+class GPUBuffer {
+public:
+    virtual ~GPUBuffer() = default;
+
+    virtual size_t length() const = 0;
+    virtual void* contents() const = 0;
+    virtual uint64_t gpuAddress() const = 0;
+    virtual void setLabel(const char* label) = 0;
+};
+
+// Creates buffers for the upload utilities. MetalGPUDevice is the real
+// device; HostGPUDevice backs buffers with host memory so allocators can
+// run without a GPU.
+class GPUDevice {
+public:
+    virtual ~GPUDevice() = default;
+
+    // Shared storage, written by the CPU and read by the GPU. category is
+    // what the buffer is accounted as.
+    virtual std::unique_ptr<GPUBuffer> newBuffer(size_t length, GPUMemoryCategory category) = 0;
+
+    // Minimum offset alignment for buffers bound as constant data
+    virtual size_t minimumConstantAlignment() const = 0;
+};
+
+struct BufferView {
+    GPUBuffer *pBuffer;
+    size_t offset;
+    size_t length;
+
+    uint64_t gpuAddress() const { return pBuffer->gpuAddress() + offset; }
+    void* contents() const { return (uint8_t*)pBuffer->contents() + offset; }
+};
@@ -0,0 +1,234 @@
+//
+//  GPUMemoryTracker.hpp
+//  Paloma Engine
+//
+
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// What an allocation holds, for memory accounting.
+enum class GPUMemoryCategory : uint32_t {
+    Vertices,
+    Indices,
+    Textures,
+    Environment,
+    RenderTargets,
+    Constants,
+    Materials,
+    Instances,
+    Count
+};
+
+inline const char* gpuMemoryCategoryName(GPUMemoryCategory category) {
+    switch (category) {
+        case GPUMemoryCategory::Vertices:      return "Vertices";
+        case GPUMemoryCategory::Indices:       return "Indices";
+        case GPUMemoryCategory::Textures:      return "Textures";
+        case GPUMemoryCategory::Environment:   return "Environment";
+        case GPUMemoryCategory::RenderTargets: return "RenderTargets";
+        case GPUMemoryCategory::Constants:     return "Constants";
+        case GPUMemoryCategory::Materials:     return "Materials";
+        case GPUMemoryCategory::Instances:     return "Instances";
+        case GPUMemoryCategory::Count:         break;
+    }
+    return "Unknown";
+}
+
+struct GPUMemoryUsage {
+    size_t bytes = 0;
+    size_t peakBytes = 0;
+    uint32_t allocations = 0;
+};
+
+// Live device memory, by category and by owning asset. Whoever creates an
+// allocation records it and whoever frees it releases it; allocations are
+// keyed by pointer, so recording the same one twice counts it once (e.g.
+// meshes that share a ModelIO buffer). Safe to use from any thread.
+class GPUMemoryTracker {
+public:
+    static constexpr size_t kCategoryCount = (size_t)GPUMemoryCategory::Count;
+
+    struct AssetUsage {
+        std::string name;
+        GPUMemoryUsage total;
+        std::array<GPUMemoryUsage, kCategoryCount> categories;
+    };
+
+    // The tracker every engine allocation is recorded in.
+    static GPUMemoryTracker& shared() {
+        static GPUMemoryTracker s_tracker;
+        return s_tracker;
+    }
+
+    void record(const void* pAllocation, size_t bytes, GPUMemoryCategory category, std::string_view asset) {
+        if (!pAllocation) {
+            return;
+        }
+        std::lock_guard lock(_mutex);
+        if (_allocations.contains(pAllocation)) {
+            return;
+        }
+        auto it = _assetIndices.find(std::string(asset));
+        if (it == _assetIndices.end()) {
+            it = _assetIndices.emplace(std::string(asset), (uint32_t)_assets.size()).first;
+            _assets.push_back({std::string(asset), {}, {}});
+        }
+        _allocations[pAllocation] = {bytes, category, it->second};
+
+        AssetUsage& owner = _assets[it->second];
+        add(_total, bytes);
+        add(_categories[(size_t)category], bytes);
+        add(owner.total, bytes);
+        add(owner.categories[(size_t)category], bytes);
+    }
+
+    // Allocations that were never recorded are ignored.
+    void release(const void* pAllocation) {
+        std::lock_guard lock(_mutex);
+        auto it = _allocations.find(pAllocation);
+        if (it == _allocations.end()) {
+            return;
+        }
+        const Entry entry = it->second;
+        _allocations.erase(it);
+
+        AssetUsage& owner = _assets[entry.asset];
+        remove(_total, entry.bytes);
+        remove(_categories[(size_t)entry.category], entry.bytes);
+        remove(owner.total, entry.bytes);
+        remove(owner.categories[(size_t)entry.category], entry.bytes);
+    }
+
+    GPUMemoryUsage total() const {
+        std::lock_guard lock(_mutex);
+        return _total;
+    }
+
+    GPUMemoryUsage category(GPUMemoryCategory category) const {
+        std::lock_guard lock(_mutex);
+        return _categories[(size_t)category];
+    }
+
+    // Every asset that has recorded an allocation, largest first.
+    std::vector<AssetUsage> assets() const {
+        std::vector<AssetUsage> assets;
+        {
+            std::lock_guard lock(_mutex);
+            assets = _assets;
+        }
+        std::stable_sort(assets.begin(), assets.end(), [](const AssetUsage& a, const AssetUsage& b) {
+            return a.total.bytes > b.total.bytes;
+        });
+        return assets;
+    }
+
+    // {"total": usage, "categories": {name: usage}, "assets": [{"name",
+    // "total", "categories"}]}, where usage is {"bytes", "peakBytes",
+    // "allocations"}. Categories with no allocations so far are left out of
+    // assets.
+    std::string json() const {
+        GPUMemoryUsage total;
+        std::array<GPUMemoryUsage, kCategoryCount> categories;
+        {
+            std::lock_guard lock(_mutex);
+            total = _total;
+            categories = _categories;
+        }
+
+        std::string out = "{\"total\":";
+        appendUsage(out, total);
+        out += ",\"categories\":";
+        appendCategories(out, categories, false);
+        out += ",\"assets\":[";
+        bool first = true;
+        for (const auto& asset : assets()) {
+            out += first ? "{\"name\":" : ",{\"name\":";
+            appendString(out, asset.name);
+            out += ",\"total\":";
+            appendUsage(out, asset.total);
+            out += ",\"categories\":";
+            appendCategories(out, asset.categories, true);
+            out += '}';
+            first = false;
+        }
+        out += "]}";
+        return out;
+    }
+
+private:
+    struct Entry {
+        size_t bytes;
+        GPUMemoryCategory category;
+        uint32_t asset;
+    };
+
+    mutable std::mutex _mutex;
+    std::unordered_map<const void*, Entry> _allocations;
+    std::unordered_map<std::string, uint32_t> _assetIndices;
+    std::vector<AssetUsage> _assets;
+    GPUMemoryUsage _total;
+    std::array<GPUMemoryUsage, kCategoryCount> _categories;
+
+    static void add(GPUMemoryUsage& usage, size_t bytes) {
+        usage.bytes += bytes;
+        usage.peakBytes = std::max(usage.peakBytes, usage.bytes);
+        usage.allocations++;
+    }
+
+    static void remove(GPUMemoryUsage& usage, size_t bytes) {
+        usage.bytes -= bytes;
+        usage.allocations--;
+    }
+
+    static void appendUsage(std::string& out, const GPUMemoryUsage& usage) {
+        char buffer[96];
+        snprintf(buffer, sizeof(buffer), "{\"bytes\":%zu,\"peakBytes\":%zu,\"allocations\":%u}",
+                 usage.bytes, usage.peakBytes, usage.allocations);
+        out += buffer;
+    }
+
+    static void appendCategories(std::string& out, const std::array<GPUMemoryUsage, kCategoryCount>& categories,
+                                 bool skipUnused) {
+        out += '{';
+        bool first = true;
+        for (size_t c = 0; c < kCategoryCount; ++c) {
+            if (skipUnused && categories[c].peakBytes == 0 && categories[c].allocations == 0) {
+                continue;
+            }
+            if (!first) {
+                out += ',';
+            }
+            appendString(out, gpuMemoryCategoryName((GPUMemoryCategory)c));
+            out += ':';
+            appendUsage(out, categories[c]);
+            first = false;
+        }
+        out += '}';
+    }
+
+    static void appendString(std::string& out, std::string_view text) {
+        out += '"';
+        for (char c : text) {
+            if (c == '"' || c == '\\') {
+                out += '\\';
+                out += c;
+            } else if ((unsigned char)c < 0x20) {
+                char escaped[8];
+                snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned char)c);
+                out += escaped;
+            } else {
+                out += c;
+            }
+        }
+        out += '"';
+    }
+};
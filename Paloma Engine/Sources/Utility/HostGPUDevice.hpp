@@ -0,0 +1,95 @@
+//
+//  HostGPUDevice.hpp
+//  Paloma Engine
+//
+
+#pragma once
+#include "GPUDevice.hpp"
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <new>
+#include <string>
+
+// GPUDevice backed by host memory, for running and measuring the upload
+// utilities without Metal. Every buffer gets a fake GPU address range of its
+// own; addresses are never reused, so a stale address resolves to nothing.
+class HostGPUDevice : public GPUDevice {
+public:
+    struct Stats {
+        size_t liveBytes = 0;
+        size_t peakBytes = 0;
+        uint32_t liveBuffers = 0;
+        uint32_t buffersCreated = 0;
+    };
+
+    explicit HostGPUDevice(size_t minimumConstantAlignment = 256)
+    : _minimumAlignment(minimumConstantAlignment) {}
+
+    std::unique_ptr<GPUBuffer> newBuffer(size_t length, GPUMemoryCategory) override {
+        uint64_t address = _nextAddress;
+        _nextAddress += (length + kAddressAlignment - 1) & ~(kAddressAlignment - 1);
+        _nextAddress += kAddressAlignment; // guard gap between buffers
+
+        auto pBuffer = std::make_unique<HostBuffer>(this, length, address);
+        _buffers[address] = pBuffer.get();
+        _stats.liveBytes += length;
+        _stats.peakBytes = std::max(_stats.peakBytes, _stats.liveBytes);
+        _stats.liveBuffers++;
+        _stats.buffersCreated++;
+        return pBuffer;
+    }
+
+    size_t minimumConstantAlignment() const override { return _minimumAlignment; }
+
+    // Host pointer for a fake GPU address, or nullptr if no live buffer
+    // contains it.
+    void* resolve(uint64_t gpuAddress) const {
+        auto it = _buffers.upper_bound(gpuAddress);
+        if (it == _buffers.begin()) return nullptr;
+        --it;
+        const HostBuffer* pBuffer = it->second;
+        if (gpuAddress >= it->first + pBuffer->length()) return nullptr;
+        return (uint8_t*)pBuffer->contents() + (gpuAddress - it->first);
+    }
+
+    const Stats& stats() const { return _stats; }
+
+private:
+    static constexpr uint64_t kAddressAlignment = 64 * 1024;
+
+    class HostBuffer : public GPUBuffer {
+    public:
+        HostBuffer(HostGPUDevice* pDevice, size_t length, uint64_t address)
+        : _pDevice(pDevice)
+        , _length(length)
+        , _address(address) {
+            _pContents = ::operator new(std::max<size_t>(length, 1), std::align_val_t{256});
+            memset(_pContents, 0, length);
+        }
+
+        ~HostBuffer() override {
+            ::operator delete(_pContents, std::align_val_t{256});
+            _pDevice->_buffers.erase(_address);
+            _pDevice->_stats.liveBytes -= _length;
+            _pDevice->_stats.liveBuffers--;
+        }
+
+        size_t length() const override { return _length; }
+        void* contents() const override { return _pContents; }
+        uint64_t gpuAddress() const override { return _address; }
+        void setLabel(const char* label) override { _label = label; }
+
+    private:
+        HostGPUDevice* _pDevice;
+        size_t _length;
+        uint64_t _address;
+        void* _pContents;
+        std::string _label;
+    };
+
+    size_t _minimumAlignment;
+    uint64_t _nextAddress = 0x100000000;
+    std::map<uint64_t, const HostBuffer*> _buffers;
+    Stats _stats;
+};
@@ -5,3 +5,11 @@
 //  Created by Artem on 19.01.2026.
 //
 
+#pragma once
+#include "ModelIO/ModelIO.hpp"
+
+// MDL::MeshBuffer::map() is declared by the wrapper but never defined, so
+// send -map directly. The bytes stay valid while the returned map is alive.
+static inline MDL::MeshBufferMap* mapMeshBuffer(MDL::MeshBuffer* pBuffer) {
+    return NS::Object::sendMessage<MDL::MeshBufferMap*>(pBuffer, sel_registerName("map"));
+}
@@ -0,0 +1,30 @@
+//
+//  NameID.hpp
+//  Paloma Engine
+//
+
+#pragma once
+#include <cstdint>
+#include <string_view>
+
+// 64-bit FNV-1a. Hashing is streamable, so a child's path ID can be derived
+// from its parent's without rebuilding the full "Root/Rig/Camera" string.
+using NameID = uint64_t;
+
+static constexpr NameID kEmptyNameID = 0xcbf29ce484222325ull;
+
+static constexpr NameID appendNameID(NameID seed, std::string_view text) {
+    for (char c : text) {
+        seed ^= (uint8_t)c;
+        seed *= 0x100000001b3ull;
+    }
+    return seed;
+}
+
+static constexpr NameID makeNameID(std::string_view text) {
+    return appendNameID(kEmptyNameID, text);
+}
+
+static constexpr NameID makeChildPathID(NameID parentPathID, std::string_view name) {
+    return appendNameID(appendNameID(parentPathID, "/"), name);
+}
@@ -0,0 +1,58 @@
+//
+//  RadixSort.hpp
+//  Paloma Engine
+//
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Stable LSD radix sort on a 64-bit key, one byte per pass. Digits every
+// element shares are skipped, so keys with unused high bits cost nothing.
+// scratch is resized to match and may be reused between calls.
+template <typename T, typename KeyFn>
+static void radixSort(std::vector<T>& values, std::vector<T>& scratch, KeyFn&& key) {
+    const size_t count = values.size();
+    if (count < 2) {
+        return;
+    }
+    scratch.resize(count);
+
+    // All eight histograms in one read of the input.
+    size_t histograms[8][256] = {};
+    for (const T& value : values) {
+        uint64_t k = key(value);
+        for (int pass = 0; pass < 8; ++pass) {
+            histograms[pass][(k >> (pass * 8)) & 0xff]++;
+        }
+    }
+
+    T* source = values.data();
+    T* destination = scratch.data();
+    for (int pass = 0; pass < 8; ++pass) {
+        size_t* histogram = histograms[pass];
+        const int shift = pass * 8;
+
+        if (histogram[(key(source[0]) >> shift) & 0xff] == count) {
+            continue;
+        }
+
+        size_t offset = 0;
+        for (int digit = 0; digit < 256; ++digit) {
+            size_t digitCount = histogram[digit];
+            histogram[digit] = offset;
+            offset += digitCount;
+        }
+
+        for (size_t i = 0; i < count; ++i) {
+            destination[histogram[(key(source[i]) >> shift) & 0xff]++] = source[i];
+        }
+        std::swap(source, destination);
+    }
+
+    if (source != values.data()) {
+        values.swap(scratch);
+    }
+}
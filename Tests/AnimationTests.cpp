@@ -0,0 +1,172 @@
+//
+//  AnimationTests.cpp
+//  Paloma Engine
+//
+
+#include "Animation.hpp"
+#include "Test.hpp"
+
+namespace {
+
+matrix_float4x4 makeTransform(simd_float3 translation, simd_quatf rotation,
+                              simd_float3 scale) {
+  const matrix_float3x3 r = simd_matrix3x3(rotation);
+  matrix_float4x4 m;
+  m.columns[0] = simd_make_float4(r.columns[0] * scale.x, 0.0f);
+  m.columns[1] = simd_make_float4(r.columns[1] * scale.y, 0.0f);
+  m.columns[2] = simd_make_float4(r.columns[2] * scale.z, 0.0f);
+  m.columns[3] = simd_make_float4(translation, 1.0f);
+  return m;
+}
+
+// trackCount tracks of smooth, differently paced motion, plus one track
+// that never moves, sampled at 30 Hz.
+AnimationClip makeClip(uint32_t trackCount, uint32_t frameCount) {
+  std::vector<Entity> targets;
+  std::vector<std::vector<matrix_float4x4>> samples;
+  for (uint32_t track = 0; track < trackCount; ++track) {
+    targets.push_back((Entity)track);
+    std::vector<matrix_float4x4> frames;
+    for (uint32_t frame = 0; frame < frameCount; ++frame) {
+      const float t = frame / 30.0f;
+      const float speed = 0.5f + 0.25f * track;
+      const simd_float3 translation = {
+          sinf(t * speed) * 2.0f, (float)track * 0.5f, cosf(t * speed * 0.7f)};
+      const simd_float3 axis =
+          simd_normalize(simd_make_float3(1.0f, (float)track, 0.5f));
+      const simd_quatf rotation = simd_quaternion(t * speed, axis);
+      const float s = 1.0f + 0.25f * sinf(t * 0.3f * speed);
+      const simd_float3 scale = {s, s, 1.0f};
+      frames.push_back(track == trackCount - 1
+                           ? makeTransform({1, 2, 3},
+                                           simd_quaternion(0.3f, axis),
+                                           {1, 1, 1})
+                           : makeTransform(translation, rotation, scale));
+    }
+    samples.push_back(std::move(frames));
+  }
+
+  AnimationClip clip;
+  clip.build(targets, samples, 30.0f);
+  return clip;
+}
+
+// Errors of clips whose tracks are all roots, so world transforms are the
+// local transforms the clips produce.
+float measureRootError(const AnimationClip &reference,
+                       CompressedAnimationClip &compressed) {
+  std::vector<matrix_float4x4> locals(reference.trackCount());
+  return measureAnimationError(
+      reference, compressed,
+      [&](Entity entity, const matrix_float4x4 &local) {
+        locals[(size_t)entity] = local;
+      },
+      [&](std::vector<matrix_float4x4> &world) { world = locals; });
+}
+
+} // namespace
+
+TEST(compressedClipStaysWithinTolerances) {
+  const AnimationClip clip = makeClip(6, 150);
+  const CompressedAnimationClip::Tolerances tolerances;
+  CompressedAnimationClip compressed =
+      CompressedAnimationClip::compress(clip, tolerances);
+  CHECK(compressed.trackCount() == clip.trackCount());
+  CHECK(compressed.frameCount == clip.frameCount);
+
+  // At a unit axis, a rotation error of r radians moves the point by at most
+  // r times the scale, which stays below 1.25 here.
+  const float bound = tolerances.translation + tolerances.scale +
+                      tolerances.rotation * 1.25f;
+  const float error = measureRootError(clip, compressed);
+  printf("  max error %g (bound %g), %zu -> %zu bytes\n", error, bound,
+         clip.sizeInBytes(), compressed.sizeInBytes());
+  CHECK(error <= bound * 1.01f);
+  CHECK(compressed.sizeInBytes() * 3 < clip.sizeInBytes());
+}
+
+TEST(compressionTradesSizeForError) {
+  const AnimationClip clip = makeClip(6, 150);
+  CompressedAnimationClip::Tolerances tight;
+  tight.translation = tight.rotation = tight.scale = 0.0001f;
+  CompressedAnimationClip::Tolerances loose;
+  loose.translation = loose.rotation = loose.scale = 0.005f;
+
+  CompressedAnimationClip tightClip =
+      CompressedAnimationClip::compress(clip, tight);
+  CompressedAnimationClip looseClip =
+      CompressedAnimationClip::compress(clip, loose);
+  const float tightError = measureRootError(clip, tightClip);
+  const float looseError = measureRootError(clip, looseClip);
+
+  CHECK(tightError <= 0.0001f * 3.25f * 1.01f);
+  CHECK(looseError <= 0.005f * 3.25f * 1.01f);
+  CHECK(looseClip.sizeInBytes() < tightClip.sizeInBytes());
+  CHECK(tightClip.sizeInBytes() < clip.sizeInBytes());
+}
+
+TEST(constantTracksKeepOneKey) {
+  std::vector<std::vector<matrix_float4x4>> samples(
+      1, std::vector<matrix_float4x4>(
+             100, makeTransform({1, 2, 3}, simd_quaternion(0.5f, {0, 1, 0}),
+                                {2, 2, 2})));
+  AnimationClip clip;
+  clip.build({(Entity)0}, samples, 30.0f);
+  CompressedAnimationClip compressed =
+      CompressedAnimationClip::compress(clip, {});
+
+  // One quantization box and one key per channel.
+  const size_t oneKeyPerChannel = 3 * 8 + 4 * sizeof(simd_float3) +
+                                  3 * sizeof(uint16_t) +
+                                  2 * sizeof(QuantizedVector) +
+                                  sizeof(PackedQuaternion);
+  CHECK(compressed.sizeInBytes() == oneKeyPerChannel);
+  CHECK(measureRootError(clip, compressed) <= 0.0005f * 3.0f);
+}
+
+TEST(packedQuaternionsRoundTrip) {
+  float maxError = 0.0f;
+  for (uint32_t i = 0; i < 1000; ++i) {
+    const float angle = 0.0063f * i;
+    const simd_float3 axis = simd_normalize(
+        simd_make_float3(sinf(i * 0.7f), cosf(i * 1.3f), sinf(i * 0.1f)));
+    const simd_quatf q = simd_quaternion(angle, axis);
+    const simd_quatf unpacked = CompressedAnimationClip::unpackQuaternion(
+        CompressedAnimationClip::packQuaternion(q));
+    // Angle of the rotation between them; q and -q are the same rotation.
+    const simd_quatf delta = simd_mul(simd_conjugate(q), unpacked);
+    const float error = 2.0f * atan2f(simd_length(delta.vector.xyz),
+                                      fabsf(delta.vector.w));
+    maxError = std::max(maxError, error);
+  }
+  // 15 bits over [-1/sqrt(2), 1/sqrt(2)] leave each component within about
+  // 2e-5, which is about 1e-4 radians in all, well below the default
+  // rotation tolerance.
+  CHECK(maxError < 2e-4f);
+}
+
+BENCHMARK(animationSampling) {
+  const AnimationClip clip = makeClip(64, 300);
+  CompressedAnimationClip compressed;
+  measure("compress 64 tracks x 300 frames", 3, [&] {
+    compressed = CompressedAnimationClip::compress(clip, {});
+  });
+
+  std::vector<matrix_float4x4> locals(clip.trackCount());
+  auto write = [&](Entity entity, const matrix_float4x4 &local) {
+    locals[(size_t)entity] = local;
+  };
+  float time = 0.0f;
+  measure("sample baked clip, 64 tracks", 10000, [&] {
+    clip.sample(time, write);
+    time += 1.0f / 60.0f;
+  });
+  time = 0.0f;
+  measure("sample compressed clip, 64 tracks", 10000, [&] {
+    compressed.sample(time, write);
+    time += 1.0f / 60.0f;
+  });
+  printf("  %-48s %12zu\n", "baked bytes", clip.sizeInBytes());
+  printf("  %-48s %12zu\n", "compressed bytes", compressed.sizeInBytes());
+  CHECK(compressed.sizeInBytes() < clip.sizeInBytes());
+}
@@ -0,0 +1,233 @@
+//
+//  DynamicAABBTreeTests.cpp
+//  Paloma Engine
+//
+
+#include "DynamicAABBTree.hpp"
+#include "FrustumCuller.hpp"
+#include "Test.hpp"
+#include "TestGeometry.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+std::vector<uint32_t> sorted(std::vector<uint32_t> values) {
+  std::sort(values.begin(), values.end());
+  return values;
+}
+
+// A tree over boxes, entity i being boxes[i], and the boxes it should hold.
+struct TreeFixture {
+  DynamicAABBTree tree;
+  std::vector<AABB> boxes;
+  std::vector<int32_t> proxies;
+  std::vector<bool> alive;
+
+  explicit TreeFixture(std::vector<AABB> initial) : boxes(std::move(initial)) {
+    for (uint32_t i = 0; i < boxes.size(); ++i) {
+      proxies.push_back(tree.createProxy(boxes[i], (Entity)i));
+      alive.push_back(true);
+    }
+  }
+
+  template <typename Overlaps>
+  std::vector<uint32_t> bruteForce(Overlaps &&overlaps) const {
+    std::vector<uint32_t> result;
+    for (uint32_t i = 0; i < boxes.size(); ++i) {
+      if (alive[i] && overlaps(boxes[i])) {
+        result.push_back(i);
+      }
+    }
+    return result;
+  }
+};
+
+} // namespace
+
+TEST(aabbTreeQueriesMatchBruteForce) {
+  TreeFixture fixture(makeTestBoxes(2000, 3));
+  TestRandom random = {9};
+  const Frustum frustum = Frustum::fromMatrix(makeTestProjection());
+  const AABB box = {{-20, -20, -20}, {20, 20, 20}};
+  const BoundingSphere sphere = {{10, 0, -30}, 25};
+  bool allMatched = true;
+
+  for (uint32_t round = 0; round < 10; ++round) {
+    // Jitter everything, some rounds far enough to leave the fat boxes,
+    // then swap some proxies out and back in.
+    const float step = round % 3 == 0 ? 5.0f : 0.05f;
+    for (uint32_t i = 0; i < fixture.boxes.size(); ++i) {
+      if (!fixture.alive[i]) {
+        continue;
+      }
+      const simd_float3 offset = {random.next(-step, step),
+                                  random.next(-step, step),
+                                  random.next(-step, step)};
+      fixture.boxes[i] = {fixture.boxes[i].min + offset,
+                          fixture.boxes[i].max + offset};
+      fixture.tree.moveProxy(fixture.proxies[i], fixture.boxes[i]);
+    }
+    for (uint32_t k = 0; k < 50; ++k) {
+      const uint32_t i = (uint32_t)random.next(0, 1999.99f);
+      if (fixture.alive[i]) {
+        fixture.tree.destroyProxy(fixture.proxies[i]);
+      } else {
+        fixture.proxies[i] =
+            fixture.tree.createProxy(fixture.boxes[i], (Entity)i);
+      }
+      fixture.alive[i] = !fixture.alive[i];
+    }
+
+    std::vector<Entity> entities;
+    fixture.tree.query(frustum, entities);
+    std::vector<uint32_t> found;
+    for (Entity entity : entities) {
+      found.push_back((uint32_t)entity);
+    }
+    allMatched &= sorted(found) == fixture.bruteForce([&](const AABB &b) {
+      return frustum.intersects(b);
+    });
+
+    found.clear();
+    fixture.tree.query(box, [&](Entity e) { found.push_back((uint32_t)e); });
+    allMatched &= sorted(found) == fixture.bruteForce([&](const AABB &b) {
+      return b.intersects(box);
+    });
+
+    found.clear();
+    fixture.tree.query(sphere,
+                       [&](Entity e) { found.push_back((uint32_t)e); });
+    allMatched &= sorted(found) == fixture.bruteForce([&](const AABB &b) {
+      return b.intersects(sphere.center, sphere.radius);
+    });
+  }
+  CHECK(allMatched);
+
+  uint32_t aliveCount = 0;
+  for (bool alive : fixture.alive) {
+    aliveCount += alive;
+  }
+  CHECK(fixture.tree.proxyCount() == aliveCount);
+  // Rotations keep the tree close to balanced.
+  CHECK(fixture.tree.height() <= 2 * (int32_t)std::ceil(std::log2(2000.0f)));
+}
+
+TEST(aabbTreeRaycastFindsTheClosestHit) {
+  // Random boxes plus a few along the ray, so it hits more than one.
+  std::vector<AABB> boxes = makeTestBoxes(2000, 4);
+  for (float x : {60.0f, -40.0f, 10.0f}) {
+    boxes.push_back({{x - 1, 0, 1}, {x + 1, 4, 3}});
+  }
+  TreeFixture fixture(boxes);
+  const simd_float3 origin = {-150, 1, 2};
+  const simd_float3 direction = simd_normalize(simd_make_float3(1, 0.01f, 0));
+  const simd_float3 inverseDirection = 1.0f / direction;
+
+  std::vector<uint32_t> expected = fixture.bruteForce([&](const AABB &b) {
+    float distance;
+    return b.intersectsRay(origin, inverseDirection, 300.0f, distance);
+  });
+  CHECK(expected.size() > 1);
+  uint32_t closest = UINT32_MAX;
+  float closestDistance = INFINITY;
+  for (uint32_t i : expected) {
+    float distance;
+    fixture.boxes[i].intersectsRay(origin, inverseDirection, 300.0f,
+                                   distance);
+    if (distance < closestDistance) {
+      closestDistance = distance;
+      closest = i;
+    }
+  }
+
+  // Returning the distance keeps only closer hits.
+  uint32_t hit = UINT32_MAX;
+  float hitDistance = INFINITY;
+  fixture.tree.raycast(origin, direction, 300.0f,
+                       [&](Entity entity, float distance) {
+                         if (distance < hitDistance) {
+                           hitDistance = distance;
+                           hit = (uint32_t)entity;
+                         }
+                         return distance;
+                       });
+  CHECK(hit == closest);
+  CHECK(hitDistance == closestDistance);
+
+  // Returning the maximum sees every hit; returning 0 stops at the first.
+  std::vector<uint32_t> all;
+  fixture.tree.raycast(origin, direction, 300.0f, [&](Entity entity, float) {
+    all.push_back((uint32_t)entity);
+    return 300.0f;
+  });
+  CHECK(sorted(all) == expected);
+  uint32_t calls = 0;
+  fixture.tree.raycast(origin, direction, 300.0f, [&](Entity, float) {
+    calls++;
+    return 0.0f;
+  });
+  CHECK(calls == 1);
+}
+
+TEST(aabbTreeOnlyReinsertsLeavesThatLeaveTheirFatBox) {
+  DynamicAABBTree tree;
+  const AABB bounds = {{0, 0, 0}, {1, 1, 1}};
+  const int32_t proxy = tree.createProxy(bounds, (Entity)7);
+  tree.createProxy({{5, 5, 5}, {6, 6, 6}}, (Entity)8);
+  CHECK(tree.entity(proxy) == (Entity)7);
+
+  const float small = DynamicAABBTree::kFatMargin * 0.5f;
+  const AABB nudged = {bounds.min + small, bounds.max + small};
+  CHECK(!tree.moveProxy(proxy, nudged));
+  CHECK(simd_all(tree.bounds(proxy).min == nudged.min));
+
+  const AABB moved = {bounds.min + 1.0f, bounds.max + 1.0f};
+  CHECK(tree.moveProxy(proxy, moved));
+  // Queries test the exact bounds, not the fat box.
+  uint32_t hits = 0;
+  tree.query(AABB{{0, 0, 0}, {0.9f, 0.9f, 0.9f}}, [&](Entity) { hits++; });
+  CHECK(hits == 0);
+
+  tree.destroyProxy(proxy);
+  CHECK(tree.proxyCount() == 1);
+}
+
+BENCHMARK(aabbTreeFrustumQuery) {
+  const std::vector<AABB> boxes = makeTestBoxes(100000, 5);
+  TreeFixture fixture(boxes);
+  const Frustum frustum = Frustum::fromMatrix(makeTestProjection());
+
+  std::vector<Entity> entities;
+  measure("100000 proxies, tree frustum query", 100, [&] {
+    entities.clear();
+    fixture.tree.query(frustum, entities);
+  });
+  const DynamicAABBTree::FrustumQueryStats stats =
+      fixture.tree.frustumQueryStats();
+  printf("  %-48s %12u\n", "nodes visited", stats.nodesVisited);
+  printf("  %-48s %12u\n", "leaves tested", stats.leavesTested);
+
+  std::vector<uint8_t> visible(boxes.size());
+  const FrustumCuller culler(frustum);
+  measure("100000 boxes, FrustumCuller over all", 100, [&] {
+    culler.cull(boxes.data(), boxes.size(), visible.data());
+  });
+  size_t visibleCount = 0;
+  for (uint8_t v : visible) {
+    visibleCount += v;
+  }
+  CHECK(entities.size() == visibleCount);
+
+  TestRandom random = {6};
+  measure("move 10000 proxies a little", 100, [&] {
+    for (uint32_t i = 0; i < 10000; ++i) {
+      const uint32_t proxy = (uint32_t)random.next(0, 99999.0f);
+      const simd_float3 offset = {random.next(-0.01f, 0.01f), 0, 0};
+      fixture.boxes[proxy] = {fixture.boxes[proxy].min + offset,
+                              fixture.boxes[proxy].max + offset};
+      fixture.tree.moveProxy(fixture.proxies[proxy], fixture.boxes[proxy]);
+    }
+  });
+  CHECK(fixture.tree.proxyCount() == boxes.size());
+}
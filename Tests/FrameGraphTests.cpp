@@ -0,0 +1,212 @@
+//
+//  FrameGraphTests.cpp
+//  Paloma Engine
+//
+
+#include "FrameGraph.hpp"
+#include "Test.hpp"
+#include "TestGeometry.hpp"
+#include <algorithm>
+
+namespace {
+
+constexpr size_t kHeapAlignment = 65536;
+
+// Four bytes a sample, like the RGBA8 and depth formats the renderer uses.
+FrameGraphAllocationSize sizeOf(const FrameGraphTextureDesc &desc) {
+  return {(size_t)desc.width * desc.height * 4 * desc.sampleCount,
+          kHeapAlignment};
+}
+
+FrameGraphTextureDesc makeDesc(uint32_t width, uint32_t height) {
+  FrameGraphTextureDesc desc;
+  desc.width = width;
+  desc.height = height;
+  return desc;
+}
+
+// No two textures that are alive at the same time share a byte of the heap,
+// and every offset keeps the heap's alignment.
+bool placementIsSafe(const FrameGraph &graph) {
+  const auto &resources = graph.resources();
+  for (size_t a = 0; a < resources.size(); ++a) {
+    const auto &r = resources[a];
+    if (r.imported || r.firstUse > r.lastUse) {
+      continue;
+    }
+    if (r.heapOffset % kHeapAlignment != 0 ||
+        r.heapOffset + r.size > graph.stats().heapBytes) {
+      return false;
+    }
+    for (size_t b = a + 1; b < resources.size(); ++b) {
+      const auto &o = resources[b];
+      if (o.imported || o.firstUse > o.lastUse) {
+        continue;
+      }
+      const bool together = o.firstUse <= r.lastUse && r.firstUse <= o.lastUse;
+      const bool overlap = o.heapOffset < r.heapOffset + r.size &&
+                           r.heapOffset < o.heapOffset + o.size;
+      if (together && overlap) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// Passes that each read one or two earlier textures and write a new one of
+// a random size; the last writes the drawable.
+void makeRandomGraph(FrameGraph &graph, uint32_t passCount, uint32_t seed) {
+  TestRandom random = {seed};
+  std::vector<FrameGraphResource> textures;
+  for (uint32_t p = 0; p < passCount; ++p) {
+    const uint32_t pass = graph.addPass("Pass", nullptr);
+    for (uint32_t k = 0; k < 2 && !textures.empty(); ++k) {
+      const uint32_t back =
+          (uint32_t)random.next(0, std::min<float>(textures.size(), 6));
+      graph.read(pass, textures[textures.size() - 1 - back]);
+    }
+    if (p + 1 == passCount) {
+      graph.write(pass, graph.importTexture("Drawable", nullptr));
+    } else {
+      const uint32_t size = 256u << (uint32_t)random.next(0, 3.99f);
+      textures.push_back(graph.createTexture("Texture", makeDesc(size, size)));
+      graph.write(pass, textures.back());
+    }
+  }
+}
+
+} // namespace
+
+TEST(frameGraphCullsPassesNobodyReads) {
+  FrameGraph graph;
+  int drawable = 0;
+  const auto back = graph.importTexture("Drawable", &drawable);
+  const auto shadow = graph.createTexture("Shadow", makeDesc(2048, 2048));
+  const auto hdr = graph.createTexture("HDR", makeDesc(1920, 1080));
+  const auto debug = graph.createTexture("Debug", makeDesc(1920, 1080));
+  const auto bloom = graph.createTexture("Bloom", makeDesc(960, 540));
+  const auto unused = graph.createTexture("Unused", makeDesc(64, 64));
+
+  std::vector<uint32_t> ran;
+  auto addPass = [&](const char *name) {
+    const uint32_t pass = (uint32_t)graph.passes().size();
+    return graph.addPass(name, [&ran, pass](const FrameGraph &graph,
+                                            const FrameGraph::PassInfo &info) {
+      // Each pass is handed its own info, aliasing flag included.
+      CHECK(&info == &graph.passes()[pass]);
+      ran.push_back(pass);
+    });
+  };
+  const uint32_t shadowPass = addPass("Shadow");
+  graph.write(shadowPass, shadow);
+  const uint32_t forwardPass = addPass("Forward");
+  graph.read(forwardPass, shadow);
+  graph.write(forwardPass, hdr);
+  // Only feeds a debug texture nothing reads, and through it another pass.
+  const uint32_t debugPass = addPass("Debug");
+  graph.read(debugPass, hdr);
+  graph.write(debugPass, debug);
+  const uint32_t debugCopyPass = addPass("DebugCopy");
+  graph.read(debugCopyPass, debug);
+  graph.write(debugCopyPass, unused);
+  const uint32_t capturePass = addPass("Capture");
+  graph.read(capturePass, hdr);
+  graph.setSideEffects(capturePass);
+  const uint32_t bloomPass = addPass("Bloom");
+  graph.read(bloomPass, hdr);
+  graph.write(bloomPass, bloom);
+  const uint32_t tonemapPass = addPass("Tonemap");
+  graph.read(tonemapPass, hdr);
+  graph.read(tonemapPass, bloom);
+  graph.write(tonemapPass, back);
+
+  CHECK(graph.compile(sizeOf));
+  graph.execute();
+  const std::vector<uint32_t> expected = {shadowPass, forwardPass,
+                                          capturePass, bloomPass, tonemapPass};
+  CHECK(ran == expected);
+  CHECK(graph.executionOrder() == expected);
+  CHECK(graph.passes()[debugPass].culled);
+  CHECK(graph.passes()[debugCopyPass].culled);
+  CHECK(graph.stats().culledPasses == 2);
+  // Culled passes' textures take no memory.
+  CHECK(graph.stats().transientTextures == 3);
+  CHECK(graph.resources()[debug].firstUse > graph.resources()[debug].lastUse);
+  CHECK(graph.texture(back) == &drawable);
+
+  // Reading a transient texture nothing wrote before is an error.
+  graph.reset();
+  const auto texture = graph.createTexture("Texture", makeDesc(64, 64));
+  const uint32_t pass = graph.addPass("Read", nullptr);
+  graph.read(pass, texture);
+  graph.write(pass, graph.importTexture("Drawable", nullptr));
+  CHECK(!graph.compile(sizeOf));
+}
+
+TEST(frameGraphAliasesTexturesWithDisjointLifetimes) {
+  // A -> B -> C -> drawable: A is dead by the time C is written.
+  FrameGraph graph;
+  const auto a = graph.createTexture("A", makeDesc(1024, 1024));
+  const auto b = graph.createTexture("B", makeDesc(512, 512));
+  const auto c = graph.createTexture("C", makeDesc(1024, 1024));
+  const uint32_t p0 = graph.addPass("WriteA", nullptr);
+  graph.write(p0, a);
+  const uint32_t p1 = graph.addPass("AToB", nullptr);
+  graph.read(p1, a);
+  graph.write(p1, b);
+  const uint32_t p2 = graph.addPass("BToC", nullptr);
+  graph.read(p2, b);
+  graph.write(p2, c);
+  const uint32_t p3 = graph.addPass("Present", nullptr);
+  graph.read(p3, c);
+  graph.write(p3, graph.importTexture("Drawable", nullptr));
+  CHECK(graph.compile(sizeOf));
+
+  const auto &resources = graph.resources();
+  CHECK(resources[a].firstUse == 0 && resources[a].lastUse == 1);
+  CHECK(resources[c].firstUse == 2 && resources[c].lastUse == 3);
+  CHECK(resources[a].heapOffset == resources[c].heapOffset);
+  CHECK(placementIsSafe(graph));
+  const size_t megabytes4 = 1024 * 1024 * 4;
+  CHECK(graph.stats().heapBytes == megabytes4 + 1024 * 1024);
+  CHECK(graph.stats().unaliasedBytes == 2 * megabytes4 + 1024 * 1024);
+  // Only the pass that first writes C has to wait for A's readers.
+  CHECK(!graph.passes()[p0].reusesAliasedMemory);
+  CHECK(!graph.passes()[p1].reusesAliasedMemory);
+  CHECK(graph.passes()[p2].reusesAliasedMemory);
+  CHECK(!graph.passes()[p3].reusesAliasedMemory);
+}
+
+TEST(frameGraphPlacementIsSafeOnRandomGraphs) {
+  bool safe = true;
+  size_t heapBytes = 0, unaliasedBytes = 0;
+  FrameGraph graph;
+  for (uint32_t seed = 1; seed <= 50; ++seed) {
+    graph.reset();
+    makeRandomGraph(graph, 40, seed);
+    CHECK(graph.compile(sizeOf));
+    safe &= placementIsSafe(graph);
+    safe &= graph.stats().heapBytes <= graph.stats().unaliasedBytes;
+    heapBytes += graph.stats().heapBytes;
+    unaliasedBytes += graph.stats().unaliasedBytes;
+  }
+  CHECK(safe);
+  // Short lifetimes leave most of the memory to share.
+  CHECK(heapBytes * 2 < unaliasedBytes);
+}
+
+BENCHMARK(frameGraphCompile) {
+  FrameGraph graph;
+  size_t heapBytes = 0, unaliasedBytes = 0;
+  measure("build and compile a 64-pass graph", 1000, [&] {
+    graph.reset();
+    makeRandomGraph(graph, 64, 7);
+    graph.compile(sizeOf);
+    heapBytes = graph.stats().heapBytes;
+    unaliasedBytes = graph.stats().unaliasedBytes;
+  });
+  printf("  %-48s %12zu\n", "heap bytes", heapBytes);
+  printf("  %-48s %12zu\n", "unaliased bytes", unaliasedBytes);
+  CHECK(placementIsSafe(graph));
+}
@@ -0,0 +1,79 @@
+//
+//  FrustumCullerTests.cpp
+//  Paloma Engine
+//
+
+#include "FrustumCuller.hpp"
+#include "Test.hpp"
+#include "TestGeometry.hpp"
+
+namespace {
+
+Frustum makeFrustum() { return Frustum::fromMatrix(makeTestProjection()); }
+
+} // namespace
+
+TEST(frustumCullerKeepsWhatTheCameraSees) {
+  const Frustum frustum = makeFrustum();
+  const AABB boxes[] = {
+      // In front, behind and beyond the far plane.
+      {{-1, -1, -11}, {1, 1, -9}},
+      {{-1, -1, 9}, {1, 1, 11}},
+      {{-1, -1, -201}, {1, 1, -199}},
+      // Off to the side, and straddling the side plane.
+      {{40, -1, -11}, {42, 1, -9}},
+      {{5, -1, -11}, {40, 1, -9}},
+      // Larger than the view, and empty, which is never culled.
+      {{-1000, -1000, -50}, {1000, 1000, -40}},
+      AABB(),
+  };
+  const uint8_t expected[] = {1, 0, 0, 0, 1, 1, 1};
+
+  uint8_t visible[7];
+  FrustumCuller(frustum).cull(boxes, 7, visible);
+  for (size_t i = 0; i < 7; ++i) {
+    CHECK(visible[i] == expected[i]);
+  }
+}
+
+TEST(frustumCullerMatchesScalarTest) {
+  const Frustum frustum = makeFrustum();
+  // Not a multiple of the lane count, so the last block is partial.
+  const std::vector<AABB> boxes = makeTestBoxes(1003, 1);
+  std::vector<uint8_t> visible(boxes.size(), 2);
+  FrustumCuller(frustum).cull(boxes.data(), boxes.size(), visible.data());
+
+  size_t mismatches = 0, visibleCount = 0;
+  for (size_t i = 0; i < boxes.size(); ++i) {
+    mismatches += visible[i] != (frustum.intersects(boxes[i]) ? 1 : 0);
+    visibleCount += visible[i] == 1;
+  }
+  CHECK(mismatches == 0);
+  // The frustum covers a good part of the cube, but not most of it.
+  CHECK(visibleCount > 10 && visibleCount < boxes.size() / 2);
+}
+
+BENCHMARK(frustumCulling) {
+  const Frustum frustum = makeFrustum();
+  const std::vector<AABB> boxes = makeTestBoxes(100000, 2);
+  std::vector<uint8_t> visible(boxes.size());
+
+  size_t scalarVisible = 0;
+  measure("100000 boxes, Frustum::intersects", 100, [&] {
+    scalarVisible = 0;
+    for (size_t i = 0; i < boxes.size(); ++i) {
+      visible[i] = frustum.intersects(boxes[i]);
+      scalarVisible += visible[i];
+    }
+  });
+
+  const FrustumCuller culler(frustum);
+  measure("100000 boxes, FrustumCuller", 100, [&] {
+    culler.cull(boxes.data(), boxes.size(), visible.data());
+  });
+  size_t simdVisible = 0;
+  for (uint8_t v : visible) {
+    simdVisible += v;
+  }
+  CHECK(simdVisible == scalarVisible);
+}
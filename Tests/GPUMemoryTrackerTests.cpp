@@ -0,0 +1,107 @@
+//
+//  GPUMemoryTrackerTests.cpp
+//  Paloma Engine
+//
+
+#include "GPUMemoryTracker.hpp"
+#include "Test.hpp"
+
+namespace {
+
+bool sameUsage(const GPUMemoryUsage &usage, size_t bytes, size_t peakBytes,
+               uint32_t allocations) {
+  return usage.bytes == bytes && usage.peakBytes == peakBytes &&
+         usage.allocations == allocations;
+}
+
+bool contains(const std::string &text, const std::string &part) {
+  return text.find(part) != std::string::npos;
+}
+
+} // namespace
+
+TEST(gpuMemoryTrackerCountsEachAllocationOnce) {
+  GPUMemoryTracker tracker;
+  int a = 0, b = 0;
+  tracker.record(&a, 1000, GPUMemoryCategory::Vertices, "Scene");
+  tracker.record(&b, 500, GPUMemoryCategory::Indices, "Scene");
+  CHECK(sameUsage(tracker.total(), 1500, 1500, 2));
+
+  // Meshes sharing a buffer record it again; it still counts once.
+  tracker.record(&a, 1000, GPUMemoryCategory::Vertices, "Other");
+  tracker.record(nullptr, 1000, GPUMemoryCategory::Vertices, "Scene");
+  CHECK(sameUsage(tracker.total(), 1500, 1500, 2));
+  CHECK(tracker.assets().size() == 1);
+
+  tracker.release(&a);
+  CHECK(sameUsage(tracker.total(), 500, 1500, 1));
+  // Releasing twice, or something never recorded, changes nothing.
+  tracker.release(&a);
+  tracker.release(nullptr);
+  CHECK(sameUsage(tracker.total(), 500, 1500, 1));
+
+  // Once released, the same pointer can be a new allocation.
+  tracker.record(&a, 200, GPUMemoryCategory::Textures, "Scene");
+  CHECK(sameUsage(tracker.total(), 700, 1500, 2));
+  CHECK(sameUsage(tracker.category(GPUMemoryCategory::Vertices), 0, 1000, 0));
+  CHECK(sameUsage(tracker.category(GPUMemoryCategory::Textures), 200, 200, 1));
+}
+
+TEST(gpuMemoryTrackerSplitsByCategoryAndAsset) {
+  GPUMemoryTracker tracker;
+  int allocations[5] = {};
+  tracker.record(&allocations[0], 100, GPUMemoryCategory::Vertices, "Small");
+  tracker.record(&allocations[1], 4000, GPUMemoryCategory::Textures, "Large");
+  tracker.record(&allocations[2], 3000, GPUMemoryCategory::Textures, "Large");
+  tracker.record(&allocations[3], 50, GPUMemoryCategory::Indices, "Small");
+  tracker.record(&allocations[4], 600, GPUMemoryCategory::Textures, "Small");
+
+  CHECK(sameUsage(tracker.category(GPUMemoryCategory::Textures), 7600, 7600,
+                  3));
+  CHECK(sameUsage(tracker.category(GPUMemoryCategory::Indices), 50, 50, 1));
+  CHECK(sameUsage(tracker.category(GPUMemoryCategory::Constants), 0, 0, 0));
+
+  // Largest first.
+  std::vector<GPUMemoryTracker::AssetUsage> assets = tracker.assets();
+  CHECK(assets.size() == 2);
+  CHECK(assets[0].name == "Large" && assets[1].name == "Small");
+  CHECK(sameUsage(assets[0].total, 7000, 7000, 2));
+  CHECK(sameUsage(assets[1].total, 750, 750, 3));
+  const auto textures = (size_t)GPUMemoryCategory::Textures;
+  CHECK(sameUsage(assets[1].categories[textures], 600, 600, 1));
+
+  // Peaks survive the release, and the order follows what is live.
+  tracker.release(&allocations[1]);
+  tracker.release(&allocations[2]);
+  assets = tracker.assets();
+  CHECK(assets[0].name == "Small" && assets[1].name == "Large");
+  CHECK(sameUsage(assets[1].total, 0, 7000, 0));
+  CHECK(sameUsage(assets[1].categories[textures], 0, 7000, 0));
+  CHECK(sameUsage(tracker.total(), 750, 7750, 3));
+}
+
+TEST(gpuMemoryTrackerWritesEscapedJSON) {
+  GPUMemoryTracker tracker;
+  int a = 0, b = 0;
+  tracker.record(&a, 64, GPUMemoryCategory::Materials, "Renderer");
+  tracker.record(&b, 32, GPUMemoryCategory::Vertices,
+                 std::string("a \"b\"\\c\n\x01", 10));
+  tracker.release(&b);
+
+  const std::string json = tracker.json();
+  CHECK(json.front() == '{' && json.back() == '}');
+  CHECK(contains(json, "{\"total\":{\"bytes\":64,\"peakBytes\":96,"
+                       "\"allocations\":1},\"categories\":{\"Vertices\":"));
+  // Every category is listed for the totals, including empty ones.
+  CHECK(contains(json, "\"Instances\":{\"bytes\":0,\"peakBytes\":0,"
+                       "\"allocations\":0}}"));
+  CHECK(contains(json, "\"assets\":[{\"name\":\"Renderer\",\"total\":"
+                       "{\"bytes\":64,\"peakBytes\":64,\"allocations\":1},"
+                       "\"categories\":{\"Materials\":"));
+  // Quotes, backslashes and control characters, NUL included, are escaped.
+  CHECK(contains(json,
+                 "{\"name\":\"a \\\"b\\\"\\\\c\\u000a\\u0001\\u0000\","));
+  // Assets only list the categories they have used, released ones included.
+  CHECK(contains(json, "\"categories\":{\"Vertices\":{\"bytes\":0,"
+                       "\"peakBytes\":32,\"allocations\":0}}}]}"));
+}
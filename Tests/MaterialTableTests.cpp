@@ -0,0 +1,153 @@
+//
+//  MaterialTableTests.cpp
+//  Paloma Engine
+//
+
+#include "HostGPUDevice.hpp"
+#include "MaterialTable.hpp"
+#include "Test.hpp"
+
+namespace {
+
+constexpr size_t kFramesInFlight = 3;
+
+MaterialArguments makeArguments(float alphaCutoff) {
+  MaterialArguments arguments = {};
+  arguments.constants.alphaCutoff = alphaCutoff;
+  return arguments;
+}
+
+// alphaCutoff of materialID as frameIndex's copy of the table holds it.
+float uploadedCutoff(const HostGPUDevice &device, const MaterialTable &table,
+                     size_t frameIndex, uint32_t materialID) {
+  const auto *pArguments = (const MaterialArguments *)device.resolve(
+      table.gpuAddress(frameIndex, materialID));
+  return pArguments ? pArguments->constants.alphaCutoff : -1.0f;
+}
+
+} // namespace
+
+TEST(materialTableEntriesStartAtConstantOffsets) {
+  HostGPUDevice device(256);
+  MaterialTable table(&device, kFramesInFlight, 4);
+  CHECK(table.stride() >= sizeof(MaterialArguments));
+  CHECK(table.stride() % 256 == 0);
+
+  const uint32_t first = table.add(makeArguments(0.0f));
+  const uint32_t second = table.add(makeArguments(0.0f));
+  CHECK(table.gpuAddress(0, second) - table.gpuAddress(0, first) ==
+        table.stride());
+}
+
+TEST(materialTableKeepsIDsAcrossGrowth) {
+  HostGPUDevice device(32);
+  MaterialTable table(&device, kFramesInFlight, 4);
+  const uint32_t generation = table.bufferGeneration();
+  uint32_t released = 0;
+  table.setReleaseCallback([&](GPUBuffer *) { released++; });
+
+  std::vector<uint32_t> ids;
+  for (uint32_t i = 0; i < 10; ++i) {
+    ids.push_back(table.add(makeArguments((float)i)));
+    CHECK(ids.back() == i);
+  }
+  CHECK(table.bufferGeneration() != generation);
+
+  for (size_t frame = 0; frame < kFramesInFlight; ++frame) {
+    table.flush(frame);
+    for (uint32_t i = 0; i < 10; ++i) {
+      CHECK(uploadedCutoff(device, table, frame, ids[i]) == (float)i);
+    }
+  }
+  CHECK(table.stats().pendingUploads == 0);
+
+  // 4 -> 8 -> 16: both replaced generations are reported as they go.
+  CHECK(released == 0);
+  table.flush(0);
+  CHECK(released == 2 * kFramesInFlight);
+  CHECK(device.stats().liveBuffers == kFramesInFlight);
+}
+
+TEST(materialTableUpdatesReachEachFrameWhenFlushed) {
+  HostGPUDevice device(32);
+  MaterialTable table(&device, kFramesInFlight);
+  const uint32_t id = table.add(makeArguments(1.0f));
+  for (size_t frame = 0; frame < kFramesInFlight; ++frame) {
+    table.flush(frame);
+  }
+
+  table.update(id, makeArguments(2.0f));
+  CHECK(table.arguments(id).constants.alphaCutoff == 2.0f);
+  CHECK(table.stats().pendingUploads == 1);
+
+  // Frames that haven't been flushed yet may still be on the GPU and keep
+  // the old entry.
+  table.flush(1);
+  CHECK(uploadedCutoff(device, table, 0, id) == 1.0f);
+  CHECK(uploadedCutoff(device, table, 1, id) == 2.0f);
+  CHECK(uploadedCutoff(device, table, 2, id) == 1.0f);
+
+  table.flush(2);
+  table.flush(0);
+  CHECK(uploadedCutoff(device, table, 0, id) == 2.0f);
+  CHECK(uploadedCutoff(device, table, 2, id) == 2.0f);
+  CHECK(table.stats().pendingUploads == 0);
+}
+
+TEST(materialTableReusesRemovedIDs) {
+  HostGPUDevice device(32);
+  MaterialTable table(&device, kFramesInFlight, 8);
+  for (uint32_t i = 0; i < 6; ++i) {
+    table.add(makeArguments((float)i));
+  }
+
+  table.remove(3);
+  table.remove(5);
+  CHECK(!table.contains(3));
+  CHECK(table.stats().liveMaterials == 4);
+
+  const uint32_t reused = table.add(makeArguments(42.0f));
+  CHECK(reused == 3 || reused == 5);
+  CHECK(table.contains(reused));
+  CHECK(table.arguments(reused).constants.alphaCutoff == 42.0f);
+
+  const MaterialTable::Stats stats = table.stats();
+  CHECK(stats.liveMaterials == 5);
+  CHECK(stats.capacity == 8);
+  CHECK(stats.freeSlots == 3);
+  CHECK(stats.bytes == 8 * table.stride() * kFramesInFlight);
+}
+
+BENCHMARK(materialTableAddUpdateFlush) {
+  HostGPUDevice device(32);
+  const uint32_t materialCount = 4096;
+
+  MaterialTable table(&device, kFramesInFlight);
+  measure("add 4096 materials from 64 slots", 1, [&] {
+    MaterialTable growing(&device, kFramesInFlight);
+    for (uint32_t i = 0; i < materialCount; ++i) {
+      growing.add(makeArguments((float)i));
+    }
+  });
+
+  for (uint32_t i = 0; i < materialCount; ++i) {
+    table.add(makeArguments((float)i));
+  }
+  size_t frame = 0;
+  uint32_t next = 0;
+  measure("update 64 materials, flush", 10000, [&] {
+    for (uint32_t i = 0; i < 64; ++i) {
+      next = (next + 97) % materialCount;
+      table.update(next, makeArguments((float)next));
+    }
+    table.flush(frame);
+    frame = (frame + 1) % kFramesInFlight;
+  });
+  measure("flush, nothing changed", 10000, [&] {
+    table.flush(frame);
+    frame = (frame + 1) % kFramesInFlight;
+  });
+
+  CHECK(table.stats().pendingUploads == 0);
+  CHECK(uploadedCutoff(device, table, 0, next) == (float)next);
+}
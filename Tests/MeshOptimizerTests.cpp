@@ -0,0 +1,170 @@
+//
+//  MeshOptimizerTests.cpp
+//  Paloma Engine
+//
+
+#include "MeshOptimizer.hpp"
+#include "Test.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+namespace {
+
+// Stride of the engine's standard interleaved vertex.
+constexpr size_t kVertexStride = 56;
+
+struct TestMesh {
+  std::vector<simd_float3> positions;
+  std::vector<uint32_t> indices;
+};
+
+// A UV sphere whose triangles and vertices have been shuffled with a fixed
+// seed, so it starts out with about the worst cache and fetch behaviour.
+TestMesh makeShuffledSphere(uint32_t rings, uint32_t segments) {
+  TestMesh mesh;
+  for (uint32_t r = 0; r <= rings; ++r) {
+    for (uint32_t s = 0; s <= segments; ++s) {
+      const float theta = (float)M_PI * r / rings;
+      const float phi = 2.0f * (float)M_PI * s / segments;
+      mesh.positions.push_back(simd_make_float3(
+          sinf(theta) * cosf(phi), cosf(theta), sinf(theta) * sinf(phi)));
+    }
+  }
+  for (uint32_t r = 0; r < rings; ++r) {
+    for (uint32_t s = 0; s < segments; ++s) {
+      const uint32_t a = r * (segments + 1) + s;
+      const uint32_t b = a + segments + 1;
+      mesh.indices.insert(mesh.indices.end(), {a, b, a + 1, a + 1, b, b + 1});
+    }
+  }
+
+  uint32_t state = 12345;
+  auto next = [&](uint32_t bound) {
+    state = state * 1664525u + 1013904223u;
+    return (state >> 8) % bound;
+  };
+  const size_t triangleCount = mesh.indices.size() / 3;
+  for (size_t t = triangleCount - 1; t > 0; --t) {
+    const size_t other = next((uint32_t)t + 1);
+    for (size_t k = 0; k < 3; ++k) {
+      std::swap(mesh.indices[t * 3 + k], mesh.indices[other * 3 + k]);
+    }
+  }
+  std::vector<uint32_t> shuffle(mesh.positions.size());
+  for (uint32_t v = 0; v < shuffle.size(); ++v) {
+    shuffle[v] = v;
+  }
+  for (size_t v = shuffle.size() - 1; v > 0; --v) {
+    std::swap(shuffle[v], shuffle[next((uint32_t)v + 1)]);
+  }
+  std::vector<simd_float3> positions(mesh.positions.size());
+  for (uint32_t v = 0; v < shuffle.size(); ++v) {
+    positions[shuffle[v]] = mesh.positions[v];
+  }
+  mesh.positions = std::move(positions);
+  for (uint32_t &index : mesh.indices) {
+    index = shuffle[index];
+  }
+  return mesh;
+}
+
+// Triangles by position, each rotated to start at its smallest vertex so
+// that the comparison ignores where a reorder starts a triangle but still
+// sees a flipped winding.
+std::vector<std::array<uint32_t, 3>>
+triangleSet(const std::vector<uint32_t> &indices,
+            const std::vector<uint32_t> &vertexOf) {
+  std::vector<std::array<uint32_t, 3>> triangles;
+  for (size_t i = 0; i < indices.size(); i += 3) {
+    std::array<uint32_t, 3> t = {vertexOf[indices[i]], vertexOf[indices[i + 1]],
+                                 vertexOf[indices[i + 2]]};
+    std::rotate(t.begin(), std::min_element(t.begin(), t.end()), t.end());
+    triangles.push_back(t);
+  }
+  std::sort(triangles.begin(), triangles.end());
+  return triangles;
+}
+
+} // namespace
+
+TEST(vertexOrderImprovesCacheAndFetch) {
+  TestMesh mesh = makeShuffledSphere(48, 64);
+  const size_t vertexCount = mesh.positions.size();
+  const std::vector<uint32_t> original = mesh.indices;
+
+  const VertexCacheStats cacheBefore =
+      analyzeVertexCache(mesh.indices.data(), mesh.indices.size(), vertexCount);
+  const float fetchBefore = analyzeVertexFetch(
+      mesh.indices.data(), mesh.indices.size(), vertexCount, kVertexStride);
+
+  // The same steps as ResourceContext::optimizeVertexOrder.
+  optimizeVertexCache(mesh.indices.data(), mesh.indices.size(), vertexCount);
+  const VertexCacheStats cacheOnly =
+      analyzeVertexCache(mesh.indices.data(), mesh.indices.size(), vertexCount);
+  optimizeOverdraw(mesh.indices.data(), mesh.indices.size(),
+                   mesh.positions.data(), vertexCount);
+  const std::vector<uint32_t> remap =
+      vertexFetchRemap(mesh.indices.data(), mesh.indices.size(), vertexCount);
+  std::vector<uint32_t> reordered = mesh.indices;
+  for (uint32_t &index : reordered) {
+    index = remap[index];
+  }
+
+  const VertexCacheStats cacheAfter =
+      analyzeVertexCache(reordered.data(), reordered.size(), vertexCount);
+  const float fetchAfter = analyzeVertexFetch(
+      reordered.data(), reordered.size(), vertexCount, kVertexStride);
+  printf("  ACMR %.3f -> %.3f, ATVR %.3f -> %.3f, overfetch %.3f -> %.3f\n",
+         cacheBefore.acmr, cacheAfter.acmr, cacheBefore.atvr, cacheAfter.atvr,
+         fetchBefore, fetchAfter);
+
+  CHECK(cacheAfter.acmr < cacheBefore.acmr * 0.5f);
+  CHECK(cacheAfter.acmr < 0.8f);
+  CHECK(cacheAfter.atvr < cacheBefore.atvr);
+  // Sorting clusters for overdraw may only cost a little cache efficiency.
+  CHECK(cacheAfter.acmr < cacheOnly.acmr * 1.1f);
+  CHECK(fetchAfter < fetchBefore * 0.25f);
+  CHECK(fetchAfter < 2.0f);
+
+  // Same triangles with the same winding, just in another order.
+  std::vector<uint32_t> identity(vertexCount);
+  for (uint32_t v = 0; v < vertexCount; ++v) {
+    identity[v] = v;
+  }
+  std::vector<uint32_t> oldVertexOf(vertexCount);
+  for (uint32_t v = 0; v < vertexCount; ++v) {
+    oldVertexOf[remap[v]] = v;
+  }
+  CHECK(triangleSet(original, identity) == triangleSet(reordered, oldVertexOf));
+}
+
+TEST(vertexFetchRemapOrdersByFirstUse) {
+  const std::vector<uint32_t> indices = {4, 2, 0, 0, 2, 3};
+  const std::vector<uint32_t> remap = vertexFetchRemap(indices.data(), 6, 6);
+  CHECK(remap[4] == 0);
+  CHECK(remap[2] == 1);
+  CHECK(remap[0] == 2);
+  CHECK(remap[3] == 3);
+  // Unused vertices go last, in their original order.
+  CHECK(remap[1] == 4);
+  CHECK(remap[5] == 5);
+}
+
+BENCHMARK(vertexOrderOptimization) {
+  const TestMesh source = makeShuffledSphere(128, 256);
+  const size_t vertexCount = source.positions.size();
+  std::vector<uint32_t> indices;
+  char label[64];
+  snprintf(label, sizeof(label), "%zu triangles, cache + overdraw + fetch",
+           source.indices.size() / 3);
+  measure(label, 5, [&] {
+    indices = source.indices;
+    optimizeVertexCache(indices.data(), indices.size(), vertexCount);
+    optimizeOverdraw(indices.data(), indices.size(), source.positions.data(),
+                     vertexCount);
+    vertexFetchRemap(indices.data(), indices.size(), vertexCount);
+  });
+  CHECK(analyzeVertexCache(indices.data(), indices.size(), vertexCount).acmr <
+        0.8f);
+}
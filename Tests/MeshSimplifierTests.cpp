@@ -0,0 +1,165 @@
+//
+//  MeshSimplifierTests.cpp
+//  Paloma Engine
+//
+
+#include "MeshSimplifier.hpp"
+#include "Test.hpp"
+#include <cmath>
+
+namespace {
+
+struct TestMesh {
+  std::vector<simd_float3> positions;
+  std::vector<uint32_t> indices;
+};
+
+// A unit UV sphere as an importer leaves it: the first and last column
+// repeat the same positions with different UVs, and so do the pole rows.
+TestMesh makeSphere(uint32_t rings, uint32_t segments) {
+  TestMesh mesh;
+  for (uint32_t r = 0; r <= rings; ++r) {
+    for (uint32_t s = 0; s <= segments; ++s) {
+      const float theta = (float)M_PI * r / rings;
+      const float phi = 2.0f * (float)M_PI * s / segments;
+      mesh.positions.push_back(simd_make_float3(
+          sinf(theta) * cosf(phi), cosf(theta), sinf(theta) * sinf(phi)));
+    }
+  }
+  for (uint32_t r = 0; r < rings; ++r) {
+    for (uint32_t s = 0; s < segments; ++s) {
+      const uint32_t a = r * (segments + 1) + s;
+      const uint32_t b = a + segments + 1;
+      // Wound to face outwards, without the zero-area halves at the poles.
+      if (r != 0) {
+        mesh.indices.insert(mesh.indices.end(), {a, a + 1, b});
+      }
+      if (r != rings - 1) {
+        mesh.indices.insert(mesh.indices.end(), {a + 1, b + 1, b});
+      }
+    }
+  }
+  return mesh;
+}
+
+// A flat size x size grid of quads in the xz plane, open on all four sides.
+TestMesh makeGrid(uint32_t size) {
+  TestMesh mesh;
+  for (uint32_t z = 0; z <= size; ++z) {
+    for (uint32_t x = 0; x <= size; ++x) {
+      mesh.positions.push_back(simd_make_float3((float)x, 0.0f, (float)z));
+    }
+  }
+  for (uint32_t z = 0; z < size; ++z) {
+    for (uint32_t x = 0; x < size; ++x) {
+      const uint32_t a = z * (size + 1) + x;
+      const uint32_t b = a + size + 1;
+      mesh.indices.insert(mesh.indices.end(), {a, b, a + 1, a + 1, b, b + 1});
+    }
+  }
+  return mesh;
+}
+
+simd_float3 triangleNormal(const TestMesh &mesh,
+                           const std::vector<uint32_t> &indices, size_t i) {
+  const simd_float3 a = mesh.positions[indices[i]];
+  const simd_float3 b = mesh.positions[indices[i + 1]];
+  const simd_float3 c = mesh.positions[indices[i + 2]];
+  return simd_cross(b - a, c - a);
+}
+
+std::vector<bool> usedVertices(const std::vector<uint32_t> &indices,
+                               size_t vertexCount) {
+  std::vector<bool> used(vertexCount, false);
+  for (uint32_t index : indices) {
+    used[index] = true;
+  }
+  return used;
+}
+
+} // namespace
+
+TEST(simplifiedSphereShrinksWithGrowingError) {
+  const TestMesh sphere = makeSphere(48, 64);
+  float previousError = 0.0f;
+  for (float fraction : {0.5f, 0.25f, 0.125f}) {
+    const size_t target = (size_t)(sphere.indices.size() * fraction) / 3 * 3;
+    const SimplifiedMesh lod =
+        simplifyMesh(sphere.positions.data(), sphere.positions.size(),
+                     sphere.indices.data(), sphere.indices.size(), target);
+    CHECK(lod.indices.size() % 3 == 0);
+    CHECK(lod.indices.size() <= target);
+    // Locked seams still leave it close to the target.
+    CHECK(lod.indices.size() > target * 0.8f);
+    CHECK(lod.error >= previousError);
+    CHECK(lod.error < 0.05f);
+    previousError = lod.error;
+
+    // No degenerate or flipped triangles: on a sphere around the origin
+    // every face points away from the center.
+    size_t bad = 0;
+    for (size_t i = 0; i < lod.indices.size(); i += 3) {
+      const uint32_t a = lod.indices[i], b = lod.indices[i + 1],
+                     c = lod.indices[i + 2];
+      const simd_float3 normal = triangleNormal(sphere, lod.indices, i);
+      const simd_float3 center = sphere.positions[a] + sphere.positions[b] +
+                                 sphere.positions[c];
+      bad += a == b || b == c || a == c || simd_dot(normal, center) <= 0.0f;
+    }
+    CHECK(bad == 0);
+  }
+}
+
+TEST(simplifierKeepsSeamsAndBorders) {
+  const TestMesh sphere = makeSphere(24, 32);
+  const SimplifiedMesh lod =
+      simplifyMesh(sphere.positions.data(), sphere.positions.size(),
+                   sphere.indices.data(), sphere.indices.size(), 0);
+  const std::vector<bool> used =
+      usedVertices(lod.indices, sphere.positions.size());
+  // Both columns of the UV seam are still there, away from the poles.
+  for (uint32_t r = 1; r < 24; ++r) {
+    CHECK(used[r * 33]);
+    CHECK(used[r * 33 + 32]);
+  }
+  CHECK(lod.indices.size() < sphere.indices.size() / 2);
+
+  // A flat grid keeps its whole outline and loses nothing in shape.
+  const TestMesh grid = makeGrid(16);
+  const SimplifiedMesh flat =
+      simplifyMesh(grid.positions.data(), grid.positions.size(),
+                   grid.indices.data(), grid.indices.size(), 0);
+  const std::vector<bool> gridUsed =
+      usedVertices(flat.indices, grid.positions.size());
+  bool outline = true;
+  for (uint32_t i = 0; i <= 16; ++i) {
+    outline &= gridUsed[i] && gridUsed[16 * 17 + i];
+    outline &= gridUsed[i * 17] && gridUsed[i * 17 + 16];
+  }
+  CHECK(outline);
+  CHECK(flat.error < 1e-4f);
+  CHECK(flat.indices.size() < grid.indices.size() / 2);
+  float area = 0.0f;
+  for (size_t i = 0; i < flat.indices.size(); i += 3) {
+    const simd_float3 normal = triangleNormal(grid, flat.indices, i);
+    CHECK(normal.y > 0.0f);
+    area += simd_length(normal) * 0.5f;
+  }
+  CHECK(fabsf(area - 256.0f) < 1e-2f);
+}
+
+BENCHMARK(meshSimplification) {
+  const TestMesh sphere = makeSphere(128, 256);
+  char label[64];
+  for (float fraction : {0.5f, 0.125f}) {
+    snprintf(label, sizeof(label), "%zu triangles to %g%%",
+             sphere.indices.size() / 3, fraction * 100.0f);
+    SimplifiedMesh lod;
+    measure(label, 3, [&] {
+      lod = simplifyMesh(sphere.positions.data(), sphere.positions.size(),
+                         sphere.indices.data(), sphere.indices.size(),
+                         (size_t)(sphere.indices.size() * fraction));
+    });
+    CHECK(lod.indices.size() <= sphere.indices.size() * fraction);
+  }
+}
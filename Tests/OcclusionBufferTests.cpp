@@ -0,0 +1,160 @@
+//
+//  OcclusionBufferTests.cpp
+//  Paloma Engine
+//
+
+#include "OcclusionBuffer.hpp"
+#include "Test.hpp"
+#include "TestGeometry.hpp"
+#include <algorithm>
+
+namespace {
+
+constexpr float kAspect =
+    (float)OcclusionBuffer::kWidth / OcclusionBuffer::kHeight;
+const uint32_t kQuadIndices[6] = {0, 1, 2, 0, 2, 3};
+
+AABB makeCube(simd_float3 center, float halfExtent) {
+  return {center - halfExtent, center + halfExtent};
+}
+
+// A 10x10 wall at z = -10 and a floor at y = -2 that runs from behind the
+// camera to z = -50, so it has to be clipped at the near plane.
+void addWallAndFloor(OcclusionBuffer &buffer) {
+  const simd_float3 wall[4] = {
+      {-5, -5, -10}, {5, -5, -10}, {5, 5, -10}, {-5, 5, -10}};
+  buffer.addOccluder(wall, 4, kQuadIndices, 6, matrix_identity_float4x4);
+  const simd_float3 floor[4] = {
+      {-1, -2, 5}, {1, -2, 5}, {1, -2, -50}, {-1, -2, -50}};
+  buffer.addOccluder(floor, 4, kQuadIndices, 6, matrix_identity_float4x4);
+}
+
+} // namespace
+
+TEST(occlusionBufferHidesOnlyWhatIsBehindOccluders) {
+  JobSystem jobSystem(3);
+  OcclusionBuffer buffer;
+  buffer.begin(makeTestProjection(kAspect));
+  addWallAndFloor(buffer);
+  buffer.rasterize(jobSystem);
+  CHECK(buffer.stats().occluders == 2);
+
+  CHECK(!buffer.isVisible(makeCube({0, 0, -20}, 1)));
+  CHECK(!buffer.isVisible(makeCube({0, 0, -40}, 8)));
+  CHECK(!buffer.isVisible(makeCube({0, -3, -8}, 0.3f)));
+  CHECK(buffer.isVisible(makeCube({0, 0, -5}, 1)));
+  CHECK(buffer.isVisible(makeCube({12, 0, -20}, 1)));
+  // Partly sticking out past the wall's edge.
+  CHECK(buffer.isVisible(makeCube({9, 0, -20}, 2)));
+  // Crossing the near plane, and empty: never culled.
+  CHECK(buffer.isVisible(makeCube({0, 0, 0}, 1)));
+  CHECK(buffer.isVisible(AABB()));
+  CHECK(buffer.stats().tested == 8);
+  CHECK(buffer.stats().occluded == 3);
+
+  // The next frame starts empty.
+  buffer.begin(makeTestProjection(kAspect));
+  buffer.rasterize(jobSystem);
+  CHECK(buffer.isVisible(makeCube({0, 0, -20}, 1)));
+}
+
+TEST(occlusionPyramidKeepsTheFarthestDepth) {
+  JobSystem jobSystem(3);
+  OcclusionBuffer buffer;
+  buffer.begin(makeTestProjection(kAspect));
+  addWallAndFloor(buffer);
+  buffer.rasterize(jobSystem);
+
+  CHECK(buffer.levelWidth(0) == OcclusionBuffer::kWidth);
+  CHECK(buffer.levelHeight(0) == OcclusionBuffer::kHeight);
+  bool conservative = true;
+  for (uint32_t level = 1; level < buffer.levelCount(); ++level) {
+    for (uint32_t y = 0; y < buffer.levelHeight(level); ++y) {
+      for (uint32_t x = 0; x < buffer.levelWidth(level); ++x) {
+        float farthest = 0.0f;
+        for (uint32_t k = 0; k < 4; ++k) {
+          const uint32_t cx = std::min(x * 2 + (k & 1),
+                                       buffer.levelWidth(level - 1) - 1);
+          const uint32_t cy = std::min(y * 2 + (k >> 1),
+                                       buffer.levelHeight(level - 1) - 1);
+          farthest = std::max(farthest, buffer.depth(cx, cy, level - 1));
+        }
+        conservative &= buffer.depth(x, y, level) >= farthest;
+      }
+    }
+  }
+  CHECK(conservative);
+  // The wall doesn't cover the whole view, so the top is the far plane.
+  CHECK(buffer.depth(0, 0, buffer.levelCount() - 1) == 1.0f);
+}
+
+TEST(occlusionBandsMatchSingleThreadedRasterization) {
+  JobSystem serial(0), parallel(3);
+  OcclusionBuffer a, b;
+  for (OcclusionBuffer *pBuffer : {&a, &b}) {
+    pBuffer->begin(makeTestProjection(kAspect));
+    addWallAndFloor(*pBuffer);
+  }
+  a.rasterize(serial);
+  b.rasterize(parallel);
+
+  bool same = true;
+  uint32_t covered = 0;
+  for (uint32_t y = 0; y < OcclusionBuffer::kHeight; ++y) {
+    for (uint32_t x = 0; x < OcclusionBuffer::kWidth; ++x) {
+      same &= a.depth(x, y) == b.depth(x, y);
+      covered += a.depth(x, y) < 1.0f;
+    }
+  }
+  CHECK(same);
+  CHECK(covered > OcclusionBuffer::kWidth * OcclusionBuffer::kHeight / 10);
+}
+
+BENCHMARK(occlusionCulling) {
+  // A row of 200 tall walls in front of 10000 boxes.
+  std::vector<simd_float3> positions;
+  std::vector<uint32_t> indices;
+  for (uint32_t i = 0; i < 200; ++i) {
+    const float x = -50.0f + i * 0.5f;
+    const uint32_t base = (uint32_t)positions.size();
+    positions.insert(positions.end(), {{x, -10, -20},
+                                       {x + 0.6f, -10, -20},
+                                       {x + 0.6f, 10, -20},
+                                       {x, 10, -20}});
+    for (uint32_t index : kQuadIndices) {
+      indices.push_back(base + index);
+    }
+  }
+  std::vector<AABB> boxes = makeTestBoxes(10000, 8);
+  for (AABB &box : boxes) {
+    // Pushed behind the walls.
+    const float depth = 25.0f + (box.max.z + 150.0f) * 0.25f;
+    box = {{box.min.x * 0.3f, box.min.y * 0.05f, -depth - 1.0f},
+           {box.max.x * 0.3f, box.max.y * 0.05f, -depth + 1.0f}};
+  }
+
+  OcclusionBuffer buffer;
+  const matrix_float4x4 projection = makeTestProjection(kAspect);
+  for (uint32_t threads : {1u, JobSystem::defaultWorkerCount() + 1}) {
+    JobSystem jobSystem(threads - 1);
+    char label[64];
+    snprintf(label, sizeof(label), "400 triangles, %u threads", threads);
+    measure(label, 200, [&] {
+      buffer.begin(projection);
+      buffer.addOccluder(positions.data(), (uint32_t)positions.size(),
+                         indices.data(), (uint32_t)indices.size(),
+                         matrix_identity_float4x4);
+      buffer.rasterize(jobSystem);
+    });
+  }
+
+  uint32_t occluded = 0;
+  measure("test 10000 boxes", 100, [&] {
+    occluded = 0;
+    for (const AABB &box : boxes) {
+      occluded += !buffer.isVisible(box);
+    }
+  });
+  printf("  %-48s %12u\n", "occluded", occluded);
+  CHECK(occluded > boxes.size() / 2);
+}
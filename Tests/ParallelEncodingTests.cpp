@@ -0,0 +1,115 @@
+//
+//  ParallelEncodingTests.cpp
+//  Paloma Engine
+//
+
+#include "ParallelEncoding.hpp"
+#include "Test.hpp"
+#include "TestDraws.hpp"
+
+namespace {
+
+using Command = RecordingCommandBackend::Command;
+
+bool sameCommands(const std::vector<Command> &a,
+                  const std::vector<Command> &b) {
+  if (a.size() != b.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < a.size(); ++i) {
+    if (a[i].type != b[i].type || a[i].pState != b[i].pState ||
+        a[i].stage != b[i].stage || a[i].address != b[i].address ||
+        a[i].index != b[i].index ||
+        a[i].draw.indexCount != b[i].draw.indexCount) {
+      return false;
+    }
+  }
+  return true;
+}
+
+std::vector<Command> encodeInChunks(JobSystem &jobSystem,
+                                    const std::vector<TestDraw> &draws,
+                                    uint32_t maxChunks,
+                                    RenderStateCounters *pCounters) {
+  const std::vector<EncodeChunk> chunks =
+      splitIntoChunks(draws.size(), maxChunks, 64);
+  return recordChunks(
+      jobSystem, chunks,
+      [&](const EncodeChunk &chunk, StateTrackingEncoder &encoder) {
+        for (size_t i = chunk.begin; i < chunk.end; ++i) {
+          encodeTestDraw(encoder, draws[i], i);
+        }
+      },
+      pCounters);
+}
+
+} // namespace
+
+TEST(splitIntoChunksCoversTheListEvenly) {
+  bool valid = true;
+  for (size_t count : {0, 1, 63, 64, 200, 1000, 100003}) {
+    for (uint32_t maxChunks : {0u, 1u, 3u, 8u}) {
+      const std::vector<EncodeChunk> chunks =
+          splitIntoChunks(count, maxChunks, 64);
+      valid &= !chunks.empty();
+      valid &= chunks.size() <= std::max(maxChunks, 1u);
+      size_t next = 0;
+      size_t smallest = SIZE_MAX, largest = 0;
+      for (size_t i = 0; i < chunks.size(); ++i) {
+        valid &= chunks[i].index == i && chunks[i].begin == next;
+        next = chunks[i].end;
+        smallest = std::min(smallest, chunks[i].end - chunks[i].begin);
+        largest = std::max(largest, chunks[i].end - chunks[i].begin);
+      }
+      valid &= next == count && largest - smallest <= 1;
+      // Splitting never leaves a chunk under the minimum.
+      valid &= chunks.size() == 1 || smallest >= 64;
+    }
+  }
+  CHECK(valid);
+  CHECK(splitIntoChunks(100, 8, 64).size() == 1);
+  CHECK(splitIntoChunks(1000, 8, 64).size() == 8);
+  CHECK(splitIntoChunks(1000, 8, 0).size() == 8);
+}
+
+TEST(recordedChunksMatchSerialEncoding) {
+  const std::vector<TestDraw> draws = makeTestDraws(20000, 31);
+  JobSystem serial(0), parallel(3);
+  RenderStateCounters serialCounters, parallelCounters;
+  const std::vector<Command> a =
+      encodeInChunks(serial, draws, 8, &serialCounters);
+  const std::vector<Command> b =
+      encodeInChunks(parallel, draws, 8, &parallelCounters);
+  // Chunks come back in draw order whichever thread encoded them.
+  CHECK(sameCommands(a, b));
+  CHECK(parallelCounters.totalIssued() == serialCounters.totalIssued());
+  CHECK(parallelCounters.draws == draws.size());
+
+  // Every chunk starts with nothing bound, so each draw still has its state.
+  CHECK(commandsMatchDraws(b, draws));
+
+  // That costs at most one bind of each kind a chunk over one encoder.
+  RecordingCommandBackend backend;
+  StateTrackingEncoder encoder(&backend);
+  for (size_t i = 0; i < draws.size(); ++i) {
+    encodeTestDraw(encoder, draws[i], i);
+  }
+  const uint32_t singleIssued = encoder.counters().totalIssued();
+  CHECK(parallelCounters.totalIssued() >= singleIssued);
+  CHECK(parallelCounters.totalIssued() <= singleIssued + 8 * 4);
+}
+
+BENCHMARK(parallelEncoding) {
+  const std::vector<TestDraw> draws = makeTestDraws(100000, 32);
+  const uint32_t threads = JobSystem::defaultWorkerCount() + 1;
+  char label[64];
+  std::vector<Command> commands;
+  for (uint32_t chunks : {1u, threads}) {
+    JobSystem jobSystem(chunks - 1);
+    snprintf(label, sizeof(label), "100000 draws, %u chunks", chunks);
+    measure(label, 20, [&] {
+      commands = encodeInChunks(jobSystem, draws, chunks, nullptr);
+    });
+  }
+  CHECK(commandsMatchDraws(commands, draws));
+}
@@ -0,0 +1,166 @@
+//
+//  RadixSortTests.cpp
+//  Paloma Engine
+//
+
+#include "RadixSort.hpp"
+#include "Test.hpp"
+#include <algorithm>
+#include <memory>
+#include <simd/simd.h>
+
+namespace {
+
+// The layout of RenderQueue's DrawPacket.
+struct Packet {
+  uint64_t sortKey;
+  uint32_t itemIndex;
+};
+
+uint64_t sortKey(const Packet &packet) { return packet.sortKey; }
+
+struct Random {
+  uint64_t state;
+  uint32_t next() {
+    state = state * 6364136223846793005ull + 1442695040888963407ull;
+    return (uint32_t)(state >> 33);
+  }
+};
+
+// Keys laid out like SortKey::make for opaque and mask draws: alpha mode,
+// then a few pipelines, a few hundred materials and a 24-bit depth.
+std::vector<Packet> makePackets(uint32_t count) {
+  Random random = {42};
+  std::vector<Packet> packets(count);
+  for (uint32_t i = 0; i < count; ++i) {
+    const uint64_t alpha = random.next() % 2;
+    const uint64_t pipeline = random.next() % 6;
+    const uint64_t material = random.next() % 400;
+    const uint64_t depth = random.next() & 0xffffff;
+    packets[i].sortKey = alpha << 58 | pipeline << 44 | material << 24 | depth;
+    packets[i].itemIndex = i;
+  }
+  return packets;
+}
+
+// The draw list the renderer sorted before draw packets: a mesh reference,
+// the full model matrix and a comparator that asks the material for its
+// order on both sides of every comparison.
+enum class LegacyAlphaMode { Opaque, Mask, Blend };
+
+struct LegacyMaterial {
+  LegacyAlphaMode alphaMode;
+  int relativeSortOrder() const {
+    switch (alphaMode) {
+    case LegacyAlphaMode::Opaque:
+      return -1;
+    case LegacyAlphaMode::Mask:
+      return 0;
+    case LegacyAlphaMode::Blend:
+      return 1;
+    }
+    return -1;
+  }
+};
+
+struct LegacyDrawCall {
+  std::shared_ptr<int> mesh;
+  const void *submesh;
+  const LegacyMaterial *material;
+  matrix_float4x4 modelTransform;
+  simd_float3 modelViewPosition;
+};
+
+} // namespace
+
+TEST(radixSortMatchesStableSort) {
+  Random random = {7};
+  std::vector<Packet> packets(5000);
+  for (uint32_t i = 0; i < packets.size(); ++i) {
+    // Few distinct keys, so stability matters.
+    packets[i] = {(uint64_t)(random.next() % 50) << 40 | random.next() % 3, i};
+  }
+  std::vector<Packet> expected = packets;
+  std::stable_sort(expected.begin(), expected.end(),
+                   [](const Packet &a, const Packet &b) {
+                     return a.sortKey < b.sortKey;
+                   });
+
+  std::vector<Packet> scratch;
+  radixSort(packets, scratch, sortKey);
+  bool same = packets.size() == expected.size();
+  for (size_t i = 0; same && i < packets.size(); ++i) {
+    same = packets[i].sortKey == expected[i].sortKey &&
+           packets[i].itemIndex == expected[i].itemIndex;
+  }
+  CHECK(same);
+}
+
+TEST(radixSortHandlesSharedAndFullWidthKeys) {
+  std::vector<Packet> packets = {
+      {~0ull, 0}, {5, 1}, {1ull << 63, 2}, {5, 3}, {0, 4}};
+  std::vector<Packet> scratch;
+  radixSort(packets, scratch, sortKey);
+  const uint32_t order[] = {4, 1, 3, 2, 0};
+  for (size_t i = 0; i < packets.size(); ++i) {
+    CHECK(packets[i].itemIndex == order[i]);
+  }
+
+  // Every digit shared: nothing moves.
+  std::vector<Packet> equal = {{9, 0}, {9, 1}, {9, 2}};
+  radixSort(equal, scratch, sortKey);
+  CHECK(equal[0].itemIndex == 0 && equal[2].itemIndex == 2);
+}
+
+BENCHMARK(drawSorting) {
+  const uint32_t drawCount = 100000;
+  const std::vector<Packet> source = makePackets(drawCount);
+
+  const LegacyMaterial materials[] = {{LegacyAlphaMode::Opaque},
+                                      {LegacyAlphaMode::Mask},
+                                      {LegacyAlphaMode::Blend}};
+  const auto mesh = std::make_shared<int>(0);
+  std::vector<LegacyDrawCall> legacySource(drawCount);
+  for (uint32_t i = 0; i < drawCount; ++i) {
+    LegacyDrawCall &draw = legacySource[i];
+    draw.mesh = mesh;
+    draw.submesh = nullptr;
+    draw.material = &materials[source[i].sortKey >> 58];
+    draw.modelTransform = matrix_identity_float4x4;
+    draw.modelViewPosition = {0.0f, 0.0f,
+                              (float)(source[i].sortKey & 0xffffff)};
+  }
+
+  std::vector<LegacyDrawCall> drawCalls;
+  measure("100000 draws, DrawCall + std::sort", 20, [&] {
+    drawCalls = legacySource;
+    std::sort(drawCalls.begin(), drawCalls.end(),
+              [](const LegacyDrawCall &a, const LegacyDrawCall &b) {
+                int leftSort = a.material->relativeSortOrder();
+                int rightSort = b.material->relativeSortOrder();
+                if (leftSort > 0 && rightSort > 0) {
+                  return a.modelViewPosition.z < b.modelViewPosition.z;
+                }
+                return leftSort < rightSort;
+              });
+  });
+
+  std::vector<Packet> packets;
+  measure("100000 draws, packets + std::sort", 20, [&] {
+    packets.assign(source.begin(), source.end());
+    std::sort(packets.begin(), packets.end(),
+              [](const Packet &a, const Packet &b) {
+                return a.sortKey < b.sortKey;
+              });
+  });
+
+  std::vector<Packet> scratch;
+  measure("100000 draws, packets + radixSort", 20, [&] {
+    packets.assign(source.begin(), source.end());
+    radixSort(packets, scratch, sortKey);
+  });
+  CHECK(std::is_sorted(packets.begin(), packets.end(),
+                       [](const Packet &a, const Packet &b) {
+                         return a.sortKey < b.sortKey;
+                       }));
+}
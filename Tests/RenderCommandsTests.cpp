@@ -0,0 +1,185 @@
+//
+//  RenderCommandsTests.cpp
+//  Paloma Engine
+//
+
+#include "RenderCommands.hpp"
+#include "Test.hpp"
+#include "TestDraws.hpp"
+
+namespace {
+
+using CommandType = RecordingCommandBackend::CommandType;
+
+std::vector<CommandType>
+commandTypes(const RecordingCommandBackend &backend) {
+  std::vector<CommandType> types;
+  for (const auto &command : backend.commands) {
+    types.push_back(command.type);
+  }
+  return types;
+}
+
+// How many times a field of the sorted draws changes, counting the first.
+template <typename Field>
+uint32_t runCount(const std::vector<TestDraw> &draws, Field field) {
+  uint32_t runs = 0;
+  for (size_t i = 0; i < draws.size(); ++i) {
+    runs += i == 0 || draws[i].*field != draws[i - 1].*field;
+  }
+  return runs;
+}
+
+// Binds everything it is given, as the renderer did before the tracker, and
+// hands the label over with every push.
+struct PassThroughEncoder {
+  RecordingCommandBackend &backend;
+  uint32_t labels = 0;
+
+  void setDepthStencilState(const MTL::DepthStencilState *pState) {
+    backend.setDepthStencilState(pState);
+  }
+  void setRenderPipelineState(const MTL::RenderPipelineState *pState) {
+    backend.setRenderPipelineState(pState);
+  }
+  void setAddress(RenderStage stage, uint64_t address, uint32_t index) {
+    backend.setAddress(stage, address, index);
+  }
+  void pushDebugGroup(const void *, std::string_view label) {
+    backend.registerLabel(labels % 64, label);
+    backend.pushDebugGroup(labels++ % 64);
+  }
+  void popDebugGroup() { backend.popDebugGroup(); }
+  void drawIndexed(const IndexedDraw &draw) { backend.drawIndexed(draw); }
+};
+
+} // namespace
+
+TEST(stateTrackingEncoderDropsRedundantBinds) {
+  RecordingCommandBackend backend;
+  StateTrackingEncoder encoder(&backend);
+  encoder.setRenderPipelineState(testPipeline(0));
+  encoder.setRenderPipelineState(testPipeline(0));
+  encoder.setDepthStencilState(testDepthState(0));
+  encoder.setDepthStencilState(testDepthState(0));
+  // The same address at another index or stage is a different binding.
+  encoder.setAddress(RenderStage::Vertex, 0x100, 0);
+  encoder.setAddress(RenderStage::Vertex, 0x100, 0);
+  encoder.setAddress(RenderStage::Vertex, 0x100, 1);
+  encoder.setAddress(RenderStage::Fragment, 0x100, 0);
+  encoder.setAddress(RenderStage::Vertex, 0x200, 0);
+  // A null pipeline is still a state to bind once.
+  encoder.setRenderPipelineState(nullptr);
+  encoder.setRenderPipelineState(nullptr);
+  encoder.setRenderPipelineState(testPipeline(0));
+
+  const std::vector<CommandType> expected = {
+      CommandType::SetRenderPipelineState, CommandType::SetDepthStencilState,
+      CommandType::SetAddress,             CommandType::SetAddress,
+      CommandType::SetAddress,             CommandType::SetAddress,
+      CommandType::SetRenderPipelineState, CommandType::SetRenderPipelineState};
+  CHECK(commandTypes(backend) == expected);
+  CHECK(backend.commands[5].address == 0x200);
+  CHECK(backend.commands[6].pState == nullptr);
+
+  const RenderStateCounters &counters = encoder.counters();
+  CHECK(counters.issued[RenderStateCounters::Pipeline] == 3);
+  CHECK(counters.skipped[RenderStateCounters::Pipeline] == 2);
+  CHECK(counters.issued[RenderStateCounters::DepthStencil] == 1);
+  CHECK(counters.skipped[RenderStateCounters::DepthStencil] == 1);
+  CHECK(counters.issued[RenderStateCounters::VertexAddress] == 3);
+  CHECK(counters.issued[RenderStateCounters::FragmentAddress] == 1);
+  CHECK(counters.totalIssued() == 8);
+  CHECK(counters.totalSkipped() == 4);
+}
+
+TEST(stateTrackingEncoderResetRebindsEverything) {
+  RecordingCommandBackend backend;
+  StateTrackingEncoder encoder(&backend);
+  const int meshA = 0, meshB = 0;
+  encoder.pushDebugGroup(&meshA, "A");
+  encoder.setRenderPipelineState(testPipeline(1));
+  encoder.setAddress(RenderStage::Fragment, 0x100, 3);
+  encoder.popDebugGroup();
+
+  // A new encoder on the GPU has nothing bound.
+  encoder.reset();
+  encoder.pushDebugGroup(&meshA, "A");
+  encoder.pushDebugGroup(&meshB, "B");
+  encoder.setRenderPipelineState(testPipeline(1));
+  encoder.setAddress(RenderStage::Fragment, 0x100, 3);
+  CHECK(encoder.counters().totalIssued() == 4);
+  CHECK(encoder.counters().totalSkipped() == 0);
+  // Labels outlive reset(): A was registered once and reused.
+  CHECK(encoder.counters().labelsRegistered == 2);
+  CHECK(backend.labels.size() == 2);
+  CHECK(backend.labels[0] == "A" && backend.labels[1] == "B");
+  CHECK(backend.commands[4].type == CommandType::PushDebugGroup &&
+        backend.commands[4].index == 0);
+
+  // A new backend has never seen them.
+  RecordingCommandBackend other;
+  encoder.setBackend(&other);
+  encoder.pushDebugGroup(&meshB, "B");
+  encoder.setRenderPipelineState(testPipeline(1));
+  CHECK(other.labels.size() == 1 && other.labels[0] == "B");
+  CHECK(other.commands.size() == 2);
+  CHECK(encoder.counters().labelsRegistered == 3);
+  encoder.resetCounters();
+  CHECK(encoder.counters().totalIssued() == 0);
+}
+
+TEST(stateTrackingEncoderKeepsEveryDrawsState) {
+  const std::vector<TestDraw> draws = makeTestDraws(5000, 21);
+  RecordingCommandBackend backend;
+  StateTrackingEncoder encoder(&backend);
+  for (size_t i = 0; i < draws.size(); ++i) {
+    encodeTestDraw(encoder, draws[i], i);
+  }
+  CHECK(commandsMatchDraws(backend.commands, draws));
+
+  // Sorted by state, a bind is only issued where its run starts.
+  const RenderStateCounters &counters = encoder.counters();
+  CHECK(counters.draws == draws.size());
+  CHECK(counters.issued[RenderStateCounters::DepthStencil] ==
+        runCount(draws, &TestDraw::depthState));
+  CHECK(counters.issued[RenderStateCounters::FragmentAddress] ==
+        runCount(draws, &TestDraw::material));
+  CHECK(counters.issued[RenderStateCounters::VertexAddress] ==
+        runCount(draws, &TestDraw::mesh) + draws.size());
+  CHECK(counters.issued[RenderStateCounters::Pipeline] ==
+        runCount(draws, &TestDraw::pipeline));
+  CHECK(counters.totalIssued() + counters.totalSkipped() == 5 * draws.size());
+  CHECK(counters.labelsRegistered == backend.labels.size());
+  CHECK(counters.labelsRegistered <= 300);
+}
+
+BENCHMARK(redundantStateFiltering) {
+  const std::vector<TestDraw> draws = makeTestDraws(100000, 22);
+  RecordingCommandBackend backend;
+  backend.commands.reserve(draws.size() * 8);
+
+  PassThroughEncoder passThrough = {backend};
+  measure("100000 draws, every bind", 20, [&] {
+    backend.commands.clear();
+    for (size_t i = 0; i < draws.size(); ++i) {
+      encodeTestDraw(passThrough, draws[i], i);
+    }
+  });
+  const size_t unfilteredCommands = backend.commands.size();
+
+  StateTrackingEncoder encoder(&backend);
+  measure("100000 draws, StateTrackingEncoder", 20, [&] {
+    backend.commands.clear();
+    encoder.reset();
+    encoder.resetCounters();
+    for (size_t i = 0; i < draws.size(); ++i) {
+      encodeTestDraw(encoder, draws[i], i);
+    }
+  });
+  printf("  %-48s %12zu\n", "commands, every bind", unfilteredCommands);
+  printf("  %-48s %12zu\n", "commands, tracked", backend.commands.size());
+  printf("  %-48s %12u\n", "binds skipped", encoder.counters().totalSkipped());
+  CHECK(commandsMatchDraws(backend.commands, draws));
+  CHECK(backend.commands.size() < unfilteredCommands);
+}
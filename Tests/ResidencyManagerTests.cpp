@@ -0,0 +1,196 @@
+//
+//  ResidencyManagerTests.cpp
+//  Paloma Engine
+//
+
+#include "ResidencyManager.hpp"
+#include "Test.hpp"
+#include <unordered_map>
+
+namespace {
+
+constexpr size_t kMegabyte = 1 << 20;
+
+// Runs a frame that uses allocations [first, last), with the GPU
+// framesInFlight frames behind.
+struct FrameDriver {
+  ResidencyManager &manager;
+  const int *pAllocations;
+  uint64_t frameIndex = 0;
+  uint32_t framesInFlight = 2;
+
+  bool frame(int first, int last) {
+    frameIndex++;
+    manager.beginFrame(frameIndex, frameIndex > framesInFlight
+                                       ? frameIndex - framesInFlight
+                                       : 0);
+    for (int i = first; i < last; ++i) {
+      manager.use(&pAllocations[i]);
+    }
+    return manager.endFrame();
+  }
+};
+
+// What the backend holds after replaying its changes agrees with the
+// manager.
+bool backendMatches(const ResidencyManager &manager,
+                    const RecordingResidencyBackend &backend,
+                    const int *pAllocations, int count) {
+  std::unordered_map<const void *, bool> resident;
+  bool valid = true;
+  for (const auto &change : backend.changes) {
+    // Never added twice or removed when not resident.
+    valid &= resident[change.pAllocation] != change.added;
+    resident[change.pAllocation] = change.added;
+  }
+  for (int i = 0; i < count; ++i) {
+    valid &= resident[&pAllocations[i]] == manager.isResident(&pAllocations[i]);
+  }
+  return valid;
+}
+
+} // namespace
+
+TEST(residencyManagerEvictsTheLeastRecentlyUsed) {
+  RecordingResidencyBackend backend;
+  ResidencyManager manager(&backend, 100 * kMegabyte, 80 * kMegabyte, 10);
+  int allocations[20];
+  for (int &allocation : allocations) {
+    manager.track(&allocation, 10 * kMegabyte);
+  }
+  manager.track(&allocations[0], 10 * kMegabyte);
+  CHECK(manager.stats().trackedAllocations == 20);
+  CHECK(manager.stats().residentAllocations == 0);
+
+  FrameDriver driver = {manager, allocations};
+  CHECK(driver.frame(0, 10));
+  CHECK(manager.stats().madeResident == 10);
+  for (uint32_t i = 2; i < 30; ++i) {
+    CHECK(!driver.frame(0, 10));
+  }
+  // The first half goes out of view a frame before the second.
+  driver.frame(5, 10);
+  CHECK(manager.stats().residentBytes == 100 * kMegabyte);
+
+  // Over budget, but everything was used too recently to remove.
+  CHECK(driver.frame(10, 15));
+  CHECK(manager.stats().residentBytes == 150 * kMegabyte);
+  CHECK(manager.stats().evicted == 0);
+  uint32_t evictedAt = 0;
+  while (driver.frameIndex < 60) {
+    driver.frame(10, 15);
+    if (manager.stats().evicted && !evictedAt) {
+      evictedAt = (uint32_t)driver.frameIndex;
+      CHECK(manager.stats().evicted == 5);
+    }
+  }
+  // Frame 40 is ten frames after the first half was last used.
+  CHECK(evictedAt == 40);
+  for (int i = 0; i < 15; ++i) {
+    CHECK(manager.isResident(&allocations[i]) == (i >= 5));
+  }
+  // Within budget again, so the idle second half stays.
+  CHECK(manager.stats().residentBytes == 100 * kMegabyte);
+  CHECK(backendMatches(manager, backend, allocations, 20));
+}
+
+TEST(residencyManagerStopsAtTheLowWaterMark) {
+  RecordingResidencyBackend backend;
+  ResidencyManager manager(&backend, 100 * kMegabyte, 50 * kMegabyte, 0);
+  int allocations[12];
+  for (int &allocation : allocations) {
+    manager.track(&allocation, 10 * kMegabyte);
+  }
+  FrameDriver driver = {manager, allocations};
+  driver.frame(0, 10);
+  driver.frame(0, 10);
+  driver.frame(3, 10);
+
+  // Frames the GPU hasn't finished hold on to what they used.
+  driver.framesInFlight = 3;
+  driver.frame(10, 11);
+  CHECK(manager.stats().evicted == 0);
+  CHECK(manager.stats().residentBytes == 110 * kMegabyte);
+
+  // Once they have, eviction goes all the way down to the low-water mark,
+  // not just under the budget.
+  driver.framesInFlight = 1;
+  CHECK(driver.frame(11, 12));
+  CHECK(manager.stats().evicted == 7);
+  for (int i = 0; i < 3; ++i) {
+    CHECK(!manager.isResident(&allocations[i]));
+  }
+  CHECK(manager.stats().residentBytes == 50 * kMegabyte);
+  CHECK(manager.isResident(&allocations[10]));
+  CHECK(manager.isResident(&allocations[11]));
+
+  // Coming back into view brings allocations back; after that nothing
+  // changes until the budget is crossed again.
+  CHECK(driver.frame(0, 3));
+  CHECK(manager.stats().madeResident == 3);
+  CHECK(manager.stats().evicted == 0);
+  CHECK(!driver.frame(0, 3));
+  CHECK(backendMatches(manager, backend, allocations, 12));
+
+  // A lower budget takes effect at the end of the next frame.
+  manager.setBudget(30 * kMegabyte, 20 * kMegabyte);
+  CHECK(driver.frame(0, 2));
+  CHECK(manager.stats().residentBytes == 20 * kMegabyte);
+  CHECK(backendMatches(manager, backend, allocations, 12));
+}
+
+TEST(residencyManagerUntracksAndIgnoresUnknownAllocations) {
+  RecordingResidencyBackend backend;
+  ResidencyManager manager(&backend, 100 * kMegabyte, 80 * kMegabyte, 0);
+  int allocations[4];
+  for (int &allocation : allocations) {
+    manager.track(&allocation, kMegabyte);
+  }
+  manager.track(nullptr, kMegabyte);
+  FrameDriver driver = {manager, allocations};
+  driver.frame(0, 4);
+
+  // Removing the middle one keeps the others findable.
+  manager.untrack(&allocations[1]);
+  CHECK(!backend.changes.back().added);
+  CHECK(backend.changes.back().pAllocation == &allocations[1]);
+  CHECK(manager.stats().trackedAllocations == 3);
+  CHECK(manager.stats().residentAllocations == 3);
+  CHECK(manager.stats().residentBytes == 3 * kMegabyte);
+  CHECK(manager.isResident(&allocations[3]));
+  CHECK(!manager.isResident(&allocations[1]));
+  // The removal is a change the next commit has to pick up.
+  manager.beginFrame(2, 1);
+  CHECK(manager.endFrame());
+
+  const size_t changes = backend.changes.size();
+  int untracked = 0;
+  manager.beginFrame(3, 2);
+  manager.use(&untracked);
+  manager.use(&allocations[1]);
+  manager.untrack(&untracked);
+  CHECK(!manager.endFrame());
+  CHECK(backend.changes.size() == changes);
+  CHECK(backendMatches(manager, backend, allocations, 4));
+}
+
+BENCHMARK(residencyManagement) {
+  RecordingResidencyBackend backend;
+  ResidencyManager manager(&backend, 1024 * kMegabyte, 768 * kMegabyte, 30);
+  std::vector<int> allocations(10000);
+  for (int &allocation : allocations) {
+    manager.track(&allocation, kMegabyte / 4);
+  }
+
+  // A window of 2000 allocations moving through the scene.
+  FrameDriver driver = {manager, allocations.data()};
+  uint32_t evicted = 0;
+  measure("10000 allocations, 2000 used a frame", 500, [&] {
+    const int first = (int)(driver.frameIndex * 13 % 8000);
+    driver.frame(first, first + 2000);
+    evicted += manager.stats().evicted;
+    backend.changes.clear();
+  });
+  printf("  %-48s %12u\n", "evicted", evicted);
+  CHECK(manager.stats().residentBytes <= manager.stats().budgetBytes);
+}
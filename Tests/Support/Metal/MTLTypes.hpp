@@ -0,0 +1,16 @@
+//
+//  MTLTypes.hpp
+//  Paloma Engine
+//
+//  Stand-in for metal-cpp's MTLTypes.hpp on hosts without the Apple SDK.
+//  Only declares what ShaderStructures.h needs on the CPU side.
+//
+
+#pragma once
+#include <cstdint>
+
+namespace MTL {
+struct ResourceID {
+  uint64_t _impl;
+};
+} // namespace MTL
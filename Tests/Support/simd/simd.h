@@ -0,0 +1,432 @@
+//
+//  simd.h
+//  Paloma Engine
+//
+//  Stand-in for Apple's <simd/simd.h> on hosts without the Apple SDK, so the
+//  Metal-free engine code can be tested anywhere. Covers only the types and
+//  functions that code uses, with the same names, lane layout and alignment.
+//  Vectors are plain structs instead of compiler vector types, so expect
+//  correct results rather than speed.
+//
+
+#pragma once
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+namespace simd_host {
+
+template <typename T, int N> struct vec;
+
+template <typename T> struct lane_mask {
+  using type = int32_t;
+};
+template <> struct lane_mask<double> {
+  using type = int64_t;
+};
+
+// Lane storage with the named members the SDK provides. Three-lane vectors
+// are padded to four, like the SDK's.
+template <typename T, int N> struct alignas(N * sizeof(T)) lanes {
+  T v[N];
+};
+template <typename T> struct alignas(2 * sizeof(T)) lanes<T, 2> {
+  union {
+    struct {
+      T x, y;
+    };
+    T v[2];
+  };
+};
+template <typename T> struct alignas(4 * sizeof(T)) lanes<T, 3> {
+  union {
+    struct {
+      T x, y, z;
+    };
+    T v[4];
+  };
+};
+template <typename T> struct alignas(4 * sizeof(T)) lanes<T, 4> {
+  union {
+    struct {
+      T x, y, z, w;
+    };
+    vec<T, 3> xyz;
+    T v[4];
+  };
+};
+
+template <typename T, int N> struct vec : lanes<T, N> {
+  using mask = vec<typename lane_mask<T>::type, N>;
+
+  vec() = default;
+  // Scalars splat to every lane.
+  vec(T value) {
+    for (int i = 0; i < N; ++i) {
+      this->v[i] = value;
+    }
+  }
+  template <typename... U>
+    requires(N > 1 && sizeof...(U) == N)
+  vec(U... values) {
+    const T init[] = {(T)values...};
+    for (int i = 0; i < N; ++i) {
+      this->v[i] = init[i];
+    }
+  }
+
+  T &operator[](size_t i) { return this->v[i]; }
+  const T &operator[](size_t i) const { return this->v[i]; }
+
+  friend vec operator-(vec a) {
+    for (int i = 0; i < N; ++i) {
+      a.v[i] = -a.v[i];
+    }
+    return a;
+  }
+
+#define SIMD_HOST_BINARY(op)                                                   \
+  friend vec operator op(vec a, const vec &b) {                                \
+    for (int i = 0; i < N; ++i) {                                              \
+      a.v[i] = a.v[i] op b.v[i];                                               \
+    }                                                                          \
+    return a;                                                                  \
+  }                                                                            \
+  vec &operator op##=(const vec & b) { return *this = *this op b; }
+  SIMD_HOST_BINARY(+)
+  SIMD_HOST_BINARY(-)
+  SIMD_HOST_BINARY(*)
+  SIMD_HOST_BINARY(/)
+#undef SIMD_HOST_BINARY
+
+#define SIMD_HOST_BITWISE(op)                                                  \
+  friend vec operator op(vec a, const vec &b)                                  \
+    requires std::is_integral_v<T>                                             \
+  {                                                                            \
+    for (int i = 0; i < N; ++i) {                                              \
+      a.v[i] = a.v[i] op b.v[i];                                               \
+    }                                                                          \
+    return a;                                                                  \
+  }
+  SIMD_HOST_BITWISE(&)
+  SIMD_HOST_BITWISE(|)
+  SIMD_HOST_BITWISE(^)
+#undef SIMD_HOST_BITWISE
+
+  // Comparisons give -1 in lanes where they hold and 0 elsewhere.
+#define SIMD_HOST_COMPARE(op)                                                  \
+  friend mask operator op(const vec &a, const vec &b) {                        \
+    mask result;                                                               \
+    for (int i = 0; i < N; ++i) {                                              \
+      result.v[i] = a.v[i] op b.v[i] ? -1 : 0;                                 \
+    }                                                                          \
+    return result;                                                             \
+  }
+  SIMD_HOST_COMPARE(==)
+  SIMD_HOST_COMPARE(!=)
+  SIMD_HOST_COMPARE(<)
+  SIMD_HOST_COMPARE(<=)
+  SIMD_HOST_COMPARE(>)
+  SIMD_HOST_COMPARE(>=)
+#undef SIMD_HOST_COMPARE
+};
+
+// Deduces N from one argument and lets the others convert, so scalars
+// splat like they do with the SDK.
+template <typename T, int N> using same = std::type_identity_t<vec<T, N>>;
+
+} // namespace simd_host
+
+typedef simd_host::vec<float, 2> simd_float2;
+typedef simd_host::vec<float, 3> simd_float3;
+typedef simd_host::vec<float, 4> simd_float4;
+typedef simd_host::vec<float, 8> simd_float8;
+typedef simd_host::vec<int32_t, 2> simd_int2;
+typedef simd_host::vec<int32_t, 3> simd_int3;
+typedef simd_host::vec<int32_t, 4> simd_int4;
+typedef simd_host::vec<int32_t, 8> simd_int8;
+typedef simd_host::vec<uint32_t, 2> simd_uint2;
+typedef simd_host::vec<uint32_t, 3> simd_uint3;
+typedef simd_host::vec<uint32_t, 4> simd_uint4;
+
+typedef simd_float2 vector_float2;
+typedef simd_float3 vector_float3;
+typedef simd_float4 vector_float4;
+typedef simd_int2 vector_int2;
+
+typedef struct {
+  simd_float3 columns[3];
+} simd_float3x3;
+typedef struct {
+  simd_float4 columns[4];
+} simd_float4x4;
+typedef simd_float3x3 matrix_float3x3;
+typedef simd_float4x4 matrix_float4x4;
+
+static const simd_float4x4 matrix_identity_float4x4 = {{
+    {1.0f, 0.0f, 0.0f, 0.0f},
+    {0.0f, 1.0f, 0.0f, 0.0f},
+    {0.0f, 0.0f, 1.0f, 0.0f},
+    {0.0f, 0.0f, 0.0f, 1.0f},
+}};
+
+// -- Construction --
+
+inline simd_float2 simd_make_float2(float x, float y) { return {x, y}; }
+inline simd_float3 simd_make_float3(float x, float y, float z) {
+  return {x, y, z};
+}
+inline simd_float3 simd_make_float3(simd_float4 v) { return v.xyz; }
+inline simd_float4 simd_make_float4(float x, float y, float z, float w) {
+  return {x, y, z, w};
+}
+inline simd_float4 simd_make_float4(simd_float3 v, float w) {
+  return {v.x, v.y, v.z, w};
+}
+
+// -- Lane-wise --
+
+template <typename T, int N>
+inline simd_host::vec<T, N> simd_min(simd_host::vec<T, N> a,
+                                     simd_host::same<T, N> b) {
+  for (int i = 0; i < N; ++i) {
+    a[i] = b[i] < a[i] ? b[i] : a[i];
+  }
+  return a;
+}
+template <typename T, int N>
+inline simd_host::vec<T, N> simd_max(simd_host::vec<T, N> a,
+                                     simd_host::same<T, N> b) {
+  for (int i = 0; i < N; ++i) {
+    a[i] = b[i] > a[i] ? b[i] : a[i];
+  }
+  return a;
+}
+template <typename T, int N>
+inline simd_host::vec<T, N> simd_clamp(simd_host::vec<T, N> x,
+                                       simd_host::same<T, N> min,
+                                       simd_host::same<T, N> max) {
+  return simd_min(simd_max(x, min), max);
+}
+template <int N>
+inline simd_host::vec<float, N> simd_abs(simd_host::vec<float, N> a) {
+  for (int i = 0; i < N; ++i) {
+    a[i] = std::fabs(a[i]);
+  }
+  return a;
+}
+template <int N>
+inline simd_host::vec<float, N> simd_mix(simd_host::vec<float, N> x,
+                                         simd_host::same<float, N> y,
+                                         simd_host::same<float, N> t) {
+  return x + t * (y - x);
+}
+template <int N>
+inline simd_host::vec<float, N> simd_rsqrt(simd_host::vec<float, N> a) {
+  for (int i = 0; i < N; ++i) {
+    a[i] = 1.0f / std::sqrt(a[i]);
+  }
+  return a;
+}
+inline float simd_min(float a, float b) { return b < a ? b : a; }
+inline float simd_max(float a, float b) { return b > a ? b : a; }
+inline float simd_clamp(float x, float min, float max) {
+  return simd_min(simd_max(x, min), max);
+}
+inline float simd_mix(float x, float y, float t) { return x + t * (y - x); }
+
+template <typename T, int N>
+inline simd_host::vec<T, N> simd_select(simd_host::vec<T, N> x,
+                                        simd_host::same<T, N> y,
+                                        typename simd_host::vec<T, N>::mask m) {
+  for (int i = 0; i < N; ++i) {
+    if (m[i] < 0) {
+      x[i] = y[i];
+    }
+  }
+  return x;
+}
+template <typename T, int N> inline bool simd_any(simd_host::vec<T, N> m) {
+  for (int i = 0; i < N; ++i) {
+    if (m[i] < 0) {
+      return true;
+    }
+  }
+  return false;
+}
+template <typename T, int N> inline bool simd_all(simd_host::vec<T, N> m) {
+  for (int i = 0; i < N; ++i) {
+    if (m[i] >= 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+template <typename T, int N> inline T simd_reduce_min(simd_host::vec<T, N> a) {
+  T result = a[0];
+  for (int i = 1; i < N; ++i) {
+    result = a[i] < result ? a[i] : result;
+  }
+  return result;
+}
+template <typename T, int N> inline T simd_reduce_max(simd_host::vec<T, N> a) {
+  T result = a[0];
+  for (int i = 1; i < N; ++i) {
+    result = a[i] > result ? a[i] : result;
+  }
+  return result;
+}
+template <typename T, int N> inline T simd_reduce_add(simd_host::vec<T, N> a) {
+  T result = a[0];
+  for (int i = 1; i < N; ++i) {
+    result += a[i];
+  }
+  return result;
+}
+
+// -- Geometry --
+
+template <int N>
+inline float simd_dot(simd_host::vec<float, N> a,
+                      simd_host::same<float, N> b) {
+  return simd_reduce_add(a * b);
+}
+template <int N>
+inline float simd_length_squared(simd_host::vec<float, N> a) {
+  return simd_dot(a, a);
+}
+template <int N> inline float simd_length(simd_host::vec<float, N> a) {
+  return std::sqrt(simd_dot(a, a));
+}
+template <int N>
+inline float simd_distance_squared(simd_host::vec<float, N> a,
+                                   simd_host::same<float, N> b) {
+  return simd_length_squared(a - b);
+}
+template <int N>
+inline float simd_distance(simd_host::vec<float, N> a,
+                           simd_host::same<float, N> b) {
+  return simd_length(a - b);
+}
+template <int N>
+inline simd_host::vec<float, N> simd_normalize(simd_host::vec<float, N> a) {
+  return a * (1.0f / simd_length(a));
+}
+inline simd_float3 simd_cross(simd_float3 a, simd_float3 b) {
+  return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z,
+          a.x * b.y - a.y * b.x};
+}
+
+// -- Matrices (column major) --
+
+inline simd_float3 simd_mul(simd_float3x3 m, simd_float3 v) {
+  return m.columns[0] * v.x + m.columns[1] * v.y + m.columns[2] * v.z;
+}
+inline simd_float4 simd_mul(simd_float4x4 m, simd_float4 v) {
+  return m.columns[0] * v.x + m.columns[1] * v.y + m.columns[2] * v.z +
+         m.columns[3] * v.w;
+}
+inline simd_float3x3 simd_mul(simd_float3x3 a, simd_float3x3 b) {
+  simd_float3x3 result;
+  for (int i = 0; i < 3; ++i) {
+    result.columns[i] = simd_mul(a, b.columns[i]);
+  }
+  return result;
+}
+inline simd_float4x4 simd_mul(simd_float4x4 a, simd_float4x4 b) {
+  simd_float4x4 result;
+  for (int i = 0; i < 4; ++i) {
+    result.columns[i] = simd_mul(a, b.columns[i]);
+  }
+  return result;
+}
+inline simd_float4x4 matrix_multiply(simd_float4x4 a, simd_float4x4 b) {
+  return simd_mul(a, b);
+}
+inline simd_float3x3 simd_matrix(simd_float3 c0, simd_float3 c1,
+                                 simd_float3 c2) {
+  return {{c0, c1, c2}};
+}
+inline simd_float4x4 simd_matrix(simd_float4 c0, simd_float4 c1,
+                                 simd_float4 c2, simd_float4 c3) {
+  return {{c0, c1, c2, c3}};
+}
+inline float simd_determinant(simd_float3x3 m) {
+  return simd_dot(m.columns[0], simd_cross(m.columns[1], m.columns[2]));
+}
+
+// -- Quaternions (x, y, z, w with w the real part) --
+
+typedef struct {
+  simd_float4 vector;
+} simd_quatf;
+
+inline simd_quatf simd_quaternion(float x, float y, float z, float w) {
+  return {{x, y, z, w}};
+}
+inline simd_quatf simd_quaternion(simd_float4 xyzw) { return {xyzw}; }
+inline simd_quatf simd_quaternion(simd_float3x3 m) {
+  const simd_float3 *c = m.columns;
+  const float trace = c[0].x + c[1].y + c[2].z;
+  if (trace >= 0.0f) {
+    const float r = 2.0f * std::sqrt(1.0f + trace);
+    return simd_quaternion((c[1].z - c[2].y) / r, (c[2].x - c[0].z) / r,
+                           (c[0].y - c[1].x) / r, r / 4.0f);
+  }
+  if (c[0].x >= c[1].y && c[0].x >= c[2].z) {
+    const float r = 2.0f * std::sqrt(1.0f + c[0].x - c[1].y - c[2].z);
+    return simd_quaternion(r / 4.0f, (c[0].y + c[1].x) / r,
+                           (c[2].x + c[0].z) / r, (c[1].z - c[2].y) / r);
+  }
+  if (c[1].y >= c[2].z) {
+    const float r = 2.0f * std::sqrt(1.0f - c[0].x + c[1].y - c[2].z);
+    return simd_quaternion((c[0].y + c[1].x) / r, r / 4.0f,
+                           (c[1].z + c[2].y) / r, (c[2].x - c[0].z) / r);
+  }
+  const float r = 2.0f * std::sqrt(1.0f - c[0].x - c[1].y + c[2].z);
+  return simd_quaternion((c[2].x + c[0].z) / r, (c[1].z + c[2].y) / r,
+                         r / 4.0f, (c[0].y - c[1].x) / r);
+}
+// Rotation of angle radians about a unit axis.
+inline simd_quatf simd_quaternion(float angle, simd_float3 axis) {
+  const float s = std::sin(angle * 0.5f);
+  return simd_quaternion(axis.x * s, axis.y * s, axis.z * s,
+                         std::cos(angle * 0.5f));
+}
+
+inline float simd_dot(simd_quatf a, simd_quatf b) {
+  return simd_dot(a.vector, b.vector);
+}
+inline float simd_length(simd_quatf q) { return simd_length(q.vector); }
+inline simd_quatf simd_normalize(simd_quatf q) {
+  return {simd_normalize(q.vector)};
+}
+inline simd_quatf simd_negate(simd_quatf q) { return {-q.vector}; }
+inline simd_quatf simd_conjugate(simd_quatf q) {
+  return simd_quaternion(-q.vector.x, -q.vector.y, -q.vector.z, q.vector.w);
+}
+inline simd_quatf simd_mul(simd_quatf a, simd_quatf b) {
+  const simd_float4 p = a.vector;
+  const simd_float4 q = b.vector;
+  return simd_quaternion(p.w * q.x + p.x * q.w + p.y * q.z - p.z * q.y,
+                         p.w * q.y - p.x * q.z + p.y * q.w + p.z * q.x,
+                         p.w * q.z + p.x * q.y - p.y * q.x + p.z * q.w,
+                         p.w * q.w - p.x * q.x - p.y * q.y - p.z * q.z);
+}
+inline simd_float3x3 simd_matrix3x3(simd_quatf q) {
+  const float x = q.vector.x, y = q.vector.y, z = q.vector.z, w = q.vector.w;
+  return {{
+      {1 - 2 * (y * y + z * z), 2 * (x * y + z * w), 2 * (x * z - y * w)},
+      {2 * (x * y - z * w), 1 - 2 * (x * x + z * z), 2 * (y * z + x * w)},
+      {2 * (x * z + y * w), 2 * (y * z - x * w), 1 - 2 * (x * x + y * y)},
+  }};
+}
+inline simd_float4x4 simd_matrix4x4(simd_quatf q) {
+  const simd_float3x3 m = simd_matrix3x3(q);
+  return {{simd_make_float4(m.columns[0], 0.0f),
+           simd_make_float4(m.columns[1], 0.0f),
+           simd_make_float4(m.columns[2], 0.0f),
+           {0.0f, 0.0f, 0.0f, 1.0f}}};
+}
@@ -0,0 +1,64 @@
+//
+//  Test.hpp
+//  Paloma Engine
+//
+//  Minimal test and benchmark registry for the headless engine tests.
+//
+
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+struct TestCase {
+  const char *name;
+  void (*run)();
+  bool benchmark;
+};
+
+std::vector<TestCase> &testCases();
+void reportFailure(const char *expression, const char *file, int line);
+
+struct TestRegistration {
+  TestRegistration(const char *name, void (*run)(), bool benchmark) {
+    testCases().push_back({name, run, benchmark});
+  }
+};
+
+// TEST bodies run on every run of PalomaTests; BENCHMARK bodies only run
+// with --benchmarks and should still CHECK that what they timed worked.
+#define TEST(name)                                                             \
+  static void name();                                                          \
+  static TestRegistration name##Registration(#name, name, false);              \
+  static void name()
+
+#define BENCHMARK(name)                                                        \
+  static void name();                                                          \
+  static TestRegistration name##Registration(#name, name, true);               \
+  static void name()
+
+// Records a failure and carries on with the test.
+#define CHECK(condition)                                                       \
+  do {                                                                         \
+    if (!(condition)) {                                                        \
+      reportFailure(#condition, __FILE__, __LINE__);                           \
+    }                                                                          \
+  } while (0)
+
+// Runs body operations times after one untimed warm-up run and prints the
+// average time per operation.
+template <typename Body>
+double measure(const char *label, uint32_t operations, Body &&body) {
+  body();
+  const auto start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < operations; ++i) {
+    body();
+  }
+  const auto end = std::chrono::steady_clock::now();
+  const double nanoseconds =
+      std::chrono::duration<double, std::nano>(end - start).count() /
+      operations;
+  printf("  %-48s %12.1f ns\n", label, nanoseconds);
+  return nanoseconds;
+}
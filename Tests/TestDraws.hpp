@@ -0,0 +1,140 @@
+//
+//  TestDraws.hpp
+//  Paloma Engine
+//
+//  Sorted draw lists shared by the command encoding tests.
+//
+
+#pragma once
+#include "RenderCommands.hpp"
+#include "TestGeometry.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <tuple>
+#include <vector>
+
+// One entry of the render queue, reduced to the state it binds.
+struct TestDraw {
+  uint32_t depthState;
+  uint32_t pipeline;
+  uint32_t material;
+  uint32_t mesh;
+  uint32_t indexCount;
+};
+
+// Draws over a few depth states and pipelines and a few hundred materials
+// and meshes, sorted by state the way SortKey orders the render queue.
+inline std::vector<TestDraw> makeTestDraws(size_t count, uint32_t seed) {
+  TestRandom random = {seed};
+  std::vector<TestDraw> draws(count);
+  for (TestDraw &draw : draws) {
+    draw.depthState = (uint32_t)random.next(0, 2);
+    draw.pipeline = (uint32_t)random.next(0, 6);
+    draw.material = (uint32_t)random.next(0, 400);
+    draw.mesh = (uint32_t)random.next(0, 300);
+    draw.indexCount = 3 * (1 + (uint32_t)random.next(0, 1000));
+  }
+  std::sort(draws.begin(), draws.end(),
+            [](const TestDraw &a, const TestDraw &b) {
+              return std::tie(a.depthState, a.pipeline, a.material, a.mesh) <
+                     std::tie(b.depthState, b.pipeline, b.material, b.mesh);
+            });
+  return draws;
+}
+
+// Stand-ins for the Metal objects, which the encoder only compares.
+inline const MTL::DepthStencilState *testDepthState(uint32_t index) {
+  return reinterpret_cast<const MTL::DepthStencilState *>(
+      (uintptr_t)(0x1000 + index * 0x100));
+}
+inline const MTL::RenderPipelineState *testPipeline(uint32_t index) {
+  return reinterpret_cast<const MTL::RenderPipelineState *>(
+      (uintptr_t)(0x10000 + index * 0x100));
+}
+inline const void *testMeshOwner(uint32_t mesh) {
+  return reinterpret_cast<const void *>((uintptr_t)(0x100000 + mesh * 0x100));
+}
+
+constexpr uint32_t kTestVertexBufferIndex = 0;
+constexpr uint32_t kTestInstanceSlotsIndex = 6;
+constexpr uint32_t kTestMaterialIndex = 1;
+
+inline uint64_t testMeshAddress(uint32_t mesh) {
+  return 0x100000000ull + mesh * 0x10000ull;
+}
+inline uint64_t testSlotsAddress(size_t drawIndex) {
+  return 0x200000000ull + drawIndex * sizeof(uint32_t);
+}
+inline uint64_t testMaterialAddress(uint32_t material) {
+  return 0x300000000ull + material * 256ull;
+}
+
+// The same binds, in the same order, as Renderer::encodeChunk: the instance
+// slots move on with every draw, everything else repeats along runs.
+template <typename Encoder>
+void encodeTestDraw(Encoder &encoder, const TestDraw &draw, size_t index) {
+  encoder.pushDebugGroup(testMeshOwner(draw.mesh), "Mesh");
+  encoder.setDepthStencilState(testDepthState(draw.depthState));
+  encoder.setAddress(RenderStage::Vertex, testMeshAddress(draw.mesh),
+                     kTestVertexBufferIndex);
+  encoder.setAddress(RenderStage::Vertex, testSlotsAddress(index),
+                     kTestInstanceSlotsIndex);
+  encoder.setRenderPipelineState(testPipeline(draw.pipeline));
+  encoder.setAddress(RenderStage::Fragment, testMaterialAddress(draw.material),
+                     kTestMaterialIndex);
+  IndexedDraw indexed = {};
+  indexed.indexCount = draw.indexCount;
+  encoder.drawIndexed(indexed);
+  encoder.popDebugGroup();
+}
+
+// Replays a command stream and checks that every draw sees the state its
+// TestDraw asked for, however many binds were dropped on the way.
+inline bool commandsMatchDraws(
+    const std::vector<RecordingCommandBackend::Command> &commands,
+    const std::vector<TestDraw> &draws) {
+  using CommandType = RecordingCommandBackend::CommandType;
+  const void *pDepthState = nullptr;
+  const void *pPipeline = nullptr;
+  uint64_t addresses[2][StateTrackingEncoder::kMaxBindings] = {};
+  size_t drawIndex = 0;
+  int depth = 0;
+  for (const auto &command : commands) {
+    switch (command.type) {
+    case CommandType::SetDepthStencilState:
+      pDepthState = command.pState;
+      break;
+    case CommandType::SetRenderPipelineState:
+      pPipeline = command.pState;
+      break;
+    case CommandType::SetAddress:
+      addresses[(uint32_t)command.stage][command.index] = command.address;
+      break;
+    case CommandType::PushDebugGroup:
+      depth++;
+      break;
+    case CommandType::PopDebugGroup:
+      depth--;
+      break;
+    case CommandType::DrawIndexed: {
+      if (drawIndex == draws.size()) {
+        return false;
+      }
+      const TestDraw &draw = draws[drawIndex];
+      const uint64_t *vertex = addresses[(uint32_t)RenderStage::Vertex];
+      const uint64_t *fragment = addresses[(uint32_t)RenderStage::Fragment];
+      if (depth != 1 || pDepthState != testDepthState(draw.depthState) ||
+          pPipeline != testPipeline(draw.pipeline) ||
+          vertex[kTestVertexBufferIndex] != testMeshAddress(draw.mesh) ||
+          vertex[kTestInstanceSlotsIndex] != testSlotsAddress(drawIndex) ||
+          fragment[kTestMaterialIndex] != testMaterialAddress(draw.material) ||
+          command.draw.indexCount != draw.indexCount) {
+        return false;
+      }
+      drawIndex++;
+      break;
+    }
+    }
+  }
+  return drawIndex == draws.size() && depth == 0;
+}
@@ -0,0 +1,51 @@
+//
+//  TestGeometry.hpp
+//  Paloma Engine
+//
+//  Cameras and boxes shared by the culling tests.
+//
+
+#pragma once
+#include "Bounds.hpp"
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// Right-handed perspective with Metal's 0..1 depth, looking down -z from the
+// origin: 60 degrees vertical field of view, near 0.1 and far 100.
+inline matrix_float4x4 makeTestProjection(float aspect = 1.0f) {
+  const float nearZ = 0.1f, farZ = 100.0f;
+  const float ys = 1.0f / tanf((float)M_PI / 6.0f);
+  const float zs = farZ / (nearZ - farZ);
+  matrix_float4x4 projection;
+  projection.columns[0] = simd_make_float4(ys / aspect, 0, 0, 0);
+  projection.columns[1] = simd_make_float4(0, ys, 0, 0);
+  projection.columns[2] = simd_make_float4(0, 0, zs, -1);
+  projection.columns[3] = simd_make_float4(0, 0, nearZ * zs, 0);
+  return projection;
+}
+
+// Uniform floats from a fixed seed, the same on every platform.
+struct TestRandom {
+  uint32_t state;
+
+  float next(float min, float max) {
+    state = state * 1664525u + 1013904223u;
+    return min + (max - min) * ((state >> 8) / (float)(1u << 24));
+  }
+};
+
+// count boxes with centers in a 300-unit cube around the origin and half
+// extents up to 5.
+inline std::vector<AABB> makeTestBoxes(size_t count, uint32_t seed) {
+  TestRandom random = {seed};
+  std::vector<AABB> boxes(count);
+  for (AABB &box : boxes) {
+    const simd_float3 center = {random.next(-150, 150), random.next(-150, 150),
+                                random.next(-150, 150)};
+    const simd_float3 extents = {random.next(0, 5), random.next(0, 5),
+                                 random.next(0, 5)};
+    box = {center - extents, center + extents};
+  }
+  return boxes;
+}
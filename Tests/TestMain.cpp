@@ -0,0 +1,58 @@
+//
+//  TestMain.cpp
+//  Paloma Engine
+//
+
+#include "Test.hpp"
+#include <cstring>
+
+static int s_failures = 0;
+
+std::vector<TestCase> &testCases() {
+  static std::vector<TestCase> s_cases;
+  return s_cases;
+}
+
+void reportFailure(const char *expression, const char *file, int line) {
+  fprintf(stderr, "%s:%d: CHECK(%s) failed\n", file, line, expression);
+  s_failures++;
+}
+
+// PalomaTests [--benchmarks] [name...]
+// Runs every test, or every benchmark, or only the ones named.
+int main(int argc, char **argv) {
+  bool benchmarks = false;
+  std::vector<const char *> names;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--benchmarks") == 0) {
+      benchmarks = true;
+    } else {
+      names.push_back(argv[i]);
+    }
+  }
+
+  int ran = 0;
+  for (const TestCase &test : testCases()) {
+    bool selected = test.benchmark == benchmarks;
+    if (!names.empty()) {
+      selected = false;
+      for (const char *name : names) {
+        selected |= strcmp(name, test.name) == 0;
+      }
+    }
+    if (!selected) {
+      continue;
+    }
+    const int failuresBefore = s_failures;
+    printf("%s\n", test.name);
+    test.run();
+    if (s_failures != failuresBefore) {
+      printf("  FAILED\n");
+    }
+    ran++;
+  }
+
+  printf("%d %s, %d failed checks\n", ran,
+         benchmarks ? "benchmarks" : "tests", s_failures);
+  return s_failures == 0 && ran > 0 ? 0 : 1;
+}
@@ -0,0 +1,204 @@
+//
+//  TextureStreamerTests.cpp
+//  Paloma Engine
+//
+
+#include "Test.hpp"
+#include "TestGeometry.hpp"
+#include "TextureStreamer.hpp"
+
+namespace {
+
+constexpr size_t kMegabyte = 1 << 20;
+
+// The streamer's total matches its textures, stays in budget, and the
+// backend was told about every mip change.
+bool accountingMatches(const TextureStreamer &streamer,
+                       const RecordingTextureStreamingBackend &backend) {
+  std::vector<uint32_t> backendMips;
+  for (uint32_t t = 0; t < streamer.stats().textures; ++t) {
+    backendMips.push_back(streamer.minimumResidentMip(t));
+  }
+  for (const auto &change : backend.changes) {
+    backendMips[change.texture] = change.firstMip;
+  }
+  size_t resident = 0;
+  bool same = true;
+  for (uint32_t t = 0; t < streamer.stats().textures; ++t) {
+    const uint32_t mip = streamer.firstResidentMip(t);
+    resident += streamer.residentBytes(t, mip);
+    same &= backendMips[t] == mip;
+  }
+  return same && resident == streamer.stats().residentBytes &&
+         resident <= streamer.stats().budgetBytes;
+}
+
+} // namespace
+
+TEST(mipForScreenSizeMatchesTexelsPerPixel) {
+  CHECK(mipForScreenSize(2048, 2048, 5000) == 0);
+  CHECK(mipForScreenSize(2048, 2048, 2048) == 0);
+  CHECK(mipForScreenSize(2048, 2048, 1024) == 1);
+  // 6.8 texels a pixel: mip 2 still has more than one.
+  CHECK(mipForScreenSize(2048, 2048, 300) == 2);
+  CHECK(mipForScreenSize(2048, 512, 256) == 3);
+  CHECK(mipForScreenSize(2048, 2048, 0) == 11);
+}
+
+TEST(downsampledMipsAverageSRGBInLinearSpace) {
+  // Black and white columns, with alpha the other way round.
+  std::vector<uint8_t> stripes(4 * 3 * 4);
+  for (uint32_t i = 0; i < 12; ++i) {
+    const uint8_t value = i % 2 ? 255 : 0;
+    for (uint32_t c = 0; c < 3; ++c) {
+      stripes[i * 4 + c] = value;
+    }
+    stripes[i * 4 + 3] = 255 - value;
+  }
+
+  // Half of white's light is 0.5 linear, which sRGB encodes as 188.
+  const std::vector<uint8_t> srgb = downsampleRGBA8(stripes, 4, 3, true);
+  CHECK(srgb.size() == 2 * 1 * 4);
+  CHECK(srgb[0] == 188 && srgb[1] == 188 && srgb[2] == 188);
+  CHECK(srgb[3] == 128);
+  const std::vector<uint8_t> linear = downsampleRGBA8(stripes, 4, 3, false);
+  CHECK(linear[0] == 128 && linear[3] == 128);
+
+  // Flat colours stay exactly as they were.
+  bool flat = true;
+  for (uint32_t value = 0; value < 256; ++value) {
+    const std::vector<uint8_t> texels(2 * 2 * 4, (uint8_t)value);
+    const std::vector<uint8_t> mip = downsampleRGBA8(texels, 2, 2, true);
+    flat &= mip.size() == 4 && mip[0] == value && mip[3] == value;
+  }
+  CHECK(flat);
+}
+
+TEST(textureStreamerEvictsTheLeastRecentlyNeededMips) {
+  RecordingTextureStreamingBackend backend;
+  TextureStreamer streamer(&backend, 40 * kMegabyte, 64 * kMegabyte);
+  const uint32_t a = streamer.addTexture(2048, 2048, 4);
+  const uint32_t b = streamer.addTexture(2048, 2048, 4);
+  const uint32_t c = streamer.addTexture(1024, 512, 4);
+  // Everything down to 64 pixels starts resident.
+  CHECK(streamer.minimumResidentMip(a) == 5);
+  CHECK(streamer.minimumResidentMip(c) == 4);
+  CHECK(streamer.mipCount(a) == 12);
+  CHECK(streamer.stats().residentBytes ==
+        2 * streamer.residentBytes(a, 5) + streamer.residentBytes(c, 4));
+
+  streamer.request(a, 0);
+  streamer.update(1);
+  CHECK(streamer.firstResidentMip(a) == 0);
+  CHECK(streamer.stats().streamedIn == 1);
+  CHECK(accountingMatches(streamer, backend));
+
+  // A and B at full size don't both fit: A's top mip, not needed this
+  // frame, makes room.
+  streamer.request(b, 0);
+  streamer.update(2);
+  CHECK(streamer.firstResidentMip(b) == 0);
+  CHECK(streamer.firstResidentMip(a) == 1);
+  CHECK(streamer.stats().streamedOut == 1);
+  CHECK(streamer.stats().deferred == 0);
+  CHECK(accountingMatches(streamer, backend));
+
+  // Several requests in a frame keep the finest, and C fits beside B.
+  streamer.request(c, 3);
+  streamer.request(c, 0);
+  streamer.request(c, 2);
+  streamer.request(b, 0);
+  streamer.update(3);
+  CHECK(streamer.firstResidentMip(c) == 0);
+  CHECK(streamer.firstResidentMip(b) == 0);
+  CHECK(accountingMatches(streamer, backend));
+
+  // Nothing asked for: nothing changes, however stale.
+  const size_t changes = backend.changes.size();
+  streamer.update(100);
+  CHECK(backend.changes.size() == changes);
+}
+
+TEST(textureStreamerDefersWhatDoesNotFit) {
+  RecordingTextureStreamingBackend backend;
+  TextureStreamer streamer(&backend, 30 * kMegabyte, 64 * kMegabyte);
+  const uint32_t a = streamer.addTexture(2048, 2048, 4);
+  const uint32_t b = streamer.addTexture(2048, 2048, 4);
+
+  // Both needed this frame, so neither can push the other out: one gets
+  // its top mip, the other the finest that still fits.
+  streamer.request(a, 0);
+  streamer.request(b, 0);
+  streamer.update(1);
+  CHECK(streamer.firstResidentMip(a) == 0);
+  CHECK(streamer.firstResidentMip(b) == 1);
+  CHECK(streamer.stats().deferred == 1);
+  CHECK(streamer.stats().wantedBytes == 2 * streamer.residentBytes(a, 0));
+  CHECK(accountingMatches(streamer, backend));
+
+  // A failed change keeps the texture as it was.
+  backend.failChanges = true;
+  streamer.setBudget(100 * kMegabyte);
+  streamer.request(b, 0);
+  streamer.update(2);
+  CHECK(streamer.firstResidentMip(b) == 1);
+  CHECK(streamer.stats().streamedIn == 0);
+  CHECK(streamer.stats().uploadedBytes == 0);
+  CHECK(accountingMatches(streamer, backend));
+  backend.failChanges = false;
+  streamer.request(b, 0);
+  streamer.update(3);
+  CHECK(streamer.firstResidentMip(b) == 0);
+  CHECK(accountingMatches(streamer, backend));
+}
+
+TEST(textureStreamerLimitsUploadsPerFrame) {
+  RecordingTextureStreamingBackend backend;
+  TextureStreamer streamer(&backend, 1000 * kMegabyte, 8 * kMegabyte);
+  const uint32_t a = streamer.addTexture(4096, 4096, 4);
+  const uint32_t b = streamer.addTexture(4096, 4096, 4);
+
+  // The first upload of a frame may go over the limit, but then nothing
+  // else streams in until the next frame.
+  streamer.request(a, 0);
+  streamer.request(b, 0);
+  streamer.update(1);
+  CHECK(streamer.firstResidentMip(a) == 0);
+  CHECK(streamer.firstResidentMip(b) == streamer.minimumResidentMip(b));
+  CHECK(streamer.stats().deferred == 1);
+  CHECK(streamer.stats().uploadedBytes ==
+        streamer.residentBytes(a, 0) - streamer.residentBytes(a, 6));
+
+  streamer.request(a, 0);
+  streamer.request(b, 0);
+  streamer.update(2);
+  CHECK(streamer.firstResidentMip(b) == 0);
+  CHECK(accountingMatches(streamer, backend));
+}
+
+BENCHMARK(textureStreaming) {
+  RecordingTextureStreamingBackend backend;
+  TextureStreamer streamer(&backend, 256 * kMegabyte, 32 * kMegabyte);
+  for (uint32_t i = 0; i < 2000; ++i) {
+    const uint32_t size = 256u << (i % 4);
+    streamer.addTexture(size, size, 4);
+  }
+
+  // A camera moving through the scene: a window of textures is close.
+  TestRandom random = {11};
+  uint64_t frame = 0;
+  uint32_t deferred = 0;
+  measure("2000 textures, 300 requests a frame", 200, [&] {
+    frame++;
+    const uint32_t first = (uint32_t)(frame * 7 % 1700);
+    for (uint32_t i = 0; i < 300; ++i) {
+      streamer.requestScreenSize(first + i, random.next(16, 2048));
+    }
+    streamer.update(frame);
+    deferred += streamer.stats().deferred;
+  });
+  printf("  %-48s %12zu\n", "resident KB",
+         streamer.stats().residentBytes / 1024);
+  printf("  %-48s %12u\n", "deferred requests", deferred);
+  CHECK(streamer.stats().residentBytes <= streamer.stats().budgetBytes);
+}
@@ -0,0 +1,231 @@
+//
+//  UploadTests.cpp
+//  Paloma Engine
+//
+
+#include "BufferUtilites.hpp"
+#include "HostGPUDevice.hpp"
+#include "Test.hpp"
+
+namespace {
+
+struct Constants {
+  float values[12];
+  uint32_t index;
+};
+
+constexpr size_t kFramesInFlight = 3;
+
+// The last frame the GPU has completed when frameIndex starts, with the CPU
+// as far ahead as it is allowed to get.
+uint64_t completedBefore(uint64_t frameIndex) {
+  return frameIndex > kFramesInFlight ? frameIndex - kFramesInFlight : 0;
+}
+
+} // namespace
+
+TEST(frameAllocatorReusesChunksOnceTheGPUIsDone) {
+  HostGPUDevice device;
+  const size_t chunkSize = 4096;
+  FrameAllocator allocator(chunkSize, &device, GPUMemoryCategory::Constants);
+
+  // Allocations of more than half a chunk get one chunk each.
+  std::vector<GPUBuffer *> frameChunks[8];
+  for (uint64_t frame = 1; frame <= 8; ++frame) {
+    allocator.beginFrame(frame, completedBefore(frame));
+    for (int i = 0; i < 3; ++i) {
+      const BufferView view = allocator.allocate(3000, 16);
+      if (frameChunks[frame - 1].empty() ||
+          frameChunks[frame - 1].back() != view.pBuffer) {
+        frameChunks[frame - 1].push_back(view.pBuffer);
+      }
+    }
+    if (frame > kFramesInFlight) {
+      CHECK(allocator.stats().chunksCreatedThisFrame == 0);
+    }
+  }
+  CHECK(allocator.stats().chunkCount == 3 * kFramesInFlight);
+  CHECK(device.stats().buffersCreated == 3 * kFramesInFlight);
+
+  // A frame never gets a chunk a frame in flight still uses.
+  for (uint64_t frame = 2; frame <= 8; ++frame) {
+    for (uint64_t previous = frame - 1;
+         previous > completedBefore(frame) && previous >= 1; --previous) {
+      for (GPUBuffer *pChunk : frameChunks[frame - 1]) {
+        for (GPUBuffer *pOther : frameChunks[previous - 1]) {
+          CHECK(pChunk != pOther);
+        }
+      }
+    }
+  }
+
+  std::vector<GPUBuffer *> newChunks;
+  allocator.takeNewChunks(newChunks);
+  CHECK(newChunks.size() == 3 * kFramesInFlight);
+  newChunks.clear();
+  allocator.takeNewChunks(newChunks);
+  CHECK(newChunks.empty());
+}
+
+TEST(frameAllocatorNeverOverlapsWithinAFrame) {
+  HostGPUDevice device(256);
+  FrameAllocator allocator(4096, &device, GPUMemoryCategory::Constants);
+  allocator.beginFrame(1, 0);
+
+  std::vector<BufferView> views;
+  for (uint32_t i = 0; i < 100; ++i) {
+    Constants constants = {};
+    constants.index = i;
+    views.push_back(allocator.copy(constants));
+  }
+  // Larger than a chunk: gets a chunk of its own.
+  const BufferView large = allocator.allocate(10000, 16);
+  CHECK(large.pBuffer->length() >= 10000);
+
+  for (uint32_t i = 0; i < views.size(); ++i) {
+    CHECK(views[i].offset % 256 == 0);
+    const auto *pCopy = (const Constants *)views[i].contents();
+    CHECK(pCopy->index == i);
+  }
+  CHECK(allocator.stats().frameBytes >= 100 * sizeof(Constants) + 10000);
+}
+
+TEST(frameSlotBufferReachesEveryFrameAndStopsUploading) {
+  HostGPUDevice device;
+  FrameSlotBuffer<Constants> slots(16, kFramesInFlight, &device,
+                                   GPUMemoryCategory::Instances);
+
+  const uint32_t slot = slots.allocateSlot();
+  Constants constants = {};
+  constants.index = 42;
+  slots.update(slot, constants);
+  CHECK(slots.pendingSlotCount() == 1);
+
+  for (size_t frame = 0; frame < kFramesInFlight; ++frame) {
+    CHECK(slots.pendingSlotCount() == 1);
+    slots.flush(frame);
+    const auto *pCopy =
+        (const Constants *)device.resolve(slots.view(frame, slot).gpuAddress());
+    CHECK(pCopy && pCopy->index == 42);
+  }
+  CHECK(slots.pendingSlotCount() == 0);
+
+  slots.freeSlot(slot);
+  CHECK(slots.allocateSlot() == slot);
+}
+
+TEST(frameSlotBufferKeepsRetiredBuffersForFramesInFlight) {
+  HostGPUDevice device;
+  FrameSlotBuffer<Constants> slots(2, kFramesInFlight, &device,
+                                   GPUMemoryCategory::Instances);
+  CHECK(device.stats().liveBuffers == kFramesInFlight);
+  const uint32_t generation = slots.bufferGeneration();
+
+  for (uint32_t i = 0; i < 10; ++i) {
+    Constants constants = {};
+    constants.index = i;
+    slots.update(slots.allocateSlot(), constants);
+  }
+  CHECK(slots.capacity() >= 10);
+  CHECK(slots.bufferGeneration() > generation);
+  // 2 -> 4 -> 8 -> 16, each grow keeping the buffers it replaced.
+  CHECK(device.stats().liveBuffers == 4 * kFramesInFlight);
+
+  // Every slot, old ones included, reaches the new buffers.
+  for (size_t frame = 0; frame < kFramesInFlight; ++frame) {
+    slots.flush(frame);
+    for (uint32_t slot = 0; slot < 10; ++slot) {
+      const auto *pCopy = (const Constants *)device.resolve(
+          slots.view(frame, slot).gpuAddress());
+      CHECK(pCopy && pCopy->index == slot);
+    }
+  }
+  // Once every frame has been flushed again the old buffers are released.
+  slots.flush(0);
+  CHECK(device.stats().liveBuffers == kFramesInFlight);
+}
+
+TEST(frameSlotBufferReportsBuffersItReleases) {
+  HostGPUDevice device;
+  FrameSlotBuffer<Constants> slots(2, kFramesInFlight, &device,
+                                   GPUMemoryCategory::Instances);
+  std::vector<GPUBuffer *> resident;
+  for (size_t frame = 0; frame < kFramesInFlight; ++frame) {
+    resident.push_back(slots.getBuffer(frame));
+  }
+  std::vector<GPUBuffer *> released;
+  slots.setReleaseCallback([&](GPUBuffer *pBuffer) {
+    // Still alive, so its owner can take it out of a residency set.
+    CHECK(device.resolve(pBuffer->gpuAddress()) == pBuffer->contents());
+    released.push_back(pBuffer);
+  });
+
+  for (uint32_t i = 0; i < 3; ++i) {
+    slots.allocateSlot();
+  }
+  CHECK(slots.capacity() == 4);
+  // Frames in flight may still read the replaced buffers.
+  for (size_t frame = 0; frame < kFramesInFlight; ++frame) {
+    slots.flush(frame);
+  }
+  CHECK(released.empty());
+  slots.flush(0);
+  CHECK(released.size() == kFramesInFlight);
+  for (size_t i = 0; i < kFramesInFlight; ++i) {
+    CHECK(std::count(released.begin(), released.end(), resident[i]) == 1);
+    CHECK(released[i] != slots.getBuffer(i));
+  }
+  CHECK(device.stats().liveBuffers == kFramesInFlight);
+
+  // Nothing is reported twice, and the current buffers never are.
+  for (size_t frame = 0; frame < 2 * kFramesInFlight; ++frame) {
+    slots.flush(frame % kFramesInFlight);
+  }
+  CHECK(released.size() == kFramesInFlight);
+}
+
+BENCHMARK(frameAllocatorCopy) {
+  HostGPUDevice device;
+  FrameAllocator allocator(256 * 1024, &device, GPUMemoryCategory::Constants);
+  const uint32_t copiesPerFrame = 2000;
+  uint64_t frame = 0;
+
+  Constants constants = {};
+  const double frameTime = measure("2000 copies per frame", 500, [&] {
+    frame++;
+    allocator.beginFrame(frame, completedBefore(frame));
+    for (uint32_t i = 0; i < copiesPerFrame; ++i) {
+      constants.index = i;
+      allocator.copy(constants);
+    }
+  });
+  printf("  %-48s %12.1f ns\n", "per copy", frameTime / copiesPerFrame);
+  printf("  %-48s %12u\n", "chunks", allocator.stats().chunkCount);
+  CHECK(allocator.stats().chunksCreatedThisFrame == 0);
+}
+
+BENCHMARK(frameSlotBufferUpdateAndFlush) {
+  HostGPUDevice device;
+  const uint32_t slotCount = 10000;
+  FrameSlotBuffer<Constants> slots(slotCount, kFramesInFlight, &device,
+                                   GPUMemoryCategory::Instances);
+  for (uint32_t i = 0; i < slotCount; ++i) {
+    slots.allocateSlot();
+  }
+
+  size_t frame = 0;
+  Constants constants = {};
+  measure("update 10% of 10000 slots, flush", 1000, [&] {
+    for (uint32_t i = 0; i < slotCount; i += 10) {
+      constants.index = i;
+      slots.update(i, constants);
+    }
+    slots.flush(frame);
+    frame = (frame + 1) % kFramesInFlight;
+  });
+  measure("flush, nothing changed", 1000, [&] {
+    slots.flush(frame);
+    frame = (frame + 1) % kFramesInFlight;
+  });
+  CHECK(slots.pendingSlotCount() == 0);
+}
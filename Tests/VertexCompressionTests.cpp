@@ -0,0 +1,181 @@
+//
+//  VertexCompressionTests.cpp
+//  Paloma Engine
+//
+
+#include "Test.hpp"
+#include "TestGeometry.hpp"
+#include "VertexCompression.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+simd_float3 randomDirection(TestRandom &random) {
+  return simd_normalize(simd_make_float3(random.next(-1, 1),
+                                         random.next(-1, 1),
+                                         random.next(-1, 1)));
+}
+
+// Standard vertices inside bounds, as Scene::load gets them from ModelIO.
+std::vector<uint8_t> makeStandardVertices(const AABB &bounds, uint32_t count,
+                                          uint32_t seed) {
+  using namespace StandardVertexLayout;
+  TestRandom random = {seed};
+  const size_t vertexStride = stride(true);
+  std::vector<uint8_t> vertices(count * vertexStride);
+  for (uint32_t i = 0; i < count; ++i) {
+    uint8_t *vertex = vertices.data() + i * vertexStride;
+    const simd_float3 normal = randomDirection(random);
+    const simd_float3 tangent = randomDirection(random);
+    const float position[4] = {random.next(bounds.min.x, bounds.max.x),
+                               random.next(bounds.min.y, bounds.max.y),
+                               random.next(bounds.min.z, bounds.max.z), 1.0f};
+    const float tangentW[4] = {tangent.x, tangent.y, tangent.z,
+                               random.next(-1, 1) < 0.0f ? -1.0f : 1.0f};
+    const float normalXYZ[3] = {normal.x, normal.y, normal.z};
+    const float texCoords[4] = {random.next(0, 1), random.next(0, 1),
+                                random.next(-4, 4), random.next(-4, 4)};
+    memcpy(vertex + kPositionOffset, position, sizeof(position));
+    memcpy(vertex + kNormalOffset, normalXYZ, sizeof(normalXYZ));
+    memcpy(vertex + kTangentOffset, tangentW, sizeof(tangentW));
+    memcpy(vertex + kTexCoords0Offset, texCoords, sizeof(texCoords));
+  }
+  return vertices;
+}
+
+} // namespace
+
+TEST(compactVerticesRoundTripWithinQuantization) {
+  const AABB bounds = {{-5, -2, -10}, {7, 3, 4}};
+  const MeshConstants constants = makeMeshConstants(bounds);
+  const uint32_t count = 20000;
+  const std::vector<uint8_t> standard = makeStandardVertices(bounds, count, 3);
+
+  float positionError = 0.0f, directionError = 0.0f;
+  float texCoords0Error = 0.0f, texCoords1Error = 0.0f;
+  uint32_t signMismatches = 0;
+  uint8_t compact[CompactVertexLayout::stride(true)];
+  for (uint32_t i = 0; i < count; ++i) {
+    const VertexAttributes in = readStandardVertex(
+        standard.data() + i * StandardVertexLayout::stride(true), true);
+    writeCompactVertex(in, constants, true, compact);
+    const VertexAttributes out = readCompactVertex(compact, constants, true);
+
+    positionError =
+        std::max(positionError, simd_length(out.position - in.position));
+    directionError =
+        std::max({directionError, simd_length(out.normal - in.normal),
+                  simd_length(out.tangent.xyz - in.tangent.xyz)});
+    signMismatches += out.tangent.w != in.tangent.w;
+    texCoords0Error = std::max(
+        texCoords0Error,
+        simd_reduce_max(simd_abs(out.texCoords0 - in.texCoords0)));
+    texCoords1Error = std::max(
+        texCoords1Error,
+        simd_reduce_max(simd_abs(out.texCoords1 - in.texCoords1)));
+  }
+  // Half a step of snorm16 across the largest extent, on each axis.
+  CHECK(positionError < simd_length(bounds.extents()) / 32767.0f);
+  CHECK(directionError < 1e-4f);
+  CHECK(signMismatches == 0);
+  // Half a half-float ulp: 2^-12 below 1, 2^-9 below 4.
+  CHECK(texCoords0Error <= 0x1p-12f);
+  CHECK(texCoords1Error <= 0x1p-9f);
+}
+
+TEST(compactVerticesKeepFlatAndEmptyBounds) {
+  // A flat quad has no extent along y, and a single point has none at all.
+  for (const AABB &bounds :
+       {AABB{{-1, 2, -1}, {1, 2, 1}}, AABB{{3, 3, 3}, {3, 3, 3}}, AABB()}) {
+    const MeshConstants constants = makeMeshConstants(bounds);
+    CHECK(simd_reduce_min(constants.positionScale) > 0.0f);
+    VertexAttributes in = {};
+    in.position = bounds.isEmpty() ? simd_float3{0, 0, 0} : bounds.max;
+    in.normal = {0, 1, 0};
+    in.tangent = {1, 0, 0, -1};
+    uint8_t compact[CompactVertexLayout::stride(false)];
+    writeCompactVertex(in, constants, false, compact);
+    const VertexAttributes out = readCompactVertex(compact, constants, false);
+    CHECK(simd_length(out.position - in.position) < 1e-4f);
+    CHECK(out.tangent.w == -1.0f);
+  }
+}
+
+TEST(octahedralAndSnormEncodingHandleTheEdges) {
+  const simd_float3 axes[] = {{1, 0, 0},  {-1, 0, 0}, {0, 1, 0},
+                              {0, -1, 0}, {0, 0, 1},  {0, 0, -1}};
+  for (simd_float3 axis : axes) {
+    const simd_float2 encoded = encodeOctahedral(axis);
+    const simd_float3 decoded = decodeOctahedral(
+        {decodeSnorm16(encodeSnorm16(encoded.x)),
+         decodeSnorm16(encodeSnorm16(encoded.y))});
+    CHECK(simd_length(decoded - axis) < 1e-6f);
+  }
+
+  CHECK(encodeSnorm16(1.0f) == 32767);
+  CHECK(encodeSnorm16(-1.0f) == -32767);
+  CHECK(encodeSnorm16(3.0f) == 32767);
+  CHECK(encodeSnorm16(-3.0f) == -32767);
+  CHECK(decodeSnorm16(-32768) == -1.0f);
+  CHECK(decodeSnorm16(0) == 0.0f);
+}
+
+TEST(halfFloatsRoundToNearestEven) {
+  CHECK(encodeHalf(0.0f) == 0x0000);
+  CHECK(encodeHalf(-0.0f) == 0x8000);
+  CHECK(encodeHalf(1.0f) == 0x3c00);
+  CHECK(encodeHalf(-2.5f) == 0xc100);
+  CHECK(encodeHalf(65504.0f) == 0x7bff);
+  // Past the largest half, and anything rounding up to it, is infinity.
+  CHECK(encodeHalf(65520.0f) == 0x7c00);
+  CHECK(encodeHalf(1e6f) == 0x7c00);
+  CHECK(encodeHalf(-INFINITY) == 0xfc00);
+  CHECK(std::isnan(decodeHalf(encodeHalf(NAN))));
+
+  // Ties go to the even mantissa, carries move into the exponent.
+  CHECK(encodeHalf(1.0f + 0x1p-11f) == 0x3c00);
+  CHECK(encodeHalf(1.0f + 3 * 0x1p-11f) == 0x3c02);
+  CHECK(encodeHalf(2.0f - 0x1p-12f) == 0x4000);
+
+  // Subnormals down to the smallest half, then zero.
+  CHECK(encodeHalf(0x1p-24f) == 0x0001);
+  CHECK(encodeHalf(0x1p-14f - 0x1p-24f) == 0x03ff);
+  CHECK(encodeHalf(0x1p-25f) == 0x0000);
+  CHECK(encodeHalf(0x1p-26f) == 0x0000);
+  CHECK(decodeHalf(0x0001) == 0x1p-24f);
+  CHECK(decodeHalf(0x03ff) == 0x1p-14f - 0x1p-24f);
+
+  // Every finite half comes back exactly.
+  bool exact = true;
+  for (uint32_t bits = 0; bits < 0x10000; ++bits) {
+    if ((bits & 0x7c00) != 0x7c00) {
+      exact &= encodeHalf(decodeHalf((uint16_t)bits)) == bits;
+    }
+  }
+  CHECK(exact);
+}
+
+BENCHMARK(vertexCompression) {
+  const AABB bounds = {{-5, -2, -10}, {7, 3, 4}};
+  const MeshConstants constants = makeMeshConstants(bounds);
+  const uint32_t count = 100000;
+  const std::vector<uint8_t> standard =
+      makeStandardVertices(bounds, count, 4);
+  std::vector<uint8_t> compact(count * CompactVertexLayout::stride(true));
+
+  measure("compress 100000 vertices", 20, [&] {
+    for (uint32_t i = 0; i < count; ++i) {
+      writeCompactVertex(
+          readStandardVertex(standard.data() +
+                                 i * StandardVertexLayout::stride(true),
+                             true),
+          constants, true,
+          compact.data() + i * CompactVertexLayout::stride(true));
+    }
+  });
+  printf("  %-48s %12zu\n", "standard bytes", standard.size());
+  printf("  %-48s %12zu\n", "compact bytes", compact.size());
+  CHECK(compact.size() * 2 < standard.size());
+}